@@ -34,11 +34,43 @@
 
 - (void)loadSourcesWithABAddressBookRef: (ABAddressBookRef)addressBookRef;
 - (void)loadGroupsWithABAddressBookRef: (ABAddressBookRef)addressBookRef;
+/**
+ * Groups of a native source and their members, called when the partition of the source is applied
+ * Must be dispatched on serial_queue
+ */
+- (void)loadGroupsOfSource: (AKSource *)source withABAddressBookRef: (ABAddressBookRef)addressBookRef;
 - (BOOL)loadContactsWithABAddressBookRef: (ABAddressBookRef)addressBookRef;
+/**
+ * RecordIDs of the people of a source in the order they are scanned in. Of linked
+ * people the one scanned first is listed
+ */
+- (NSArray *)contactIDsInSourceWithID: (ABRecordID)sourceID withABAddressBookRef: (ABAddressBookRef)addressBookRef;
 
+/**
+ * Insert the recordID of contact into the sections of the first digits of its phone numbers
+ * and of their national numbers, the + section if it has international numbers, into the
+ * no phone number section otherwise
+ */
 - (void)processPhoneNumbersOfContact: (AKContact *)contact withABAddressBookRef: (ABAddressBookRef)addressBookRef;
+/**
+ * Remove the recordID from every section of hashTableSortedByPhone
+ */
+- (void)removeRecordIDFromPhoneSections: (ABRecordID)recordID;
 
 - (void)loadAddressBookWithCompletionHandler: (void (^)(BOOL))completionHandler;
+/**
+ * Load the partitions of a source not yet loaded by the current pass, all partitions for the aggregate source
+ */
+- (void)loadPartitionOfSourceWithID: (ABRecordID)sourceID;
+/**
+ * Replace the section tables with empty ones and forget the records located in them
+ * Must be dispatched on serial_queue
+ */
+- (void)resetTables;
+/**
+ * Run update on serial_queue with a local ABAddressBookRef and publish a snapshot of the result
+ */
+- (void)performIndexUpdate: (void (^)(ABAddressBookRef addressBookRef))update;
 /**
  * Insert recordID of contact into the sorted array of the section corresponding to the sectionKey of the record
  */
@@ -47,21 +79,53 @@
  * Remove a recordID of contact from the sorted array of the section corresponding to the sectionKey of the record
  */
 - (void)deleteRecordIDfromContactIdentifiersForContact: (AKContact *)contact;
+/**
+ * Remove the recordID from the name and phone sections and the indexes. The
+ * presentation delegate is told of the removal if notify is YES
+ */
+- (void)removeRecordID: (ABRecordID)recordID fromContactIdentifiersWithAddressBookRef: (ABAddressBookRef)addressBookRef notifyingDelegate: (BOOL)notify;
+/**
+ * Remove the recordID from the members of every group of every source
+ */
+- (void)removeRecordIDFromGroups: (ABRecordID)recordID;
+/**
+ * Record that sections of a hashTableSortedBy* table changed, their arrays are copied into the next snapshot
+ */
+- (void)markDirtySectionKeys: (NSArray *)sectionKeys ofTable: (SEL)table;
+/**
+ * Insert contact into / remove recordID from each of contactIndexes
+ */
+- (void)insertContactInIndexes: (AKContact *)contact;
+- (void)removeRecordIDFromIndexes: (ABRecordID)recordID;
 
 - (BOOL)archiveDictionary: (NSDictionary *)dictionary withFileName: (NSString *)fileName;
 - (NSMutableDictionary *)unarchiveDictionaryWithFileName: (NSString *)fileName;
+/**
+ * Reads the section tables, the sort keys they were ordered with and the
+ * search entries from sectionCache
+ */
 - (BOOL)unarchiveCache;
-- (BOOL)archiveCache;
+/**
+ * Schedules the write of changed sections, sort key sections and search entries
+ * and returns before anything is written, see AKSectionCache
+ */
+- (void)archiveCache;
+/**
+ * The completion handler is called on the write queue of sectionCache with
+ * whether the scheduled writes were committed
+ */
+- (void)archiveCacheWithCompletionHandler: (void (^)(BOOL committed))completionHandler;
+/**
+ * Persist what the contacts list of the displayed source and group shows, for the next launch to paint it
+ * Names are read again only for changedContactIDs, all of them if nil. Returns NO if the group is absent
+ */
+- (BOOL)archiveDisplaySnapshotWithChangedContactIDs: (NSSet *)changedContactIDs andABAddressBookRef: (ABAddressBookRef)addressBookRef;
 - (BOOL)deleteArchiveWithFileName: (NSString *)fileName;
 - (BOOL)deleteArchive;
 /**
  * The index where a record should appear in an alphabetically sorted array
  */
 + (NSUInteger)indexOfRecordID: (ABRecordID) recordID inArray: (NSArray *)array withSortOrdering: (ABPersonSortOrdering)sortOrdering andAddressBookRef: (ABAddressBookRef)addressBookRef;
-/**
- * Removes a recordID from a dictionary storing recordIDs organized into sections
- */
-+ (NSUInteger)removeRecordID: (ABRecordID)recordID withSectionKey: (NSString *)sectionKey fromContactIdentifierDictionary: (NSMutableDictionary *)contactIDs;
 /**
  * Returns a filename for a given selector
  */
@@ -31,6 +31,45 @@
 #import "AKSource.h"
 #import "AKGroup.h"
 #import "AKContact.h"
+#import "AKContactIndex.h"
+#import "AKInstrumentation.h"
+#import "AKProgressReporter.h"
+#import "AKIndexSnapshot.h"
+#import "AKDisplaySnapshot.h"
+#import "AKSearchEntryIndex.h"
+#import "AKSourcePartition.h"
+#import "AKDirectorySource.h"
+#import "AKAddressBookPool.h"
+#import "AKRecordLocator.h"
+#import "AKSectionCache.h"
+
+/**
+ * Result of scanning the people of a partition. Scans only read the address
+ * book, they are applied to the section tables on serial_queue
+ */
+@interface AKPartitionScan : NSObject
+
+@property (strong, nonatomic) AKSourcePartition *partition;
+/**
+ * ContactIDs in the order of the scan
+ */
+@property (strong, nonatomic) NSArray *contactIDs;
+/**
+ * Arrays of linked contactIDs keyed by contactID
+ */
+@property (strong, nonatomic) NSDictionary *linkedContactIDs;
+/**
+ * AKSearchEntry keyed by contactID when the pass populates indexes
+ */
+@property (strong, nonatomic) NSDictionary *searchEntries;
+@property (strong, nonatomic) NSSet *createdRecordIDs;
+@property (strong, nonatomic) NSSet *changedRecordIDs;
+
+@end
+
+@implementation AKPartitionScan
+
+@end
 
 @implementation AKAddressBook (Loader)
 
@@ -41,56 +80,91 @@
      */
     dispatch_block_t block = ^{
         
-        if ([self unarchiveCache]) {
+        // Tables in memory are more recent than the cache, whose writes may be pending
+        BOOL inMemory = (self.hashTableSortedByFirst && self.hashTableSortedByLast && self.hashTableSortedByPhone);
+        if (inMemory || [self unarchiveCache]) {
+            if (!inMemory) {
+                self.dirtySectionKeys = nil;
+            }
             [self setLoading: YES];
+            [self publishSnapshot]; // Show the cached tables while loading
+            [self populateIndexesFromSearchEntries];
         }
         else if (!self.hashTableSortedByFirst || !self.hashTableSortedByLast || !self.hashTableSortedByPhone) {
-            self.hashTableSortedByFirst = [[NSMutableDictionary alloc] init];
-            self.hashTableSortedByLast = [[NSMutableDictionary alloc] init];
-            self.hashTableSortedByPhone = [[NSMutableDictionary alloc] init];
+            [self resetTables];
+        }
+        
+        [self.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            [self.loadProgress startWithPhaseCount: 2];
             
-            for (NSString *sectionKey in [AKAddressBook sectionKeys])
-            {
-                [self.hashTableSortedByFirst setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
-                [self.hashTableSortedByLast setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
-            }
-            NSArray *sectionKeys = @[@"0",@"1",@"2",@"3",@"4",@"5",@"6",@"7",@"8",@"9",@"+",noPhoneNumberKey];
-            for (NSString *sectionKey in sectionKeys)
+            // Do not change order of loading
+            [self loadSourcesWithABAddressBookRef: addressBookRef];
+            
+            [self loadGroupsWithABAddressBookRef: addressBookRef];
+            
+            // The partitions of the displayed source are loaded first, the others follow in the background
+            [self loadContactsWithABAddressBookRef: addressBookRef];
+            
+            AKLoadPass *pass = self.loadPass;
+            pass.completionHandler = completionHandler;
+            
+            [self publishSnapshot];
+            
+            [self.loadProgress finish];
+            
+            // Completes the pass if the displayed source was the only one
+            [self didLoadPartitionsOfPass: pass withABAddressBookRef: addressBookRef];
+            
+            [self archiveCache];
+            
+            for (AKSourcePartition *partition in [pass.partitions objectEnumerator])
             {
-                [self.hashTableSortedByFirst setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
-                [self.hashTableSortedByLast setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
-                [self.hashTableSortedByPhone setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
+                dispatch_async(pass.background_queue, ^{
+                    [self loadPartition: partition ofPass: pass];
+                });
             }
-        }
-        
-#if __IPHONE_OS_VERSION_MAX_ALLOWED >= 60000
-        CFErrorRef error = NULL;
-        ABAddressBookRef addressBookRef = ABAddressBookCreateWithOptions(NULL, &error);
-        if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookCreateWithOptions (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
-#else
-        ABAddressBookRef addressBook = ABAddressBookCreate();
-#endif
-        
-        // Do not change order of loading
-        [self loadSourcesWithABAddressBookRef: addressBookRef];
-        
-        [self loadGroupsWithABAddressBookRef: addressBookRef];
-        
-        BOOL contactsChanged = [self loadContactsWithABAddressBookRef: addressBookRef];
-        
-        CFRelease(addressBookRef);
-        
-        [self archiveCache];
-        
-        if (completionHandler) {
-            dispatch_async(dispatch_get_main_queue(), ^{
-                completionHandler(contactsChanged);
-            });
-        }
+        }];
     };
     dispatch_async(self.serial_queue, block);
 }
 
+- (void)resetTables
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    self.hashTableSortedByFirst = [[NSMutableDictionary alloc] init];
+    self.hashTableSortedByLast = [[NSMutableDictionary alloc] init];
+    self.hashTableSortedByPhone = [[NSMutableDictionary alloc] init];
+    self.dirtySectionKeys = nil;
+    [self.recordLocatorByFirst removeAllRecords];
+    [self.recordLocatorByLast removeAllRecords];
+    
+    for (NSString *sectionKey in [AKAddressBook sectionKeys])
+    {
+        [self.hashTableSortedByFirst setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
+        [self.hashTableSortedByLast setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
+    }
+    NSArray *sectionKeys = @[@"0",@"1",@"2",@"3",@"4",@"5",@"6",@"7",@"8",@"9",@"+",noPhoneNumberKey];
+    for (NSString *sectionKey in sectionKeys)
+    {
+        [self.hashTableSortedByFirst setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
+        [self.hashTableSortedByLast setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
+        [self.hashTableSortedByPhone setObject: [[NSMutableArray alloc] init] forKey: sectionKey];
+    }
+}
+
+- (void)performIndexUpdate: (void (^)(ABAddressBookRef addressBookRef))update
+{
+    dispatch_async(self.serial_queue, ^{
+        [self.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            update(addressBookRef);
+            
+            [self publishSnapshot];
+            [self archiveCache];
+        }];
+    });
+}
+
 - (void)loadSourcesWithABAddressBookRef: (ABAddressBookRef)addressBookRef
 {
     NSAssert(!dispatch_get_specific(IsOnMainQueueKey), @"Must not be dispatched on main queue");
@@ -115,13 +189,32 @@
     ABRecordID defaultSourceID = ABRecordGetRecordID(source);
     CFRelease(source);
     
+    NSMutableArray *directorySources = [[NSMutableArray alloc] init];
+    
     for (id obj in sources)
     {
         ABRecordRef recordRef = (__bridge ABRecordRef)obj;
         ABRecordID recordID = ABRecordGetRecordID(recordRef);
         
         ABSourceType type =  [(NSNumber *)CFBridgingRelease(ABRecordCopyValue(recordRef, kABSourceTypeProperty)) intValue];
-        if (type == kABSourceTypeExchangeGAL) continue; // No support for Exchange Global Address List, yet
+        if (type == kABSourceTypeExchangeGAL)
+        {   // Global Address Lists are searched remotely, they have no contacts to load
+            id<AKDirectoryTransport> transport = self.directoryTransport;
+            if (!transport) continue;
+            
+            AKDirectorySource *directorySource = nil;
+            for (AKDirectorySource *previous in self.directorySources)
+            {   // Keep the results cached by the previous load
+                if (previous.sourceID == recordID && previous.transport == transport) directorySource = previous;
+            }
+            if (!directorySource)
+            {
+                NSString *name = (NSString *)CFBridgingRelease(ABRecordCopyValue(recordRef, kABSourceNameProperty));
+                directorySource = [[AKDirectorySource alloc] initWithSourceID: recordID name: name transport: transport];
+            }
+            [directorySources addObject: directorySource];
+            continue;
+        }
         
         AKSource *source = [self sourceForSourceId: recordID];
         if (!source) {
@@ -137,7 +230,13 @@
             [self.sources addObject: source];
         }
     }
-    self.sourceID = (sources.count > 1) ? kSourceAggregate : defaultSourceID;
+    self.directorySources = [directorySources copy];
+    
+    if (![self sourceForSourceId: self.sourceID])
+    {   // Keep the displayed source unless it is gone
+        self.sourceID = (sources.count > 1) ? kSourceAggregate : defaultSourceID;
+        self.groupID = kGroupAggregate;
+    }
 }
 
 - (void)loadGroupsWithABAddressBookRef: (ABAddressBookRef)addressBookRef
@@ -146,10 +245,6 @@
     
     if (ShowGroups == NO) return;
     
-    [self setGroupID: kGroupAggregate];
-    
-    AKGroup *mainAggregateGroup = nil;
-    
     for (AKSource *source in self.sources)
     {
         AKGroup *aggregateGroup = [source groupForGroupId: kGroupAggregate];
@@ -159,347 +254,616 @@
         }   // Group members are recompiled on all reload
         [aggregateGroup.memberIDs removeAllObjects];
         
-        if (source.recordID < 0)
+        if (source.recordID == kSourceAggregate)
         {
-            if (source.recordID == kSourceAggregate)
-            {
-                mainAggregateGroup = aggregateGroup;
-                [mainAggregateGroup setIsMainAggregate: YES];
-            }
-            continue; // Skip custom sources
+            [aggregateGroup setIsMainAggregate: YES];
         }
+    }   // Groups of native sources are loaded along with the partition of the source
+}
+
+- (void)loadGroupsOfSource: (AKSource *)source withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    if (ShowGroups == NO || source.recordID < 0) return;
+    
+    NSArray *groups = (NSArray *) CFBridgingRelease(ABAddressBookCopyArrayOfAllGroupsInSource(addressBookRef, source.recordRef));
+    
+    for (id obj in groups)
+    {
+        ABRecordRef recordRef = (__bridge ABRecordRef)obj;
+        ABRecordID recordID = ABRecordGetRecordID(recordRef);
         
-        NSArray *groups = (NSArray *) CFBridgingRelease(ABAddressBookCopyArrayOfAllGroupsInSource(addressBookRef, source.recordRef));
+        AKGroup *group = [source groupForGroupId: recordID];
+        if (!group) {
+            group = [[AKGroup alloc] initWithABRecordID: recordID andAddressBookRef: self.addressBookRef];
+            [source.groups addObject: group];
+        }
         
-        for (id obj in groups)
+        NSArray *members = (NSArray *)CFBridgingRelease(ABGroupCopyArrayOfAllMembers(recordRef));
+        NSMutableSet *memberIDs = [[NSMutableSet alloc] initWithCapacity: members.count];
+        for (id member in members)
         {
-            ABRecordRef recordRef = (__bridge ABRecordRef)obj;
-            ABRecordID recordID = ABRecordGetRecordID(recordRef);
-            
-            AKGroup *group = [source groupForGroupId: recordID];
-            if (!group) {
-                group = [[AKGroup alloc] initWithABRecordID: recordID andAddressBookRef: self.addressBookRef];
-                [source.groups addObject: group];
-            }
-            
-            NSArray *members = (NSArray *)CFBridgingRelease(ABGroupCopyArrayOfAllMembers(recordRef));
-            [group.memberIDs removeAllObjects];
-            for (id member in members)
+            ABRecordRef record = (__bridge ABRecordRef)member;
+            // From ABGRoup Reference: Groups may not contain other groups
+            if (ABRecordGetRecordType(record) == kABPersonType)
             {
-                ABRecordRef record = (__bridge ABRecordRef)member;
-                // From ABGRoup Reference: Groups may not contain other groups
-                if (ABRecordGetRecordType(record) == kABPersonType)
-                {
-                    [group.memberIDs addObject: @(ABRecordGetRecordID(record))];
-                }
+                [memberIDs addObject: @(ABRecordGetRecordID(record))];
             }
-            NSString *name = (NSString *)CFBridgingRelease(ABRecordCopyValue(recordRef, kABGroupNameProperty));
-            NSLog(@"% 3d : %@ member count: %lu", recordID, name, (unsigned long)group.memberIDs.count);
         }
-        [source revertGroupsOrder];
+        if (![group.memberIDs isEqualToSet: memberIDs])
+        {   // Views of the group filtered with the previous members are stale
+            [group.memberIDs setSet: memberIDs];
+            group.memberVersion += 1;
+        }
+        AKCounterAdd(AKCounterGroupsLoaded, 1);
     }
+    [source revertGroupsOrder];
 }
 
 - (BOOL)loadContactsWithABAddressBookRef: (ABAddressBookRef)addressBookRef
 {
-    NSAssert(!dispatch_get_specific(IsOnMainQueueKey), @"Must not be dispatched on main queue");
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
     
-    BOOL change = NO;
+    // Indexes that are empty (eg: on a cold start from cached section tables) are populated by the scan
+    NSMutableArray *unpopulatedIndexes = [[NSMutableArray alloc] init];
+    for (id<AKContactIndex> index in self.contactIndexes)
+    {
+        if (index.count == 0) [unpopulatedIndexes addObject: index];
+    }
+    
+    NSMutableArray *sourceIDs = [[NSMutableArray alloc] init];
+    for (AKSource *source in self.sources)
+    {
+        if (source.recordID >= 0) [sourceIDs addObject: @(source.recordID)]; // Skip custom sources
+    }
+    
+    self.loadPass = [[AKLoadPass alloc] initWithSourceIDs: sourceIDs
+                                           dateLastLoaded: (self.isLoading) ? self.sectionCache.committedWatermark : nil
+                                       unpopulatedIndexes: unpopulatedIndexes
+                                         cachedContactIDs: (self.isLoading) ? self.allContactIDs : nil];
+    
+    self.contactsCount = (addressBookRef) ? ABAddressBookGetPersonCount(addressBookRef) : 0;
+    self.nativeContactsCount = self.contactsCount;
+    NSLog(@"Number of contacts: %ld", (long)self.contactsCount);
+    
+    // The aggregate source is composed of the partitions of all sources
+    NSArray *displayedSourceIDs = (self.sourceID == kSourceAggregate) ? sourceIDs : @[@(self.sourceID)];
+    BOOL change = [self loadPartitionsOfSourceIDs: displayedSourceIDs ofPass: self.loadPass withABAddressBookRef: addressBookRef];
+    
+    AKSource *displayedSource = [self sourceForSourceId: self.sourceID];
+    if (ShowGroups && ![displayedSource groupForGroupId: self.groupID])
+    {
+        self.groupID = kGroupAggregate;
+    }
+    return change;
+}
+
+- (BOOL)loadPartitionsOfSourceIDs: (NSArray *)sourceIDs ofPass: (AKLoadPass *)pass withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    AKSpanStart start = AKSpanBegin();
+    
+    // People are copied first so the total of the first phase is known before scanning
+    NSMutableArray *partitions = [[NSMutableArray alloc] init];
+    NSMutableArray *contactIDsOfPartitions = [[NSMutableArray alloc] init];
+    int64_t totalUnitCount = 0;
+    for (NSNumber *sourceID in sourceIDs)
+    {
+        AKSourcePartition *partition = [pass partitionForSourceID: sourceID.intValue];
+        if (![partition changeStatusFrom: AKSourcePartitionUnloaded to: AKSourcePartitionScanning]) continue;
+        
+        NSArray *contactIDs = [self contactIDsInSourceWithID: sourceID.intValue withABAddressBookRef: addressBookRef];
+        [partitions addObject: partition];
+        [contactIDsOfPartitions addObject: contactIDs];
+        totalUnitCount += contactIDs.count;
+    }
+    [self.loadProgress beginPhaseWithTotalUnitCount: totalUnitCount];
+    
+    NSMutableArray *scans = [[NSMutableArray alloc] init];
+    for (NSUInteger index = 0; index < partitions.count; ++index)
+    {
+        [scans addObject: [self scanContactIDs: [contactIDsOfPartitions objectAtIndex: index]
+                                   ofPartition: [partitions objectAtIndex: index]
+                                        ofPass: pass
+                                      progress: self.loadProgress
+                          withABAddressBookRef: addressBookRef]];
+    }
+    
+    AKSpanEnd(AKSpanScan, start);
+    start = AKSpanBegin();
+    
+    // The total of the second phase is known before any change is applied
+    totalUnitCount = 0;
+    for (AKPartitionScan *scan in scans)
+    {
+        totalUnitCount += scan.createdRecordIDs.count + scan.changedRecordIDs.count;
+    }
+    [self.loadProgress beginPhaseWithTotalUnitCount: totalUnitCount];
     
-    NSMutableSet *allContactIdentifiers = [[NSMutableSet alloc] init];
     if (self.isLoading)
     {
-        [allContactIdentifiers addObjectsFromArray: self.allContactIDs];
+        if ([self.presentationDelegate respondsToSelector: @selector(addressBookWillBeginUpdates:)])
+        {
+            [self.presentationDelegate addressBookWillBeginUpdates: self];
+        }
     }
     
-    AKSource *aggregateSource = [self sourceForSourceId: kSourceAggregate];
-    AKGroup *mainAggregateGroup = [aggregateSource groupForGroupId: kGroupAggregate];
+    BOOL change = NO;
+    for (AKPartitionScan *scan in scans)
+    {
+        change |= [self applyPartitionScan: scan ofPass: pass progress: self.loadProgress withABAddressBookRef: addressBookRef];
+    }
+    
+    if ([self.presentationDelegate respondsToSelector:@selector(addressBookDidEndUpdates:)])
+    {
+        [self.presentationDelegate addressBookDidEndUpdates: self];
+    }
+    
+    AKSpanEnd(AKSpanDiff, start);
+    return change;
+}
+
+- (void)loadPartitionOfSourceWithID: (ABRecordID)sourceID
+{
+    AKLoadPass *pass = self.loadPass;
+    for (AKSourcePartition *partition in [pass.partitions objectEnumerator])
+    {
+        if (sourceID != kSourceAggregate && partition.sourceID != sourceID) continue;
+        if (partition.status != AKSourcePartitionUnloaded) continue;
+        
+        dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), ^{
+            [self loadPartition: partition ofPass: pass];
+        });
+    }
+}
+
+- (void)loadPartition: (AKSourcePartition *)partition ofPass: (AKLoadPass *)pass
+{
+    NSAssert(!dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must not be dispatched on serial background queue");
     
-    NSMutableSet *nativeContactIDs = [[NSMutableSet alloc] init];
-    NSMutableSet *appContactIDs = [[NSMutableSet alloc] init];
-    NSMutableSet *allLinkedRecordIDs = [[NSMutableSet alloc] init];
+    if (![partition changeStatusFrom: AKSourcePartitionUnloaded to: AKSourcePartitionScanning]) return;
+    
+    // Scanning only reads the address book, so it runs off serial_queue
+    AKSpanStart start = AKSpanBegin();
+    __block AKPartitionScan *scan;
+    [self.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef scanAddressBookRef) {
+        NSArray *contactIDs = [self contactIDsInSourceWithID: partition.sourceID withABAddressBookRef: scanAddressBookRef];
+        scan = [self scanContactIDs: contactIDs ofPartition: partition ofPass: pass progress: nil withABAddressBookRef: scanAddressBookRef];
+    }];
+    AKSpanEnd(AKSpanScan, start);
+    
+    [self performIndexUpdate: ^(ABAddressBookRef addressBookRef) {
+        if (pass != self.loadPass) return; // Superseded by a reload
+        
+        AKSpanStart applyStart = AKSpanBegin();
+        [self applyPartitionScan: scan ofPass: pass progress: nil withABAddressBookRef: addressBookRef];
+        [self didLoadPartitionsOfPass: pass withABAddressBookRef: addressBookRef];
+        AKSpanEnd(AKSpanDiff, applyStart);
+    }];
+}
+
+- (NSArray *)contactIDsInSourceWithID: (ABRecordID)sourceID withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    ABRecordRef sourceRef = ABAddressBookGetSourceWithRecordID(addressBookRef, sourceID);
+    if (!sourceRef) return @[];
+    // ABAddressBookCopyArrayOfAllPeopleInSource calls ABAddressBookCopyArrayOfAllPeopleInSourceWithSortOrdering
+    // Perfomance is not affected by which of the two is called
+    NSArray *people = (NSArray *)CFBridgingRelease(ABAddressBookCopyArrayOfAllPeopleInSourceWithSortOrdering(addressBookRef, sourceRef, self.sortOrdering));
+    
+    NSMutableArray *contactIDs = [[NSMutableArray alloc] initWithCapacity: people.count];
+    for (id obj in people)
+    {
+        [contactIDs addObject: @(ABRecordGetRecordID((__bridge ABRecordRef)obj))];
+    }
+    return [contactIDs copy];
+}
+
+- (AKPartitionScan *)scanContactIDs: (NSArray *)scannedContactIDs
+                        ofPartition: (AKSourcePartition *)partition
+                             ofPass: (AKLoadPass *)pass
+                           progress: (AKProgressReporter *)progress
+               withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    AKPartitionScan *scan = [[AKPartitionScan alloc] init];
+    scan.partition = partition;
+    
+    NSMutableArray *contactIDs = [[NSMutableArray alloc] initWithCapacity: scannedContactIDs.count];
+    NSMutableDictionary *linkedContactIDs = [[NSMutableDictionary alloc] init];
+    NSMutableDictionary *searchEntries = [[NSMutableDictionary alloc] init];
     NSMutableSet *createdRecordIDs = [[NSMutableSet alloc] init];
     NSMutableSet *changedRecordIDs = [[NSMutableSet alloc] init];
     
-    NSDate *start = [NSDate date];
-    
-    self.contactsCount = ABAddressBookGetPersonCount(self.addressBookRef);
-    self.nativeContactsCount = self.contactsCount;
-    NSLog(@"Number of contacts: %ld", (long)self.contactsCount);
-    self.loadProgress.totalUnitCount = self.contactsCount;
-    self.loadProgress.completedUnitCount = 0;
-    // Get array of records in Address Book
-    for (AKSource *source in self.sources)
+    for (NSNumber *contactID in scannedContactIDs)
     {
-        if (source.recordID < 0) {
-            continue; // Skip custom sources
+        [progress advanceByUnitCount: 1];
+        AKCounterAdd(AKCounterContactsScanned, 1);
+        
+        AKContact *contact = [self contactForContactId: contactID.intValue withAddressBookRef: addressBookRef];
+        
+        [contactIDs addObject: contactID];
+        
+        NSDate *created = [contact valueForProperty: kABPersonCreationDateProperty];
+        NSDate *modified = [contact valueForProperty: kABPersonModificationDateProperty];
+        
+        NSArray *linked = [contact linkedContactIDs];
+        if (linked.count > 0)
+        {
+            [linkedContactIDs setObject: linked forKey: contactID];
         }
         
-        AKGroup *aggregateGroup = [source groupForGroupId: kGroupAggregate];
+        if (!pass.dateLastLoaded || [pass.dateLastLoaded compare: created] != NSOrderedDescending)
+        { // Created should be compared first
+            [createdRecordIDs addObject: contactID];
+        }
+        else if ([pass.dateLastLoaded compare: modified] != NSOrderedDescending)
+        { // Contact changed
+            [changedRecordIDs addObject: contactID];
+        }
         
-        // ABAddressBookCopyArrayOfAllPeopleInSource calls ABAddressBookCopyArrayOfAllPeopleInSourceWithSortOrdering
-        // Perfomance is not affected by which of the two is called
-        NSArray *people = (NSArray *)CFBridgingRelease(ABAddressBookCopyArrayOfAllPeopleInSourceWithSortOrdering(addressBookRef, source.recordRef, self.sortOrdering));
-        for (id obj in people)
+        if (pass.unpopulatedIndexes.count > 0)
         {
-            self.loadProgress.completedUnitCount += 1;
-            
-            ABRecordRef recordRef = (__bridge ABRecordRef)obj;
-            
-            ABRecordID recordID = ABRecordGetRecordID(recordRef);
-            NSNumber *contactID = [NSNumber numberWithInt: recordID];
-            
-            AKContact *contact = [self contactForContactId: recordID withAddressBookRef: addressBookRef];
-            
-            [nativeContactIDs addObject: contactID];
-            
-            NSDate *created = [contact valueForProperty: kABPersonCreationDateProperty];
-            NSDate *modified = [contact valueForProperty: kABPersonModificationDateProperty];
-            
-            NSArray *linkedContactIDs = [contact linkedContactIDs];
-            if (linkedContactIDs.count > 0 && ![allLinkedRecordIDs member: contactID])
-            {
-                [allLinkedRecordIDs addObjectsFromArray: linkedContactIDs];
-            }
-            
-            if (!self.dateAddressBookLoaded || [self.dateAddressBookLoaded compare: created] != NSOrderedDescending)
-            { // Created should be compared first
-                [createdRecordIDs addObject: contactID];
-                self.loadProgress.totalUnitCount += 1;
-            }
-            else if ([self.dateAddressBookLoaded compare: modified] != NSOrderedDescending)
-            { // Contact changed
-                [changedRecordIDs addObject: contactID];
-                self.loadProgress.totalUnitCount += 1;
-            }
-            
-            // Aggregate groups are repopulated on each load
-            // so there's no need to remove members from them
-            if (![allLinkedRecordIDs member: contactID])
-            {
-                [mainAggregateGroup.memberIDs addObject: contactID];
-            }
-            [aggregateGroup.memberIDs addObject: contactID];
+            [searchEntries setObject: [AKSearchEntry entryWithContact: contact] forKey: contactID];
         }
     }
+    scan.contactIDs = [contactIDs copy];
+    scan.linkedContactIDs = [linkedContactIDs copy];
+    scan.searchEntries = [searchEntries copy];
+    scan.createdRecordIDs = [createdRecordIDs copy];
+    scan.changedRecordIDs = [changedRecordIDs copy];
+    return scan;
+}
+
+- (BOOL)applyPartitionScan: (AKPartitionScan *)scan
+                    ofPass: (AKLoadPass *)pass
+                  progress: (AKProgressReporter *)progress
+      withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    BOOL change = NO;
     
-    NSLog(@"Native address book scanned in: %.2f", fabs([[NSDate date] timeIntervalSinceDate: start]));
-    start = [NSDate date];
+    AKSource *source = [self sourceForSourceId: scan.partition.sourceID];
+    [self loadGroupsOfSource: source withABAddressBookRef: addressBookRef];
     
-    if (self.isLoading)
+    AKGroup *aggregateGroup = [source groupForGroupId: kGroupAggregate];
+    AKSource *aggregateSource = [self sourceForSourceId: kSourceAggregate];
+    AKGroup *mainAggregateGroup = [aggregateSource groupForGroupId: kGroupAggregate];
+    
+    for (NSNumber *contactID in scan.contactIDs)
     {
-        if ([self.presentationDelegate respondsToSelector: @selector(addressBookWillBeginUpdates:)])
+        NSArray *linked = [scan.linkedContactIDs objectForKey: contactID];
+        if (linked && ![pass.linkedContactIDs member: contactID])
         {
-            [self.presentationDelegate addressBookWillBeginUpdates: self];
+            [pass.linkedContactIDs addObjectsFromArray: linked];
         }
         
-        [allContactIdentifiers minusSet: nativeContactIDs];
-        [allContactIdentifiers minusSet: appContactIDs];
-        if (allContactIdentifiers.count > 0)
+        // Aggregate groups are repopulated on each load
+        // so there's no need to remove members from them
+        if (![pass.linkedContactIDs member: contactID])
         {
-            NSLog(@"Deleted contactIDs: %@", allContactIdentifiers);
+            [mainAggregateGroup.memberIDs addObject: contactID];
+            
+            AKSearchEntry *entry = [scan.searchEntries objectForKey: contactID];
+            if (entry)
+            {
+                AKSpanStart indexStart = AKSpanBegin();
+                for (id<AKContactIndex> index in pass.unpopulatedIndexes)
+                {
+                    [index insertSearchEntry: entry];
+                }
+                AKSpanEnd(AKSpanIndexInsert, indexStart);
+            }
         }
-        for (NSNumber *recordID in allContactIdentifiers)
+        [aggregateGroup.memberIDs addObject: contactID];
+    }
+    
+    NSSet *contactIDs = [[NSSet alloc] initWithArray: scan.contactIDs];
+    [pass.unverifiedContactIDs minusSet: contactIDs];
+    scan.partition.contactIDs = contactIDs;
+    
+    // The contact listed for a set of linked contacts shows the values of all of them,
+    // and which one is listed may change, so the whole set is applied again
+    NSMutableSet *changedRecordIDs = [scan.changedRecordIDs mutableCopy];
+    for (NSSet *recordIDs in @[scan.createdRecordIDs, scan.changedRecordIDs])
+    {
+        for (NSNumber *recordID in recordIDs)
         {
-            change = YES;
-            AKContact *contact = [self contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
-            [self deleteRecordIDfromContactIdentifiersForContact: contact];
+            for (NSNumber *linkedRecordID in [scan.linkedContactIDs objectForKey: recordID])
+            {
+                if (![scan.createdRecordIDs member: linkedRecordID] && [contactIDs member: linkedRecordID])
+                {
+                    [changedRecordIDs addObject: linkedRecordID];
+                }
+            }
         }
     }
     
-    for (NSNumber *recordID in createdRecordIDs)
+    [pass.changedContactIDs unionSet: scan.createdRecordIDs];
+    [pass.changedContactIDs unionSet: changedRecordIDs];
+    
+    for (NSNumber *recordID in scan.createdRecordIDs)
     {
         change = YES;
-        self.loadProgress.completedUnitCount += 1;
+        [progress advanceByUnitCount: 1];
         AKContact *contact =  [self contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
-        if (self.isLoading)
-        {
-            NSLog(@"% 3d : %@ is new", recordID.intValue, contact.compositeName);
-        }
-        if (![allLinkedRecordIDs member: recordID])
+        AKCounterAdd(AKCounterContactsCreated, 1);
+        if (![pass.linkedContactIDs member: recordID])
         {
             [self insertRecordIDinContactIdentifiersForContact: contact withAddressBookRef: addressBookRef];
+            [self processPhoneNumbersOfContact: contact withABAddressBookRef: addressBookRef];
         }
-        [self processPhoneNumbersOfContact: contact withABAddressBookRef: addressBookRef];
     }
     for (NSNumber *recordID in changedRecordIDs)
     {
         change = YES;
-        self.loadProgress.completedUnitCount += 1;
+        [progress advanceByUnitCount: 1];
         AKContact *contact = [self contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
-        if (self.isLoading)
+        AKCounterAdd(AKCounterContactsChanged, 1);
+        [self deleteRecordIDfromContactIdentifiersForContact: contact];
+        if (![pass.linkedContactIDs member: recordID])
         {
-            NSLog(@"% 3d : %@ did change", recordID.intValue, contact.compositeName);
+            [self insertRecordIDinContactIdentifiersForContact: contact withAddressBookRef: addressBookRef];
+            [self processPhoneNumbersOfContact: contact withABAddressBookRef: addressBookRef];
         }
-        [self deleteRecordIDfromContactIdentifiersForContact: contact];
-        [self insertRecordIDinContactIdentifiersForContact: contact withAddressBookRef: addressBookRef];
-        [self processPhoneNumbersOfContact: contact withABAddressBookRef: addressBookRef];
     }
     
-    if ([self.presentationDelegate respondsToSelector:@selector(addressBookDidEndUpdates:)])
+    [scan.partition changeStatusFrom: AKSourcePartitionScanning to: AKSourcePartitionLoaded];
+    pass.changed |= change;
+    return change;
+}
+
+- (void)didLoadPartitionsOfPass: (AKLoadPass *)pass withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    if (![pass allPartitionsLoaded] || pass.finished) return;
+    pass.finished = YES;
+    
+    // Contacts cached but not found in any source have been deleted
+    if (pass.unverifiedContactIDs.count > 0)
     {
-        [self.presentationDelegate addressBookDidEndUpdates: self];
+        AKCounterAdd(AKCounterContactsDeleted, pass.unverifiedContactIDs.count);
+        for (NSNumber *recordID in pass.unverifiedContactIDs)
+        {
+            AKContact *contact = [self contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
+            [self deleteRecordIDfromContactIdentifiersForContact: contact];
+        }
+        [pass.unverifiedContactIDs removeAllObjects];
+        pass.changed = YES;
+        [self publishSnapshot];
     }
     
-    NSLog(@"Lookup table constructed in: %.2f", fabs([[NSDate date] timeIntervalSinceDate: start]));
-    return change;
+    // Committed with the tables, contacts changed while the pass ran are seen by the next one
+    [self.sectionCache writeWatermark: pass.dateStarted];
+    
+    void (^completionHandler)(BOOL) = pass.completionHandler;
+    pass.completionHandler = nil;
+    if (completionHandler) {
+        BOOL changed = pass.changed;
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completionHandler(changed);
+        });
+    }
+    
+    // Persisted once the aggregate group is complete, or if it was written with another sort ordering or name format
+    AKDisplaySnapshot *archived = self.archivedDisplaySnapshot;
+    if (!archived)
+    {
+        NSString *displaySnapshotPath = [[AKAddressBook documentsDirectoryPath] stringByAppendingPathComponent: [AKDisplaySnapshot fileName]];
+        archived = [AKDisplaySnapshot snapshotHeaderWithContentsOfFile: displaySnapshotPath];
+    }
+    if (pass.changed || !archived.isCurrent || archived.sourceID != self.sourceID || archived.groupID != self.groupID) {
+        [self archiveDisplaySnapshotWithChangedContactIDs: pass.changedContactIDs andABAddressBookRef: addressBookRef];
+    }
 }
 
 - (void)processPhoneNumbersOfContact: (AKContact *)contact withABAddressBookRef: (ABAddressBookRef)addressBookRef
 {
     ABPropertyID property = kABPersonPhoneProperty;
     NSArray *phoneNumbers = [contact valuesForLinkedMultiValueProperty: property];
-    if (phoneNumbers.count > 0)
+    
+    NSMutableOrderedSet *sectionKeys = [[NSMutableOrderedSet alloc] init];
+    for (NSString *phoneNumber in phoneNumbers)
     {
-        for (NSString *phoneNumber in phoneNumbers) {
-            NSString *normalizedPhoneNumber = phoneNumber.stringWithNormalizedPhoneNumber;
-            NSString *digits = phoneNumber.stringWithNonDigitsRemoved;
-            if (digits.length > 0)
-            {
-                NSString *key = [digits substringToIndex: 1];
-                NSMutableArray *sectionArray = [self.hashTableSortedByPhone objectForKey: key];
-                
-                if ([sectionArray indexOfObject: @(contact.recordID)] == NSNotFound) {
-                    [sectionArray addObject: @(contact.recordID)];
-                }
-            }
-            if ([normalizedPhoneNumber hasPrefix: @"+"])
-            {
-                NSMutableArray *sectionArray = [self.hashTableSortedByPhone objectForKey: @"+"];
-                
-                if ([sectionArray indexOfObject: @(contact.recordID)] == NSNotFound) {
-                    [sectionArray addObject: @(contact.recordID)];
-                }
-            }
-            for (NSString *prefix in [AKAddressBook countryCodePrefixes])
+        NSString *digits = phoneNumber.stringWithNonDigitsRemoved;
+        if (digits.length > 0)
+        {
+            [sectionKeys addObject: [digits substringToIndex: 1]];
+        }
+        if ([phoneNumber.stringWithNormalizedPhoneNumber hasPrefix: @"+"])
+        {
+            [sectionKeys addObject: @"+"];
+        }
+        for (NSString *prefix in [AKAddressBook countryCodePrefixes])
+        {   // Also found by the first digit of the national number
+            if ([digits hasPrefix: prefix])
             {
-                if ([digits hasPrefix: prefix])
+                if (digits.length > prefix.length)
                 {
-                    digits = [digits substringFromIndex: prefix.length];
-                    if (digits.length > 0)
-                    {
-                        NSString *key = [digits substringToIndex: prefix.length];
-                        NSMutableArray *sectionArray = [self.hashTableSortedByPhone objectForKey: key];
-                        if ([sectionArray indexOfObject: @(contact.recordID)] == NSNotFound) {
-                            [sectionArray addObject: @(contact.recordID)];
-                        }
-                    }
+                    [sectionKeys addObject: [digits substringWithRange: NSMakeRange(prefix.length, 1)]];
                 }
+                break;
             }
         }
     }
-    else
+    if (sectionKeys.count == 0)
+    {
+        [sectionKeys addObject: noPhoneNumberKey];
+    }
+    
+    for (NSString *key in sectionKeys)
     {
-        NSMutableArray *sectionArray = [self.hashTableSortedByPhone objectForKey: noPhoneNumberKey];
-        [sectionArray addObject: @(contact.recordID)];
+        NSMutableArray *sectionArray = [self.hashTableSortedByPhone objectForKey: key];
+        if (sectionArray && [sectionArray indexOfObject: @(contact.recordID)] == NSNotFound) {
+            [sectionArray addObject: @(contact.recordID)];
+            [self markDirtySectionKeys: @[key] ofTable: @selector(hashTableSortedByPhone)];
+        }
     }
 }
 
+- (void)removeRecordIDFromPhoneSections: (ABRecordID)recordID
+{
+    NSMutableArray *sectionKeys = [[NSMutableArray alloc] init];
+    [self.hashTableSortedByPhone enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSMutableArray *sectionArray, BOOL *stop) {
+        NSUInteger index = [sectionArray indexOfObject: @(recordID)];
+        if (index != NSNotFound)
+        {
+            [sectionArray removeObjectAtIndex: index];
+            [sectionKeys addObject: key];
+        }
+    }];
+    [self markDirtySectionKeys: sectionKeys ofTable: @selector(hashTableSortedByPhone)];
+}
+
 #pragma mark - Insert / Remove methods
 
 - (void)insertRecordIDinContactIdentifiersForContact: (AKContact *)contact withAddressBookRef: (ABAddressBookRef)addressBookRef
 {
-    // First name
-    NSString *firstName = [contact nameToDetermineSectionForSortOrdering: kABPersonSortByFirstName];
-    NSString *sectionKey = [AKContact sectionKeyForName: firstName];
-    NSMutableArray *sectionArray = (NSMutableArray *)[self.hashTableSortedByFirst objectForKey: sectionKey];
+    [self insertContact: contact inSections: self.hashTableSortedByFirst withLocator: self.recordLocatorByFirst andAddressBookRef: addressBookRef];
+    [self insertContact: contact inSections: self.hashTableSortedByLast withLocator: self.recordLocatorByLast andAddressBookRef: addressBookRef];
+    [self markDirtySectionKeys: [self.recordLocatorByFirst sectionKeysOfRecordID: contact.recordID] ofTable: @selector(hashTableSortedByFirst)];
+    [self markDirtySectionKeys: [self.recordLocatorByLast sectionKeysOfRecordID: contact.recordID] ofTable: @selector(hashTableSortedByLast)];
     
-    NSUInteger index = [AKAddressBook indexOfRecordID: contact.recordID inArray: sectionArray withSortOrdering: kABPersonSortByFirstName andAddressBookRef: addressBookRef];
-    [sectionArray insertObject: @(contact.recordID) atIndex: index];
+    [self insertContactInIndexes: contact];
     
-    if ([sectionKey isEqualToString: @"#"] && [firstName isMemberOfCharacterSet: [NSCharacterSet decimalDigitCharacterSet]])
+    if (self.isLoading)
     {
-        sectionKey = [firstName substringToIndex: 1];
-        sectionArray = (NSMutableArray *)[self.hashTableSortedByFirst objectForKey: sectionKey];
-        index = [AKAddressBook indexOfRecordID: contact.recordID inArray: sectionArray withSortOrdering: kABPersonSortByFirstName andAddressBookRef: addressBookRef];
-        [sectionArray insertObject: @(contact.recordID) atIndex: index];
+        if ([self.presentationDelegate respondsToSelector:@selector(addressBook:didInsertRecordID:)])
+        {
+            [self.presentationDelegate addressBook: self didInsertRecordID: contact.recordID];
+        }
     }
+}
+
+- (void)insertContact: (AKContact *)contact inSections: (NSMutableDictionary *)sections withLocator: (AKRecordLocator *)locator andAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSString *name = [contact nameToDetermineSectionForSortOrdering: locator.sortOrdering];
+    NSString *sectionKey = [AKContact sectionKeyForName: name];
+    AKSortKey *sortKey = [AKSortKey sortKeyOfContact: contact sortOrdering: locator.sortOrdering];
     
-    // Last name
-    NSString *lastName = [contact nameToDetermineSectionForSortOrdering: kABPersonSortByLastName];
-    sectionKey = [AKContact sectionKeyForName: lastName];
-    sectionArray = (NSMutableArray *)[self.hashTableSortedByLast objectForKey: sectionKey];
-    index = [AKAddressBook indexOfRecordID: contact.recordID inArray: sectionArray withSortOrdering: kABPersonSortByLastName andAddressBookRef: addressBookRef];
-    [sectionArray insertObject: @(contact.recordID) atIndex: index];
+    [locator insertRecordID: contact.recordID withSortKey: sortKey inSectionWithKey: sectionKey ofSections: sections andAddressBookRef: addressBookRef];
     
-    if ([sectionKey isEqualToString: @"#"] && [lastName isMemberOfCharacterSet: [NSCharacterSet decimalDigitCharacterSet]])
+    if ([sectionKey isEqualToString: @"#"] && [name isMemberOfCharacterSet: [NSCharacterSet decimalDigitCharacterSet]])
     {
-        sectionKey = [lastName substringToIndex: 1];
-        sectionArray = (NSMutableArray *)[self.hashTableSortedByLast objectForKey: sectionKey];
-        index = [AKAddressBook indexOfRecordID: contact.recordID inArray: sectionArray withSortOrdering: kABPersonSortByLastName andAddressBookRef: addressBookRef];
-        [sectionArray insertObject: @(contact.recordID) atIndex: index];
+        sectionKey = [name substringToIndex: 1];
+        [locator insertRecordID: contact.recordID withSortKey: sortKey inSectionWithKey: sectionKey ofSections: sections andAddressBookRef: addressBookRef];
     }
+}
+
+- (void)deleteRecordIDfromContactIdentifiersForContact: (AKContact *)contact
+{
+    [self removeRecordID: contact.recordID fromContactIdentifiersWithAddressBookRef: contact.addressBookRef notifyingDelegate: self.isLoading];
+}
+
+- (void)removeRecordID: (ABRecordID)recordID fromContactIdentifiersWithAddressBookRef: (ABAddressBookRef)addressBookRef notifyingDelegate: (BOOL)notify
+{
+    // Located by the sections and names the contact was inserted with, it may have been renamed since
+    AKRecordLocator *locator = (self.sortOrdering == kABPersonSortByFirstName) ? self.recordLocatorByFirst : self.recordLocatorByLast;
+    NSString *sectionKey = [[locator sectionKeysOfRecordID: recordID] firstObject];
+    [self markDirtySectionKeys: [self.recordLocatorByFirst sectionKeysOfRecordID: recordID] ofTable: @selector(hashTableSortedByFirst)];
+    [self markDirtySectionKeys: [self.recordLocatorByLast sectionKeysOfRecordID: recordID] ofTable: @selector(hashTableSortedByLast)];
     
-    if (self.isLoading)
+    NSUInteger indexByFirst = [self.recordLocatorByFirst removeRecordID: recordID fromSections: self.hashTableSortedByFirst andAddressBookRef: addressBookRef];
+    NSUInteger indexByLast = [self.recordLocatorByLast removeRecordID: recordID fromSections: self.hashTableSortedByLast andAddressBookRef: addressBookRef];
+    
+    [self removeRecordIDFromPhoneSections: recordID];
+    [self removeRecordIDFromIndexes: recordID];
+    
+    if ((indexByFirst != NSNotFound || indexByLast != NSNotFound) && notify)
     {
-        if ([self.presentationDelegate respondsToSelector:@selector(addressBook:didInsertRecordID:)])
+        if ([self.presentationDelegate respondsToSelector:@selector(addressBook:didRemoveRecordID:fromSectionWithKey:)])
         {
-            [self.presentationDelegate addressBook: self didInsertRecordID: contact.recordID];
+            [self.presentationDelegate addressBook: self didRemoveRecordID: recordID fromSectionWithKey: sectionKey];
+        }
+        else if ([self.presentationDelegate respondsToSelector:@selector(addressBook:didRemoveRecordID:)])
+        {
+            [self.presentationDelegate addressBook: self didRemoveRecordID: recordID];
         }
     }
 }
 
-- (void)deleteRecordIDfromContactIdentifiersForContact: (AKContact *)contact
+- (void)removeRecordIDFromGroups: (ABRecordID)recordID
 {
-    NSString *sectionKeyByFirst, *sectionKeyByLast;
-    
-    if (contact)
-    { // Can still exist when it is removed and added due to a name change
-        NSString *nameByFirst = [contact nameToDetermineSectionForSortOrdering: kABPersonSortByFirstName];
-        NSString *nameByLast = [contact nameToDetermineSectionForSortOrdering: kABPersonSortByLastName];
-        sectionKeyByFirst = [AKContact sectionKeyForName: nameByFirst];
-        sectionKeyByLast = [AKContact sectionKeyForName: nameByLast];
-    }
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
     
-    NSUInteger indexByFirst = [AKAddressBook removeRecordID: contact.recordID withSectionKey: sectionKeyByFirst fromContactIdentifierDictionary: self.hashTableSortedByFirst];
-    NSUInteger indexByLast = [AKAddressBook removeRecordID: contact.recordID withSectionKey: sectionKeyByLast fromContactIdentifierDictionary: self.hashTableSortedByLast];
-    
-    if ((indexByFirst != NSNotFound || indexByLast != NSNotFound) && self.isLoading)
+    NSNumber *contactID = @(recordID);
+    for (AKSource *source in self.sources)
     {
-        if ([self.presentationDelegate respondsToSelector:@selector(addressBook:didRemoveRecordID:)])
+        for (AKGroup *group in source.groups)
         {
-            [self.presentationDelegate addressBook: self didRemoveRecordID: contact.recordID];
+            if ([group.memberIDs member: contactID])
+            {
+                [group.memberIDs removeObject: contactID];
+                group.memberVersion += 1;
+            }
         }
     }
 }
 
-# pragma mark - Class methods
+- (void)markDirtySectionKeys: (NSArray *)sectionKeys ofTable: (SEL)table
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    if (!self.dirtySectionKeys || sectionKeys.count == 0) return; // Every section is copied anyway
+    
+    NSString *tableName = NSStringFromSelector(table);
+    NSMutableSet *dirtySectionKeys = [self.dirtySectionKeys objectForKey: tableName];
+    if (!dirtySectionKeys)
+    {
+        dirtySectionKeys = [[NSMutableSet alloc] init];
+        [self.dirtySectionKeys setObject: dirtySectionKeys forKey: tableName];
+    }
+    [dirtySectionKeys addObjectsFromArray: sectionKeys];
+}
 
-+ (NSUInteger)indexOfRecordID: (ABRecordID) recordID inArray: (NSArray *)array withSortOrdering: (ABPersonSortOrdering)sortOrdering andAddressBookRef: (ABAddressBookRef)addressBookRef
+- (void)insertContactInIndexes: (AKContact *)contact
 {
-    return [array indexOfObject: @(recordID)
-                  inSortedRange: (NSRange){0, array.count}
-                        options: NSBinarySearchingInsertionIndex
-                usingComparator: [AKAddressBook recordIDBasedComparatorWithSortOrdering: sortOrdering andAddressBookRef: addressBookRef]];
+    AKSpanStart start = AKSpanBegin();
+    AKSearchEntry *entry = [AKSearchEntry entryWithContact: contact];
+    for (id<AKContactIndex> index in self.contactIndexes)
+    {
+        [index insertSearchEntry: entry];
+    }
+    AKSpanEnd(AKSpanIndexInsert, start);
 }
 
-+ (NSUInteger)removeRecordID: (ABRecordID)recordID withSectionKey: (NSString *)sectionKey fromContactIdentifierDictionary: (NSMutableDictionary *)contactIDs
+- (void)populateIndexesFromSearchEntries
 {
-    NSMutableArray *sectionArray;
-    NSUInteger index = NSNotFound;
-    if (sectionKey)
+    NSMutableArray *unpopulatedIndexes = [[NSMutableArray alloc] init];
+    for (id<AKContactIndex> index in self.contactIndexes)
     {
-        sectionArray = [contactIDs objectForKey: sectionKey];
-        index = [sectionArray indexOfObject: @(recordID)];
+        if (index != self.searchEntryIndex && index.count == 0) [unpopulatedIndexes addObject: index];
     }
+    if (unpopulatedIndexes.count == 0) return;
     
-    if (index == NSNotFound)
-    { // Moved to another section
-        for (NSString *key in contactIDs)
-        { // This is slow but should run seldom
-            sectionArray = [contactIDs objectForKey: key];
-            index = [sectionArray indexOfObject: @(recordID)];
-            if (index != NSNotFound)
-            {
-                break;
-            }
+    AKSpanStart start = AKSpanBegin();
+    [self.searchEntryIndex enumerateEntriesUsingBlock: ^(AKSearchEntry *entry) {
+        for (id<AKContactIndex> index in unpopulatedIndexes)
+        {
+            [index insertSearchEntry: entry];
         }
-    }
-    if (index != NSNotFound)
+    }];
+    AKSpanEnd(AKSpanIndexInsert, start);
+}
+
+- (void)removeRecordIDFromIndexes: (ABRecordID)recordID
+{
+    for (id<AKContactIndex> index in self.contactIndexes)
     {
-        [sectionArray removeObjectAtIndex: index];
+        [index removeRecordID: recordID];
     }
-    return index;
+}
+
+# pragma mark - Class methods
+
++ (NSUInteger)indexOfRecordID: (ABRecordID) recordID inArray: (NSArray *)array withSortOrdering: (ABPersonSortOrdering)sortOrdering andAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    return [array indexOfObject: @(recordID)
+                  inSortedRange: (NSRange){0, array.count}
+                        options: NSBinarySearchingInsertionIndex
+                usingComparator: [AKAddressBook recordIDBasedComparatorWithSortOrdering: sortOrdering andAddressBookRef: addressBookRef]];
 }
 
 + (NSString *)fileNameForSelector: (SEL)selector
@@ -518,6 +882,18 @@
     {
         fileName = @"cacheDigit.plist";
     }
+    else if ([NSStringFromSelector(selector) isEqualToString: NSStringFromSelector(@selector(searchEntryIndex))])
+    {
+        fileName = @"cacheSearch.bin";
+    }
+    else if ([NSStringFromSelector(selector) isEqualToString: NSStringFromSelector(@selector(recordLocatorByFirst))])
+    {
+        fileName = @"cacheFirstKeys.plist";
+    }
+    else if ([NSStringFromSelector(selector) isEqualToString: NSStringFromSelector(@selector(recordLocatorByLast))])
+    {
+        fileName = @"cacheLastKeys.plist";
+    }
     return fileName;
 }
 
@@ -534,72 +910,10 @@
             AKContact *contact1 = [[AKAddressBook sharedInstance] contactForContactId: recordID1 withAddressBookRef: addressBookRef];
             AKContact *contact2 = [[AKAddressBook sharedInstance] contactForContactId: recordID2 withAddressBookRef: addressBookRef];
             
-            ABPropertyID prop1 = (sortOrdering == kABPersonSortByFirstName) ? kABPersonFirstNameProperty : kABPersonLastNameProperty;
-            ABPropertyID prop2 = (sortOrdering == kABPersonSortByFirstName) ? kABPersonFirstNameProperty : kABPersonLastNameProperty;
-            
-            NSString *elem1, *elem2;
-            NSComparisonResult result = NSOrderedSame;
-            
-            if (contact1.isPerson && contact2.isPerson)
-            {
-                elem1 = [contact1 valueForProperty: prop1];
-                elem2 = [contact2 valueForProperty: prop2];
-                
-                prop1 = prop2 = (sortOrdering == kABPersonSortByFirstName) ? kABPersonLastNameProperty : kABPersonFirstNameProperty;
-                if (!elem1) {
-                    elem1 = [contact1 valueForProperty: prop1];
-                }
-                if (!elem2) {
-                    elem2 = [contact2 valueForProperty: prop2];
-                }
-                
-                result = [elem1 localizedCaseInsensitiveCompare: elem2];
-                if (result == NSOrderedSame)
-                {
-                    elem1 = [contact1 valueForProperty: prop1];
-                    elem2 = [contact2 valueForProperty: prop2];
-                    
-                    result = [elem1 localizedCaseInsensitiveCompare: elem2];
-                }
-            }
-            else if (contact1.isPerson && contact2.isOrganization)
-            {
-                prop2 = kABPersonOrganizationProperty;
-                
-                elem1 = [contact1 valueForProperty: prop1];
-                elem2 = [contact2 valueForProperty: prop2];
-                
-                prop1 = (sortOrdering == kABPersonSortByFirstName) ? kABPersonLastNameProperty : kABPersonFirstNameProperty;
-                if (!elem1) {
-                    elem1 = [contact1 valueForProperty: prop1];
-                }
-                
-                result = [elem1 localizedCaseInsensitiveCompare: elem2];
-            }
-            else if (contact1.isOrganization && contact2.isPerson)
-            {
-                prop1 = kABPersonOrganizationProperty;
-                
-                elem1 = [contact1 valueForProperty: prop1];
-                elem2 = [contact2 valueForProperty: prop2];
-                
-                prop2 = (sortOrdering == kABPersonSortByFirstName) ? kABPersonLastNameProperty : kABPersonFirstNameProperty;
-                if (!elem2) {
-                    elem2 =  [contact2 valueForProperty: prop2];
-                }
-                
-                result = [elem1 localizedCaseInsensitiveCompare: elem2];
-            }
-            else if (contact1.isOrganization && contact2.isOrganization)
-            {
-                prop1 = prop2 = kABPersonOrganizationProperty;
-                
-                elem1 = [contact1 valueForProperty: prop1];
-                elem2 = [contact2 valueForProperty: prop2];
-                
-                result = [elem1 localizedCaseInsensitiveCompare: elem2];
-            }
-            return result;
+            // Same order as the sections are sorted in by AKRecordLocator
+            AKSortKey *sortKey1 = [AKSortKey sortKeyOfContact: contact1 sortOrdering: sortOrdering];
+            AKSortKey *sortKey2 = [AKSortKey sortKeyOfContact: contact2 sortOrdering: sortOrdering];
+            return [sortKey1 compare: sortKey2];
         }
     };
     return comparator;
@@ -609,27 +923,15 @@
 
 - (BOOL)archiveDictionary: (NSDictionary *)dictionary withFileName: (NSString *)fileName
 {
-    BOOL success = NO;
-    
     NSString *path = [[AKAddressBook documentsDirectoryPath] stringByAppendingPathComponent: fileName];
     
-    NSOutputStream *stream = [NSOutputStream outputStreamToFileAtPath: path append: NO];
-    if (stream)
+    // Written to a temporary file that replaces the archive so an interrupted write never truncates it
+    NSError *error;
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList: dictionary format: NSPropertyListBinaryFormat_v1_0 options: 0 error: &error];
+    BOOL success = (data && [data writeToFile: path options: NSDataWritingAtomic error: &error]);
+    if (!success)
     {
-        CFStringRef err;
-        [stream open];
-        
-        CFIndex index = CFPropertyListWriteToStream((__bridge CFPropertyListRef)(dictionary), (__bridge CFWriteStreamRef)stream, kCFPropertyListBinaryFormat_v1_0, &err);
-        if (index == 0)
-        {
-            NSLog(@"CFPropertyListWriteToStream error: %@", err);
-        }
-        [stream close];
-        success = YES;
-    }
-    else
-    {
-        NSLog(@"Failed to create output stream");
+        NSLog(@"Archive of %@ (%ld): %@", fileName, (long)error.code, error.localizedDescription);
     }
     return success;
 }
@@ -674,29 +976,98 @@
     return dictionary;
 }
 
+- (NSArray *)cachedTableNames
+{
+    return @[[[AKAddressBook fileNameForSelector: @selector(hashTableSortedByFirst)] stringByDeletingPathExtension],
+             [[AKAddressBook fileNameForSelector: @selector(hashTableSortedByLast)] stringByDeletingPathExtension],
+             [[AKAddressBook fileNameForSelector: @selector(hashTableSortedByPhone)] stringByDeletingPathExtension],
+             [[AKAddressBook fileNameForSelector: @selector(recordLocatorByFirst)] stringByDeletingPathExtension],
+             [[AKAddressBook fileNameForSelector: @selector(recordLocatorByLast)] stringByDeletingPathExtension]];
+}
+
 - (BOOL)unarchiveCache
 {
-    NSMutableDictionary *dictionary = [self unarchiveDictionaryWithFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByFirst)]];
-    self.hashTableSortedByFirst = dictionary;
+    NSArray *tableNames = [self cachedTableNames];
+    NSDictionary *tables = [self.sectionCache readTablesNamed: tableNames];
+    
+    self.hashTableSortedByFirst = [tables objectForKey: [tableNames objectAtIndex: 0]];
+    self.hashTableSortedByLast = [tables objectForKey: [tableNames objectAtIndex: 1]];
+    self.hashTableSortedByPhone = [tables objectForKey: [tableNames objectAtIndex: 2]];
     
-    dictionary = [self unarchiveDictionaryWithFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByLast)]];
-    self.hashTableSortedByLast = dictionary;
+    BOOL success = (self.hashTableSortedByFirst && self.hashTableSortedByLast && self.hashTableSortedByPhone) ? YES : NO;
+    if (!success) return NO;
     
-    dictionary = [self unarchiveDictionaryWithFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByPhone)]];
-    self.hashTableSortedByPhone = dictionary;
+    // Sort keys the sections were ordered with, committed in the same batch
+    [self.recordLocatorByFirst locateRecordsOfSections: self.hashTableSortedByFirst withSortKeySections: [tables objectForKey: [tableNames objectAtIndex: 3]]];
+    [self.recordLocatorByLast locateRecordsOfSections: self.hashTableSortedByLast withSortKeySections: [tables objectForKey: [tableNames objectAtIndex: 4]]];
     
-    return (self.hashTableSortedByFirst && self.hashTableSortedByLast && self.hashTableSortedByPhone) ? YES : NO;
+    // The search entries are only used if they were committed along with the section tables
+    NSString *fileName = [AKAddressBook fileNameForSelector: @selector(searchEntryIndex)];
+    uint64_t stamp = [self.sectionCache committedStampOfFileNamed: fileName];
+    if (stamp != 0)
+    {
+        [self.searchEntryIndex loadFromFile: [self.sectionCache pathOfFileNamed: fileName] withStamp: stamp];
+    }
+    return success;
 }
 
-- (BOOL)archiveCache
+- (void)archiveCache
 {
-    BOOL success_1 = [self archiveDictionary: self.hashTableSortedByFirst withFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByFirst)]];
+    [self archiveCacheWithCompletionHandler: nil];
+}
+
+- (void)archiveCacheWithCompletionHandler: (void (^)(BOOL))completionHandler
+{
+    NSArray *tableNames = [self cachedTableNames];
+    // Sort keys are written as tables of their own, so only the sections whose sort keys changed are written with the batch
+    [self.sectionCache writeTables: @{[tableNames objectAtIndex: 0]: self.hashTableSortedByFirst,
+                                      [tableNames objectAtIndex: 1]: self.hashTableSortedByLast,
+                                      [tableNames objectAtIndex: 2]: self.hashTableSortedByPhone,
+                                      [tableNames objectAtIndex: 3]: [self.recordLocatorByFirst sortKeySectionsOfSections: self.hashTableSortedByFirst],
+                                      [tableNames objectAtIndex: 4]: [self.recordLocatorByLast sortKeySectionsOfSections: self.hashTableSortedByLast]}];
     
-    BOOL success_2 = [self archiveDictionary: self.hashTableSortedByLast withFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByLast)]];
+    NSDictionary *entries = [self.searchEntryIndex entriesForArchiving];
+    if (entries)
+    {
+        [self.sectionCache writeFileNamed: [AKAddressBook fileNameForSelector: @selector(searchEntryIndex)] withDataBlock: ^NSData *(uint64_t stamp) {
+            return [AKSearchEntryIndex dataWithEntries: entries stamp: stamp];
+        }];
+    }
+    if (completionHandler)
+    {
+        [self.sectionCache performWhenCommitted: completionHandler];
+    }
+}
+
+- (BOOL)archiveDisplaySnapshotWithChangedContactIDs: (NSSet *)changedContactIDs andABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSAssert(!dispatch_get_specific(IsOnMainQueueKey), @"Must not be dispatched on main queue");
+    
+    // What the next launch shows, the default source until another one is displayed
+    ABRecordID sourceID = self.sourceID;
+    ABRecordID groupID = self.groupID;
+    AKSource *source = [self sourceForSourceId: sourceID];
+    AKGroup *group = [source groupForGroupId: groupID];
+    if (!group) return NO;
     
-    BOOL success_3 = [self archiveDictionary: self.hashTableSortedByPhone withFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByPhone)]];
+    NSString *path = [[AKAddressBook documentsDirectoryPath] stringByAppendingPathComponent: [AKDisplaySnapshot fileName]];
+    AKDisplaySnapshot *previousSnapshot = self.archivedDisplaySnapshot;
+    if (!previousSnapshot && changedContactIDs)
+    { // Names written by the previous launch
+        previousSnapshot = [AKDisplaySnapshot snapshotWithContentsOfFile: path];
+    }
     
-    return (success_1 && success_2 && success_3);
+    AKDisplaySnapshot *displaySnapshot = [[AKDisplaySnapshot alloc] initWithIndexSnapshot: self.snapshot
+                                                                                memberIDs: [group.memberIDs copy]
+                                                                                 sourceID: sourceID
+                                                                                  groupID: groupID
+                                                                         previousSnapshot: (changedContactIDs) ? previousSnapshot : nil
+                                                                        changedContactIDs: changedContactIDs
+                                                                        andAddressBookRef: addressBookRef];
+    
+    BOOL success = [displaySnapshot writeToFile: path];
+    if (success) self.archivedDisplaySnapshot = displaySnapshot;
+    return success;
 }
 
 - (BOOL)deleteArchiveWithFileName: (NSString *)fileName
@@ -721,8 +1092,12 @@
     BOOL success_1 = [self deleteArchiveWithFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByFirst)]];
     BOOL success_2 = [self deleteArchiveWithFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByLast)]];
     BOOL success_3 = [self deleteArchiveWithFileName: [AKAddressBook fileNameForSelector: @selector(hashTableSortedByPhone)]];
+    BOOL success_4 = [self.sectionCache removeAllFiles];
+    [self deleteArchiveWithFileName: [AKDisplaySnapshot fileName]];
+    [self deleteArchiveWithFileName: [AKDisplaySnapshot headerFileName]];
+    self.archivedDisplaySnapshot = nil;
     
-    return (success_1 && success_2 && success_3);
+    return ((success_1 && success_2 && success_3) || success_4);
 }
 
 @end
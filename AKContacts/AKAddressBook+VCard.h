@@ -0,0 +1,67 @@
+//
+//  AKAddressBook+VCard.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKAddressBook.h"
+
+/**
+ * Number of vCards saved to the address book with a single ABAddressBookSave
+ */
+FOUNDATION_EXPORT const NSUInteger AKVCardDefaultBatchSize;
+
+typedef void (^AKVCardCompletionHandler)(NSInteger count, double recordsPerSecond);
+
+@class AKContact;
+
+/**
+ * vCard 3.0 of the contact as written by the export
+ */
+FOUNDATION_EXPORT NSString *AKVCardStringWithContact(AKContact *contact);
+/**
+ * People of the vCards of the file as created by the import, without adding
+ * them to an address book. ABRecordRefs, nil if the file can't be read
+ */
+FOUNDATION_EXPORT NSArray *AKVCardRecordsWithContentsOfFile(NSString *path);
+
+@interface AKAddressBook (VCard)
+
+/**
+ * Stream vCards (3.0 and 4.0) from a file into the address book.
+ * Records are created in batches of batchSize with a single save per batch
+ * and inserted into the sorted lookup tables right after the save.
+ * The completion handler is called on the main queue with the number of
+ * records imported and the throughput in records per second. The import stops
+ * at the first batch that fails to save and reports -1, records of the batches
+ * saved before stay imported. Call on the main queue
+ */
+- (void)importVCardsFromFileAtPath: (NSString *)path batchSize: (NSUInteger)batchSize completionHandler: (AKVCardCompletionHandler)completionHandler;
+/**
+ * Stream all contacts of the address book into a vCard 3.0 file, batchSize records at a time
+ */
+- (void)exportVCardsToFileAtPath: (NSString *)path batchSize: (NSUInteger)batchSize completionHandler: (AKVCardCompletionHandler)completionHandler;
+
+@end
@@ -0,0 +1,881 @@
+//
+//  AKAddressBook+VCard.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKAddressBook+VCard.h"
+#import "AKAddressBook+Loader.h"
+#import "AKContact.h"
+#import "AKGroup.h"
+#import "AKSource.h"
+#import "AKAddressBookPool.h"
+
+const NSUInteger AKVCardDefaultBatchSize = 250;
+
+static const NSUInteger kVCardReadChunkSize = 64 * 1024;
+static const NSUInteger kVCardMaxLineOctets = 75;
+/**
+ * Year of dates without a year in ABAddressBook, written as --MMDD
+ */
+static NSString *const kVCardNoYear = @"1604";
+
+#pragma mark - Escaping
+
+static NSString *AKVCardUnescape(NSString *value)
+{
+    if ([value rangeOfString: @"\\"].location == NSNotFound) return value;
+    
+    NSMutableString *ret = [[NSMutableString alloc] initWithCapacity: value.length];
+    for (NSUInteger index = 0; index < value.length; ++index)
+    {
+        unichar character = [value characterAtIndex: index];
+        if (character == '\\' && index + 1 < value.length)
+        {
+            unichar next = [value characterAtIndex: ++index];
+            if (next == 'n' || next == 'N') [ret appendString: @"\n"];
+            else [ret appendFormat: @"%C", next];
+        }
+        else
+        {
+            [ret appendFormat: @"%C", character];
+        }
+    }
+    return [ret copy];
+}
+
+static NSString *AKVCardEscape(NSString *value)
+{
+    NSMutableString *ret = [value mutableCopy];
+    [ret replaceOccurrencesOfString: @"\\" withString: @"\\\\" options: 0 range: NSMakeRange(0, ret.length)];
+    [ret replaceOccurrencesOfString: @";" withString: @"\\;" options: 0 range: NSMakeRange(0, ret.length)];
+    [ret replaceOccurrencesOfString: @"," withString: @"\\," options: 0 range: NSMakeRange(0, ret.length)];
+    [ret replaceOccurrencesOfString: @"\r\n" withString: @"\\n" options: 0 range: NSMakeRange(0, ret.length)];
+    [ret replaceOccurrencesOfString: @"\n" withString: @"\\n" options: 0 range: NSMakeRange(0, ret.length)];
+    return [ret copy];
+}
+
+/**
+ * Split a structured value (eg: N or ADR) on unescaped semicolons and unescape the components
+ */
+static NSArray *AKVCardComponents(NSString *value)
+{
+    NSMutableArray *components = [[NSMutableArray alloc] init];
+    NSUInteger location = 0;
+    for (NSUInteger index = 0; index < value.length; ++index)
+    {
+        unichar character = [value characterAtIndex: index];
+        if (character == '\\')
+        {
+            index += 1;
+        }
+        else if (character == ';')
+        {
+            [components addObject: AKVCardUnescape([value substringWithRange: NSMakeRange(location, index - location)])];
+            location = index + 1;
+        }
+    }
+    [components addObject: AKVCardUnescape([value substringFromIndex: MIN(location, value.length)])];
+    return [components copy];
+}
+
+static NSString *AKVCardComponentAtIndex(NSArray *components, NSUInteger index)
+{
+    NSString *component = (index < components.count) ? [components objectAtIndex: index] : nil;
+    return (component.length > 0) ? component : nil;
+}
+
+#pragma mark - Labels
+
+/**
+ * Label of the types of a value, the custom label if none of them has a label of its own
+ */
+static NSString *AKVCardLabelForTypes(NSSet *types, NSString *customLabel, ABPropertyID property)
+{
+    if (property == kABPersonPhoneProperty)
+    {
+        if ([types member: @"iphone"]) return (__bridge NSString *)kABPersonPhoneIPhoneLabel;
+        if ([types member: @"cell"]) return (__bridge NSString *)kABPersonPhoneMobileLabel;
+        if ([types member: @"pager"]) return (__bridge NSString *)kABPersonPhonePagerLabel;
+        if ([types member: @"fax"])
+        {
+            if ([types member: @"home"]) return (__bridge NSString *)kABPersonPhoneHomeFAXLabel;
+            if ([types member: @"work"]) return (__bridge NSString *)kABPersonPhoneWorkFAXLabel;
+            return (__bridge NSString *)kABPersonPhoneOtherFAXLabel;
+        }
+        if ([types member: @"main"]) return (__bridge NSString *)kABPersonPhoneMainLabel;
+    }
+    if (property == kABPersonURLProperty && ([types member: @"home page"] || [types member: @"homepage"]))
+    {
+        return (__bridge NSString *)kABPersonHomePageLabel;
+    }
+    if ([types member: @"home"]) return (__bridge NSString *)kABHomeLabel;
+    if ([types member: @"work"]) return (__bridge NSString *)kABWorkLabel;
+    if (customLabel.length > 0) return customLabel;
+    return (__bridge NSString *)kABOtherLabel;
+}
+
+static NSString *AKVCardTypeForLabel(NSString *label)
+{
+    if (label.length == 0) return nil;
+    
+    NSDictionary *types = @{(__bridge NSString *)kABPersonPhoneIPhoneLabel: @"CELL,IPHONE",
+                            (__bridge NSString *)kABPersonPhoneMobileLabel: @"CELL",
+                            (__bridge NSString *)kABPersonPhonePagerLabel: @"PAGER",
+                            (__bridge NSString *)kABPersonPhoneHomeFAXLabel: @"HOME,FAX",
+                            (__bridge NSString *)kABPersonPhoneWorkFAXLabel: @"WORK,FAX",
+                            (__bridge NSString *)kABPersonPhoneOtherFAXLabel: @"FAX",
+                            (__bridge NSString *)kABPersonPhoneMainLabel: @"MAIN",
+                            (__bridge NSString *)kABPersonHomePageLabel: @"HOMEPAGE",
+                            (__bridge NSString *)kABHomeLabel: @"HOME",
+                            (__bridge NSString *)kABWorkLabel: @"WORK",
+                            (__bridge NSString *)kABOtherLabel: @"OTHER"};
+    NSString *type = [types objectForKey: label];
+    if (!type)
+    { // Custom labels are stored verbatim as a quoted type
+        type = [NSString stringWithFormat: @"\"%@\"", [label stringByReplacingOccurrencesOfString: @"\"" withString: @""]];
+    }
+    return type;
+}
+
+#pragma mark - vCard Reader
+
+@interface AKVCardLine : NSObject
+
+@property (copy, nonatomic) NSString *name;
+/**
+ * Lowercase types of the TYPE parameters
+ */
+@property (strong, nonatomic) NSSet *types;
+/**
+ * Type that is not a standard vCard type, in its original case. Quoted types
+ * are custom labels as written by AKVCardTypeForLabel
+ */
+@property (copy, nonatomic) NSString *customLabel;
+@property (copy, nonatomic) NSString *value;
+
++ (instancetype)lineWithString: (NSString *)string;
+
+@end
+
+@implementation AKVCardLine
+
++ (instancetype)lineWithString: (NSString *)string
+{
+    NSUInteger colon = NSNotFound;
+    BOOL quoted = NO;
+    for (NSUInteger index = 0; index < string.length; ++index)
+    {
+        unichar character = [string characterAtIndex: index];
+        if (character == '"') quoted = !quoted;
+        else if (character == ':' && !quoted)
+        {
+            colon = index;
+            break;
+        }
+    }
+    if (colon == NSNotFound) return nil;
+    
+    AKVCardLine *line = [[AKVCardLine alloc] init];
+    line.value = [string substringFromIndex: colon + 1];
+    
+    // Semicolons within quotes belong to the parameter value
+    NSMutableArray *parameters = [[NSMutableArray alloc] init];
+    NSString *parameterString = [string substringToIndex: colon];
+    NSUInteger location = 0;
+    quoted = NO;
+    for (NSUInteger index = 0; index <= parameterString.length; ++index)
+    {
+        unichar character = (index < parameterString.length) ? [parameterString characterAtIndex: index] : ';';
+        if (character == '"') quoted = !quoted;
+        else if (character == ';' && (!quoted || index == parameterString.length))
+        {
+            [parameters addObject: [parameterString substringWithRange: NSMakeRange(location, index - location)]];
+            location = index + 1;
+        }
+    }
+    NSString *name = [parameters.firstObject uppercaseString];
+    NSRange group = [name rangeOfString: @"." options: NSBackwardsSearch];
+    line.name = (group.location != NSNotFound) ? [name substringFromIndex: group.location + 1] : name;
+    
+    NSSet *standardTypes = [AKVCardLine standardTypes];
+    NSMutableSet *types = [[NSMutableSet alloc] init];
+    for (NSUInteger index = 1; index < parameters.count; ++index)
+    {
+        NSString *parameter = [parameters objectAtIndex: index];
+        NSRange equals = [parameter rangeOfString: @"="];
+        NSString *value;
+        if (equals.location == NSNotFound)
+        { // vCard 2.1 style bare type, or encoding
+            [types addObject: parameter.lowercaseString];
+            continue;
+        }
+        else if ([[[parameter substringToIndex: equals.location] lowercaseString] isEqualToString: @"type"])
+        {
+            value = [parameter substringFromIndex: equals.location + 1];
+        }
+        if (value.length == 0) continue;
+        
+        NSArray *values = [[value stringByReplacingOccurrencesOfString: @"\"" withString: @""] componentsSeparatedByString: @","];
+        if (value.length > 1 && [value hasPrefix: @"\""] && [value hasSuffix: @"\""] &&
+            ![standardTypes isSupersetOfSet: [[NSSet alloc] initWithArray: [values valueForKey: @"lowercaseString"]]])
+        { // Custom labels are written quoted and may contain commas
+            line.customLabel = [value substringWithRange: NSMakeRange(1, value.length - 2)];
+            [types addObject: line.customLabel.lowercaseString];
+            continue;
+        }
+        for (NSString *type in values)
+        {
+            [types addObject: type.lowercaseString];
+            if (!line.customLabel && type.length > 0 && ![standardTypes member: type.lowercaseString]) line.customLabel = type;
+        }
+    }
+    line.types = [types copy];
+    return line;
+}
+
+/**
+ * Types of the vCard 2.1, 3.0 and 4.0 specifications and of the Contacts app
+ */
++ (NSSet *)standardTypes
+{
+    static NSSet *standardTypes = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        standardTypes = [[NSSet alloc] initWithArray: @[@"home", @"work", @"other", @"pref", @"voice", @"cell", @"mobile", @"iphone", @"pager",
+                                                         @"fax", @"main", @"msg", @"text", @"textphone", @"video", @"bbs", @"modem", @"car",
+                                                         @"isdn", @"pcs", @"internet", @"x400", @"dom", @"intl", @"postal", @"parcel",
+                                                         @"homepage", @"home page"]];
+    });
+    return standardTypes;
+}
+
+@end
+
+@interface AKVCardReader : NSObject
+
+@property (strong, nonatomic) NSInputStream *stream;
+@property (strong, nonatomic) NSMutableData *buffer;
+@property (assign, nonatomic) NSUInteger offset;
+@property (assign, nonatomic) BOOL endOfStream;
+@property (copy, nonatomic) NSString *pendingLine;
+
+- (instancetype)initWithPath: (NSString *)path;
+/**
+ * Returns the content lines of the next vCard or nil at the end of the stream.
+ * At most kVCardReadChunkSize bytes are buffered beyond the current line
+ */
+- (NSArray *)nextCard;
+- (void)close;
+
+@end
+
+@implementation AKVCardReader
+
+- (instancetype)initWithPath: (NSString *)path
+{
+    self = [super init];
+    if (self)
+    {
+        _stream = [NSInputStream inputStreamWithFileAtPath: path];
+        [_stream open];
+        _buffer = [[NSMutableData alloc] initWithCapacity: kVCardReadChunkSize];
+        _endOfStream = (_stream == nil);
+    }
+    return self;
+}
+
+- (void)close
+{
+    [self.stream close];
+    self.stream = nil;
+}
+
+- (NSString *)nextRawLine
+{
+    static const uint8_t newline = '\n';
+    NSData *separator = [NSData dataWithBytes: &newline length: 1];
+    
+    while (YES)
+    {
+        NSRange range = [self.buffer rangeOfData: separator options: 0 range: NSMakeRange(self.offset, self.buffer.length - self.offset)];
+        if (range.location != NSNotFound || (self.endOfStream && self.offset < self.buffer.length))
+        {
+            NSUInteger end = (range.location != NSNotFound) ? range.location : self.buffer.length;
+            NSUInteger length = end - self.offset;
+            const uint8_t *bytes = (const uint8_t *)self.buffer.bytes + self.offset;
+            if (length > 0 && bytes[length - 1] == '\r') length -= 1;
+            
+            NSString *line = [[NSString alloc] initWithBytes: bytes length: length encoding: NSUTF8StringEncoding];
+            if (!line) line = [[NSString alloc] initWithBytes: bytes length: length encoding: NSISOLatin1StringEncoding];
+            self.offset = MIN(end + 1, self.buffer.length);
+            return line;
+        }
+        if (self.endOfStream) return nil;
+        
+        // Drop consumed bytes so the buffer stays within a chunk or two
+        [self.buffer replaceBytesInRange: NSMakeRange(0, self.offset) withBytes: NULL length: 0];
+        self.offset = 0;
+        
+        uint8_t chunk[kVCardReadChunkSize];
+        NSInteger read = [self.stream read: chunk maxLength: kVCardReadChunkSize];
+        if (read > 0)
+        {
+            [self.buffer appendBytes: chunk length: read];
+        }
+        else
+        {
+            if (read < 0) NSLog(@"vCard read error: %@", self.stream.streamError);
+            self.endOfStream = YES;
+        }
+    }
+}
+
+- (NSString *)nextLine
+{
+    NSString *line = self.pendingLine ?: [self nextRawLine];
+    self.pendingLine = nil;
+    if (!line) return nil;
+    
+    NSMutableString *unfolded;
+    NSString *next;
+    while ((next = [self nextRawLine]))
+    {
+        if (next.length > 0 && ([next characterAtIndex: 0] == ' ' || [next characterAtIndex: 0] == '\t'))
+        {
+            if (!unfolded) unfolded = [line mutableCopy];
+            [unfolded appendString: [next substringFromIndex: 1]];
+        }
+        else
+        {
+            self.pendingLine = next;
+            break;
+        }
+    }
+    return (unfolded) ? [unfolded copy] : line;
+}
+
+- (NSArray *)nextCard
+{
+    NSMutableArray *lines;
+    NSString *string;
+    while ((string = [self nextLine]))
+    {
+        if (!lines)
+        {
+            if ([string caseInsensitiveCompare: @"BEGIN:VCARD"] == NSOrderedSame)
+            {
+                lines = [[NSMutableArray alloc] init];
+            }
+            continue;
+        }
+        if ([string caseInsensitiveCompare: @"END:VCARD"] == NSOrderedSame)
+        {
+            return [lines copy];
+        }
+        AKVCardLine *line = [AKVCardLine lineWithString: string];
+        if (line) [lines addObject: line];
+    }
+    return nil;
+}
+
+@end
+
+#pragma mark - Record Conversion
+
+static NSDateFormatter *AKVCardDateFormatter(NSString *format)
+{
+    NSDateFormatter *formatter = [[NSDateFormatter alloc] init];
+    formatter.locale = [[NSLocale alloc] initWithLocaleIdentifier: @"en_US_POSIX"];
+    formatter.timeZone = [NSTimeZone timeZoneForSecondsFromGMT: 0];
+    formatter.dateFormat = format;
+    return formatter;
+}
+
+static void AKVCardSetValue(ABRecordRef recordRef, ABPropertyID property, id value)
+{
+    if (!value) return;
+    
+    CFErrorRef error = NULL;
+    ABRecordSetValue(recordRef, property, (__bridge CFTypeRef)value, &error);
+    if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABRecordSetValue (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
+}
+
+/**
+ * Returns a new person record populated from the content lines of a vCard
+ * Unsaved records have no recordID yet, so values are set on the record directly
+ * with the same semantics as the AKRecord setters
+ */
+static ABRecordRef AKVCardCreateRecord(NSArray *lines, ABRecordRef sourceRef, NSDateFormatter *dateFormatter)
+{
+    ABRecordRef recordRef = (sourceRef) ? ABPersonCreateInSource(sourceRef) : ABPersonCreate();
+    if (!recordRef) return NULL;
+    
+    NSMutableDictionary *multiValues = [[NSMutableDictionary alloc] init];
+    void (^addMultiValue)(ABPropertyID, id, NSString *) = ^(ABPropertyID property, id value, NSString *label) {
+        NSMutableArray *values = [multiValues objectForKey: @(property)];
+        if (!values)
+        {
+            values = [[NSMutableArray alloc] init];
+            [multiValues setObject: values forKey: @(property)];
+        }
+        [values addObject: @[value, label]];
+    };
+    
+    NSString *formattedName;
+    BOOL hasName = NO;
+    for (AKVCardLine *line in lines)
+    {
+        NSString *name = line.name;
+        if ([name isEqualToString: @"N"])
+        {
+            NSArray *components = AKVCardComponents(line.value);
+            ABPropertyID properties[] = {kABPersonLastNameProperty, kABPersonFirstNameProperty, kABPersonMiddleNameProperty, kABPersonPrefixProperty, kABPersonSuffixProperty};
+            for (NSUInteger index = 0; index < sizeof(properties) / sizeof(properties[0]); ++index)
+            {
+                NSString *component = AKVCardComponentAtIndex(components, index);
+                if (component) hasName = YES;
+                AKVCardSetValue(recordRef, properties[index], component);
+            }
+        }
+        else if ([name isEqualToString: @"FN"])
+        {
+            formattedName = AKVCardUnescape(line.value);
+        }
+        else if ([name isEqualToString: @"ORG"])
+        {
+            NSArray *components = AKVCardComponents(line.value);
+            AKVCardSetValue(recordRef, kABPersonOrganizationProperty, AKVCardComponentAtIndex(components, 0));
+            AKVCardSetValue(recordRef, kABPersonDepartmentProperty, AKVCardComponentAtIndex(components, 1));
+        }
+        else if ([name isEqualToString: @"TITLE"])
+        {
+            AKVCardSetValue(recordRef, kABPersonJobTitleProperty, AKVCardUnescape(line.value));
+        }
+        else if ([name isEqualToString: @"NICKNAME"])
+        {
+            AKVCardSetValue(recordRef, kABPersonNicknameProperty, AKVCardUnescape(line.value));
+        }
+        else if ([name isEqualToString: @"NOTE"])
+        {
+            AKVCardSetValue(recordRef, kABPersonNoteProperty, AKVCardUnescape(line.value));
+        }
+        else if ([name isEqualToString: @"BDAY"])
+        {
+            NSString *date = [line.value componentsSeparatedByString: @"T"].firstObject;
+            NSString *value = date.stringWithNonDigitsRemoved;
+            if ([date hasPrefix: @"--"] && value.length == 4)
+            { // Dates without a year (vCard 4.0 --MMDD) are stored with the year of the Contacts app
+                value = [kVCardNoYear stringByAppendingString: value];
+            }
+            if (value.length == 8)
+            {
+                AKVCardSetValue(recordRef, kABPersonBirthdayProperty, [dateFormatter dateFromString: value]);
+            }
+        }
+        else if ([name isEqualToString: @"KIND"] || [name isEqualToString: @"X-ABSHOWAS"])
+        {
+            NSString *value = line.value.lowercaseString;
+            if ([value isEqualToString: @"org"] || [value isEqualToString: @"organization"] || [value isEqualToString: @"company"])
+            {
+                AKVCardSetValue(recordRef, kABPersonKindProperty, (__bridge NSNumber *)kABPersonKindOrganization);
+            }
+        }
+        else if ([name isEqualToString: @"TEL"])
+        {
+            NSString *value = AKVCardUnescape(line.value);
+            if ([value.lowercaseString hasPrefix: @"tel:"]) value = [value substringFromIndex: 4];
+            if (value.length > 0) addMultiValue(kABPersonPhoneProperty, value, AKVCardLabelForTypes(line.types, line.customLabel, kABPersonPhoneProperty));
+        }
+        else if ([name isEqualToString: @"EMAIL"])
+        {
+            NSString *value = AKVCardUnescape(line.value);
+            if (value.length > 0) addMultiValue(kABPersonEmailProperty, value, AKVCardLabelForTypes(line.types, line.customLabel, kABPersonEmailProperty));
+        }
+        else if ([name isEqualToString: @"URL"])
+        {
+            NSString *value = AKVCardUnescape(line.value);
+            if (value.length > 0) addMultiValue(kABPersonURLProperty, value, AKVCardLabelForTypes(line.types, line.customLabel, kABPersonURLProperty));
+        }
+        else if ([name isEqualToString: @"ADR"])
+        {
+            NSArray *components = AKVCardComponents(line.value);
+            NSMutableDictionary *address = [[NSMutableDictionary alloc] init];
+            NSArray *keys = @[[NSNull null], [NSNull null], (NSString *)kABPersonAddressStreetKey, (NSString *)kABPersonAddressCityKey,
+                              (NSString *)kABPersonAddressStateKey, (NSString *)kABPersonAddressZIPKey, (NSString *)kABPersonAddressCountryKey];
+            for (NSUInteger index = 0; index < keys.count; ++index)
+            {
+                NSString *component = AKVCardComponentAtIndex(components, index);
+                id key = [keys objectAtIndex: index];
+                if (component && key != [NSNull null]) [address setObject: component forKey: key];
+            }
+            if (address.count > 0) addMultiValue(kABPersonAddressProperty, address, AKVCardLabelForTypes(line.types, line.customLabel, kABPersonAddressProperty));
+        }
+    }
+    
+    if (!hasName && formattedName.length > 0)
+    {
+        AKVCardSetValue(recordRef, kABPersonFirstNameProperty, formattedName);
+    }
+    
+    for (NSNumber *property in multiValues)
+    {
+        ABMutableMultiValueRef multiValue = ABMultiValueCreateMutable(ABPersonGetTypeOfProperty(property.intValue));
+        for (NSArray *pair in [multiValues objectForKey: property])
+        {
+            ABMultiValueAddValueAndLabel(multiValue, (__bridge CFTypeRef)pair[0], (__bridge CFStringRef)pair[1], NULL);
+        }
+        AKVCardSetValue(recordRef, property.intValue, (__bridge id)multiValue);
+        CFRelease(multiValue);
+    }
+    return recordRef;
+}
+
+#pragma mark - vCard Writer
+
+static void AKVCardAppendLine(NSMutableString *output, NSString *line)
+{
+    // Fold lines longer than 75 octets without splitting composed characters
+    __block NSUInteger octets = 0;
+    [line enumerateSubstringsInRange: NSMakeRange(0, line.length) options: NSStringEnumerationByComposedCharacterSequences usingBlock: ^(NSString *substring, NSRange substringRange, NSRange enclosingRange, BOOL *stop) {
+        NSUInteger length = [substring lengthOfBytesUsingEncoding: NSUTF8StringEncoding];
+        if (octets + length > kVCardMaxLineOctets)
+        {
+            [output appendString: @"\r\n "];
+            octets = 1;
+        }
+        [output appendString: substring];
+        octets += length;
+    }];
+    [output appendString: @"\r\n"];
+}
+
+static void AKVCardAppendMultiValues(NSMutableString *output, AKContact *contact, ABPropertyID property, NSString *name, NSString *(^format)(id))
+{
+    for (NSNumber *identifier in [contact identifiersForMultiValueProperty: property])
+    {
+        id value = [contact valueForMultiValueProperty: property andIdentifier: identifier.intValue];
+        NSString *string = (value) ? format(value) : nil;
+        if (string.length == 0) continue;
+        
+        NSString *type = AKVCardTypeForLabel([contact labelForMultiValueProperty: property andIdentifier: identifier.intValue]);
+        NSString *parameters = (type) ? [NSString stringWithFormat: @";TYPE=%@", type] : @"";
+        AKVCardAppendLine(output, [NSString stringWithFormat: @"%@%@:%@", name, parameters, string]);
+    }
+}
+
+static void AKVCardAppendContact(NSMutableString *output, AKContact *contact, NSDateFormatter *dateFormatter)
+{
+    NSString *(^escaped)(ABPropertyID) = ^(ABPropertyID property) {
+        NSString *value = [contact valueForProperty: property];
+        return (value) ? AKVCardEscape(value) : @"";
+    };
+    
+    AKVCardAppendLine(output, @"BEGIN:VCARD");
+    AKVCardAppendLine(output, @"VERSION:3.0");
+    AKVCardAppendLine(output, [NSString stringWithFormat: @"N:%@;%@;%@;%@;%@", escaped(kABPersonLastNameProperty), escaped(kABPersonFirstNameProperty),
+                               escaped(kABPersonMiddleNameProperty), escaped(kABPersonPrefixProperty), escaped(kABPersonSuffixProperty)]);
+    AKVCardAppendLine(output, [NSString stringWithFormat: @"FN:%@", AKVCardEscape(contact.displayName)]);
+    
+    if (contact.isOrganization)
+    {
+        AKVCardAppendLine(output, @"X-ABShowAs:COMPANY");
+    }
+    NSString *organization = escaped(kABPersonOrganizationProperty), *department = escaped(kABPersonDepartmentProperty);
+    if (organization.length > 0 || department.length > 0)
+    {
+        AKVCardAppendLine(output, [NSString stringWithFormat: @"ORG:%@;%@", organization, department]);
+    }
+    NSDictionary *singleValues = @{@"TITLE": @(kABPersonJobTitleProperty), @"NICKNAME": @(kABPersonNicknameProperty), @"NOTE": @(kABPersonNoteProperty)};
+    for (NSString *name in singleValues)
+    {
+        NSString *value = escaped([[singleValues objectForKey: name] intValue]);
+        if (value.length > 0) AKVCardAppendLine(output, [NSString stringWithFormat: @"%@:%@", name, value]);
+    }
+    NSDate *birthday = [contact valueForProperty: kABPersonBirthdayProperty];
+    if (birthday)
+    {
+        NSString *date = [dateFormatter stringFromDate: birthday];
+        if ([date hasPrefix: [kVCardNoYear stringByAppendingString: @"-"]])
+        { // Written as a date without a year, --MMDD
+            date = [@"--" stringByAppendingString: [[date substringFromIndex: kVCardNoYear.length] stringWithNonDigitsRemoved]];
+        }
+        AKVCardAppendLine(output, [NSString stringWithFormat: @"BDAY:%@", date]);
+    }
+    
+    AKVCardAppendMultiValues(output, contact, kABPersonPhoneProperty, @"TEL", ^NSString *(id value) { return AKVCardEscape(value); });
+    AKVCardAppendMultiValues(output, contact, kABPersonEmailProperty, @"EMAIL", ^NSString *(id value) { return AKVCardEscape(value); });
+    AKVCardAppendMultiValues(output, contact, kABPersonURLProperty, @"URL", ^NSString *(id value) { return AKVCardEscape(value); });
+    AKVCardAppendMultiValues(output, contact, kABPersonAddressProperty, @"ADR", ^NSString *(id value) {
+        NSDictionary *address = (NSDictionary *)value;
+        NSArray *keys = @[(NSString *)kABPersonAddressStreetKey, (NSString *)kABPersonAddressCityKey, (NSString *)kABPersonAddressStateKey,
+                          (NSString *)kABPersonAddressZIPKey, (NSString *)kABPersonAddressCountryKey];
+        NSMutableArray *components = [[NSMutableArray alloc] initWithObjects: @"", @"", nil];
+        for (NSString *key in keys)
+        {
+            NSString *component = [address objectForKey: key];
+            [components addObject: (component) ? AKVCardEscape(component) : @""];
+        }
+        return [components componentsJoinedByString: @";"];
+    });
+    
+    AKVCardAppendLine(output, @"END:VCARD");
+}
+
+static BOOL AKVCardWriteString(NSOutputStream *stream, NSString *string)
+{
+    NSData *data = [string dataUsingEncoding: NSUTF8StringEncoding];
+    const uint8_t *bytes = data.bytes;
+    NSUInteger written = 0;
+    while (written < data.length)
+    {
+        NSInteger result = [stream write: bytes + written maxLength: data.length - written];
+        if (result <= 0)
+        {
+            NSLog(@"vCard write error: %@", stream.streamError);
+            return NO;
+        }
+        written += result;
+    }
+    return YES;
+}
+
+#pragma mark - Single Conversions
+
+NSString *AKVCardStringWithContact(AKContact *contact)
+{
+    NSMutableString *output = [[NSMutableString alloc] init];
+    AKVCardAppendContact(output, contact, AKVCardDateFormatter(@"yyyy-MM-dd"));
+    return [output copy];
+}
+
+NSArray *AKVCardRecordsWithContentsOfFile(NSString *path)
+{
+    if (![[NSFileManager defaultManager] isReadableFileAtPath: path]) return nil;
+    
+    AKVCardReader *reader = [[AKVCardReader alloc] initWithPath: path];
+    NSDateFormatter *dateFormatter = AKVCardDateFormatter(@"yyyyMMdd");
+    
+    NSMutableArray *records = [[NSMutableArray alloc] init];
+    NSArray *lines;
+    while ((lines = [reader nextCard]))
+    {
+        ABRecordRef recordRef = AKVCardCreateRecord(lines, NULL, dateFormatter);
+        if (recordRef) [records addObject: (__bridge_transfer id)recordRef];
+    }
+    [reader close];
+    return [records copy];
+}
+
+@implementation AKAddressBook (VCard)
+
+- (void)importVCardsFromFileAtPath: (NSString *)path batchSize: (NSUInteger)batchSize completionHandler: (AKVCardCompletionHandler)completionHandler
+{
+    NSAssert(dispatch_get_specific(IsOnMainQueueKey), @"Must be dispatched on main queue");
+    
+    if (batchSize == 0) batchSize = AKVCardDefaultBatchSize;
+    
+    ABRecordID sourceID = [self sourceForSourceId: self.sourceID].recordID;
+    
+    // The saves of the import notify the main queue reference, the records are inserted by the import instead of a reload
+    self.importCount += 1;
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        
+        __block NSInteger count = 0;
+        __block BOOL success = NO;
+        __block double recordsPerSecond = 0;
+        [self.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            if (!addressBookRef) return;
+            CFErrorRef error = NULL;
+            
+            // Records can't be created in the aggregate source, those go to the default source
+            ABRecordRef sourceRef = (sourceID >= 0) ? ABAddressBookGetSourceWithRecordID(addressBookRef, sourceID) : NULL;
+            if (sourceRef) CFRetain(sourceRef);
+            else sourceRef = ABAddressBookCopyDefaultSource(addressBookRef);
+            ABRecordID importSourceID = ABRecordGetRecordID(sourceRef);
+            
+            AKVCardReader *reader = [[AKVCardReader alloc] initWithPath: path];
+            NSDateFormatter *dateFormatter = AKVCardDateFormatter(@"yyyyMMdd");
+            
+            NSDate *start = [NSDate date];
+            count = 0;
+            BOOL endOfFile = NO;
+            success = YES;
+            
+            while (!endOfFile && success)
+            {
+                @autoreleasepool
+                { // Only one batch of records is alive at any time
+                    NSMutableArray *records = [[NSMutableArray alloc] initWithCapacity: batchSize];
+                    while (records.count < batchSize)
+                    {
+                        NSArray *lines = [reader nextCard];
+                        if (!lines)
+                        {
+                            endOfFile = YES;
+                            break;
+                        }
+                        ABRecordRef recordRef = AKVCardCreateRecord(lines, sourceRef, dateFormatter);
+                        if (recordRef)
+                        {
+                            ABAddressBookAddRecord(addressBookRef, recordRef, &error);
+                            if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookAddRecord (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
+                            [records addObject: (__bridge_transfer id)recordRef];
+                        }
+                    }
+                    
+                    if (records.count > 0)
+                    {
+                        success = ABAddressBookSave(addressBookRef, &error);
+                        if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookSave (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
+                        if (!success)
+                        {   // The records of the batch were not saved and have no recordIDs, the import stops
+                            ABAddressBookRevert(addressBookRef);
+                            break;
+                        }
+                        
+                        NSMutableArray *recordIDs = [[NSMutableArray alloc] initWithCapacity: records.count];
+                        for (id obj in records)
+                        {
+                            ABRecordID recordID = ABRecordGetRecordID((__bridge ABRecordRef)obj);
+                            if (recordID != kABRecordInvalidID) [recordIDs addObject: @(recordID)];
+                        }
+                        
+                        // References of other threads must revert to see the saved records
+                        [self.addressBookPool invalidateHandles];
+                        [self performIndexUpdate: ^(ABAddressBookRef indexAddressBookRef) {
+                            [self insertImportedRecordIDs: recordIDs ofSourceID: importSourceID withAddressBookRef: indexAddressBookRef];
+                        }];
+                        count += recordIDs.count;
+                    }
+                }
+            }
+            [reader close];
+            CFRelease(sourceRef);
+            
+            NSTimeInterval elapsed = fabs([start timeIntervalSinceNow]);
+            recordsPerSecond = (elapsed > 0) ? count / elapsed : 0;
+            NSLog(@"vCard import: %ld records in %.2f (%.0f records/s)", (long)count, elapsed, recordsPerSecond);
+        }];
+        
+        // Ends once the records saved are inserted. People added or removed by others
+        // while the import ignored change notifications make the counts differ
+        dispatch_async(self.serial_queue, ^{
+            __block BOOL changed = NO;
+            [self.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef countAddressBookRef) {
+                changed = (countAddressBookRef && ABAddressBookGetPersonCount(countAddressBookRef) != self.nativeContactsCount);
+            }];
+            dispatch_async(dispatch_get_main_queue(), ^{
+                self.importCount -= 1;
+                if (self.importCount == 0 && changed)
+                {
+                    [self reloadAddressBook];
+                }
+                if (completionHandler) {
+                    completionHandler((success) ? count : -1, recordsPerSecond);
+                }
+            });
+        });
+    });
+}
+
+- (void)insertImportedRecordIDs: (NSArray *)recordIDs ofSourceID: (ABRecordID)sourceID withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    AKSource *source = [self sourceForSourceId: sourceID];
+    AKGroup *aggregateGroup = [source groupForGroupId: kGroupAggregate];
+    AKGroup *mainAggregateGroup = [[self sourceForSourceId: kSourceAggregate] groupForGroupId: kGroupAggregate];
+    
+    for (NSNumber *recordID in recordIDs)
+    {
+        AKContact *contact = [self contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
+        [self insertRecordIDinContactIdentifiersForContact: contact withAddressBookRef: addressBookRef];
+        [self processPhoneNumbersOfContact: contact withABAddressBookRef: addressBookRef];
+        
+        [aggregateGroup.memberIDs addObject: recordID];
+        [mainAggregateGroup.memberIDs addObject: recordID];
+    }
+    self.contactsCount += recordIDs.count;
+    self.nativeContactsCount += recordIDs.count;
+}
+
+- (void)exportVCardsToFileAtPath: (NSString *)path batchSize: (NSUInteger)batchSize completionHandler: (AKVCardCompletionHandler)completionHandler
+{
+    if (batchSize == 0) batchSize = AKVCardDefaultBatchSize;
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        
+        NSArray *contactIDs = self.allContactIDs;
+        
+        __block NSInteger count = 0;
+        __block BOOL success = NO;
+        __block double recordsPerSecond = 0;
+        [self.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            if (!addressBookRef) return;
+            NSDateFormatter *dateFormatter = AKVCardDateFormatter(@"yyyy-MM-dd");
+            
+            NSOutputStream *stream = [NSOutputStream outputStreamToFileAtPath: path append: NO];
+            [stream open];
+            
+            NSDate *start = [NSDate date];
+            count = 0;
+            success = (stream != nil);
+            
+            for (NSUInteger location = 0; success && location < contactIDs.count; location += batchSize)
+            {
+                @autoreleasepool
+                {
+                    NSRange range = NSMakeRange(location, MIN(batchSize, contactIDs.count - location));
+                    NSMutableString *output = [[NSMutableString alloc] init];
+                    for (NSNumber *recordID in [contactIDs subarrayWithRange: range])
+                    {
+                        AKContact *contact = [self contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
+                        if (contact.recordRef)
+                        {
+                            AKVCardAppendContact(output, contact, dateFormatter);
+                            count += 1;
+                        }
+                    }
+                    success = AKVCardWriteString(stream, output);
+                }
+            }
+            [stream close];
+            
+            NSTimeInterval elapsed = fabs([start timeIntervalSinceNow]);
+            recordsPerSecond = (elapsed > 0) ? count / elapsed : 0;
+            NSLog(@"vCard export: %ld records in %.2f (%.0f records/s)", (long)count, elapsed, recordsPerSecond);
+        }];
+        
+        if (completionHandler) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionHandler((success) ? count : -1, recordsPerSecond);
+            });
+        }
+    });
+}
+
+@end
@@ -33,12 +33,33 @@ FOUNDATION_EXPORT const void *const IsOnSerialBackgroundQueueKey;
 FOUNDATION_EXPORT const BOOL ShowGroups;
 FOUNDATION_EXPORT const ABRecordID kUnkownContactID;
 FOUNDATION_EXPORT NSString *const noPhoneNumberKey;
+/**
+ * Posted on the main queue when a snapshot is published outside of loading
+ */
+FOUNDATION_EXPORT NSString *const AKAddressBookSnapshotDidChangeNotification;
 
 @class AKAddressBook;
 @class AKContact;
 @class AKGroup;
 @class AKSource;
+@class AKNameTokenIndex;
+@class AKKeypadIndex;
+@class AKSearchEntryIndex;
+@class AKDateIndex;
+@class AKFacetIndex;
+@class AKEmailIndex;
+@class AKRecordLocator;
+@class AKSectionCache;
+@class AKSectionViewCache;
+@class AKProgressReporter;
+@class AKIndexSnapshot;
+@class AKDisplaySnapshot;
+@class AKLoadPass;
+@class AKCache;
+@class AKAddressBookPool;
 @protocol HWContactProtocol;
+@protocol AKDirectoryTransport;
+@protocol AKContactIndex;
 
 #define kAddressBookLoadingMask (1 << 8)
 
@@ -70,6 +91,11 @@ NS_INLINE AKSourceGroup AKMakeSourceGroup(NSUInteger source, NSUInteger group) {
 - (void)addressBookWillBeginUpdates: (AKAddressBook *)addressBook;
 - (void)addressBook: (AKAddressBook *)addressBook didInsertRecordID: (ABRecordID)recordID;
 - (void)addressBook: (AKAddressBook *)addressBook didRemoveRecordID: (ABRecordID)recordID;
+/**
+ * Called instead of addressBook:didRemoveRecordID: if implemented, with the key
+ * of the section of the sort ordering the record was removed from
+ */
+- (void)addressBook: (AKAddressBook *)addressBook didRemoveRecordID: (ABRecordID)recordID fromSectionWithKey: (NSString *)sectionKey;
 - (void)addressBookDidEndUpdates: (AKAddressBook *)addressBook;
 - (void)addressBook:(AKAddressBook *)addressBook didMakeLoadProgress: (CGFloat)progress;
 
@@ -80,10 +106,20 @@ NS_INLINE AKSourceGroup AKMakeSourceGroup(NSUInteger source, NSUInteger group) {
 @property (assign, nonatomic) id<AKAddressBookPresentationDelegate> presentationDelegate;
 
 @property (assign, nonatomic) ABAddressBookRef addressBookRef;
+/**
+ * ABAddressBook references of the background threads that load and search
+ **/
+@property (strong, nonatomic, readonly) AKAddressBookPool *addressBookPool;
 
+/**
+ * Loading and other changes of the section tables are serialized on serial_queue
+ **/
 @property (strong, nonatomic, readonly) dispatch_queue_t serial_queue;
-
-@property (strong, nonatomic, readonly) dispatch_semaphore_t semaphore;
+/**
+ * Searches and other readers of the snapshot run concurrently on concurrent_queue
+ * Publishing a snapshot swaps the atomic snapshot property and does not wait for them
+ **/
+@property (strong, nonatomic, readonly) dispatch_queue_t concurrent_queue;
 
 @property (assign, nonatomic) AddressBookStatus status;
 @property (assign, nonatomic, getter = isLoading) BOOL loading;
@@ -91,13 +127,18 @@ NS_INLINE AKSourceGroup AKMakeSourceGroup(NSUInteger source, NSUInteger group) {
 @property (assign, readonly, nonatomic) BOOL canAccessNativeAddressBook;
 @property (assign, readonly, nonatomic) ABAuthorizationStatus nativeAddressBookAuthorizationStatus;
 
-@property (strong, nonatomic) NSProgress *loadProgress;
+/**
+ * Progress of loading in two phases: scanning the native address book and applying the changes
+ **/
+@property (strong, nonatomic, readonly) AKProgressReporter *loadProgress;
 /**
  * AKSource objects in the order of display
  **/
 @property (strong, nonatomic) NSMutableArray *sources;
 /**
  * Arrays of Contact IDs with alphabetic lookup letters as keys
+ * The hashTableSortedBy* tables are the working copies of the loader and
+ * must only be accessed on serial_queue. Read the snapshot elsewhere
  **/
 @property (strong, nonatomic) NSMutableDictionary *hashTableSortedByFirst;
 @property (strong, nonatomic) NSMutableDictionary *hashTableSortedByLast;
@@ -105,12 +146,80 @@ NS_INLINE AKSourceGroup AKMakeSourceGroup(NSUInteger source, NSUInteger group) {
  * Arrays of Contact IDs with phone number first numbers as keys
  **/
 @property (strong, nonatomic) NSMutableDictionary *hashTableSortedByPhone;
-@property (strong, nonatomic) NSCache *phoneNumberCache;
+/**
+ * Sections and sort keys the records of hashTableSortedByFirst and
+ * hashTableSortedByLast were inserted with. Accessed on serial_queue
+ **/
+@property (strong, nonatomic, readonly) AKRecordLocator *recordLocatorByFirst;
+@property (strong, nonatomic, readonly) AKRecordLocator *recordLocatorByLast;
+/**
+ * Sets of the keys of sections changed since the last published snapshot, keyed
+ * by the name of the hashTableSortedBy* table. Nil when every section may have
+ * changed. Accessed on serial_queue
+ **/
+@property (strong, nonatomic) NSMutableDictionary *dirtySectionKeys;
+/**
+ * Display snapshot written last, the names of unchanged contacts are reused
+ * from it. Accessed on serial_queue
+ **/
+@property (strong, nonatomic) AKDisplaySnapshot *archivedDisplaySnapshot;
+/**
+ * RecordIDs keyed by phone numbers looked up with contactForPhoneNumber:
+ **/
+@property (strong, nonatomic) AKCache *phoneNumberCache;
+/**
+ * Folded name tokens of displayed contacts for typo tolerant searching
+ **/
+@property (strong, nonatomic, readonly) AKNameTokenIndex *nameTokenIndex;
+/**
+ * Keypad digits of name tokens and phone number trigrams for dial pad searching
+ **/
+@property (strong, nonatomic, readonly) AKKeypadIndex *keypadIndex;
+/**
+ * Folded names and phone numbers of contacts, persisted with the section tables
+ * so that searches match without reading ABAddressBook
+ **/
+@property (strong, nonatomic, readonly) AKSearchEntryIndex *searchEntryIndex;
+/**
+ * Birthdays and dates of contacts by day of the year for upcoming events
+ **/
+@property (strong, nonatomic, readonly) AKDateIndex *dateIndex;
+/**
+ * Organization, department, job title and city values of contacts for filtering
+ **/
+@property (strong, nonatomic, readonly) AKFacetIndex *facetIndex;
+/**
+ * recordIDs by email address and by email domain
+ **/
+@property (strong, nonatomic, readonly) AKEmailIndex *emailIndex;
+/**
+ * Persists the section tables and the search entries in the background
+ **/
+@property (strong, nonatomic, readonly) AKSectionCache *sectionCache;
+/**
+ * Filtered sections of recently displayed groups, updated with each snapshot
+ **/
+@property (strong, nonatomic, readonly) AKSectionViewCache *sectionViewCache;
+/**
+ * Indexes maintained along with the section tables, see AKContactIndex
+ **/
+@property (strong, nonatomic, readonly) NSArray *contactIndexes;
+
+/**
+ * Most recently published immutable copy of the section tables
+ * Readers grab it once and use it without locking or copying
+ **/
+@property (strong, readonly) AKIndexSnapshot *snapshot;
 
 @property (nonatomic, readonly) NSDictionary *hashTable;
 @property (nonatomic, readonly) NSDictionary *hashTableSortedInverse;
 @property (nonatomic, readonly) NSArray *allContactIDs;
 @property (nonatomic, readonly) NSSet *contactIDsWithoutPhoneNumber;
+/**
+ * Position of each displayed contactID in the alphabetic order of hashTable.
+ * Built lazily per snapshot, ranking search results by it avoids comparing names
+ **/
+@property (nonatomic, readonly) NSDictionary *sortRanks;
 /**
  * ID of displayed source and group
  **/
@@ -118,29 +227,93 @@ NS_INLINE AKSourceGroup AKMakeSourceGroup(NSUInteger source, NSUInteger group) {
 @property (assign, nonatomic) ABRecordID groupID;
 
 @property (assign, nonatomic) BOOL needReload;
+/**
+ * Number of vCard imports running. External change notifications are not
+ * reloaded while it is non-zero, the imports insert the records they save
+ * Only accessed on the main queue
+ **/
+@property (assign, nonatomic) NSInteger importCount;
 
 @property (assign, nonatomic) NSInteger contactsCount;
 @property (assign, nonatomic) NSInteger nativeContactsCount;
 
+/**
+ * When the last load completed, loads requested within 2 seconds are skipped
+ * Contacts changed since the last load are found with the watermark committed
+ * along with the section tables, see AKSectionCache
+ **/
 @property (nonatomic) NSDate *dateAddressBookLoaded;
+/**
+ * Partitions of the last load, the ones of sources not displayed load after the load completes
+ */
+@property (strong) AKLoadPass *loadPass;
+/**
+ * Transport of directory searches of Exchange Global Address List sources
+ * Directory sources are created on load when set
+ */
+@property (strong) id<AKDirectoryTransport> directoryTransport;
+/**
+ * AKDirectorySource of each Exchange Global Address List source
+ */
+@property (strong) NSArray *directorySources;
 
-@property (assign, nonatomic, readonly) ABPersonSortOrdering sortOrdering;
+/**
+ * Sort ordering of the section tables, set on serial_queue. On other queues
+ * the ordering of the displayed sections is snapshot.sortOrdering
+ **/
+@property (assign, readonly) ABPersonSortOrdering sortOrdering;
+/**
+ * System name format as of the last updateSortOrderingAndNameFormat, set on
+ * serial_queue along with sortOrdering. The display snapshot is written again
+ * when either changes
+ **/
+@property (assign, readonly) ABPersonCompositeNameFormat compositeNameFormat;
 
 + (AKAddressBook *)sharedInstance;
 + (NSArray *)sectionKeys;
 + (NSArray *)countryCodePrefixes;
 + (NSString *)documentsDirectoryPath;
+/**
+ * Persists the section tables in the SectionCache directory of the documents directory
+ **/
+- (id)init;
+- (instancetype)initWithSectionCacheDirectoryPath: (NSString *)path;
 - (BOOL)hasStatus: (AddressBookStatus)status;
 - (void)requestAddressBookAccessWithCompletionHandler:(void (^)(BOOL))completionHandler;
 - (void)reloadAddressBook;
 - (void)loadAddressBook;
+/**
+ * Adopts a changed system sort ordering or name format without reloading:
+ * the section tables of both orderings are current, the snapshot is
+ * republished with the other one primary and the display snapshot is rewritten
+ **/
+- (void)updateSortOrderingAndNameFormat;
 - (AKSource *)defaultSource;
 - (AKSource *)sourceForSourceId: (ABRecordID)recordId;
 - (AKContact *)contactForContactId: (ABRecordID)recordId;
 - (AKContact *)contactForContactId: (ABRecordID)recordId withAddressBookRef: (ABAddressBookRef)addressBookRef;
 - (AKContact *)contactForPhoneNumber: (NSString *)phoneNumber;
 - (AKContact *)contactForPhoneNumber: (NSString *)phoneNumber withAddressBookRef: (ABAddressBookRef)addressBookRef;
+- (AKContact *)contactForEmailAddress: (NSString *)emailAddress;
+- (AKContact *)contactForEmailAddress: (NSString *)emailAddress withAddressBookRef: (ABAddressBookRef)addressBookRef;
+/**
+ * Contacts keyed by the addresses asked for, addresses without a contact are left out
+ */
+- (NSDictionary *)contactsForEmailAddresses: (NSArray *)emailAddresses withAddressBookRef: (ABAddressBookRef)addressBookRef;
+/**
+ * Contacts having an address at the domain, in the order of their recordIDs
+ */
+- (NSArray *)contactsForEmailDomain: (NSString *)domain withAddressBookRef: (ABAddressBookRef)addressBookRef;
 - (AKSource *)sourceForContactId: (ABRecordID)recordId;
+/**
+ * Removes the contact from ABAddressBook, then from the sections, indexes and
+ * groups, telling the presentation delegate. Call on the main queue
+ */
 - (void)deleteRecordID: (ABRecordID)recordID;
+/**
+ * Publish the working copies of the section tables as a new snapshot
+ * Must be dispatched on serial_queue
+ **/
+- (void)publishSnapshot;
 
 @end
@@ -31,6 +31,20 @@
 #import "AKGroup.h"
 #import "AKSource.h"
 #import "AKAddressBook+Loader.h"
+#import "AKNameTokenIndex.h"
+#import "AKKeypadIndex.h"
+#import "AKSearchEntryIndex.h"
+#import "AKDateIndex.h"
+#import "AKFacetIndex.h"
+#import "AKEmailIndex.h"
+#import "AKRecordLocator.h"
+#import "AKSectionCache.h"
+#import "AKSectionView.h"
+#import "AKInstrumentation.h"
+#import "AKProgressReporter.h"
+#import "AKIndexSnapshot.h"
+#import "AKCacheRegistry.h"
+#import "AKAddressBookPool.h"
 
 const BOOL ShowGroups = YES;
 
@@ -52,10 +66,14 @@ const ABRecordID kUnkownContactID = 0x7FFFFFFF;
 
 NSString *const noPhoneNumberKey = @"-";
 
+NSString *const AKAddressBookSnapshotDidChangeNotification = @"AKAddressBookSnapshotDidChangeNotification";
+
 @interface AKAddressBook () <UIAlertViewDelegate>
 
-@property (assign, nonatomic) ABPersonSortOrdering sortOrdering;
+@property (assign) ABPersonSortOrdering sortOrdering;
+@property (assign) ABPersonCompositeNameFormat compositeNameFormat;
 @property (assign, nonatomic) ABAuthorizationStatus nativeAddressBookAuthorizationStatus;
+@property (strong) AKIndexSnapshot *snapshot;
 
 @end
 
@@ -68,6 +86,10 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
     @autoreleasepool
     {
         AKAddressBook *addressBook = (__bridge AKAddressBook *)context;
+        // Background handles revert on their next use to see the external change
+        [addressBook.addressBookPool invalidateHandles];
+        // Saves of a running import, whose records it inserts itself
+        if (addressBook.importCount > 0) return;
         [addressBook reloadAddressBook];
     }
 }
@@ -103,26 +125,53 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
 #pragma mark - Instance methods
 
 - (id)init
+{
+    return [self initWithSectionCacheDirectoryPath: [[AKAddressBook documentsDirectoryPath] stringByAppendingPathComponent: @"SectionCache"]];
+}
+
+- (instancetype)initWithSectionCacheDirectoryPath: (NSString *)path
 {
     self = [super init];
     if (self)
     {
         _serial_queue = dispatch_queue_create([NSStringFromClass([AKAddressBook class]) UTF8String], DISPATCH_QUEUE_SERIAL);
         dispatch_queue_set_specific(_serial_queue, IsOnSerialBackgroundQueueKey, (__bridge void *)self, NULL);
-        _semaphore = dispatch_semaphore_create(1);
+        NSString *concurrentQueueName = [NSStringFromClass([AKAddressBook class]) stringByAppendingString: @".concurrent"];
+        _concurrent_queue = dispatch_queue_create([concurrentQueueName UTF8String], DISPATCH_QUEUE_CONCURRENT);
         
         _needReload = YES;
         
-        _loadProgress = [[NSProgress alloc] initWithParent: nil userInfo: nil];
-        [_loadProgress addObserver: self forKeyPath: NSStringFromSelector(@selector(totalUnitCount)) options: NSKeyValueObservingOptionNew context:nil];
-        [_loadProgress addObserver: self forKeyPath: NSStringFromSelector(@selector(completedUnitCount)) options: NSKeyValueObservingOptionNew context:nil];
+        _loadProgress = [[AKProgressReporter alloc] initWithUpdatesPerSecond: 10];
+        __weak AKAddressBook *_self = self;
+        [_loadProgress addObserverWithHandler: ^(double fractionCompleted, BOOL finished) {
+            if ([_self.presentationDelegate respondsToSelector:@selector(addressBook:didMakeLoadProgress:)]) {
+                [_self.presentationDelegate addressBook: _self didMakeLoadProgress: fractionCompleted];
+            }
+        }];
         
         _status = kAddressBookOffline;
         
         _sourceID = kSourceAggregate;
         _groupID = kGroupAggregate;
         
-        _phoneNumberCache = [[NSCache alloc] init];
+        _phoneNumberCache = [[AKCache alloc] initWithName: @"phoneNumbers" priority: AKCachePriorityDefault];
+        [_phoneNumberCache setDefaultCost: 64];
+        
+        _nameTokenIndex = [[AKNameTokenIndex alloc] init];
+        _snapshot = [[AKIndexSnapshot alloc] initWithGeneration: 0 sortOrdering: ABPersonGetSortOrdering()
+                                           sectionsSortedByFirst: nil sectionsSortedByLast: nil sectionsSortedByPhone: nil];
+        
+        _keypadIndex = [[AKKeypadIndex alloc] init];
+        _searchEntryIndex = [[AKSearchEntryIndex alloc] init];
+        _dateIndex = [[AKDateIndex alloc] init];
+        _facetIndex = [[AKFacetIndex alloc] init];
+        _recordLocatorByFirst = [[AKRecordLocator alloc] initWithSortOrdering: kABPersonSortByFirstName];
+        _recordLocatorByLast = [[AKRecordLocator alloc] initWithSortOrdering: kABPersonSortByLastName];
+        _emailIndex = [[AKEmailIndex alloc] init];
+        _contactIndexes = @[_nameTokenIndex, _keypadIndex, _searchEntryIndex, _dateIndex, _facetIndex, _emailIndex];
+        
+        _sectionViewCache = [[AKSectionViewCache alloc] initWithAddressBook: self];
+        _sectionCache = [[AKSectionCache alloc] initWithDirectoryPath: path];
         
         /*
          * The ABAddressBook API is not thread safe. ABAddressBook related calls are dispatched on the main queue.
@@ -142,7 +191,10 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
         _addressBookRef = ABAddressBookCreate();
 #endif
         
+        _addressBookPool = [[AKAddressBookPool alloc] init];
+        
         _sortOrdering = ABPersonGetSortOrdering();
+        _compositeNameFormat = ABPersonGetCompositeNameFormatForRecord(NULL);
         if (&ABAddressBookGetAuthorizationStatus) {
             _nativeAddressBookAuthorizationStatus = ABAddressBookGetAuthorizationStatus();
         }
@@ -153,13 +205,17 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
         
         [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(applicationWillEnterForeground:) name: UIApplicationWillEnterForegroundNotification object: nil];
         
-        ABAddressBookRegisterExternalChangeCallback(_addressBookRef, addressBookChanged, (__bridge void*) self);
+        if (_addressBookRef) {
+            ABAddressBookRegisterExternalChangeCallback(_addressBookRef, addressBookChanged, (__bridge void*) self);
+        }
     }
     return self;
 }
 
 - (void)applicationWillEnterForeground: (NSNotification *)notification
 {
+    [self updateSortOrderingAndNameFormat];
+    
     if ([self hasStatus: kAddressBookOnline])
     {
         NSInteger contactsCount = ABAddressBookGetPersonCount(self.addressBookRef);
@@ -186,10 +242,9 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
 - (void)dealloc
 {
     if (_addressBookRef) {
+        ABAddressBookUnregisterExternalChangeCallback(_addressBookRef, addressBookChanged, (__bridge void*) self);
         CFRelease(_addressBookRef);
     }
-    [self.loadProgress removeObserver: self forKeyPath: NSStringFromSelector(@selector(totalUnitCount))];
-    [self.loadProgress removeObserver: self forKeyPath: NSStringFromSelector(@selector(completedUnitCount))];
     [[NSNotificationCenter defaultCenter] removeObserver: self];
 }
 
@@ -296,6 +351,31 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
     }
 }
 
+- (void)updateSortOrderingAndNameFormat
+{
+    NSAssert(dispatch_get_specific(IsOnMainQueueKey), @"Must be dispatched on main queue");
+    
+    ABPersonSortOrdering sortOrdering = ABPersonGetSortOrdering();
+    ABPersonCompositeNameFormat compositeNameFormat = ABPersonGetCompositeNameFormatForRecord(NULL);
+    
+    // Compared and applied in order with loads and index updates, which read sortOrdering on serial_queue
+    dispatch_async(self.serial_queue, ^{
+        if (sortOrdering == self.sortOrdering && compositeNameFormat == self.compositeNameFormat) return;
+        
+        self.sortOrdering = sortOrdering;
+        self.compositeNameFormat = compositeNameFormat;
+        if (![self hasStatus: kAddressBookOnline]) return; // The next load publishes with the new ordering
+        
+        // Sort ranks and views of the ordering are derived from the new snapshot on demand,
+        // views of the previous ordering stay cached until evicted
+        [self publishSnapshot];
+        // Published snapshots notify once, reloading the table with both changes
+        [self.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            [self archiveDisplaySnapshotWithChangedContactIDs: nil andABAddressBookRef: addressBookRef];
+        }];
+    });
+}
+
 - (void)loadAddressBook
 {
     NSAssert(dispatch_get_specific(IsOnMainQueueKey), @"Must be dispatched on main queue");
@@ -315,13 +395,14 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
             if (self.addressBookRef) {
                 ABAddressBookRevert(self.addressBookRef);
             }
+            [self.addressBookPool invalidateHandles];
             break;
         case kAddressBookInitializing:
         default:
             break;
     }
     
-    NSDate *start = [NSDate date];
+    AKSpanStart start = AKSpanBegin();
     
     if ([self.presentationDelegate respondsToSelector:@selector(addressBookWillBeginLoading:)])
     {
@@ -330,7 +411,7 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
     
     [self loadAddressBookWithCompletionHandler:^(BOOL addressBookChanged) {
         self.dateAddressBookLoaded = [NSDate date];
-        NSLog(@"Address book loaded in %.2f", fabs([self.dateAddressBookLoaded timeIntervalSinceDate: start]));
+        AKSpanEnd(AKSpanLoad, start);
         
         self.status = kAddressBookOnline;
         
@@ -343,33 +424,53 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
 
 - (NSDictionary *)hashTable
 {
-    return (self.sortOrdering == kABPersonSortByFirstName) ? self.hashTableSortedByFirst : self.hashTableSortedByLast;
+    return self.snapshot.sections;
 }
 
 - (NSDictionary *)hashTableSortedInverse
 {
-    return (self.sortOrdering != kABPersonSortByFirstName) ? self.hashTableSortedByFirst : self.hashTableSortedByLast;
+    return self.snapshot.inverseSections;
 }
 
 - (NSArray *)allContactIDs
 {
-    NSMutableSet *contactIDs = [[NSMutableSet alloc] init];
-    
-    for (NSString *sectionKey in self.hashTable)
-    {
-        NSArray *sectionArray = [[self.hashTable objectForKey: sectionKey] copy];
-        for (NSNumber *contactID in sectionArray)
-        {
-            [contactIDs addObject: contactID];
-        }
-    }
-    return (contactIDs.count > 0) ? [contactIDs allObjects] : nil;
+    return self.snapshot.allContactIDs;
 }
 
 - (NSSet *)contactIDsWithoutPhoneNumber
 {
-    NSArray *contactIDsWithoutPhoneNumbers = [self.hashTableSortedByPhone objectForKey: noPhoneNumberKey];
-    return (contactIDsWithoutPhoneNumbers.count > 0) ? [[NSSet alloc] initWithArray: contactIDsWithoutPhoneNumbers] : [[NSSet alloc] init];
+    return self.snapshot.contactIDsWithoutPhoneNumber;
+}
+
+- (NSDictionary *)sortRanks
+{
+    return self.snapshot.sortRanks;
+}
+
+- (void)publishSnapshot
+{
+    NSAssert(dispatch_get_specific(IsOnSerialBackgroundQueueKey), @"Must be dispatched on serial background queue");
+    
+    AKIndexSnapshot *previousSnapshot = self.snapshot;
+    AKIndexSnapshot *snapshot = [[AKIndexSnapshot alloc] initWithGeneration: previousSnapshot.generation + 1
+                                                               sortOrdering: self.sortOrdering
+                                                      sectionsSortedByFirst: self.hashTableSortedByFirst
+                                                       sectionsSortedByLast: self.hashTableSortedByLast
+                                                      sectionsSortedByPhone: self.hashTableSortedByPhone
+                                                           previousSnapshot: previousSnapshot
+                                                           dirtySectionKeys: self.dirtySectionKeys];
+    self.dirtySectionKeys = [[NSMutableDictionary alloc] init];
+    // The atomic property swaps the pointer without waiting for running searches
+    // Readers of the previous snapshot keep it alive
+    self.snapshot = snapshot;
+    [self.sectionViewCache updateWithSnapshot: snapshot previousSnapshot: previousSnapshot];
+    
+    if (!self.isLoading)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            [[NSNotificationCenter defaultCenter] postNotificationName: AKAddressBookSnapshotDidChangeNotification object: self];
+        });
+    }
 }
 
 - (AKSource *)defaultSource
@@ -409,7 +510,8 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
 {
     NSAssert(dispatch_get_specific(IsOnMainQueueKey), @"Must be dispatched on main queue");
 
-    return [[AKContact alloc] initWithABRecordID: recordId sortOrdering: self.sortOrdering andAddressBookRef: self.addressBookRef];
+    // The ordering of the displayed sections, sortOrdering may already be the next one
+    return [[AKContact alloc] initWithABRecordID: recordId sortOrdering: self.snapshot.sortOrdering andAddressBookRef: self.addressBookRef];
 }
 
 - (AKContact *)contactForContactId: (ABRecordID)recordId withAddressBookRef: (ABAddressBookRef)addressBookRef
@@ -417,7 +519,6 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
     return [[AKContact alloc] initWithABRecordID: recordId sortOrdering: self.sortOrdering andAddressBookRef: addressBookRef];
 }
 
-#warning Deal with hashTable being mutated on loading while this and other methods iterate on it
 - (AKContact *)contactForPhoneNumber: (NSString *)phoneNumber
 {
     NSAssert(dispatch_get_specific(IsOnMainQueueKey), @"Must be dispatched on main queue");
@@ -445,7 +546,7 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
         else
         {
             NSString *firstDigit = [phoneNumber substringToIndex: 1];
-            NSArray *sectionArray = [[self.hashTableSortedByPhone objectForKey: firstDigit] copy];
+            NSArray *sectionArray = [self.snapshot.sectionsSortedByPhone objectForKey: firstDigit];
             for (NSNumber *recordID in sectionArray)
             {
                 AKContact *record = [self contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
@@ -464,6 +565,40 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
     return contact;
 }
 
+- (AKContact *)contactForEmailAddress: (NSString *)emailAddress
+{
+    NSAssert(dispatch_get_specific(IsOnMainQueueKey), @"Must be dispatched on main queue");
+    
+    return [self contactForEmailAddress: emailAddress withAddressBookRef: self.addressBookRef];
+}
+
+- (AKContact *)contactForEmailAddress: (NSString *)emailAddress withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    return (emailAddress) ? [[self contactsForEmailAddresses: @[emailAddress] withAddressBookRef: addressBookRef] objectForKey: emailAddress] : nil;
+}
+
+- (NSDictionary *)contactsForEmailAddresses: (NSArray *)emailAddresses withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSMutableDictionary *contacts = [[NSMutableDictionary alloc] init];
+    NSDictionary *recordIDs = [self.emailIndex recordIDsWithEmailAddresses: emailAddresses];
+    [recordIDs enumerateKeysAndObjectsUsingBlock: ^(NSString *emailAddress, NSIndexSet *indexes, BOOL *stop) {
+        // Shared addresses resolve to the contact created first
+        AKContact *contact = [self contactForContactId: (ABRecordID)indexes.firstIndex withAddressBookRef: addressBookRef];
+        if (contact) [contacts setObject: contact forKey: emailAddress];
+    }];
+    return [contacts copy];
+}
+
+- (NSArray *)contactsForEmailDomain: (NSString *)domain withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSMutableArray *contacts = [[NSMutableArray alloc] init];
+    [[self.emailIndex recordIDsWithEmailDomain: domain] enumerateIndexesUsingBlock: ^(NSUInteger recordID, BOOL *stop) {
+        AKContact *contact = [self contactForContactId: (ABRecordID)recordID withAddressBookRef: addressBookRef];
+        if (contact) [contacts addObject: contact];
+    }];
+    return [contacts copy];
+}
+
 - (AKSource *)sourceForContactId: (ABRecordID)recordId
 {
     AKSource *ret = nil;
@@ -488,47 +623,41 @@ void addressBookChanged(ABAddressBookRef reference, CFDictionaryRef dictionary,
     
     AKContact *contact = [self contactForContactId: recordID];
     
-    for (NSString *key in self.hashTableSortedByFirst)
-    {
-        NSMutableArray *sectionArray = [[self.hashTableSortedByFirst objectForKey: key] copy];
-        [sectionArray removeObject: @(recordID)];
-    }
-    for (NSString *key in self.hashTableSortedByLast)
-    {
-        NSMutableArray *sectionArray = [[self.hashTableSortedByLast objectForKey: key] copy];
-        [sectionArray removeObject: @(recordID)];
-    }
-    
     [self setNeedReload: NO];
     
     CFErrorRef error = NULL;
-    ABAddressBookRemoveRecord(self.addressBookRef, contact.recordRef, &error);
+    BOOL success = ABAddressBookRemoveRecord(self.addressBookRef, contact.recordRef, &error);
     if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookRemoveRecord (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
     
-    ABAddressBookSave(self.addressBookRef, &error);
-    if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookSave (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
-}
-
-#pragma mark - Key-Value Observing
-
-- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
-{   // This is not dispatched on main queue
-    if (object == self.loadProgress)
+    if (success)
     {
-        int64_t completedUnitCount = self.loadProgress.completedUnitCount;
-        int64_t totalUnitCount = self.loadProgress.totalUnitCount;
+        success = ABAddressBookSave(self.addressBookRef, &error);
+        if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookSave (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
+    }
+    if (!success)
+    {   // Still in the address book, so it stays listed
+        ABAddressBookRevert(self.addressBookRef);
+        return;
+    }
+    // The change notification is not delivered to the saving process
+    [self.addressBookPool invalidateHandles];
+    
+    [self performIndexUpdate: ^(ABAddressBookRef addressBookRef) {
+        if ([self.presentationDelegate respondsToSelector: @selector(addressBookWillBeginUpdates:)])
+        {
+            [self.presentationDelegate addressBookWillBeginUpdates: self];
+        }
         
-        int64_t denom = (totalUnitCount > 100) ? (totalUnitCount / 100) : totalUnitCount;
-        if (completedUnitCount % denom == 0) { // Don't call to often; this eats precious CPU time
-            dispatch_block_t block = ^{
-                if ([self.presentationDelegate respondsToSelector:@selector(addressBook:didMakeLoadProgress:)]) {
-                    [self.presentationDelegate addressBook: self didMakeLoadProgress: self.loadProgress.fractionCompleted];
-                }
-            };
-            if (dispatch_get_specific(IsOnMainQueueKey)) block();
-            else dispatch_async(dispatch_get_main_queue(), block);
+        [self removeRecordID: recordID fromContactIdentifiersWithAddressBookRef: addressBookRef notifyingDelegate: YES];
+        [self removeRecordIDFromGroups: recordID];
+        self.contactsCount -= 1;
+        self.nativeContactsCount -= 1;
+        
+        if ([self.presentationDelegate respondsToSelector: @selector(addressBookDidEndUpdates:)])
+        {
+            [self.presentationDelegate addressBookDidEndUpdates: self];
         }
-    }
+    }];
 }
 
 #pragma mark - UIAlertViewDelegate
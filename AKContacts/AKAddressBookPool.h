@@ -0,0 +1,67 @@
+//
+//  AKAddressBookPool.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AddressBook/AddressBook.h>
+
+/**
+ * Long lived ABAddressBook references of background work. ABAddressBook is not
+ * thread safe, so a reference is leased to one block at a time. A block
+ * performed within another one on the same thread gets the reference of the
+ * outermost block. References are reverted to see external changes when they
+ * are leased after invalidateHandles, never while a block uses them. Returned
+ * references are reused by later blocks, at most four of them are kept while
+ * not in use however many threads GCD runs the blocks on
+ */
+@interface AKAddressBookPool : NSObject
+
+@property (assign, readonly) NSUInteger handlesCreated;
+@property (assign, readonly) NSUInteger handlesReverted;
+/**
+ * References not leased to a block
+ */
+@property (assign, readonly) NSUInteger idleHandleCount;
+
+/**
+ * Performs the block with a reference owned by the pool, only valid on the
+ * calling thread within the block. Do not release. The reference is NULL if
+ * it could not be created. Must not be called on the main queue, use
+ * addressBookRef of AKAddressBook there
+ */
+- (void)performWithAddressBookRef: (void (^)(ABAddressBookRef addressBookRef))block;
+/**
+ * Reference of the outermost performWithAddressBookRef: block running on the
+ * calling thread, NULL outside of one
+ */
+- (ABAddressBookRef)addressBookRefForCurrentThread;
+/**
+ * Call when the native address book changed externally
+ */
+- (void)invalidateHandles;
+
+@end
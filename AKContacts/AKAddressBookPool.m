@@ -0,0 +1,192 @@
+//
+//  AKAddressBookPool.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKAddressBookPool.h"
+#import <libkern/OSAtomic.h>
+#import <pthread.h>
+
+/**
+ * References kept for reuse while no block uses them, more are released
+ * GCD runs blocks on as many worker threads as it sees fit
+ */
+static const NSUInteger kAddressBookPoolIdleHandles = 4;
+
+typedef struct AKAddressBookHandle {
+    ABAddressBookRef addressBookRef;
+    int32_t generation;
+} AKAddressBookHandle;
+
+static void AKAddressBookHandleDestroy(AKAddressBookHandle *handle)
+{
+    if (handle->addressBookRef) CFRelease(handle->addressBookRef);
+    free(handle);
+}
+
+@interface AKAddressBookPool ()
+{
+    pthread_key_t _leaseKey;
+    AKAddressBookHandle *_idleHandles[kAddressBookPoolIdleHandles];
+    NSUInteger _idleHandleCount;
+    volatile int32_t _generation;
+    volatile int32_t _handlesCreated;
+    volatile int32_t _handlesReverted;
+}
+
+@end
+
+@implementation AKAddressBookPool
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        // Leases end with their block, so threads never exit holding one
+        int status = pthread_key_create(&_leaseKey, NULL);
+        if (status != 0) { NSLog(@"pthread_key_create (%d)", status); }
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    for (NSUInteger index = 0; index < _idleHandleCount; ++index)
+    {
+        AKAddressBookHandleDestroy(_idleHandles[index]);
+    }
+    pthread_key_delete(_leaseKey);
+}
+
+- (NSUInteger)handlesCreated
+{
+    return (NSUInteger)_handlesCreated;
+}
+
+- (NSUInteger)handlesReverted
+{
+    return (NSUInteger)_handlesReverted;
+}
+
+- (NSUInteger)idleHandleCount
+{
+    @synchronized(self)
+    {
+        return _idleHandleCount;
+    }
+}
+
+- (void)performWithAddressBookRef: (void (^)(ABAddressBookRef))block
+{
+    NSAssert(![NSThread isMainThread], @"Must not be dispatched on main thread");
+    
+    AKAddressBookHandle *lease = pthread_getspecific(_leaseKey);
+    if (lease)
+    { // Nested, values read by the outer block stay consistent with the ones read here
+        block(lease->addressBookRef);
+        return;
+    }
+    
+    AKAddressBookHandle *handle = [self checkOutHandle];
+    pthread_setspecific(_leaseKey, handle);
+    block((handle) ? handle->addressBookRef : NULL);
+    pthread_setspecific(_leaseKey, NULL);
+    if (handle) [self checkInHandle: handle];
+}
+
+- (ABAddressBookRef)addressBookRefForCurrentThread
+{
+    AKAddressBookHandle *lease = pthread_getspecific(_leaseKey);
+    return (lease) ? lease->addressBookRef : NULL;
+}
+
+/**
+ * An idle handle reverted if it is stale, or a new one
+ */
+- (AKAddressBookHandle *)checkOutHandle
+{
+    int32_t generation = _generation;
+    
+    AKAddressBookHandle *handle = NULL;
+    @synchronized(self)
+    {
+        if (_idleHandleCount > 0)
+        {
+            _idleHandleCount -= 1;
+            handle = _idleHandles[_idleHandleCount];
+        }
+    }
+    
+    if (!handle)
+    {
+        handle = calloc(1, sizeof(AKAddressBookHandle));
+#if __IPHONE_OS_VERSION_MAX_ALLOWED >= 60000
+        CFErrorRef error = NULL;
+        handle->addressBookRef = ABAddressBookCreateWithOptions(NULL, &error);
+        if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookCreateWithOptions (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
+#else
+        handle->addressBookRef = ABAddressBookCreate();
+#endif
+        if (!handle->addressBookRef)
+        { // Not kept so that the next lease tries again
+            free(handle);
+            return NULL;
+        }
+        handle->generation = generation;
+        OSAtomicIncrement32Barrier(&_handlesCreated);
+    }
+    else if (handle->generation != generation)
+    {
+        ABAddressBookRevert(handle->addressBookRef);
+        handle->generation = generation;
+        OSAtomicIncrement32Barrier(&_handlesReverted);
+    }
+    return handle;
+}
+
+- (void)checkInHandle: (AKAddressBookHandle *)handle
+{
+    BOOL kept = NO;
+    @synchronized(self)
+    {
+        if (_idleHandleCount < kAddressBookPoolIdleHandles)
+        {
+            _idleHandles[_idleHandleCount] = handle;
+            _idleHandleCount += 1;
+            kept = YES;
+        }
+    }
+    
+    if (!kept) AKAddressBookHandleDestroy(handle);
+}
+
+- (void)invalidateHandles
+{
+    OSAtomicIncrement32Barrier(&_generation);
+}
+
+@end
@@ -0,0 +1,122 @@
+//
+//  AKCacheRegistry.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Caches of lower priority are trimmed first
+ */
+typedef NS_ENUM(NSInteger, AKCachePriority)
+{
+    AKCachePriorityLow = 0,
+    AKCachePriorityDefault,
+    /**
+     * Decoded index data that is rebuilt on demand once evicted
+     */
+    AKCachePriorityIndex,
+};
+
+/**
+ * A cache accounted for by AKCacheRegistry. Thread safe
+ */
+@protocol AKRegisteredCache <NSObject>
+
+@property (copy, nonatomic, readonly) NSString *name;
+@property (assign, nonatomic, readonly) AKCachePriority priority;
+/**
+ * Estimated size of the cached objects in bytes
+ */
+@property (assign, readonly) NSUInteger cost;
+@property (assign, readonly) NSUInteger count;
+@property (assign, readonly) NSUInteger hits;
+@property (assign, readonly) NSUInteger misses;
+@property (assign, readonly) NSUInteger evictions;
+/**
+ * Evict the least recently used objects until the cost is at most cost
+ * Returns the number of objects evicted
+ */
+- (NSUInteger)trimToCost: (NSUInteger)cost;
+
+@end
+
+/**
+ * Least recently used objects with a cost, registered with the shared
+ * AKCacheRegistry on init
+ */
+@interface AKCache : NSObject <AKRegisteredCache>
+
+/**
+ * Cost of objects set without one. Default value is 0
+ */
+@property (assign) NSUInteger defaultCost;
+/**
+ * Maximum number of objects, 0 for no limit. Default value is 0
+ */
+@property (assign) NSUInteger countLimit;
+
+- (instancetype)initWithName: (NSString *)name priority: (AKCachePriority)priority;
+
+- (id)objectForKey: (id)key;
+- (void)setObject: (id)object forKey: (id)key;
+- (void)setObject: (id)object forKey: (id)key cost: (NSUInteger)cost;
+- (void)removeObjectForKey: (id)key;
+- (void)removeAllObjects;
+
+@end
+
+/**
+ * Keeps the total cost of the registered caches within a budget by trimming
+ * them in order of priority. Memory warnings empty every cache, lowest priority first
+ */
+@interface AKCacheRegistry : NSObject
+
+/**
+ * Bytes, default value is 16 MB
+ */
+@property (assign) NSUInteger budget;
+@property (assign, readonly) NSUInteger totalCost;
+
++ (AKCacheRegistry *)sharedInstance;
+
+/**
+ * Caches are referenced weakly
+ */
+- (void)registerCache: (id<AKRegisteredCache>)cache;
+- (void)unregisterCache: (id<AKRegisteredCache>)cache;
+/**
+ * Schedules trimToBudget in the background, coalesced. Caches call this when their cost grows
+ */
+- (void)setNeedsTrim;
+- (void)trimToBudget;
+- (void)trimAllCaches;
+/**
+ * Cost, count, hits, misses, hit rate and evictions keyed by cache name
+ */
+- (NSDictionary *)statistics;
+
+@end
@@ -0,0 +1,401 @@
+//
+//  AKCacheRegistry.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKCacheRegistry.h"
+#import <UIKit/UIKit.h>
+#import <libkern/OSAtomic.h>
+
+static const NSUInteger kCacheRegistryDefaultBudget = 16 * 1024 * 1024;
+
+#pragma mark - AKCache
+
+@interface AKCacheEntry : NSObject
+
+@property (strong, nonatomic) id key;
+@property (strong, nonatomic) id object;
+@property (assign, nonatomic) NSUInteger cost;
+/**
+ * Neighbours in the order of use, entries are retained by the cache
+ */
+@property (unsafe_unretained, nonatomic) AKCacheEntry *newer;
+@property (unsafe_unretained, nonatomic) AKCacheEntry *older;
+
+@end
+
+@implementation AKCacheEntry
+
+@end
+
+@interface AKCache ()
+{
+    NSUInteger _cost;
+    NSUInteger _hits;
+    NSUInteger _misses;
+    NSUInteger _evictions;
+}
+
+/**
+ * AKCacheEntry keyed by key. Guarded by self
+ */
+@property (strong, nonatomic) NSMutableDictionary *entries;
+@property (unsafe_unretained, nonatomic) AKCacheEntry *newest;
+@property (unsafe_unretained, nonatomic) AKCacheEntry *oldest;
+
+@end
+
+@implementation AKCache
+
+@synthesize name = _name;
+@synthesize priority = _priority;
+
+- (instancetype)initWithName: (NSString *)name priority: (AKCachePriority)priority
+{
+    self = [super init];
+    if (self)
+    {
+        _name = [name copy];
+        _priority = priority;
+        _entries = [[NSMutableDictionary alloc] init];
+        [[AKCacheRegistry sharedInstance] registerCache: self];
+    }
+    return self;
+}
+
+- (NSUInteger)cost
+{
+    @synchronized(self)
+    {
+        return _cost;
+    }
+}
+
+- (NSUInteger)count
+{
+    @synchronized(self)
+    {
+        return self.entries.count;
+    }
+}
+
+- (NSUInteger)hits
+{
+    @synchronized(self)
+    {
+        return _hits;
+    }
+}
+
+- (NSUInteger)misses
+{
+    @synchronized(self)
+    {
+        return _misses;
+    }
+}
+
+- (NSUInteger)evictions
+{
+    @synchronized(self)
+    {
+        return _evictions;
+    }
+}
+
+- (id)objectForKey: (id)key
+{
+    if (!key) return nil;
+    
+    @synchronized(self)
+    {
+        AKCacheEntry *entry = [self.entries objectForKey: key];
+        if (!entry)
+        {
+            ++_misses;
+            return nil;
+        }
+        ++_hits;
+        [self unlinkEntry: entry];
+        [self linkEntryAsNewest: entry];
+        return entry.object;
+    }
+}
+
+- (void)setObject: (id)object forKey: (id)key
+{
+    [self setObject: object forKey: key cost: self.defaultCost];
+}
+
+- (void)setObject: (id)object forKey: (id)key cost: (NSUInteger)cost
+{
+    if (!key) return;
+    if (!object)
+    {
+        [self removeObjectForKey: key];
+        return;
+    }
+    
+    @synchronized(self)
+    {
+        [self removeEntryForKey: key];
+        
+        AKCacheEntry *entry = [[AKCacheEntry alloc] init];
+        entry.key = key;
+        entry.object = object;
+        entry.cost = cost;
+        [self.entries setObject: entry forKey: key];
+        [self linkEntryAsNewest: entry];
+        _cost += cost;
+        
+        while (self.countLimit > 0 && self.entries.count > self.countLimit)
+        {
+            [self removeEntryForKey: self.oldest.key];
+            ++_evictions;
+        }
+    }
+    if (cost > 0) [[AKCacheRegistry sharedInstance] setNeedsTrim];
+}
+
+- (void)removeObjectForKey: (id)key
+{
+    if (!key) return;
+    
+    @synchronized(self)
+    {
+        [self removeEntryForKey: key];
+    }
+}
+
+- (void)removeAllObjects
+{
+    @synchronized(self)
+    {
+        [self.entries removeAllObjects];
+        self.newest = nil;
+        self.oldest = nil;
+        _cost = 0;
+    }
+}
+
+- (NSUInteger)trimToCost: (NSUInteger)cost
+{
+    NSUInteger evicted = 0;
+    @synchronized(self)
+    {
+        while (_cost > cost && self.oldest)
+        {
+            [self removeEntryForKey: self.oldest.key];
+            ++evicted;
+        }
+        _evictions += evicted;
+    }
+    return evicted;
+}
+
+/**
+ * Must be called synchronized on self
+ */
+- (void)removeEntryForKey: (id)key
+{
+    AKCacheEntry *entry = [self.entries objectForKey: key];
+    if (!entry) return;
+    
+    [self unlinkEntry: entry];
+    _cost -= entry.cost;
+    [self.entries removeObjectForKey: key];
+}
+
+- (void)unlinkEntry: (AKCacheEntry *)entry
+{
+    if (entry.newer) entry.newer.older = entry.older;
+    else self.newest = entry.older;
+    if (entry.older) entry.older.newer = entry.newer;
+    else self.oldest = entry.newer;
+    entry.newer = nil;
+    entry.older = nil;
+}
+
+- (void)linkEntryAsNewest: (AKCacheEntry *)entry
+{
+    entry.older = self.newest;
+    if (self.newest) self.newest.newer = entry;
+    self.newest = entry;
+    if (!self.oldest) self.oldest = entry;
+}
+
+@end
+
+#pragma mark - AKCacheRegistry
+
+@interface AKCacheRegistry ()
+{
+    volatile int32_t _trimScheduled;
+}
+
+/**
+ * Guarded by self
+ */
+@property (strong, nonatomic) NSHashTable *caches;
+@property (strong, nonatomic) dispatch_queue_t registry_queue;
+
+@end
+
+@implementation AKCacheRegistry
+
++ (AKCacheRegistry *)sharedInstance
+{
+    static dispatch_once_t once;
+    static AKCacheRegistry *registry;
+    dispatch_once(&once, ^{ registry = [[self alloc] init]; });
+    return registry;
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _budget = kCacheRegistryDefaultBudget;
+        _caches = [NSHashTable weakObjectsHashTable];
+        _registry_queue = dispatch_queue_create([NSStringFromClass([AKCacheRegistry class]) UTF8String], DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_registry_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+        
+        [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(didReceiveMemoryWarning:) name: UIApplicationDidReceiveMemoryWarningNotification object: nil];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    [[NSNotificationCenter defaultCenter] removeObserver: self];
+}
+
+- (void)registerCache: (id<AKRegisteredCache>)cache
+{
+    @synchronized(self)
+    {
+        [self.caches addObject: cache];
+    }
+}
+
+- (void)unregisterCache: (id<AKRegisteredCache>)cache
+{
+    @synchronized(self)
+    {
+        [self.caches removeObject: cache];
+    }
+}
+
+/**
+ * Registered caches, lowest priority first
+ */
+- (NSArray *)cachesInOrderOfEviction
+{
+    NSArray *caches;
+    @synchronized(self)
+    {
+        caches = [self.caches allObjects];
+    }
+    return [caches sortedArrayUsingComparator: ^NSComparisonResult(id<AKRegisteredCache> cache1, id<AKRegisteredCache> cache2) {
+        if (cache1.priority != cache2.priority) return (cache1.priority < cache2.priority) ? NSOrderedAscending : NSOrderedDescending;
+        return [cache1.name compare: cache2.name];
+    }];
+}
+
+- (NSUInteger)totalCost
+{
+    NSUInteger totalCost = 0;
+    for (id<AKRegisteredCache> cache in [self cachesInOrderOfEviction])
+    {
+        totalCost += cache.cost;
+    }
+    return totalCost;
+}
+
+- (void)setNeedsTrim
+{
+    if (!OSAtomicCompareAndSwap32Barrier(0, 1, &_trimScheduled)) return;
+    
+    dispatch_async(self.registry_queue, ^{
+        OSAtomicCompareAndSwap32Barrier(1, 0, &_trimScheduled);
+        [self trimToBudget];
+    });
+}
+
+- (void)trimToBudget
+{
+    NSArray *caches = [self cachesInOrderOfEviction];
+    NSUInteger totalCost = 0;
+    for (id<AKRegisteredCache> cache in caches)
+    {
+        totalCost += cache.cost;
+    }
+    
+    NSUInteger budget = self.budget;
+    for (id<AKRegisteredCache> cache in caches)
+    {
+        if (totalCost <= budget) break;
+        
+        NSUInteger cost = cache.cost, excess = totalCost - budget;
+        [cache trimToCost: (cost > excess) ? cost - excess : 0];
+        NSUInteger trimmedCost = cache.cost;
+        totalCost -= (cost > trimmedCost) ? cost - trimmedCost : 0;
+    }
+}
+
+- (void)trimAllCaches
+{
+    for (id<AKRegisteredCache> cache in [self cachesInOrderOfEviction])
+    {
+        [cache trimToCost: 0];
+    }
+}
+
+- (void)didReceiveMemoryWarning: (NSNotification *)notification
+{
+    [self trimAllCaches];
+}
+
+- (NSDictionary *)statistics
+{
+    NSMutableDictionary *statistics = [[NSMutableDictionary alloc] init];
+    for (id<AKRegisteredCache> cache in [self cachesInOrderOfEviction])
+    {
+        NSUInteger hits = cache.hits, misses = cache.misses;
+        double hitRate = (hits + misses > 0) ? (double)hits / (hits + misses) : 0.0;
+        [statistics setObject: @{@"cost": @(cache.cost),
+                                 @"count": @(cache.count),
+                                 @"hits": @(hits),
+                                 @"misses": @(misses),
+                                 @"hitRate": @(hitRate),
+                                 @"evictions": @(cache.evictions)}
+                       forKey: cache.name];
+    }
+    return [statistics copy];
+}
+
+@end
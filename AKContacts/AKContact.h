@@ -48,6 +48,11 @@ FOUNDATION_EXPORT const int newContactID;
 - (NSString *)displayName;
 - (NSString *)phoneticName;
 - (NSString *)nameDelimiter;
+/**
+ * Range of compositeName shown in bold: the last name of a person, the
+ * whole name of an organization, NSNotFound location otherwise
+ */
+- (NSRange)boldRangeOfCompositeName: (NSString *)compositeName;
 - (NSAttributedString *)attributedName;
 - (NSString *)displayDetails;
 - (BOOL)isNative;
@@ -66,6 +71,11 @@ FOUNDATION_EXPORT const int newContactID;
 - (void)revert;
 
 - (NSInteger)numberOfMatchingTerms: (NSArray *)terms;
+/**
+ * Same as numberOfMatchingTerms: and passes back a relevance score for ranking
+ * the contact among other matches. Whole-word matches score higher than prefixes
+ */
+- (NSInteger)numberOfMatchingTerms: (NSArray *)terms score: (NSInteger *)score;
 - (NSArray *)indexesOfPhoneNumbersMatchingTerms: (NSArray *)terms preciseMatch: (BOOL)preciseMatch;
 + (NSString *)sectionKeyForName: (NSString *)name;
 /**
@@ -29,9 +29,11 @@
 #import "AKContact.h"
 #import "AKAddressBook.h"
 #import "AKAddressBook+Loader.h"
+#import "AKAddressBookPool.h"
 #import "AKGroup.h"
 #import "AKSource.h"
 #import "AKLabel.h"
+#import "AKSearchEntryIndex.h"
 
 const int newContactID = -1<<9;
 
@@ -200,21 +202,30 @@ const int newContactID = -1<<9;
     return (NSString *)CFBridgingRelease(ABPersonCopyCompositeNameDelimiterForRecord(self.recordRef));
 }
 
-- (NSAttributedString *)attributedName
+- (NSRange)boldRangeOfCompositeName: (NSString *)compositeName
 {
-    NSString *compositeName = [self compositeName];
-    NSMutableAttributedString *attributedName = [[NSMutableAttributedString alloc] initWithString: compositeName];
-    [attributedName addAttribute: NSFontAttributeName value: [UIFont systemFontOfSize: 20.f] range: NSMakeRange(0, attributedName.length - 1)];
-    
+    NSRange range = NSMakeRange(NSNotFound, 0);
     if (self.isPerson) {
         NSString *lastName = [self valueForProperty: kABPersonLastNameProperty];
         if (lastName.length > 0) {
-            NSRange range = [compositeName rangeOfString: lastName];
-            [attributedName addAttribute: NSFontAttributeName value: [UIFont boldSystemFontOfSize: 20.f] range: range];
+            range = [compositeName rangeOfString: lastName];
         }
     }
     else if (self.isOrganization) {
-        [attributedName addAttribute: NSFontAttributeName value: [UIFont boldSystemFontOfSize: 20.f] range: NSMakeRange(0, attributedName.length)];
+        range = NSMakeRange(0, compositeName.length);
+    }
+    return range;
+}
+
+- (NSAttributedString *)attributedName
+{
+    NSString *compositeName = [self compositeName];
+    NSMutableAttributedString *attributedName = [[NSMutableAttributedString alloc] initWithString: compositeName];
+    [attributedName addAttribute: NSFontAttributeName value: [UIFont systemFontOfSize: 20.f] range: NSMakeRange(0, attributedName.length - 1)];
+    
+    NSRange range = [self boldRangeOfCompositeName: compositeName];
+    if (range.location != NSNotFound) {
+        [attributedName addAttribute: NSFontAttributeName value: [UIFont boldSystemFontOfSize: 20.f] range: range];
     }
     return attributedName;
 }
@@ -364,6 +375,8 @@ const int newContactID = -1<<9;
         CFErrorRef error = NULL;
         ABAddressBookSave(super.addressBookRef, &error);
         if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookSave (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
+        // The change notification is not delivered to the saving process
+        [[AKAddressBook sharedInstance].addressBookPool invalidateHandles];
     }
     
     if (self.recordID == newContactID)
@@ -372,7 +385,12 @@ const int newContactID = -1<<9;
         
         AKAddressBook *addressBook = [AKAddressBook sharedInstance];
         
-        [addressBook insertRecordIDinContactIdentifiersForContact: self withAddressBookRef: self.addressBookRef];
+        ABRecordID recordID = self.recordID;
+        [addressBook performIndexUpdate: ^(ABAddressBookRef addressBookRef) {
+            AKContact *contact = [addressBook contactForContactId: recordID withAddressBookRef: addressBookRef];
+            [addressBook insertRecordIDinContactIdentifiersForContact: contact withAddressBookRef: addressBookRef];
+            [addressBook processPhoneNumbersOfContact: contact withABAddressBookRef: addressBookRef];
+        }];
         
         if (addressBook.groupID >= 0)
         { // Add to group
@@ -407,114 +425,23 @@ const int newContactID = -1<<9;
 
 - (NSInteger)numberOfMatchingTerms: (NSArray *)terms
 {
-    NSInteger termsMatched = 0;
-    if (self.recordRef)
+    return [self numberOfMatchingTerms: terms score: NULL];
+}
+
+- (NSInteger)numberOfMatchingTerms: (NSArray *)terms score: (NSInteger *)score
+{
+    if (!self.recordRef)
     {
-        void(^setBit)(NSInteger *, NSInteger) = ^(NSInteger *byte, NSInteger bit) { *byte |= 1 << bit; };
-        BOOL(^isBitSet)(NSInteger *, NSInteger) = ^(NSInteger *byte, NSInteger bit) { return (BOOL)(*byte & (1 << bit)); };
-        
-        if (self.isPerson)
-        {
-            NSArray *properties = @[@(kABPersonFirstNameProperty), @(kABPersonLastNameProperty), @(kABPersonMiddleNameProperty)];
-            
-            NSInteger termBitmask = 0, nameBitmask = 0;
-            for (NSInteger i = 0; i < terms.count; ++i)
-            {
-                NSString *term = [[[terms objectAtIndex: i] lowercaseString] stringWithDiacriticsRemoved];
-                for (NSInteger j = 0; j < properties.count; ++j)
-                {
-                    ABPropertyID property = [properties[j] intValue];
-                    NSString *value = [self valueForProperty: property];
-                    value = value.stringWithDiacriticsRemoved;
-                    if ([value.lowercaseString hasPrefix: term] && !isBitSet(&termBitmask, i) && !isBitSet(&nameBitmask, j))
-                    {
-                        termsMatched += 1;
-                        setBit(&termBitmask, i);
-                        setBit(&nameBitmask, j);
-                    }
-                }
-            }
-        }
-        else if (self.isOrganization)
-        {
-            NSString *value = [self valueForProperty: kABPersonOrganizationProperty];
-            NSString *term = [terms componentsJoinedByString: @" "];
-            if ([value.stringWithDiacriticsRemoved.lowercaseString hasPrefix: term.stringWithDiacriticsRemoved.lowercaseString])
-            {
-                termsMatched += 1;
-            }
-        }
+        if (score) *score = 0;
+        return 0;
     }
-    return termsMatched;
+    return [[AKSearchEntry entryWithContact: self] numberOfMatchingTerms: terms score: score];
 }
 
 - (NSArray *)indexesOfPhoneNumbersMatchingTerms: (NSArray *)terms preciseMatch: (BOOL)preciseMatch
 {
-    NSArray *(^phoneTerms)(NSArray *) = ^(NSArray *terms) {
-        NSMutableArray *phoneTerms = [[NSMutableArray alloc] init];
-        for (NSString *term in terms)
-        {
-            if (term.stringWithNormalizedPhoneNumber.length > 0)
-            {
-                [phoneTerms addObject: term];
-            }
-        }
-        return [phoneTerms copy];
-    };
-    
-    BOOL (^stringMatchesTerm)(NSString *, NSString *) = ^(NSString *string, NSString *term) {
-        if (preciseMatch) {
-            return [string isEqualToString: term];
-        }
-        else {
-            return [string hasPrefix: term];
-        }
-    };
-    
-    NSMutableArray *matchingIndexes = [[NSMutableArray alloc] init];
-    terms = phoneTerms(terms);
-    if (terms.count > 0)
-    {
-        if (self.recordRef)
-        {
-            ABPropertyID property = kABPersonPhoneProperty;
-            NSArray *identifiers = [self identifiersForMultiValueProperty: property];
-            for (NSInteger index = 0; index < identifiers.count; ++index)
-            {
-                ABMultiValueIdentifier identifier = [[identifiers objectAtIndex: index] intValue];
-                NSString *value = [self valueForMultiValueProperty: property andIdentifier: identifier];
-                NSString *digits = value.stringWithNonDigitsRemoved;
-                if (digits.length > 0)
-                {
-                    for (NSString *term in terms)
-                    {
-                        if (term.length == 0)
-                        {
-                            continue;
-                        }
-                        if (stringMatchesTerm(digits, term) || stringMatchesTerm(value.stringWithNormalizedPhoneNumber, term) || stringMatchesTerm(value, term))
-                        {
-                            [matchingIndexes addObject: @(index)];
-                            break;
-                        }
-                        for (NSString *prefix in [AKAddressBook countryCodePrefixes])
-                        {
-                            if ([digits hasPrefix: prefix])
-                            {
-                                digits = [digits substringFromIndex: prefix.length];
-                                if (digits.length > 0 && stringMatchesTerm(digits, term))
-                                {
-                                    [matchingIndexes addObject: @(index)];
-                                    break;
-                                }
-                            }
-                        }
-                    }
-                }
-            }
-        }
-    }
-    return [matchingIndexes copy];
+    if (!self.recordRef) return @[];
+    return [[AKSearchEntry entryWithContact: self] indexesOfPhoneNumbersMatchingTerms: terms preciseMatch: preciseMatch];
 }
 
 - (NSString *)nameToDetermineSectionForSortOrdering: (ABPersonSortOrdering)sortOrdering
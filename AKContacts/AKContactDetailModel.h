@@ -0,0 +1,88 @@
+//
+//  AKContactDetailModel.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Display values of one value of a property of a contact
+ */
+@interface AKContactDetailRow : NSObject
+
+/**
+ * Identifier of the value of a multi value property, NSNotFound otherwise
+ */
+@property (assign, nonatomic, readonly) NSInteger identifier;
+/**
+ * Text displayed, eg: the formatted date of a date value
+ */
+@property (copy, nonatomic, readonly) NSString *text;
+/**
+ * Localized label as displayed
+ */
+@property (copy, nonatomic, readonly) NSString *label;
+
+@end
+
+/**
+ * What the contact screen displays of a contact outside of editing: the
+ * values of each property with their labels, the linked contacts and the
+ * height of rows that depend on the values. Immutable, built on a background
+ * queue and cached until the record is modified
+ */
+@interface AKContactDetailModel : NSObject
+
+@property (assign, nonatomic, readonly) ABRecordID recordID;
+/**
+ * Latest modification date of the record and its linked people when the model was built
+ */
+@property (strong, nonatomic, readonly) NSDate *modificationDate;
+@property (strong, nonatomic, readonly) NSArray *linkedContactIDs;
+@property (assign, nonatomic, readonly) CGFloat noteHeight;
+
+/**
+ * Calls completionHandler on the main queue with the model of the record,
+ * the cached one if neither the record nor its linked people were modified since it was built
+ */
++ (void)loadModelForRecordID: (ABRecordID)recordID completionHandler: (void (^)(AKContactDetailModel *model))completionHandler;
+/**
+ * Builds the model in the background ahead of a tap
+ */
++ (void)prefetchModelForRecordID: (ABRecordID)recordID;
+/**
+ * Cached model, nil if not built yet. Does not check for modification
+ */
++ (AKContactDetailModel *)cachedModelForRecordID: (ABRecordID)recordID;
++ (void)removeModelForRecordID: (ABRecordID)recordID;
+
+/**
+ * Number of AKContactDetailRow of the property
+ */
+- (NSInteger)numberOfRowsForProperty: (ABPropertyID)property;
+- (AKContactDetailRow *)rowForProperty: (ABPropertyID)property atIndex: (NSInteger)index;
+
+@end
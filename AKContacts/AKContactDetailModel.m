@@ -0,0 +1,306 @@
+//
+//  AKContactDetailModel.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKContactDetailModel.h"
+#import "AKContact.h"
+#import "AKAddressBook.h"
+#import "AKAddressBookPool.h"
+#import "AKCacheRegistry.h"
+#import "AKIndexSnapshot.h"
+
+static const CGFloat noteWidth = 210.f;
+static const CGFloat noteMaxHeight = 120.f;
+static const CGFloat noteMargin = 25.f;
+/**
+ * Estimated bytes of a model and of each of its rows besides their strings
+ */
+static const NSUInteger modelBaseCost = 256;
+static const NSUInteger rowBaseCost = 64;
+
+@interface AKContactDetailRow ()
+
+@property (assign, nonatomic) NSInteger identifier;
+@property (copy, nonatomic) NSString *text;
+@property (copy, nonatomic) NSString *label;
+
+@end
+
+@implementation AKContactDetailRow
+
+@end
+
+@interface AKContactDetailModel ()
+
+@property (assign, nonatomic) ABRecordID recordID;
+@property (strong, nonatomic) NSDate *modificationDate;
+@property (strong, nonatomic) NSArray *linkedContactIDs;
+@property (assign, nonatomic) CGFloat noteHeight;
+/**
+ * Arrays of AKContactDetailRow keyed by ABPropertyID
+ */
+@property (strong, nonatomic) NSDictionary *rowsByProperty;
+/**
+ * Estimated bytes held by the model, its cost in the cache
+ */
+@property (assign, nonatomic) NSUInteger cost;
+
+/**
+ * Models keyed by recordID
+ */
++ (AKCache *)cache;
+/**
+ * Serial queue the models are built on with the pool's ABAddressBookRef of the queue's thread
+ */
++ (dispatch_queue_t)model_queue;
+/**
+ * Must be dispatched on model_queue
+ */
++ (AKContactDetailModel *)modelForRecordID: (ABRecordID)recordID;
++ (AKContactDetailModel *)modelForRecordID: (ABRecordID)recordID withAddressBookRef: (ABAddressBookRef)addressBookRef;
++ (NSString *)displayLabel: (NSString *)label;
+/**
+ * Latest modification date of the record and its linked people
+ */
++ (NSDate *)modificationDateOfRecordRef: (ABRecordRef)recordRef;
+
+- (instancetype)initWithContact: (AKContact *)contact modificationDate: (NSDate *)modificationDate;
+
+@end
+
+@implementation AKContactDetailModel
+
++ (AKCache *)cache
+{
+    static AKCache *cache = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        cache = [[AKCache alloc] initWithName: @"contactDetailModels" priority: AKCachePriorityLow];
+        [cache setCountLimit: 32];
+    });
+    return cache;
+}
+
++ (dispatch_queue_t)model_queue
+{
+    static dispatch_queue_t model_queue = NULL;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        model_queue = dispatch_queue_create([NSStringFromClass([AKContactDetailModel class]) UTF8String], DISPATCH_QUEUE_SERIAL);
+    });
+    return model_queue;
+}
+
++ (NSString *)displayLabel: (NSString *)label
+{   // As the detail cells display labels
+    return ([label compare: @"iPhone"] != NSOrderedSame) ? [label lowercaseString] : label;
+}
+
++ (NSDate *)modificationDateOfRecordRef: (ABRecordRef)recordRef
+{   // Latest modification date across the record and the people linked to it
+    NSDate *modificationDate = (NSDate *)CFBridgingRelease(ABRecordCopyValue(recordRef, kABPersonModificationDateProperty));
+    
+    NSArray *linkedPeople = (NSArray *)CFBridgingRelease(ABPersonCopyArrayOfAllLinkedPeople(recordRef));
+    for (id linkedPerson in linkedPeople)
+    {
+        NSDate *date = (NSDate *)CFBridgingRelease(ABRecordCopyValue((__bridge ABRecordRef)linkedPerson, kABPersonModificationDateProperty));
+        if (date && (!modificationDate || [date compare: modificationDate] == NSOrderedDescending))
+        {
+            modificationDate = date;
+        }
+    }
+    return modificationDate;
+}
+
++ (AKContactDetailModel *)modelForRecordID: (ABRecordID)recordID
+{
+    __block AKContactDetailModel *model;
+    [[AKAddressBook sharedInstance].addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+        model = [AKContactDetailModel modelForRecordID: recordID withAddressBookRef: addressBookRef];
+    }];
+    return model;
+}
+
++ (AKContactDetailModel *)modelForRecordID: (ABRecordID)recordID withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    if (!addressBookRef) return nil;
+    AKAddressBook *addressBook = [AKAddressBook sharedInstance];
+    
+    ABRecordRef recordRef = ABAddressBookGetPersonWithRecordID(addressBookRef, recordID);
+    if (!recordRef) return nil;
+    
+    NSDate *modificationDate = [AKContactDetailModel modificationDateOfRecordRef: recordRef];
+    
+    AKContactDetailModel *model = [[AKContactDetailModel cache] objectForKey: @(recordID)];
+    if (model && [model.modificationDate isEqualToDate: modificationDate]) return model;
+    
+    AKContact *contact = [[AKContact alloc] initWithABRecordID: recordID
+                                                 sortOrdering: addressBook.snapshot.sortOrdering
+                                            andAddressBookRef: addressBookRef];
+    model = [[AKContactDetailModel alloc] initWithContact: contact modificationDate: modificationDate];
+    [[AKContactDetailModel cache] setObject: model forKey: @(recordID) cost: model.cost];
+    return model;
+}
+
++ (void)loadModelForRecordID: (ABRecordID)recordID completionHandler: (void (^)(AKContactDetailModel *))completionHandler
+{
+    dispatch_async([AKContactDetailModel model_queue], ^{
+        AKContactDetailModel *model = [AKContactDetailModel modelForRecordID: recordID];
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completionHandler(model);
+        });
+    });
+}
+
++ (void)prefetchModelForRecordID: (ABRecordID)recordID
+{
+    dispatch_async([AKContactDetailModel model_queue], ^{
+        [AKContactDetailModel modelForRecordID: recordID];
+    });
+}
+
++ (AKContactDetailModel *)cachedModelForRecordID: (ABRecordID)recordID
+{
+    return [[AKContactDetailModel cache] objectForKey: @(recordID)];
+}
+
++ (void)removeModelForRecordID: (ABRecordID)recordID
+{
+    [[AKContactDetailModel cache] removeObjectForKey: @(recordID)];
+}
+
+- (instancetype)initWithContact: (AKContact *)contact modificationDate: (NSDate *)modificationDate
+{
+    self = [super init];
+    if (self)
+    {
+        _recordID = contact.recordID;
+        _modificationDate = modificationDate;
+        _linkedContactIDs = [contact linkedContactIDs];
+        
+        NSMutableDictionary *rowsByProperty = [[NSMutableDictionary alloc] init];
+        
+        NSArray *properties = @[@(kABPersonPhoneProperty), @(kABPersonEmailProperty), @(kABPersonURLProperty),
+                                @(kABPersonAddressProperty), @(kABPersonDateProperty),
+                                @(kABPersonSocialProfileProperty), @(kABPersonInstantMessageProperty)];
+        for (NSNumber *property in properties)
+        {
+            ABPropertyID propertyID = property.intValue;
+            NSMutableArray *rows = [[NSMutableArray alloc] init];
+            for (NSNumber *identifier in [contact identifiersForMultiValueProperty: propertyID])
+            {
+                ABMultiValueIdentifier multiValueIdentifier = identifier.intValue;
+                
+                AKContactDetailRow *row = [[AKContactDetailRow alloc] init];
+                row.identifier = multiValueIdentifier;
+                row.label = [AKContactDetailModel displayLabel: [contact localizedLabelForMultiValueProperty: propertyID andIdentifier: multiValueIdentifier]];
+                
+                id value = [contact valueForMultiValueProperty: propertyID andIdentifier: multiValueIdentifier];
+                if (propertyID == kABPersonAddressProperty)
+                {
+                    row.text = [contact addressForIdentifier: multiValueIdentifier andNumRows: NULL];
+                }
+                else if (propertyID == kABPersonDateProperty)
+                {
+                    row.text = (value) ? [NSDateFormatter localizedStringFromDate: value
+                                                                        dateStyle: NSDateFormatterLongStyle
+                                                                        timeStyle: NSDateFormatterNoStyle] : nil;
+                }
+                else if (propertyID == kABPersonSocialProfileProperty)
+                {
+                    row.text = [value objectForKey: (NSString *)kABPersonSocialProfileUsernameKey];
+                }
+                else if (propertyID == kABPersonInstantMessageProperty)
+                {
+                    row.text = [value objectForKey: (NSString *)kABPersonInstantMessageUsernameKey];
+                }
+                else
+                {
+                    row.text = value;
+                }
+                [rows addObject: row];
+            }
+            if (rows.count > 0)
+            {
+                [rowsByProperty setObject: [rows copy] forKey: property];
+            }
+        }
+        
+        NSDate *birthday = [contact valueForProperty: kABPersonBirthdayProperty];
+        if (birthday)
+        {
+            AKContactDetailRow *row = [[AKContactDetailRow alloc] init];
+            row.identifier = NSNotFound;
+            row.label = [AKContactDetailModel displayLabel: [AKContact localizedNameForProperty: kABPersonBirthdayProperty]];
+            row.text = [NSDateFormatter localizedStringFromDate: birthday
+                                                      dateStyle: NSDateFormatterLongStyle
+                                                      timeStyle: NSDateFormatterNoStyle];
+            [rowsByProperty setObject: @[row] forKey: @(kABPersonBirthdayProperty)];
+        }
+        
+        NSString *note = [contact valueForProperty: kABPersonNoteProperty];
+        if (note)
+        {
+            AKContactDetailRow *row = [[AKContactDetailRow alloc] init];
+            row.identifier = NSNotFound;
+            row.label = [AKContactDetailModel displayLabel: [AKContact localizedNameForProperty: kABPersonNoteProperty]];
+            row.text = note;
+            [rowsByProperty setObject: @[row] forKey: @(kABPersonNoteProperty)];
+            
+            // String measuring of UIKit is thread safe as of iOS 6
+            _noteHeight = [note sizeWithFont: [UIFont systemFontOfSize: [UIFont systemFontSize]]
+                           constrainedToSize: CGSizeMake(noteWidth, noteMaxHeight)
+                               lineBreakMode: NSLineBreakByWordWrapping].height + noteMargin;
+        }
+        _rowsByProperty = [rowsByProperty copy];
+        
+        // UTF-16 text and labels dominate, a long note the most
+        NSUInteger cost = modelBaseCost + _linkedContactIDs.count * sizeof(ABRecordID);
+        for (NSArray *rows in [rowsByProperty allValues])
+        {
+            for (AKContactDetailRow *row in rows)
+            {
+                cost += rowBaseCost + (row.text.length + row.label.length) * sizeof(unichar);
+            }
+        }
+        _cost = cost;
+    }
+    return self;
+}
+
+- (NSInteger)numberOfRowsForProperty: (ABPropertyID)property
+{
+    return [[self.rowsByProperty objectForKey: @(property)] count];
+}
+
+- (AKContactDetailRow *)rowForProperty: (ABPropertyID)property atIndex: (NSInteger)index
+{
+    NSArray *rows = [self.rowsByProperty objectForKey: @(property)];
+    return (index >= 0 && index < rows.count) ? [rows objectAtIndex: index] : nil;
+}
+
+@end
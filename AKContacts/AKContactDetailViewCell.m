@@ -30,6 +30,7 @@
 #import "AKContact.h"
 #import "AKContactViewController.h"
 #import "AKAddressBook.h"
+#import "AKContactDetailModel.h"
 
 @interface AKContactDetailViewCell ()
 
@@ -113,7 +114,25 @@
     [self.textView removeFromSuperview];
     [self.contentView addSubview: (self.abPropertyID == kABPersonNoteProperty) ? self.textView : self.textField];
     
-    if (self.abPropertyID == kABPersonPhoneProperty ||
+    AKContactDetailRow *detailRow = (self.controller.editing) ? nil : [self.controller.detailModel rowForProperty: property atIndex: row];
+    if (detailRow)
+    {   // Values prepared by the detail model
+        [self setTag: detailRow.identifier];
+        text = detailRow.text;
+        label = detailRow.label;
+        
+        if (self.abPropertyID == kABPersonNoteProperty)
+        {
+            [self.textView setText: text];
+        }
+        if (self.abPropertyID == kABPersonNoteProperty ||
+            self.abPropertyID == kABPersonBirthdayProperty ||
+            self.abPropertyID == kABPersonDateProperty)
+        {
+            [self setSelectionStyle: UITableViewCellSelectionStyleNone];
+        }
+    }
+    else if (self.abPropertyID == kABPersonPhoneProperty ||
         self.abPropertyID == kABPersonEmailProperty ||
         self.abPropertyID == kABPersonURLProperty)
     {
@@ -190,7 +209,7 @@
     
     [self.textField setPlaceholder: placeholder];
     [self.textField setText: text];
-    if ([label compare: @"iPhone"] != NSOrderedSame) label = [label lowercaseString];
+    if (!detailRow && [label compare: @"iPhone"] != NSOrderedSame) label = [label lowercaseString];
     [self.textLabel setText: label];
 }
 
@@ -66,7 +66,7 @@
     [self setSelectionStyle: UITableViewCellSelectionStyleBlue];
     [self setAccessoryType: UITableViewCellAccessoryNone];
     
-    ABRecordID recordID = [[[self.controller.contact linkedContactIDs] objectAtIndex: row] intValue];
+    ABRecordID recordID = [[[self.controller linkedContactIDs] objectAtIndex: row] intValue];
     
     if (recordID != self.controller.parentLinkedContactID)
     {
@@ -11,6 +11,8 @@
 #import "AKContact.h"
 #import "AKGroup.h"
 #import "AKSource.h"
+#import "AKIndexSnapshot.h"
+#import "AKSectionView.h"
 
 NSString *const AKContactPickerViewDidDismissNotification = @"AKContactPickerViewDidDismissNotification";
 
@@ -20,11 +22,11 @@ NSString *const AKContactPickerViewDidDismissNotification = @"AKContactPickerVie
 /**
  * Dictionary keys of displayed contacts
  **/
-@property (strong, nonatomic) NSMutableArray *keys;
+@property (strong, nonatomic) NSArray *keys;
 /**
  * Identifiers of displayed contacts
  **/
-@property (strong, nonatomic) NSMutableDictionary *contactIdentifiers;
+@property (strong, nonatomic) NSDictionary *contactIdentifiers;
 /**
  * Identifiers of contacts changed
  **/
@@ -77,42 +79,16 @@ NSString *const AKContactPickerViewDidDismissNotification = @"AKContactPickerVie
 
 - (void)loadContacts
 {
-    [self setKeys: [[NSMutableArray alloc] init]];
-    
     AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
     
-    AKSource *source = [akAddressBook sourceForSourceId: akAddressBook.sourceID];
-    AKGroup *group = [source groupForGroupId: kGroupAggregate];
-    NSMutableSet *groupMembers = [group memberIDs];
-    
-    NSArray *keyArray = [[akAddressBook.hashTable allKeys] sortedArrayUsingSelector: @selector(compare:)];
-    
-    [self setContactIdentifiers: [[NSMutableDictionary alloc] init]];
-    
-    for (NSString *key in keyArray)
-    {
-        NSMutableArray *arrayForKey = [akAddressBook.hashTable objectForKey: key];
-        NSMutableArray *sectionArray = [arrayForKey mutableCopy];
-        
-        NSMutableArray *recordsToRemove = [[NSMutableArray alloc] init];
-        for (NSNumber *contactID in sectionArray)
-        {
-            if ([groupMembers member: contactID] == nil)
-                [recordsToRemove addObject: contactID];
-        }
-        [sectionArray removeObjectsInArray: recordsToRemove];
-        if ([sectionArray count] > 0)
-        {
-            [self.contactIdentifiers setObject: sectionArray forKey: key];
-            [self.keys addObject: key];
-        }
-    }
-    
-    if ([self.keys count] > 0 && [[self.keys objectAtIndex: 0] isEqualToString: @"#"])
-    { // Little hack to move # to the end of the list
-        [self.keys addObject: [self.keys objectAtIndex: 0]];
-        [self.keys removeObjectAtIndex: 0];
-    }
+    // Shares the view of the aggregate group with the contacts list
+    AKIndexSnapshot *snapshot = akAddressBook.snapshot;
+    AKSectionView *view = [akAddressBook.sectionViewCache viewForSourceID: akAddressBook.sourceID
+                                                                 groupID: kGroupAggregate
+                                                            sortOrdering: snapshot.sortOrdering
+                                                              ofSnapshot: snapshot];
+    [self setKeys: view.keys];
+    [self setContactIdentifiers: view.contactIDs];
 }
 
 - (void)cancelButtonTouchUpInside: (id)sender
@@ -29,6 +29,7 @@
 #import <UIKit/UIKit.h>
 
 @class AKContact;
+@class AKContactDetailModel;
 
 @protocol AKContactViewControllerDelegate <NSObject>
 @required
@@ -46,6 +47,10 @@
 
 @property (strong, nonatomic) UITableView *tableView;
 @property (strong, nonatomic) AKContact *contact;
+/**
+ * Values displayed outside of editing, nil until built
+ */
+@property (strong, nonatomic) AKContactDetailModel *detailModel;
 @property (unsafe_unretained, nonatomic) id<AKContactViewControllerDelegate> delegate;
 /**
  * Set to YES when add new address row is
@@ -64,5 +69,13 @@
  * Create a person view with a contactID
  */
 -(id)initWithContactID: (ABRecordID)contactID;
+/**
+ * Create a person view with a model built in the background
+ */
+- (id)initWithContactID: (ABRecordID)contactID detailModel: (AKContactDetailModel *)detailModel;
+/**
+ * ContactIDs of linked contacts from the detail model if there is one
+ */
+- (NSArray *)linkedContactIDs;
 
 @end
@@ -42,6 +42,7 @@
 #import "AKLabelViewController.h"
 #import "AKAddressBook.h"
 #import "AKMessenger.h"
+#import "AKContactDetailModel.h"
 
 typedef NS_ENUM(NSInteger, SectionID) {
     kSectionHeader = 0,
@@ -91,6 +92,10 @@ static const float defaultCellHeight = 44.f;
  * Returns the index a section should be inserted at
  */
 - (NSInteger)insertIndexForSection: (NSInteger)section;
+/**
+ * Builds the detail model in the background and reloads the table with it
+ */
+- (void)loadDetailModel;
 
 @end
 
@@ -149,10 +154,45 @@ static const float defaultCellHeight = 44.f;
     return self;
 }
 
+- (id)initWithContactID: (ABRecordID)contactID detailModel: (AKContactDetailModel *)detailModel
+{
+    self = [self initWithContactID: contactID];
+    if (self)
+    {
+        _detailModel = detailModel;
+    }
+    return self;
+}
+
+- (NSArray *)linkedContactIDs
+{
+    return (self.detailModel && !self.editing) ? self.detailModel.linkedContactIDs : [self.contact linkedContactIDs];
+}
+
 - (NSInteger)numberOfElementsInSection: (NSInteger)section
 {
     ABPropertyID property = [AKContactViewController abPropertyIDforSection: section];
     
+    if (self.detailModel && !self.editing)
+    {
+        switch (section)
+        {
+            case kSectionPhone:
+            case kSectionEmail:
+            case kSectionURL:
+            case kSectionAddress:
+            case kSectionDate:
+            case kSectionSocialProfile:
+            case kSectionInstantMessage:
+            case kSectionBirthday:
+            case kSectionNote: return [self.detailModel numberOfRowsForProperty: property];
+                
+            case kSectionLinkedRecords: return [self.detailModel.linkedContactIDs count];
+                
+            default: break;
+        }
+    }
+    
     switch (section)
     {
         case kSectionPhone:
@@ -174,6 +214,16 @@ static const float defaultCellHeight = 44.f;
     }
 }
 
+- (void)loadDetailModel
+{
+    [AKContactDetailModel loadModelForRecordID: self.contact.recordID completionHandler: ^(AKContactDetailModel *model) {
+        if (!model || self.editing || model.recordID != self.contact.recordID) return;
+        
+        [self setDetailModel: model];
+        [self.tableView reloadData];
+    }];
+}
+
 - (BOOL)isSectionEditable: (NSInteger)section
 {
     switch (section)
@@ -400,6 +450,10 @@ static const float defaultCellHeight = 44.f;
             return (self.editing == YES) ? defaultCellHeight + 40.f : defaultCellHeight;
             
         case kSectionNote:
+            if (self.detailModel && !self.editing)
+            {
+                return ([self.detailModel numberOfRowsForProperty: kABPersonNoteProperty] > 0) ? self.detailModel.noteHeight : defaultCellHeight;
+            }
             return ([self.contact valueForProperty: kABPersonNoteProperty]) ?
             [[self.contact valueForProperty: kABPersonNoteProperty] sizeWithFont: [UIFont systemFontOfSize: [UIFont systemFontSize]]
                                                                constrainedToSize: CGSizeMake(210.f, 120.f)
@@ -459,7 +513,7 @@ static const float defaultCellHeight = 44.f;
     
     switch (section) {
         case kSectionLinkedRecords:
-            return (self.editing || [self.contact linkedContactIDs].count == 0) ? nil : NSLocalizedString(@"Linked Contacts", @"");
+            return (self.editing || [self linkedContactIDs].count == 0) ? nil : NSLocalizedString(@"Linked Contacts", @"");
         default: return nil;
     }
 }
@@ -616,7 +670,7 @@ static const float defaultCellHeight = 44.f;
         }
         else if (section == kSectionLinkedRecords)
         {
-            ABRecordID recordId = [[[self.contact linkedContactIDs] objectAtIndex: indexPath.row] intValue];
+            ABRecordID recordId = [[[self linkedContactIDs] objectAtIndex: indexPath.row] intValue];
             
             if (self.parentLinkedContactID != recordId)
             {
@@ -705,6 +759,12 @@ static const float defaultCellHeight = 44.f;
         
         ABRecordID contactID = self.contact.recordID;
         
+        if (self.detailModel && ABAddressBookHasUnsavedChanges(self.contact.addressBookRef))
+        {   // The model shows the values before editing, it is rebuilt once the changes are saved
+            [self setDetailModel: nil];
+            [AKContactDetailModel removeModelForRecordID: contactID];
+        }
+        
         [self.contact commit]; // ContactID changes from newContactID here
         
         [self setWillAddAddress: NO];
@@ -721,6 +781,11 @@ static const float defaultCellHeight = 44.f;
 #endif
             return;
         }
+        
+        if (!self.detailModel)
+        {
+            [self loadDetailModel];
+        }
     }
     
     NSMutableIndexSet *reloadSet = [[NSMutableIndexSet alloc] init];
@@ -27,6 +27,7 @@
 //
 
 #import "AKContactsProgressIndicatorView.h"
+#import "AKProgressReporter.h"
 
 #import <QuartzCore/QuartzCore.h>
 
@@ -36,6 +37,7 @@ static const CGFloat kRadius = 11.f;
 @interface AKContactsProgressIndicatorView ()
 
 @property (strong, nonatomic) CAShapeLayer *spinLayer;
+@property (strong, nonatomic) id progressObserver;
 
 @end
 
@@ -58,16 +60,17 @@ static const CGFloat kRadius = 11.f;
         _spinLayer.strokeEnd = 0.f;
         [[self layer] addSublayer: _spinLayer];
         
-        NSString *keyPath = NSStringFromSelector(@selector(completedUnitCount));
-        [[AKAddressBook sharedInstance].loadProgress addObserver: self forKeyPath: keyPath options: NSKeyValueObservingOptionNew context: NULL];
+        __weak AKContactsProgressIndicatorView *_self = self;
+        _progressObserver = [[AKAddressBook sharedInstance].loadProgress addObserverWithHandler: ^(double fractionCompleted, BOOL finished) {
+            [_self setProgress: fractionCompleted finished: finished];
+        }];
     }
     return self;
 }
 
 - (void)dealloc
 {
-    NSString *keyPath = NSStringFromSelector(@selector(completedUnitCount));
-    [[AKAddressBook sharedInstance].loadProgress removeObserver: self forKeyPath: keyPath];
+    [[AKAddressBook sharedInstance].loadProgress removeObserver: _progressObserver];
 }
 
 - (void)layoutSubviews
@@ -82,23 +85,14 @@ static const CGFloat kRadius = 11.f;
     [[self spinLayer] setFrame: [self bounds]];
 }
 
-- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
-{ // This is not dispatched on main queue
-    NSUInteger completedUnitCount = [AKAddressBook sharedInstance].loadProgress.completedUnitCount;
-    NSUInteger totalUnitCount = [AKAddressBook sharedInstance].loadProgress.totalUnitCount;
+- (void)setProgress: (double)progress finished: (BOOL)finished
+{ // Called on main queue
+    [CATransaction begin];
+    [CATransaction setDisableActions: YES];
+    [[self spinLayer] setStrokeEnd: progress];
+    [CATransaction commit];
     
-    NSUInteger denom = (totalUnitCount > 100) ? (totalUnitCount / 100) : totalUnitCount;
-    if (completedUnitCount % denom == 0)
-    {
-        dispatch_async(dispatch_get_main_queue(), ^{
-            CGFloat progress = (CGFloat)completedUnitCount / totalUnitCount;
-            [CATransaction begin];
-            [CATransaction setDisableActions: YES];
-            [[self spinLayer] setStrokeEnd: progress];
-            [CATransaction commit];
-        });
-    }
-    if (completedUnitCount == totalUnitCount)
+    if (finished)
     {
         [self removeFromSuperview];
     }
@@ -31,6 +31,7 @@
 #import "AKContact.h"
 #import "AKContactsViewController.h"
 #import "AKContactsTableViewDataSource.h"
+#import "AKDisplaySnapshot.h"
 
 @implementation AKContactsRecordViewCell
 
@@ -53,22 +54,36 @@
 - (void)configureCellAtIndexPath:(NSIndexPath *)indexPath
 {
     AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
+    AKContactsTableViewDataSource *dataSource = self.controller.dataSource;
     
     NSString *key = nil;
-    if ([self.controller.dataSource.keys count] > indexPath.section)
-        key = [self.controller.dataSource.keys objectAtIndex: indexPath.section];
+    if ([dataSource.keys count] > indexPath.section)
+        key = [dataSource.keys objectAtIndex: indexPath.section];
     
-    NSArray *identifiersArray = [self.controller.dataSource.contactIDs objectForKey: key];
+    NSArray *identifiersArray = [dataSource.contactIDs objectForKey: key];
     if ([identifiersArray count] == 0) return;
     NSNumber *recordId = [identifiersArray objectAtIndex: indexPath.row];
-    AKContact *contact = [akAddressBook contactForContactId: recordId.intValue];
-    if (!contact) return;
-    [self setTag: [contact recordID]];
+    
+    NSString *compositeName = nil;
+    NSRange boldRange = NSMakeRange(NSNotFound, 0);
+    AKDisplaySnapshot *displaySnapshot = dataSource.displaySnapshot;
+    if ([displaySnapshot.memberIDs member: recordId])
+    {   // Painted before the address book is opened
+        compositeName = [displaySnapshot displayNameForRecordID: recordId.intValue];
+        boldRange = [displaySnapshot boldRangeForRecordID: recordId.intValue];
+    }
+    else
+    {
+        AKContact *contact = [akAddressBook contactForContactId: recordId.intValue];
+        if (!contact) return;
+        compositeName = contact.compositeName;
+        if (compositeName) boldRange = [contact boldRangeOfCompositeName: compositeName];
+    }
+    [self setTag: recordId.intValue];
     [self setSelectionStyle: UITableViewCellSelectionStyleBlue];
     [self.textLabel setFont: [UIFont systemFontOfSize: 20.f]];
     
     [self setAccessoryView: nil];
-    NSString *compositeName = contact.compositeName;
     if (!compositeName)
     {
         [self.textLabel setFont: [UIFont italicSystemFontOfSize: 20.f]];
@@ -81,18 +96,9 @@
             NSMutableAttributedString *text = [[NSMutableAttributedString alloc] initWithString: compositeName];
             [text addAttribute: NSFontAttributeName value: [UIFont systemFontOfSize: 20.f] range: NSMakeRange(0, text.length - 1)];
             
-            if (contact.isPerson)
-            {
-                NSString *lastName = [contact valueForProperty: kABPersonLastNameProperty];
-                if (lastName.length > 0)
-                {
-                    NSRange range = [compositeName rangeOfString: lastName];
-                    [text addAttribute: NSFontAttributeName value: [UIFont boldSystemFontOfSize: 20.f] range: range];
-                }
-            }
-            else if (contact.isOrganization)
+            if (boldRange.location != NSNotFound && NSMaxRange(boldRange) <= text.length)
             {
-                [text addAttribute: NSFontAttributeName value: [UIFont boldSystemFontOfSize: 20.f] range: NSMakeRange(0, text.length)];
+                [text addAttribute: NSFontAttributeName value: [UIFont boldSystemFontOfSize: 20.f] range: boldRange];
             }
             [self.textLabel setAttributedText: text];
         }
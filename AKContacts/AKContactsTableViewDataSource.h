@@ -27,9 +27,12 @@
 //
 
 #import <Foundation/Foundation.h>
+#import "AKFacetIndex.h"
 
 @class AKContactsTableViewDataSource;
 @class AKContact;
+@class AKDisplaySnapshot;
+@class AKAddressBook;
 
 @protocol AKContactsTableViewDataSourceDelegate <NSObject>
 @optional
@@ -37,18 +40,27 @@
 - (void)dataSourceDidBeginSearch: (AKContactsTableViewDataSource *)dataSource;
 - (void)dataSourceWillEndSearch: (AKContactsTableViewDataSource *)dataSource;
 - (void)dataSourceDidEndSearch: (AKContactsTableViewDataSource *)dataSource;
+/**
+ * Called on the main queue when entries of directory sources arrive
+ */
+- (void)dataSourceDidUpdateDirectoryEntries: (AKContactsTableViewDataSource *)dataSource;
 @end
 
 @interface AKContactsTableViewDataSource : NSObject
 
+/**
+ * Address book the contacts are displayed and searched from
+ */
+@property (strong, nonatomic, readonly) AKAddressBook *addressBook;
+
 /**
  * Dictionary keys of displayed contacts
  **/
-@property (strong, nonatomic) NSMutableArray *keys;
+@property (strong, nonatomic) NSArray *keys;
 /**
  * Subset of all contactIDs that are displayed
  **/
-@property (strong, nonatomic) NSMutableDictionary *contactIDs;
+@property (strong, nonatomic) NSDictionary *contactIDs;
 /**
  * Set of contactIDs that are displayed
  */
@@ -58,8 +70,19 @@
  * Search results
  */
 @property (strong, nonatomic) NSArray *filteredContactIDs;
+/**
+ * AKDirectoryEntry of directory sources matching the search term, shown after
+ * filteredContactIDs. Cached entries are set with the local results, the ones
+ * queried remotely are appended as they arrive
+ */
+@property (strong, nonatomic, readonly) NSArray *directoryEntries;
 
 @property (strong, readonly) NSString *searchTerm;
+/**
+ * Incremented when a search is cancelled or its term is edited other than by appending
+ * Search steps of an older generation terminate early and their results are dropped
+ */
+@property (assign, readonly) int32_t searchGeneration;
 
 @property (assign, nonatomic) id<AKContactsTableViewDataSourceDelegate> delegate;
 /**
@@ -71,11 +94,59 @@
  * Default value is kABMultiValueInvalidIdentifier
  */
 @property (assign, nonatomic) ABPropertyID manifoldingPropertyID;
+/**
+ * Fuzzy mode: when the exact prefix search yields fewer matches than this,
+ * contacts with a name token within a small edit distance of the search terms
+ * are appended to the results. Set to 0 to turn off. Default value is 3
+ */
+@property (assign, nonatomic) NSUInteger fuzzyMatchingThreshold;
+/**
+ * Dial pad mode: search terms of digits only match names spelled on the keypad
+ * (eg: 5646 matches John) as well as phone numbers containing the digits.
+ * Name matches come first. Default value is NO
+ */
+@property (assign, nonatomic, getter = isKeypadSearchEnabled) BOOL keypadSearchEnabled;
+
+/**
+ * Facet values keyed by AKFacet numbers. Only contacts of the source and group
+ * having all of the values are displayed and searched. Applied by loadData
+ */
+@property (copy, nonatomic) NSDictionary *facetFilters;
+
+/**
+ * Persisted list of the previous launch shown until the address book is online
+ */
+@property (strong, nonatomic, readonly) AKDisplaySnapshot *displaySnapshot;
+
+/**
+ * Displays the contacts of the shared address book
+ */
+- (id)init;
+- (instancetype)initWithAddressBook: (AKAddressBook *)addressBook;
 
 - (AKContact *)contactForIndexPath: (NSIndexPath *)indexPath;
 
 - (void)loadData;
+/**
+ * Replaces the array of a section. Sections are shared with the views of
+ * the address book's sectionViewCache so they are never mutated in place
+ */
+- (void)setContactIDs: (NSArray *)sectionArray forKey: (NSString *)key;
+/**
+ * Number of displayed contacts keyed by the values of the facet
+ */
+- (NSDictionary *)countsOfFacet: (AKFacet)facet;
+/**
+ * Loads keys and contactIDs from the persisted display snapshot if it matches
+ * the selected source, group and sort ordering. Does not access ABAddressBook
+ */
+- (BOOL)loadDataFromDisplaySnapshot;
 - (void)handleSearchForTerm: (NSString *)searchTerm;
 - (void)finishSearch;
+/**
+ * Query the next page of directory entries of the search term. Returns NO if
+ * no directory source has more entries
+ */
+- (BOOL)loadMoreDirectoryEntries;
 
 @end
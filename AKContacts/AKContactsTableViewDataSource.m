@@ -40,33 +40,129 @@
 #import "AKContact.h"
 #import "AKGroup.h"
 #import "AKSource.h"
+#import "AKNameTokenIndex.h"
+#import "AKRankedResults.h"
+#import "AKKeypadIndex.h"
+#import "AKInstrumentation.h"
+#import "AKIndexSnapshot.h"
+#import "AKDisplaySnapshot.h"
+#import "AKSectionView.h"
+#import "AKSearchEntryIndex.h"
+#import "AKDirectorySource.h"
+#import "AKAddressBookPool.h"
+#import <libkern/OSAtomic.h>
+
+/**
+ * Terms shorter than this are not matched fuzzily
+ */
+static const NSUInteger kFuzzyMinimumTermLength = 3;
+/**
+ * Terms shorter than this are not sent to directory sources
+ */
+static const NSUInteger kDirectoryMinimumTermLength = 2;
 
 @interface AKSearchStackElement : NSObject
 
 @property (copy, nonatomic) NSString *character;
 @property (strong, nonatomic) NSArray *matches;
+/**
+ * Fuzzy matches shown after the matches, they are not filtered by the next keystroke
+ */
+@property (strong, nonatomic) NSArray *fuzzyMatches;
+/**
+ * Matches without forcing the lazy ordering of ranked results, for filtering
+ */
+@property (nonatomic, readonly) NSArray *unorderedMatches;
+/**
+ * Matches followed by fuzzy matches, for display
+ */
+@property (nonatomic, readonly) NSArray *results;
 
 @end
 
 @implementation AKSearchStackElement
 
+- (NSArray *)unorderedMatches
+{
+    return ([self.matches isKindOfClass: [AKRankedResults class]]) ? [(AKRankedResults *)self.matches unorderedRecordIDs] : self.matches;
+}
+
+- (NSArray *)results
+{
+    if (self.fuzzyMatches.count == 0) return self.matches;
+    return [(self.matches ?: @[]) arrayByAddingObjectsFromArray: self.fuzzyMatches];
+}
+
 @end
 
 @interface AKContactsTableViewDataSource ()
 
 - (AKSearchStackElement *)searchStackElementForTerm: (NSString *)searchTerm withCharacterIndex: (NSInteger)characterIndex;
 - (NSArray *)contactIDsHavingPrefix: (NSString *)prefix;
-- (NSArray *)contactIDsHavingNamePrefix: (NSString *)prefix;
-- (NSArray *)contactIDsHavingNumberPrefix: (NSString *)prefix;
-- (NSArray *)filterArray: (NSArray *)array withTerms:(NSArray *)terms andSortOrdering: (ABPersonSortOrdering)sortOrdering;
+- (NSArray *)contactIDsHavingPrefix: (NSString *)prefix ofSnapshot: (AKIndexSnapshot *)snapshot amongContactIDs: (NSSet *)contactIDs;
+- (NSArray *)contactIDsHavingNamePrefix: (NSString *)prefix ofSnapshot: (AKIndexSnapshot *)snapshot;
+- (NSArray *)contactIDsHavingNumberPrefix: (NSString *)prefix ofSnapshot: (AKIndexSnapshot *)snapshot;
+- (void)invalidateFirstKeystrokeMatchesForView: (NSArray *)viewKey ofSnapshot: (AKIndexSnapshot *)snapshot;
+- (void)precomputeFirstKeystrokeMatches;
+- (NSArray *)filterArray: (NSArray *)array withTerms:(NSArray *)terms sortOrdering: (ABPersonSortOrdering)sortOrdering andAddressBookRef: (ABAddressBookRef)addressBookRef;
+- (NSArray *)fuzzyMatchesForTerms: (NSArray *)terms excludingContactIDs: (NSArray *)contactIDs;
+- (NSArray *)contactIDsMatchingKeypadDigits: (NSString *)digits;
+- (NSArray *)rankedArray: (NSArray *)array withScores: (const NSInteger *)scores;
+- (void)searchDirectoriesForTerm: (NSString *)searchTerm;
+- (void)appendDirectoryEntries: (NSArray *)entries forTerm: (NSString *)term;
 
-@property (strong, nonatomic) NSString *searchTerm;
+@property (strong) NSString *searchTerm;
+@property (strong, nonatomic) NSArray *directoryEntries;
+/**
+ * Term of the directory entries. Only accessed on the main queue
+ */
+@property (copy, nonatomic) NSString *directorySearchTerm;
+@property (strong, nonatomic) AKDisplaySnapshot *displaySnapshot;
+/**
+ * displayedContactIDs as an index set for intersecting with facet postings
+ */
+@property (strong, nonatomic) NSIndexSet *displayedRecordIDs;
+/**
+ * Only accessed on search_queue
+ */
 @property (strong, nonatomic) NSMutableArray *searchStack;
-
 /**
- Terminates array operations if waiting on the addressbook semaphore
+ * Last term passed to handleSearchForTerm:. Only accessed on the main queue
  */
-@property (assign, nonatomic) BOOL shouldTerminate;
+@property (copy, nonatomic) NSString *pendingSearchTerm;
+/**
+ * Serializes the steps of this data source's searches. Targets the concurrent
+ * queue of the address book so that searches run in parallel with each other
+ * and with loading
+ */
+@property (strong, nonatomic) dispatch_queue_t search_queue;
+/**
+ * Generation of the search step running on search_queue
+ */
+@property (assign, nonatomic) int32_t activeSearchGeneration;
+/**
+ * Ordered results of single character terms among the displayed contacts
+ * keyed by the character. Guarded by itself
+ */
+@property (strong, nonatomic) NSMutableDictionary *firstKeystrokeMatches;
+/**
+ * Snapshot the first keystroke matches are current with. Guarded by firstKeystrokeMatches
+ */
+@property (strong, nonatomic) AKIndexSnapshot *firstKeystrokeSnapshot;
+/**
+ * Incremented when matches are invalidated, precomputations of an older
+ * generation stop. Guarded by firstKeystrokeMatches
+ */
+@property (assign, nonatomic) NSUInteger firstKeystrokeGeneration;
+/**
+ * Source, group, filters and membership version of the view the first keystroke
+ * matches were computed for. Only accessed on the main queue
+ */
+@property (copy, nonatomic) NSArray *firstKeystrokeViewKey;
+/**
+ * Precomputation at idle priority, serial
+ */
+@property (strong, nonatomic) dispatch_queue_t precompute_queue;
 
 @end
 
@@ -75,11 +171,26 @@
 #pragma mark - Instance methods
 
 - (id)init
+{
+    return [self initWithAddressBook: [AKAddressBook sharedInstance]];
+}
+
+- (instancetype)initWithAddressBook: (AKAddressBook *)addressBook
 {
     self = [super init];
     if (self)
     {
+        _addressBook = addressBook;
         _manifoldingPropertyID = kABMultiValueInvalidIdentifier;
+        _fuzzyMatchingThreshold = 3;
+        
+        _search_queue = dispatch_queue_create([NSStringFromClass([AKContactsTableViewDataSource class]) UTF8String], DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_search_queue, addressBook.concurrent_queue);
+        
+        _firstKeystrokeMatches = [[NSMutableDictionary alloc] init];
+        NSString *label = [NSString stringWithFormat: @"%@.precompute", NSStringFromClass([AKContactsTableViewDataSource class])];
+        _precompute_queue = dispatch_queue_create([label UTF8String], DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_precompute_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
     }
     return self;
 }
@@ -94,11 +205,11 @@
     NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
     
     AKContact *contact;
-    if ([[AKAddressBook sharedInstance] hasStatus: kAddressBookOnline]) {
+    if ([self.addressBook hasStatus: kAddressBookOnline]) {
         if (self.searchTerm.length > 0) {
             if (indexPath.row < self.filteredContactIDs.count) {
                 NSNumber *recordID = [self.filteredContactIDs objectAtIndex: indexPath.row];
-                contact = [[AKAddressBook sharedInstance] contactForContactId: recordID.intValue];
+                contact = [self.addressBook contactForContactId: recordID.intValue];
             }
         }
         else {
@@ -107,7 +218,7 @@
                 NSArray *identifiersArray = [self.contactIDs objectForKey: key];
                 if (identifiersArray.count > 0 && indexPath.row <= identifiersArray.count) {
                     NSNumber *recordID = [identifiersArray objectAtIndex: indexPath.row];
-                    contact = [[AKAddressBook sharedInstance] contactForContactId: recordID.intValue];
+                    contact = [self.addressBook contactForContactId: recordID.intValue];
                 }
             }
         }
@@ -115,45 +226,236 @@
     return contact;
 }
 
+- (BOOL)loadDataFromDisplaySnapshot
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    AKAddressBook *akAddressBook = self.addressBook;
+    
+    NSString *path = [[AKAddressBook documentsDirectoryPath] stringByAppendingPathComponent: [AKDisplaySnapshot fileName]];
+    AKDisplaySnapshot *header = [AKDisplaySnapshot snapshotHeaderWithContentsOfFile: path];
+    if (!header.isCurrent || header.sourceID != akAddressBook.sourceID || header.groupID != akAddressBook.groupID)
+    { // Not worth reading the sections and names
+        return NO;
+    }
+    AKDisplaySnapshot *displaySnapshot = [AKDisplaySnapshot snapshotWithContentsOfFile: path];
+    if (!displaySnapshot ||
+        displaySnapshot.sourceID != akAddressBook.sourceID ||
+        displaySnapshot.groupID != akAddressBook.groupID ||
+        !displaySnapshot.isCurrent)
+    {
+        return NO;
+    }
+    
+    self.displaySnapshot = displaySnapshot;
+    self.contactIDs = [displaySnapshot.contactIDs copy];
+    self.keys = [displaySnapshot.keys copy];
+    self.displayedContactIDs = displaySnapshot.memberIDs;
+    self.displayedRecordIDs = nil;
+    self.searchTerm = nil;
+    return YES;
+}
+
 - (void)loadData
 {
-    AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
+    AKAddressBook *akAddressBook = self.addressBook;
     
-    AKSource *source = [akAddressBook sourceForSourceId: akAddressBook.sourceID];
-    AKGroup *group = [source groupForGroupId: akAddressBook.groupID];
-    NSMutableSet *groupMembers = [group memberIDs];
+    if (self.displaySnapshot)
+    { // Keep showing the persisted list until the verification scan completes
+        if (![akAddressBook hasStatus: kAddressBookOnline]) return;
+        self.displaySnapshot = nil;
+    }
     
-    NSArray *sectionKeys = [AKAddressBook sectionKeys];
+    // Views of recently displayed groups are kept current by the loader
+    AKIndexSnapshot *snapshot = akAddressBook.snapshot;
+    AKSectionView *view = [akAddressBook.sectionViewCache viewForSourceID: akAddressBook.sourceID
+                                                                 groupID: akAddressBook.groupID
+                                                            sortOrdering: snapshot.sortOrdering
+                                                              ofSnapshot: snapshot];
     
-    NSMutableDictionary *contactIDs = [[NSMutableDictionary alloc] initWithCapacity: [akAddressBook.hashTable count]];
-    NSMutableArray *keys = [[NSMutableArray alloc] init];
-    NSMutableSet *displayedContactIDs = [[NSMutableSet alloc] init];
+    self.contactIDs = view.contactIDs;
+    self.keys = view.keys;
+    self.displayedContactIDs = view.displayedContactIDs;
+    self.displayedRecordIDs = nil;
+    self.searchTerm = nil;
+    
+    if (self.facetFilters.count > 0)
+    {
+        [self applyFacetFilters];
+    }
+    
+    NSArray *viewKey = @[@(view.sourceID), @(view.groupID), @(view.sortOrdering), @(view.memberVersion), @(view.memberCount),
+                         (self.facetFilters) ? self.facetFilters : @{}, @(self.manifoldingPropertyID)];
+    [self invalidateFirstKeystrokeMatchesForView: viewKey ofSnapshot: snapshot];
+    if (!akAddressBook.isLoading)
+    {
+        [self precomputeFirstKeystrokeMatches];
+    }
+}
+
++ (NSArray *)firstKeystrokePrefixes
+{
+    static NSArray *prefixes = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSMutableArray *array = [[NSMutableArray alloc] init];
+        for (unichar character = 'A'; character <= 'Z'; ++character)
+        {
+            [array addObject: [NSString stringWithCharacters: &character length: 1]];
+        }
+        for (unichar character = '0'; character <= '9'; ++character)
+        {
+            [array addObject: [NSString stringWithCharacters: &character length: 1]];
+        }
+        prefixes = [array copy];
+    });
+    return prefixes;
+}
+
+/**
+ * Drops all matches if the view changed, otherwise only those of the sections that differ in the snapshot
+ */
+- (void)invalidateFirstKeystrokeMatchesForView: (NSArray *)viewKey ofSnapshot: (AKIndexSnapshot *)snapshot
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    BOOL viewChanged = ![viewKey isEqualToArray: self.firstKeystrokeViewKey];
+    self.firstKeystrokeViewKey = viewKey;
     
-    for (NSString *key in sectionKeys)
+    @synchronized(self.firstKeystrokeMatches)
     {
-        NSArray *arrayForKey = [akAddressBook.hashTable objectForKey: key];
-        NSMutableArray *sectionArray = [arrayForKey mutableCopy];
+        AKIndexSnapshot *previousSnapshot = self.firstKeystrokeSnapshot;
+        if (previousSnapshot == snapshot && !viewChanged) return;
+        self.firstKeystrokeSnapshot = snapshot;
+        self.firstKeystrokeGeneration += 1;
         
-        NSMutableArray *recordsToRemove = [[NSMutableArray alloc] init];
-        for (NSNumber *contactID in sectionArray)
+        if (viewChanged || !previousSnapshot || previousSnapshot.sortOrdering != snapshot.sortOrdering ||
+            (self.manifoldingPropertyID == kABPersonPhoneProperty &&
+             ![previousSnapshot.contactIDsWithoutPhoneNumber isEqualToSet: snapshot.contactIDsWithoutPhoneNumber]))
         {
-            if (![groupMembers member: contactID]) {
-                [recordsToRemove addObject: contactID];
-            }
+            [self.firstKeystrokeMatches removeAllObjects];
+            return;
         }
-        [sectionArray removeObjectsInArray: recordsToRemove];
-        [displayedContactIDs addObjectsFromArray: sectionArray];
         
-        if (sectionArray.count > 0)
+        BOOL(^sectionChanged)(NSDictionary *, NSDictionary *, NSString *) = ^(NSDictionary *sections, NSDictionary *previousSections, NSString *key) {
+            NSArray *sectionArray = [sections objectForKey: key], *previousArray = [previousSections objectForKey: key];
+            return (BOOL)(sectionArray != previousArray && ![sectionArray isEqualToArray: previousArray]);
+        };
+        for (NSString *prefix in [self.firstKeystrokeMatches allKeys])
         {
-            [contactIDs setObject: sectionArray forKey: key];
-            [keys addObject: key];
+            if (sectionChanged(snapshot.sectionsSortedByFirst, previousSnapshot.sectionsSortedByFirst, prefix) ||
+                sectionChanged(snapshot.sectionsSortedByLast, previousSnapshot.sectionsSortedByLast, prefix) ||
+                sectionChanged(snapshot.sectionsSortedByPhone, previousSnapshot.sectionsSortedByPhone, prefix))
+            {
+                [self.firstKeystrokeMatches removeObjectForKey: prefix];
+            }
         }
     }
+}
+
+- (void)precomputeFirstKeystrokeMatches
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    AKIndexSnapshot *snapshot;
+    NSUInteger generation;
+    @synchronized(self.firstKeystrokeMatches)
+    {
+        snapshot = self.firstKeystrokeSnapshot;
+        generation = self.firstKeystrokeGeneration;
+    }
+    NSSet *displayedContactIDs = self.displayedContactIDs;
+    if (!snapshot) return;
+    
+    dispatch_async(self.precompute_queue, ^{
+        for (NSString *prefix in [AKContactsTableViewDataSource firstKeystrokePrefixes])
+        {
+            @synchronized(self.firstKeystrokeMatches)
+            {
+                if (self.firstKeystrokeGeneration != generation) return; // Superseded by a newer precomputation
+                if ([self.firstKeystrokeMatches objectForKey: prefix]) continue;
+            }
+            
+            // Copying orders the lazily ranked results in full
+            NSArray *matches = [NSArray arrayWithArray: [self contactIDsHavingPrefix: prefix ofSnapshot: snapshot amongContactIDs: displayedContactIDs]];
+            
+            @synchronized(self.firstKeystrokeMatches)
+            {
+                if (self.firstKeystrokeGeneration != generation) return;
+                [self.firstKeystrokeMatches setObject: matches forKey: prefix];
+            }
+        }
+    });
+}
+
+- (void)applyFacetFilters
+{
+    AKSpanStart start = AKSpanBegin();
+    
+    AKFacetIndex *facetIndex = self.addressBook.facetIndex;
+    NSMutableIndexSet *recordIDs = nil;
+    for (NSNumber *facet in self.facetFilters)
+    {
+        NSIndexSet *posting = [facetIndex recordIDsWithValue: [self.facetFilters objectForKey: facet] ofFacet: facet.integerValue];
+        if (!recordIDs)
+        {
+            recordIDs = [posting mutableCopy];
+        }
+        else
+        {
+            NSMutableIndexSet *intersection = [[NSMutableIndexSet alloc] init];
+            [posting enumerateIndexesUsingBlock: ^(NSUInteger recordID, BOOL *stop) {
+                if ([recordIDs containsIndex: recordID]) [intersection addIndex: recordID];
+            }];
+            recordIDs = intersection;
+        }
+    }
+    
+    NSMutableDictionary *contactIDs = [[NSMutableDictionary alloc] initWithCapacity: self.contactIDs.count];
+    NSMutableArray *keys = [[NSMutableArray alloc] initWithCapacity: self.keys.count];
+    NSMutableSet *displayedContactIDs = [[NSMutableSet alloc] init];
+    for (NSString *key in self.keys)
+    {
+        NSIndexSet *indexes = [[self.contactIDs objectForKey: key] indexesOfObjectsPassingTest: ^BOOL(NSNumber *recordID, NSUInteger index, BOOL *stop) {
+            return [recordIDs containsIndex: recordID.unsignedIntegerValue];
+        }];
+        if (indexes.count == 0) continue;
+        
+        NSArray *sectionArray = [[self.contactIDs objectForKey: key] objectsAtIndexes: indexes];
+        [contactIDs setObject: sectionArray forKey: key];
+        [keys addObject: key];
+        [displayedContactIDs addObjectsFromArray: sectionArray];
+    }
     self.contactIDs = [contactIDs copy];
     self.keys = [keys copy];
     self.displayedContactIDs = [displayedContactIDs copy];
-    self.searchTerm = nil;
+    
+    AKSpanEnd(AKSpanFacetFilter, start);
+}
+
+- (NSDictionary *)countsOfFacet: (AKFacet)facet
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    if (!self.displayedRecordIDs)
+    {
+        NSMutableIndexSet *recordIDs = [[NSMutableIndexSet alloc] init];
+        for (NSNumber *recordID in self.displayedContactIDs)
+        {
+            [recordIDs addIndex: recordID.unsignedIntegerValue];
+        }
+        self.displayedRecordIDs = [recordIDs copy];
+    }
+    return [self.addressBook.facetIndex countsOfFacet: facet amongRecordIDs: self.displayedRecordIDs];
+}
+
+- (void)setContactIDs: (NSArray *)sectionArray forKey: (NSString *)key
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    NSMutableDictionary *contactIDs = [self.contactIDs mutableCopy];
+    [contactIDs setObject: [sectionArray copy] forKey: key];
+    self.contactIDs = [contactIDs copy];
 }
 
 - (void)handleSearchForTerm:(NSString *)searchTerm {
@@ -163,29 +465,28 @@
     // Don't trim trailing whitespace needed for tokenization
     searchTerm = [searchTerm stringByTrimmingLeadingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
     
-    NSString *previousSearchTerm = self.searchTerm;
+    NSString *previousSearchTerm = self.pendingSearchTerm;
+    self.pendingSearchTerm = searchTerm;
     NSString *commonPrefix = [previousSearchTerm commonPrefixWithString: searchTerm options: 0];
     NSInteger nextCharacterIndex = (searchTerm.length > 0) ? (searchTerm.length - 1) : 0;
     
-    if (commonPrefix.length < previousSearchTerm.length) {
-        self.shouldTerminate = YES;
-        
-        NSDate *start = [NSDate date];
-        dispatch_semaphore_wait([AKAddressBook sharedInstance].semaphore, DISPATCH_TIME_FOREVER);
-        NSLog(@"Semaphore raised in %.2f", fabs([[NSDate date] timeIntervalSinceDate: start]));
-        
-        self.shouldTerminate = NO;
-        
-        [self clearSearchStackFromIndex: commonPrefix.length];
-        
+    BOOL shouldClearSearchStack = (commonPrefix.length < previousSearchTerm.length);
+    if (shouldClearSearchStack) {
+        // Steps of the previous term that are still running or queued terminate early
+        OSAtomicIncrement32Barrier(&_searchGeneration);
         nextCharacterIndex = commonPrefix.length;
-        
-        dispatch_semaphore_signal([AKAddressBook sharedInstance].semaphore);
     }
+    int32_t generation = _searchGeneration;
+    AKSpanStart enqueued = AKSpanBegin();
     
     dispatch_block_t block = ^{
         
-        dispatch_semaphore_wait([AKAddressBook sharedInstance].semaphore, DISPATCH_TIME_FOREVER);
+        AKSpanEnd(AKSpanSearchQueueWait, enqueued);
+        self.activeSearchGeneration = generation;
+        
+        if (shouldClearSearchStack) {
+            [self clearSearchStackFromIndex: commonPrefix.length];
+        }
         
         if (searchTerm.length > 0) {
             if (searchTerm.length > self.searchStack.count)
@@ -196,10 +497,12 @@
                     
                     if (![character isMemberOfCharacterSet: [NSCharacterSet whitespaceCharacterSet]])
                     {
+                        AKSpanStart start = AKSpanBegin();
                         AKSearchStackElement *element = [self searchStackElementForTerm: searchTerm withCharacterIndex: index];
                         if (element) {
                             [self.searchStack addObject: element];
                         }
+                        AKSpanEnd(AKSpanSearchKeystroke, start);
                     }
                     else if (self.searchStack.count > 0)
                     {
@@ -208,6 +511,7 @@
                         AKSearchStackElement *element = [[AKSearchStackElement alloc] init];
                         element.character = character;
                         element.matches = [previousStackElement.matches copy];
+                        element.fuzzyMatches = previousStackElement.fuzzyMatches;
                         [self.searchStack addObject: element];
                     }
                 }
@@ -215,33 +519,33 @@
             
         }
         
-        if (self.searchStack.count > 0) {
-            self.searchTerm = searchTerm;
-            self.filteredContactIDs = [self.searchStack.lastObject matches];
-        }
-        else {
-            [self finishSearch];
-        }
-        
-        if ([self.delegate respondsToSelector: @selector(dataSourceDidEndSearch:)]) {
-            [self.delegate dataSourceDidEndSearch: self];
+        NSArray *matches = (self.searchStack.count > 0) ? [self.searchStack.lastObject results] : nil;
+        if (!matches) {
+            [self.searchStack removeAllObjects];
         }
         
-        dispatch_semaphore_signal([AKAddressBook sharedInstance].semaphore);
+        dispatch_async(dispatch_get_main_queue(), ^{
+            if (generation != _searchGeneration) {
+                return; // Superseded, a newer step delivers the results
+            }
+            self.searchTerm = (matches) ? searchTerm : nil;
+            self.filteredContactIDs = matches;
+            // Directory entries don't narrow with the local matches, the term is searched regardless
+            [self searchDirectoriesForTerm: searchTerm];
+            
+            if ([self.delegate respondsToSelector: @selector(dataSourceDidEndSearch:)]) {
+                [self.delegate dataSourceDidEndSearch: self];
+            }
+        });
     };
     
-    dispatch_async([AKAddressBook sharedInstance].serial_queue, block);
+    dispatch_async(self.search_queue, block);
 }
 
 - (void)clearSearchStackFromIndex: (NSInteger)clearStackFromIndex {
     if (clearStackFromIndex < self.searchStack.count) {
-        if (clearStackFromIndex == 0) {
-            [self finishSearch];
-        }
-        else {
-            NSRange range = NSMakeRange(clearStackFromIndex, self.searchStack.count - clearStackFromIndex);
-            [self.searchStack removeObjectsAtIndexes: [NSIndexSet indexSetWithIndexesInRange: range]];
-        }
+        NSRange range = NSMakeRange(clearStackFromIndex, self.searchStack.count - clearStackFromIndex);
+        [self.searchStack removeObjectsAtIndexes: [NSIndexSet indexSetWithIndexesInRange: range]];
     }
 }
 
@@ -256,136 +560,168 @@
         element = [[AKSearchStackElement alloc] init];
         element.character = character;
         
-        if (characterIndex == 0)
+        if (self.isKeypadSearchEnabled && self.manifoldingPropertyID == kABMultiValueInvalidIdentifier &&
+            [searchTerm isMemberOfCharacterSet: [NSCharacterSet decimalDigitCharacterSet]])
+        { // The index answers each keystroke directly, no need to filter the previous matches
+            element.matches = [self contactIDsMatchingKeypadDigits: searchTerm];
+            return element;
+        }
+        else if (characterIndex == 0)
         {
             element.character = character;
             element.matches = [self contactIDsHavingPrefix: character];
         }
         else
         {
-            NSArray *matchingIDs = [self.searchStack.lastObject matches];
-            matchingIDs = [self filterArray: matchingIDs withTerms: terms andSortOrdering: [AKAddressBook sharedInstance].sortOrdering];
+            __block NSArray *matchingIDs = [self.searchStack.lastObject unorderedMatches];
+            [self.addressBook.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+                matchingIDs = [self filterArray: matchingIDs withTerms: terms sortOrdering: self.addressBook.snapshot.sortOrdering andAddressBookRef: addressBookRef];
+            }];
             element.matches = [matchingIDs copy];
         }
+        
+        if (element.matches.count < self.fuzzyMatchingThreshold && self.manifoldingPropertyID == kABMultiValueInvalidIdentifier)
+        { // Exact prefix matching is the common path, only fall back to fuzzy when it yields too few results
+            element.fuzzyMatches = [self fuzzyMatchesForTerms: terms excludingContactIDs: element.matches];
+        }
     }
     return element;
 }
 
 - (NSArray *)contactIDsHavingPrefix: (NSString *)prefix
 {
-    NSArray *contactIDs;
+    AKIndexSnapshot *snapshot = self.addressBook.snapshot;
+    
+    if (self.searchStack.count == 0)
+    { // The first keystroke is a lookup once the displayed contacts were precomputed
+        @synchronized(self.firstKeystrokeMatches)
+        {
+            NSArray *matches = [self.firstKeystrokeMatches objectForKey: prefix.uppercaseString];
+            if (matches && self.firstKeystrokeSnapshot == snapshot) return matches;
+        }
+    }
+    
+    NSSet *contactIDs = (self.searchStack.count == 0) ? self.displayedContactIDs : [[NSSet alloc] initWithArray: [self.searchStack.lastObject unorderedMatches]];
+    return [self contactIDsHavingPrefix: prefix ofSnapshot: snapshot amongContactIDs: contactIDs];
+}
+
+- (NSArray *)contactIDsHavingPrefix: (NSString *)prefix ofSnapshot: (AKIndexSnapshot *)snapshot amongContactIDs: (NSSet *)contactIDs
+{
+    NSMutableSet *sectionSet;
     if ([prefix isMemberOfCharacterSet: [NSCharacterSet letterCharacterSet]])
     {
-        contactIDs = [self contactIDsHavingNamePrefix: prefix];
+        sectionSet = [[NSMutableSet alloc] initWithArray: [self contactIDsHavingNamePrefix: prefix ofSnapshot: snapshot]];
     }
     else
     {
-        contactIDs = [self contactIDsHavingNumberPrefix: prefix];
+        sectionSet = [[NSMutableSet alloc] initWithArray: [self contactIDsHavingNumberPrefix: prefix ofSnapshot: snapshot]];
     }
+    [sectionSet intersectSet: contactIDs];
     
     if (self.manifoldingPropertyID == kABPersonPhoneProperty) {
-        NSMutableSet *manifoldedSet = [[NSMutableSet alloc] initWithArray: contactIDs];
-        [manifoldedSet minusSet: [AKAddressBook sharedInstance].contactIDsWithoutPhoneNumber];
-        contactIDs = [manifoldedSet allObjects];
+        [sectionSet minusSet: snapshot.contactIDsWithoutPhoneNumber];
     }
+    NSArray *matches = [sectionSet allObjects];
     
-#if __IPHONE_OS_VERSION_MAX_ALLOWED >= 60000
-    CFErrorRef error = NULL;
-    ABAddressBookRef addressBookRef = ABAddressBookCreateWithOptions(NULL, &error);
-    if (error) { CFStringRef desc = CFErrorCopyDescription(error); NSLog(@"ABAddressBookCreateWithOptions (%ld): %@", CFErrorGetCode(error), desc); CFRelease(desc); error = NULL; }
-#else
-    ABAddressBookRef addressBookRef = ABAddressBookCreate();
-#endif
-    
-    contactIDs = [self sortedArray: contactIDs withAddressBookRef: addressBookRef];
-    
-    if (addressBookRef) {
-        CFRelease(addressBookRef);
+    // Contacts whose section in the displayed sort ordering matches the prefix come first
+    NSSet *primarySectionSet = [[NSSet alloc] initWithArray: [snapshot.sections objectForKey: prefix.uppercaseString]];
+    NSInteger *scores = malloc(sizeof(NSInteger) * MAX(matches.count, 1));
+    NSUInteger index = 0;
+    for (NSNumber *recordID in matches)
+    {
+        scores[index++] = ([primarySectionSet member: recordID]) ? 1 : 0;
     }
-    return contactIDs;
+    matches = [[AKRankedResults alloc] initWithRecordIDs: matches scores: scores ranks: snapshot.sortRanks pageSize: [AKRankedResults defaultPageSize]];
+    free(scores);
+    
+    return matches;
 }
 
-- (NSArray *)contactIDsHavingNamePrefix: (NSString *)prefix
+/**
+ * Contacts of the sections of the prefix in both sort orderings
+ */
+- (NSArray *)contactIDsHavingNamePrefix: (NSString *)prefix ofSnapshot: (AKIndexSnapshot *)snapshot
 {
     prefix = prefix.uppercaseString;
-    AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
     
-    NSArray *sectionArray = [akAddressBook.hashTableSortedByFirst objectForKey: prefix];
+    NSArray *sectionArray = [snapshot.sectionsSortedByFirst objectForKey: prefix];
     NSMutableSet *sectionSet = [NSMutableSet setWithArray: sectionArray];
     
-    NSArray *inverseSortedSectionArray = [akAddressBook.hashTableSortedByLast objectForKey: prefix];
+    NSArray *inverseSortedSectionArray = [snapshot.sectionsSortedByLast objectForKey: prefix];
     NSMutableSet *inverseSortedSectionSet = [NSMutableSet setWithArray: inverseSortedSectionArray];
     
     [sectionSet unionSet: inverseSortedSectionSet];
     
-    if (self.searchStack.count == 0) {
-        [sectionSet intersectSet: self.displayedContactIDs];
-    }
-    else {
-        NSSet *displayedContactIDs = [[NSSet alloc] initWithArray: [self.searchStack.lastObject matches]];
-        [sectionSet intersectSet: displayedContactIDs];
-    }
     return [sectionSet allObjects];
 }
 
-- (NSArray *)contactIDsHavingNumberPrefix: (NSString *)prefix
+/**
+ * Contacts of the sections of the prefix in both sort orderings and of the phone number section
+ */
+- (NSArray *)contactIDsHavingNumberPrefix: (NSString *)prefix ofSnapshot: (AKIndexSnapshot *)snapshot
 {
     prefix = prefix.uppercaseString;
-    AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
     
-    NSArray *sectionArraySortedByFirst = [akAddressBook.hashTableSortedByFirst objectForKey: prefix];
+    NSArray *sectionArraySortedByFirst = [snapshot.sectionsSortedByFirst objectForKey: prefix];
     NSMutableSet *sectionSet = [NSMutableSet setWithArray: sectionArraySortedByFirst];
     
-    NSArray *sectionArraySortedByLast = [akAddressBook.hashTableSortedByLast objectForKey: prefix];
+    NSArray *sectionArraySortedByLast = [snapshot.sectionsSortedByLast objectForKey: prefix];
     NSSet *sectionSetSortedByLast = [NSMutableSet setWithArray: sectionArraySortedByLast];
     
     [sectionSet unionSet: sectionSetSortedByLast];
     
-    NSArray *sectionArraySortedByPhone = [akAddressBook.hashTableSortedByPhone objectForKey: prefix];
+    NSArray *sectionArraySortedByPhone = [snapshot.sectionsSortedByPhone objectForKey: prefix];
     NSSet *sectionSetSortedByPhone = [NSMutableSet setWithArray: sectionArraySortedByPhone];
     
     [sectionSet unionSet: sectionSetSortedByPhone];
     
-    if (self.searchStack.count == 0) {
-        [sectionSet intersectSet: self.displayedContactIDs];
-    }
-    else {
-        NSSet *displayedContactIDs = [[NSSet alloc] initWithArray: [self.searchStack.lastObject matches]];
-        [sectionSet intersectSet: displayedContactIDs];
-    }
     return [sectionSet allObjects];
 }
 
-- (NSArray *)filterArray: (NSArray *)array withTerms:(NSArray *)terms andSortOrdering: (ABPersonSortOrdering)sortOrdering
+- (NSArray *)filterArray: (NSArray *)array withTerms:(NSArray *)terms sortOrdering: (ABPersonSortOrdering)sortOrdering andAddressBookRef: (ABAddressBookRef)addressBookRef
 {
-#if __IPHONE_OS_VERSION_MAX_ALLOWED >= 60000
-    CFErrorRef error = NULL;
-    ABAddressBookRef addressBookRef = ABAddressBookCreateWithOptions(NULL, &error);
-    if (error) { NSLog(@"Address book reference error (%ld): %@", CFErrorGetCode(error), CFErrorCopyDescription(error)); error = NULL; }
-#else
-    ABAddressBookRef addressBookRef = ABAddressBookCreate();
-#endif
+    AKSearchEntryIndex *searchEntryIndex = self.addressBook.searchEntryIndex;
+    
+    // Only read for contacts missing from the search entry index or to count properties other than phone numbers
+    AKContact *(^contactForRecordID)(NSNumber *) = ^(NSNumber *recordID) {
+        return [self.addressBook contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
+    };
     
     NSCountedSet *countedSet = [[NSCountedSet alloc] init];
+    NSMutableDictionary *scores = [[NSMutableDictionary alloc] init];
     for (NSNumber *recordID in array)
     {
-        if (self.shouldTerminate) {
-            NSLog(@"Terminating filterArray:withTerms:andSortOrdering:");
+        if (self.activeSearchGeneration != _searchGeneration) {
+            AKCounterAdd(AKCounterSearchTerminations, 1);
             break;
         }
-        AKContact *contact = [[AKAddressBook sharedInstance] contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
+        AKContact *contact = nil;
+        AKSearchEntry *entry = [searchEntryIndex entryForRecordID: recordID.intValue];
+        if (!entry) {
+            contact = contactForRecordID(recordID);
+            entry = (contact.recordRef) ? [AKSearchEntry entryWithContact: contact] : nil;
+        }
         
-        NSInteger matchingTerms = [contact numberOfMatchingTerms: terms];
-        if (self.manifoldingPropertyID != kABMultiValueInvalidIdentifier) {
-            NSInteger propertyCount = [contact countForLinkedMultiValueProperty: self.manifoldingPropertyID];
-            if (propertyCount == 0) { // Don't match contacts who doesn't have the properties of type manifoldingPropertyID
-                matchingTerms = 0;
-            }
+        NSInteger score = 0;
+        NSInteger matchingTerms = [entry numberOfMatchingTerms: terms score: &score];
+        
+        NSInteger propertyCount = 0;
+        if (self.manifoldingPropertyID == kABPersonPhoneProperty) {
+            propertyCount = entry.linkedPhoneNumbers.count;
+        }
+        else if (self.manifoldingPropertyID != kABMultiValueInvalidIdentifier) {
+            if (!contact) contact = contactForRecordID(recordID);
+            propertyCount = [contact countForLinkedMultiValueProperty: self.manifoldingPropertyID];
+        }
+        if (self.manifoldingPropertyID != kABMultiValueInvalidIdentifier && propertyCount == 0) {
+            // Don't match contacts who doesn't have the properties of type manifoldingPropertyID
+            matchingTerms = 0;
         }
         
-        NSArray *matchingPhoneIndexes = [contact indexesOfPhoneNumbersMatchingTerms: terms preciseMatch: NO];
+        NSArray *matchingPhoneIndexes = [entry indexesOfPhoneNumbersMatchingTerms: terms preciseMatch: NO];
         if (matchingPhoneIndexes.count > 0) {
             matchingTerms += 1;
+            score += 1;
         }
         
         if (matchingTerms == terms.count)
@@ -393,9 +729,10 @@
             NSUInteger count = (self.manifoldingPropertyID == kABMultiValueInvalidIdentifier) ? 1 : matchingPhoneIndexes.count;
             if (count == 0)
             {
-                count = [contact countForLinkedMultiValueProperty: self.manifoldingPropertyID];
+                count = propertyCount;
             }
             count -= [countedSet countForObject: recordID];
+            [scores setObject: @(score) forKey: recordID];
             
             for (NSUInteger index = 0; index < count; ++index)
             {
@@ -413,35 +750,165 @@
         }
     }
     
-    NSArray *sortedArray = [self sortedArray: manifoldedArray withAddressBookRef: addressBookRef];
-    
-    if (addressBookRef) {
-        CFRelease(addressBookRef);
+    NSInteger *manifoldedScores = malloc(sizeof(NSInteger) * MAX(manifoldedArray.count, 1));
+    for (NSUInteger index = 0; index < manifoldedArray.count; ++index)
+    {
+        manifoldedScores[index] = [[scores objectForKey: manifoldedArray[index]] integerValue];
     }
+    NSArray *rankedArray = [self rankedArray: manifoldedArray withScores: manifoldedScores];
+    free(manifoldedScores);
+    
     self.manifoldingPropertyID = kABMultiValueInvalidIdentifier;
     
-    return sortedArray;
+    return rankedArray;
 }
 
-- (NSArray *)sortedArray: (NSArray *)array withAddressBookRef: (ABAddressBookRef)addressBookRef
+- (NSArray *)fuzzyMatchesForTerms: (NSArray *)terms excludingContactIDs: (NSArray *)contactIDs
 {
-    NSMutableArray *sortedArray = [[NSMutableArray alloc] init];
-    for (NSNumber *recordID in array) {
-        if (self.shouldTerminate) {
-            NSLog(@"Terminating sortedArray:withAddressBookRef:");
-            break;
+    AKNameTokenIndex *nameTokenIndex = self.addressBook.nameTokenIndex;
+    
+    NSMutableSet *matches;
+    for (NSString *term in terms)
+    {
+        if (term.length < kFuzzyMinimumTermLength || [term isMemberOfCharacterSet: [NSCharacterSet decimalDigitCharacterSet]])
+        {
+            continue;
+        }
+        NSUInteger maximumDistance = (term.length < 6) ? 1 : 2;
+        NSSet *termMatches = [nameTokenIndex contactIDsMatchingPrefix: term maximumDistance: maximumDistance];
+        if (!matches)
+        {
+            matches = [termMatches mutableCopy];
+        }
+        else
+        {
+            [matches intersectSet: termMatches];
+        }
+    }
+    if (matches.count == 0) return nil;
+    
+    [matches intersectSet: self.displayedContactIDs];
+    [matches minusSet: [NSSet setWithArray: contactIDs]];
+    
+    return [self rankedArray: [matches allObjects] withScores: NULL];
+}
+
+- (NSArray *)contactIDsMatchingKeypadDigits: (NSString *)digits
+{
+    NSDictionary *matches = [self.addressBook.keypadIndex contactIDsMatchingDigits: digits];
+    
+    NSMutableArray *contactIDs = [[NSMutableArray alloc] initWithCapacity: matches.count];
+    NSInteger *scores = malloc(sizeof(NSInteger) * MAX(matches.count, 1));
+    for (NSNumber *recordID in matches)
+    {
+        if (![self.displayedContactIDs member: recordID]) continue;
+        
+        AKKeypadMatch match = [[matches objectForKey: recordID] unsignedIntegerValue];
+        scores[contactIDs.count] = ((match & AKKeypadMatchName) ? 2 : 0) + ((match & AKKeypadMatchNumber) ? 1 : 0);
+        [contactIDs addObject: recordID];
+    }
+    NSArray *rankedArray = [self rankedArray: contactIDs withScores: scores];
+    free(scores);
+    
+    return rankedArray;
+}
+
+- (NSArray *)rankedArray: (NSArray *)array withScores: (const NSInteger *)scores
+{
+    NSDictionary *sortRanks = self.addressBook.sortRanks;
+    return [[AKRankedResults alloc] initWithRecordIDs: array scores: scores ranks: sortRanks pageSize: [AKRankedResults defaultPageSize]];
+}
+
+- (void)searchDirectoriesForTerm: (NSString *)searchTerm
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    NSString *term = [searchTerm stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
+    if (term.length < kDirectoryMinimumTermLength) term = nil;
+    if (term == self.directorySearchTerm || [term isEqualToString: self.directorySearchTerm]) return;
+    
+    NSArray *directorySources = self.addressBook.directorySources;
+    if (self.directorySearchTerm)
+    {
+        for (AKDirectorySource *directorySource in directorySources)
+        {
+            [directorySource cancelSearchForTerm: self.directorySearchTerm];
         }
-        NSInteger index = [AKAddressBook indexOfRecordID: recordID.intValue inArray: sortedArray withSortOrdering: [AKAddressBook sharedInstance].sortOrdering andAddressBookRef: addressBookRef];
-        [sortedArray insertObject: recordID atIndex: index];
     }
-    return [sortedArray copy];
+    self.directorySearchTerm = term;
+    
+    NSMutableOrderedSet *entries = [[NSMutableOrderedSet alloc] init];
+    if (term)
+    {
+        for (AKDirectorySource *directorySource in directorySources)
+        {
+            NSArray *cachedEntries = [directorySource cachedEntriesForTerm: term];
+            if (cachedEntries)
+            {
+                [entries addObjectsFromArray: cachedEntries];
+            }
+            else
+            {
+                [directorySource searchForTerm: term pageIndex: 0 completionHandler: ^(NSArray *pageEntries, BOOL hasMorePages, NSError *error) {
+                    [self appendDirectoryEntries: pageEntries forTerm: term];
+                }];
+            }
+        }
+    }
+    
+    BOOL changed = (self.directoryEntries.count > 0 || entries.count > 0);
+    self.directoryEntries = (entries.count > 0) ? [entries array] : nil;
+    if (changed && [self.delegate respondsToSelector: @selector(dataSourceDidUpdateDirectoryEntries:)]) {
+        [self.delegate dataSourceDidUpdateDirectoryEntries: self];
+    }
+}
+
+- (void)appendDirectoryEntries: (NSArray *)entries forTerm: (NSString *)term
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    if (entries.count == 0 || ![term isEqualToString: self.directorySearchTerm]) return;
+    
+    // Entries are equal by identifier, directories may return an entry on more than one page
+    NSMutableOrderedSet *mergedEntries = [[NSMutableOrderedSet alloc] initWithArray: self.directoryEntries];
+    [mergedEntries addObjectsFromArray: entries];
+    self.directoryEntries = [mergedEntries array];
+    
+    if ([self.delegate respondsToSelector: @selector(dataSourceDidUpdateDirectoryEntries:)]) {
+        [self.delegate dataSourceDidUpdateDirectoryEntries: self];
+    }
+}
+
+- (BOOL)loadMoreDirectoryEntries
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    NSString *term = self.directorySearchTerm;
+    if (!term) return NO;
+    
+    BOOL ret = NO;
+    for (AKDirectorySource *directorySource in self.addressBook.directorySources)
+    {
+        ret |= [directorySource searchNextPageForTerm: term completionHandler: ^(NSArray *entries, BOOL hasMorePages, NSError *error) {
+            [self appendDirectoryEntries: entries forTerm: term];
+        }];
+    }
+    return ret;
 }
 
 - (void)finishSearch
 {
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    OSAtomicIncrement32Barrier(&_searchGeneration);
+    self.pendingSearchTerm = nil;
     self.filteredContactIDs = nil;
     self.searchTerm = nil;
-    [self.searchStack removeAllObjects];
+    [self searchDirectoriesForTerm: nil];
+    
+    dispatch_async(self.search_queue, ^{
+        [self.searchStack removeAllObjects];
+    });
 }
 
 - (NSMutableArray *)searchStack
@@ -32,12 +32,16 @@
 #import "AKContact.h"
 #import "AKContactPickerViewController.h"
 #import "AKContactViewController.h"
+#import "AKContactDetailModel.h"
 #import "AKGroup.h"
 #import "AKSource.h"
 #import "AKGroupPickerViewController.h"
 #import "AKGroupsViewController.h"
+#import "AKUpcomingEventsViewController.h"
 #import "AKContactPickerViewController.h"
 #import "AKAddressBook+Loader.h"
+#import "AKInstrumentation.h"
+#import "AKIndexSnapshot.h"
 
 #import <AddressBook/AddressBook.h>
 #import <AddressBookUI/AddressBookUI.h>
@@ -58,6 +62,10 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
 @property (strong, nonatomic) UITableView *tableView;
 @property (strong, nonatomic) UISearchBar *searchBar;
 @property (strong, nonatomic) AKContactsTableViewDataSource *dataSource;
+/**
+ * Contact whose detail model is being built before its view is pushed
+ */
+@property (assign, nonatomic) ABRecordID openingContactID;
 
 - (void)presentNewContactViewController;
 - (void)presentContactPickerViewController;
@@ -66,6 +74,11 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
 - (void)reloadTableViewData;
 - (void)toggleBackButton;
 - (void)setRightBarButtonItem;
+/**
+ * Upcoming events button when the view is the root of the navigation stack
+ */
+- (void)setLeftBarButtonItem;
+- (void)upcomingButtonTouchUpInside: (id)sender;
 /**
  * AKContactViewControllerDelegate
  */
@@ -101,6 +114,7 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     }
     self.tableView = [[UITableView alloc] initWithFrame: CGRectMake(0.f, 0.f, width, height) style: UITableViewStylePlain];
     self.dataSource = [[AKContactsTableViewDataSource alloc] init];
+    self.openingContactID = kABRecordInvalidID;
     self.dataSource.delegate = self;
     self.tableView.dataSource = self;
     self.tableView.delegate = self;
@@ -123,6 +137,8 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     
     [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(reloadTableViewData) name: AKContactPickerViewDidDismissNotification object: nil];
     
+    [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(reloadTableViewData) name: AKAddressBookSnapshotDidChangeNotification object: nil];
+    
     NSString *keyPath = NSStringFromSelector(@selector(status));
     [[AKAddressBook sharedInstance] addObserver: self
                                      forKeyPath: keyPath
@@ -131,7 +147,9 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     
     [AKAddressBook sharedInstance].presentationDelegate = self;
     
-    [self.dataSource loadData];
+    if (![self.dataSource loadDataFromDisplaySnapshot]) {
+        [self.dataSource loadData];
+    }
 }
 
 - (void)viewWillAppear:(BOOL)animated
@@ -142,6 +160,8 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     
     [self setRightBarButtonItem];
     
+    [self setLeftBarButtonItem];
+    
     if ([self.searchBar.text length] > 0)
     {
         [self.searchBar becomeFirstResponder];
@@ -311,6 +331,24 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     }
 }
 
+- (void)setLeftBarButtonItem
+{
+    if ([self.navigationController.viewControllers objectAtIndex: 0] == self)
+    { // Groups view offers the button otherwise
+        UIBarButtonItem *upcomingButton = [[UIBarButtonItem alloc] initWithTitle: NSLocalizedString(@"Upcoming", @"")
+                                                                           style: UIBarButtonItemStyleBordered
+                                                                          target: self
+                                                                          action: @selector(upcomingButtonTouchUpInside:)];
+        [self.navigationItem setLeftBarButtonItem: upcomingButton];
+    }
+}
+
+- (void)upcomingButtonTouchUpInside: (id)sender
+{
+    AKUpcomingEventsViewController *upcomingView = [[AKUpcomingEventsViewController alloc] init];
+    [self.navigationController pushViewController: upcomingView animated: YES];
+}
+
 - (void)reloadTableViewData
 {
     dispatch_block_t block = ^{
@@ -344,7 +382,8 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
     
     if ([akAddressBook hasStatus: kAddressBookOnline]  ||
-        [akAddressBook isLoading])
+        [akAddressBook isLoading] ||
+        self.dataSource.displaySnapshot)
         return (self.dataSource.displayedContactsCount > 0) ? [self.dataSource.keys count] : 1;
     else
         return 1;
@@ -358,7 +397,8 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
     
     if ([akAddressBook hasStatus: kAddressBookOnline]  ||
-        [akAddressBook isLoading])
+        [akAddressBook isLoading] ||
+        self.dataSource.displaySnapshot)
     {
         if (self.dataSource.displayedContactsCount > 0)
         {
@@ -378,7 +418,8 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     AKAddressBook *akAddressBook = [AKAddressBook sharedInstance];
     
     if ([akAddressBook hasStatus: kAddressBookOnline]  ||
-        [akAddressBook isLoading])
+        [akAddressBook isLoading] ||
+        self.dataSource.displaySnapshot)
     {
         if (self.dataSource.displayedContactsCount == 0)
         {
@@ -458,15 +499,33 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     return indexPath;
 }
 
-- (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath
+- (BOOL)tableView:(UITableView *)tableView shouldHighlightRowAtIndexPath:(NSIndexPath *)indexPath
 {
     UITableViewCell *cell = [tableView cellForRowAtIndexPath: indexPath];
     
     if (cell.tag != NSNotFound)
+    { // Touch down precedes selection, start building the detail model
+        [AKContactDetailModel prefetchModelForRecordID: (ABRecordID)cell.tag];
+    }
+    return YES;
+}
+
+- (void)tableView:(UITableView *)tableView didSelectRowAtIndexPath:(NSIndexPath *)indexPath
+{
+    UITableViewCell *cell = [tableView cellForRowAtIndexPath: indexPath];
+    
+    if (cell.tag != NSNotFound && self.openingContactID == kABRecordInvalidID)
     {
-        AKContactViewController *contactView = [[AKContactViewController alloc ] initWithContactID: (ABRecordID)cell.tag];
-        [contactView setDelegate: self];
-        [self.navigationController pushViewController: contactView animated: YES];
+        ABRecordID contactID = (ABRecordID)cell.tag;
+        [self setOpeningContactID: contactID];
+        
+        [AKContactDetailModel loadModelForRecordID: contactID completionHandler: ^(AKContactDetailModel *model) {
+            [self setOpeningContactID: kABRecordInvalidID];
+            
+            AKContactViewController *contactView = [[AKContactViewController alloc ] initWithContactID: contactID detailModel: model];
+            [contactView setDelegate: self];
+            [self.navigationController pushViewController: contactView animated: YES];
+        }];
     }
     
     [tableView deselectRowAtIndexPath: indexPath animated: YES];
@@ -647,49 +706,54 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
 - (void)addressBookWillBeginUpdates: (AKAddressBook *)addressBook
 {
     dispatch_async(dispatch_get_main_queue(), ^{
+        AKSpanStart start = AKSpanBegin();
         [self.tableView beginUpdates];
+        AKSpanEnd(AKSpanMainThreadDelegate, start);
     });
 }
 
 - (void)addressBook: (AKAddressBook *)addressBook didInsertRecordID: (ABRecordID)recordID
 {
     dispatch_block_t block = ^{
+        AKSpanStart start = AKSpanBegin();
         AKContact *contact = [addressBook contactForContactId: recordID];
-        NSString *sectionKey = [AKContact sectionKeyForName: [contact nameToDetermineSectionForSortOrdering: addressBook.sortOrdering]];
+        NSString *sectionKey = [AKContact sectionKeyForName: [contact nameToDetermineSectionForSortOrdering: addressBook.snapshot.sortOrdering]];
         
-        NSMutableArray *sectionArray = [self.dataSource.contactIDs objectForKey: sectionKey];
+        NSMutableArray *sectionArray = [[self.dataSource.contactIDs objectForKey: sectionKey] mutableCopy];
         
         NSUInteger row = [AKAddressBook indexOfRecordID: recordID inArray: sectionArray
-                                       withSortOrdering: addressBook.sortOrdering
+                                       withSortOrdering: addressBook.snapshot.sortOrdering
                                       andAddressBookRef: contact.addressBookRef];
         
         [sectionArray insertObject: @(recordID) atIndex: row];
+        [self.dataSource setContactIDs: sectionArray forKey: sectionKey];
         
         NSUInteger section = [self.dataSource.keys indexOfObject: sectionKey];
         NSArray *sections = @[[NSIndexPath indexPathForRow: row inSection: section]];
         [self.tableView insertRowsAtIndexPaths: sections withRowAnimation: UITableViewRowAnimationAutomatic];
+        AKSpanEnd(AKSpanMainThreadDelegate, start);
     };
     dispatch_async(dispatch_get_main_queue(), block);
 }
 
-- (void)addressBook: (AKAddressBook *)addressBook didRemoveRecordID: (ABRecordID)recordID
+- (void)addressBook: (AKAddressBook *)addressBook didRemoveRecordID: (ABRecordID)recordID fromSectionWithKey: (NSString *)sectionKey
 {
     dispatch_block_t block = ^{
-        for (NSString *key in self.dataSource.contactIDs)
+        AKSpanStart start = AKSpanBegin();
+        NSArray *sectionArray = (sectionKey) ? [self.dataSource.contactIDs objectForKey: sectionKey] : nil;
+        NSUInteger row = [sectionArray indexOfObject: @(recordID)];
+        if (sectionArray && row != NSNotFound)
         {
-            NSMutableArray *sectionArray = [self.dataSource.contactIDs objectForKey: key];
-            NSUInteger row = [sectionArray indexOfObject: @(recordID)];
-            if (row != NSNotFound)
-            {
-                NSUInteger section = [self.dataSource.keys indexOfObject: key];
-                
-                NSArray *sections = @[[NSIndexPath indexPathForRow: row inSection: section]];
-                [sectionArray removeObjectAtIndex: row];
-                
-                [self.tableView deleteRowsAtIndexPaths: sections withRowAnimation: UITableViewRowAnimationAutomatic];
-                break;
-            }
+            NSUInteger section = [self.dataSource.keys indexOfObject: sectionKey];
+            
+            NSArray *sections = @[[NSIndexPath indexPathForRow: row inSection: section]];
+            NSMutableArray *mutableSectionArray = [sectionArray mutableCopy];
+            [mutableSectionArray removeObjectAtIndex: row];
+            [self.dataSource setContactIDs: mutableSectionArray forKey: sectionKey];
+            
+            [self.tableView deleteRowsAtIndexPaths: sections withRowAnimation: UITableViewRowAnimationAutomatic];
         }
+        AKSpanEnd(AKSpanMainThreadDelegate, start);
     };
     dispatch_async(dispatch_get_main_queue(), block);
 }
@@ -697,7 +761,9 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
 - (void)addressBookDidEndUpdates: (AKAddressBook *)addressBook
 {
     dispatch_async(dispatch_get_main_queue(), ^{
+        AKSpanStart start = AKSpanBegin();
         [self.tableView endUpdates];
+        AKSpanEnd(AKSpanMainThreadDelegate, start);
     });
 }
 
@@ -725,4 +791,9 @@ typedef NS_ENUM(NSInteger, ActionSheetButtons)
     });
 }
 
+- (void)dataSourceDidUpdateDirectoryEntries: (AKContactsTableViewDataSource *)dataSource
+{
+    [self.tableView reloadData];
+}
+
 @end
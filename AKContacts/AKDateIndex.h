@@ -0,0 +1,73 @@
+//
+//  AKDateIndex.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKContactIndex.h"
+
+/**
+ * Birthday or date of a contact
+ */
+@interface AKDateEvent : NSObject
+
+@property (assign, nonatomic, readonly) ABRecordID recordID;
+/**
+ * Identifier of the value of kABPersonDateProperty
+ * kABMultiValueInvalidIdentifier for the birthday
+ */
+@property (assign, nonatomic, readonly) ABMultiValueIdentifier identifier;
+@property (assign, nonatomic, readonly) NSInteger month;
+@property (assign, nonatomic, readonly) NSInteger day;
+/**
+ * 0 if the year is unknown
+ */
+@property (assign, nonatomic, readonly) NSInteger year;
+/**
+ * Number of days from the start of the query to the next occurrence of the event
+ * Set on the events returned by eventsFromDate:numberOfDays:
+ */
+@property (assign, nonatomic, readonly) NSUInteger daysAhead;
+
+- (BOOL)isBirthday;
+
+@end
+
+/**
+ * Birthdays and dates of contacts bucketed by their day of the year
+ * Buckets follow a leap year, dates on February 29 occur on February 28
+ * in other years
+ */
+@interface AKDateIndex : NSObject <AKContactIndex>
+
+/**
+ * AKDateEvent occurring in numberOfDays starting with the day of date
+ * in the current calendar, ordered by their next occurrence.
+ * Ranges wrap around the end of the year and are capped at a year
+ */
+- (NSArray *)eventsFromDate: (NSDate *)date numberOfDays: (NSUInteger)numberOfDays;
+
+@end
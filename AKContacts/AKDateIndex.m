@@ -0,0 +1,225 @@
+//
+//  AKDateIndex.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKDateIndex.h"
+#import "AKSearchEntryIndex.h"
+
+static const NSInteger kDateIndexDayCount = 366;
+static const NSInteger kDateIndexFebruary28 = 58;
+static const NSInteger kDateIndexFebruary29 = 59;
+
+/**
+ * Day of a leap year, 0 based
+ */
+NS_INLINE NSInteger AKDateIndexOrdinal(NSInteger month, NSInteger day)
+{
+    static const NSInteger daysBeforeMonth[] = { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335 };
+    if (month < 1 || month > 12 || day < 1 || day > 31) return NSNotFound;
+    return daysBeforeMonth[month - 1] + day - 1;
+}
+
+NS_INLINE BOOL AKDateIndexIsLeapYear(NSInteger year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+#pragma mark - AKDateEvent
+
+@interface AKDateEvent ()
+
+@property (assign, nonatomic, readwrite) ABRecordID recordID;
+@property (assign, nonatomic, readwrite) ABMultiValueIdentifier identifier;
+@property (assign, nonatomic, readwrite) NSInteger month;
+@property (assign, nonatomic, readwrite) NSInteger day;
+@property (assign, nonatomic, readwrite) NSInteger year;
+@property (assign, nonatomic, readwrite) NSUInteger daysAhead;
+
+@end
+
+@implementation AKDateEvent
+
+- (BOOL)isBirthday
+{
+    return (self.identifier == kABMultiValueInvalidIdentifier);
+}
+
+- (AKDateEvent *)eventWithDaysAhead: (NSUInteger)daysAhead
+{
+    AKDateEvent *event = [[AKDateEvent alloc] init];
+    event.recordID = self.recordID;
+    event.identifier = self.identifier;
+    event.month = self.month;
+    event.day = self.day;
+    event.year = self.year;
+    event.daysAhead = daysAhead;
+    return event;
+}
+
+@end
+
+#pragma mark - AKDateIndex
+
+@interface AKDateIndex ()
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+/**
+ * Arrays of AKDateEvent indexed by the day of a leap year
+ */
+@property (strong, nonatomic) NSArray *buckets;
+/**
+ * Arrays of AKDateEvent keyed by contactID, empty for contacts without dates
+ */
+@property (strong, nonatomic) NSMutableDictionary *records;
+
+@end
+
+@implementation AKDateIndex
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _queue = dispatch_queue_create([NSStringFromClass([AKDateIndex class]) UTF8String], DISPATCH_QUEUE_CONCURRENT);
+        _records = [[NSMutableDictionary alloc] init];
+        
+        NSMutableArray *buckets = [[NSMutableArray alloc] initWithCapacity: kDateIndexDayCount];
+        for (NSInteger ordinal = 0; ordinal < kDateIndexDayCount; ++ordinal)
+        {
+            [buckets addObject: [[NSMutableArray alloc] init]];
+        }
+        _buckets = [buckets copy];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+    dispatch_sync(self.queue, ^{
+        count = self.records.count;
+    });
+    return count;
+}
+
+- (void)insertSearchEntry: (AKSearchEntry *)entry
+{
+    NSMutableArray *events = [[NSMutableArray alloc] init];
+    for (NSArray *date in entry.dates)
+    {
+        if (date.count != 4) continue;
+        
+        AKDateEvent *event = [[AKDateEvent alloc] init];
+        event.recordID = entry.recordID;
+        event.identifier = [[date objectAtIndex: 0] intValue];
+        event.month = [[date objectAtIndex: 1] integerValue];
+        event.day = [[date objectAtIndex: 2] integerValue];
+        event.year = [[date objectAtIndex: 3] integerValue];
+        if (AKDateIndexOrdinal(event.month, event.day) != NSNotFound) [events addObject: event];
+    }
+    
+    NSNumber *recordID = @(entry.recordID);
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: recordID];
+        
+        for (AKDateEvent *event in events)
+        {
+            [[self.buckets objectAtIndex: AKDateIndexOrdinal(event.month, event.day)] addObject: event];
+        }
+        [self.records setObject: [events copy] forKey: recordID];
+    });
+}
+
+- (void)removeRecordID: (ABRecordID)recordID
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: @(recordID)];
+    });
+}
+
+- (void)removeAllRecords
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self.records removeAllObjects];
+        for (NSMutableArray *bucket in self.buckets)
+        {
+            [bucket removeAllObjects];
+        }
+    });
+}
+
+- (void)unindexRecordID: (NSNumber *)recordID
+{
+    for (AKDateEvent *event in [self.records objectForKey: recordID])
+    {
+        [[self.buckets objectAtIndex: AKDateIndexOrdinal(event.month, event.day)] removeObjectIdenticalTo: event];
+    }
+    [self.records removeObjectForKey: recordID];
+}
+
+- (NSArray *)eventsFromDate: (NSDate *)date numberOfDays: (NSUInteger)numberOfDays
+{
+    NSDateComponents *components = [[NSCalendar currentCalendar] components: NSYearCalendarUnit | NSMonthCalendarUnit | NSDayCalendarUnit fromDate: date];
+    NSInteger startOrdinal = AKDateIndexOrdinal(components.month, components.day);
+    if (startOrdinal == NSNotFound) return @[];
+    
+    NSMutableArray *events = [[NSMutableArray alloc] init];
+    dispatch_sync(self.queue, ^{
+        void (^appendBucket)(NSInteger, NSUInteger) = ^(NSInteger ordinal, NSUInteger daysAhead) {
+            for (AKDateEvent *event in [self.buckets objectAtIndex: ordinal])
+            {
+                [events addObject: [event eventWithDaysAhead: daysAhead]];
+            }
+        };
+        
+        NSInteger year = components.year, ordinal = startOrdinal;
+        NSUInteger daysAhead = 0;
+        // Each day of the leap year is visited at most once
+        for (NSInteger visited = 0; visited < kDateIndexDayCount && daysAhead < numberOfDays; ++visited)
+        {
+            BOOL isLeapYear = AKDateIndexIsLeapYear(year);
+            if (ordinal != kDateIndexFebruary29 || isLeapYear)
+            {
+                appendBucket(ordinal, daysAhead);
+                if (ordinal == kDateIndexFebruary28 && !isLeapYear && startOrdinal != kDateIndexFebruary29)
+                {
+                    appendBucket(kDateIndexFebruary29, daysAhead);
+                }
+                ++daysAhead;
+            }
+            if (++ordinal == kDateIndexDayCount)
+            {
+                ordinal = 0;
+                ++year;
+            }
+        }
+    });
+    return [events copy];
+}
+
+@end
@@ -0,0 +1,125 @@
+//
+//  AKDirectorySource.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * A person found in a remote directory (eg: Exchange Global Address List).
+ * Directory entries are not ABRecords, they are shown next to local contacts
+ */
+@interface AKDirectoryEntry : NSObject
+
+/**
+ * Identifier of the entry in the directory, unique within the directory
+ */
+@property (copy, nonatomic, readonly) NSString *identifier;
+@property (copy, nonatomic, readonly) NSString *displayName;
+@property (copy, nonatomic, readonly) NSString *firstName;
+@property (copy, nonatomic, readonly) NSString *lastName;
+@property (copy, nonatomic, readonly) NSString *organization;
+@property (copy, nonatomic, readonly) NSString *jobTitle;
+@property (copy, nonatomic, readonly) NSString *emailAddress;
+@property (copy, nonatomic, readonly) NSString *phoneNumber;
+
+/**
+ * Dictionary with keys matching the property names. Nil without identifier
+ */
++ (instancetype)entryWithDictionary: (NSDictionary *)dictionary;
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
+/**
+ * Transport of directory queries. Replace with AKLocalDirectoryTransport to
+ * run against a local fake server
+ */
+@protocol AKDirectoryTransport <NSObject>
+
+/**
+ * Query one page of the entries matching term. The completion handler may be
+ * called on any queue with an array of AKDirectoryEntry, whether the directory
+ * has more pages of entries, or an error
+ */
+- (void)searchDirectoryForTerm: (NSString *)term
+                     pageIndex: (NSUInteger)pageIndex
+                      pageSize: (NSUInteger)pageSize
+             completionHandler: (void (^)(NSArray *entries, BOOL hasMorePages, NSError *error))completionHandler;
+/**
+ * Cancel queries of term not completed yet. Their completion handler is not called
+ */
+- (void)cancelSearchForTerm: (NSString *)term;
+
+@end
+
+/**
+ * Asynchronous search of a remote directory. Results are cached for timeToLive
+ * seconds and a query of a page that is already in flight is not sent again,
+ * its completion handlers are called when the first query completes
+ */
+@interface AKDirectorySource : NSObject
+
+/**
+ * RecordID of the ABSource of the directory
+ */
+@property (assign, nonatomic, readonly) ABRecordID sourceID;
+@property (copy, nonatomic, readonly) NSString *name;
+@property (strong, nonatomic, readonly) id<AKDirectoryTransport> transport;
+/**
+ * Default value is 50
+ */
+@property (assign) NSUInteger pageSize;
+/**
+ * Seconds a page of results is served from the cache. Default value is 300
+ */
+@property (assign) NSTimeInterval timeToLive;
+
+- (instancetype)initWithSourceID: (ABRecordID)sourceID name: (NSString *)name transport: (id<AKDirectoryTransport>)transport;
+/**
+ * Entries of the consecutive cached pages of term from the first. Does not
+ * block on the network
+ */
+- (NSArray *)cachedEntriesForTerm: (NSString *)term;
+/**
+ * Entries of the page, from the cache if not expired, from the transport
+ * otherwise. The completion handler is called on the main queue
+ */
+- (void)searchForTerm: (NSString *)term
+            pageIndex: (NSUInteger)pageIndex
+    completionHandler: (void (^)(NSArray *entries, BOOL hasMorePages, NSError *error))completionHandler;
+/**
+ * Query the page following the consecutive cached pages of term. Returns NO
+ * if the last cached page is the last page of the directory
+ */
+- (BOOL)searchNextPageForTerm: (NSString *)term completionHandler: (void (^)(NSArray *entries, BOOL hasMorePages, NSError *error))completionHandler;
+/**
+ * Drop the completion handlers of queries of term in flight
+ */
+- (void)cancelSearchForTerm: (NSString *)term;
+- (void)removeAllCachedEntries;
+
+@end
@@ -0,0 +1,309 @@
+//
+//  AKDirectorySource.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKDirectorySource.h"
+#import "AKCacheRegistry.h"
+
+static NSString *const AKDirectoryEntryIdentifierKey = @"identifier";
+/**
+ * Estimated size of a cached AKDirectoryEntry in bytes
+ */
+static const NSUInteger kDirectoryEntryCost = 512;
+
+@interface AKDirectoryEntry ()
+
+@property (copy, nonatomic) NSString *identifier;
+@property (copy, nonatomic) NSString *displayName;
+@property (copy, nonatomic) NSString *firstName;
+@property (copy, nonatomic) NSString *lastName;
+@property (copy, nonatomic) NSString *organization;
+@property (copy, nonatomic) NSString *jobTitle;
+@property (copy, nonatomic) NSString *emailAddress;
+@property (copy, nonatomic) NSString *phoneNumber;
+
++ (NSArray *)propertyNames;
+
+@end
+
+@implementation AKDirectoryEntry
+
++ (NSArray *)propertyNames
+{
+    return @[AKDirectoryEntryIdentifierKey, @"displayName", @"firstName", @"lastName", @"organization", @"jobTitle", @"emailAddress", @"phoneNumber"];
+}
+
++ (instancetype)entryWithDictionary: (NSDictionary *)dictionary
+{
+    NSString *identifier = [dictionary objectForKey: AKDirectoryEntryIdentifierKey];
+    if (![identifier isKindOfClass: [NSString class]] || identifier.length == 0) return nil;
+    
+    AKDirectoryEntry *entry = [[AKDirectoryEntry alloc] init];
+    for (NSString *key in [AKDirectoryEntry propertyNames])
+    {
+        id value = [dictionary objectForKey: key];
+        if ([value isKindOfClass: [NSString class]])
+        {
+            [entry setValue: value forKey: key];
+        }
+    }
+    if (!entry.displayName)
+    {
+        NSMutableArray *names = [[NSMutableArray alloc] init];
+        if (entry.firstName) [names addObject: entry.firstName];
+        if (entry.lastName) [names addObject: entry.lastName];
+        entry.displayName = (names.count > 0) ? [names componentsJoinedByString: @" "] : entry.emailAddress;
+    }
+    return entry;
+}
+
+- (NSDictionary *)dictionaryRepresentation
+{
+    return [self dictionaryWithValuesForKeys: [AKDirectoryEntry propertyNames]];
+}
+
+- (BOOL)isEqual: (id)object
+{
+    if (![object isKindOfClass: [AKDirectoryEntry class]]) return NO;
+    return [self.identifier isEqualToString: [(AKDirectoryEntry *)object identifier]];
+}
+
+- (NSUInteger)hash
+{
+    return self.identifier.hash;
+}
+
+@end
+
+/**
+ * A page of results as returned by the transport
+ */
+@interface AKDirectoryPage : NSObject
+
+@property (strong, nonatomic) NSArray *entries;
+@property (assign, nonatomic) BOOL hasMorePages;
+@property (strong, nonatomic) NSDate *dateLoaded;
+
+@end
+
+@implementation AKDirectoryPage
+
+@end
+
+@interface AKDirectorySource ()
+
+@property (assign, nonatomic) ABRecordID sourceID;
+@property (copy, nonatomic) NSString *name;
+@property (strong, nonatomic) id<AKDirectoryTransport> transport;
+/**
+ * AKDirectoryPage keyed by page key. Evicted under memory pressure
+ */
+@property (strong, nonatomic) AKCache *pageCache;
+/**
+ * Arrays of completion handlers keyed by page key of queries in flight.
+ * Only accessed on directory_queue
+ */
+@property (strong, nonatomic) NSMutableDictionary *pendingHandlers;
+@property (strong, nonatomic) dispatch_queue_t directory_queue;
+
++ (NSString *)normalizedTerm: (NSString *)term;
++ (NSString *)pageKeyForTerm: (NSString *)term pageIndex: (NSUInteger)pageIndex;
+/**
+ * Nil if the page is not cached or expired
+ */
+- (AKDirectoryPage *)unexpiredPageForKey: (NSString *)pageKey;
+
+@end
+
+@implementation AKDirectorySource
+
++ (NSString *)normalizedTerm: (NSString *)term
+{
+    term = [term stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceAndNewlineCharacterSet]];
+    return [term stringByFoldingWithOptions: NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch locale: [NSLocale currentLocale]];
+}
+
++ (NSString *)pageKeyForTerm: (NSString *)term pageIndex: (NSUInteger)pageIndex
+{
+    return [NSString stringWithFormat: @"%lu\n%@", (unsigned long)pageIndex, term];
+}
+
+- (instancetype)initWithSourceID: (ABRecordID)sourceID name: (NSString *)name transport: (id<AKDirectoryTransport>)transport
+{
+    self = [super init];
+    if (self)
+    {
+        _sourceID = sourceID;
+        _name = [name copy];
+        _transport = transport;
+        _pageSize = 50;
+        _timeToLive = 300.0;
+        
+        NSString *cacheName = [NSString stringWithFormat: @"directoryPages.%d", sourceID];
+        _pageCache = [[AKCache alloc] initWithName: cacheName priority: AKCachePriorityLow];
+        [_pageCache setCountLimit: 256];
+        _pendingHandlers = [[NSMutableDictionary alloc] init];
+        
+        NSString *label = [NSString stringWithFormat: @"%@.%d", NSStringFromClass([AKDirectorySource class]), sourceID];
+        _directory_queue = dispatch_queue_create([label UTF8String], DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (AKDirectoryPage *)unexpiredPageForKey: (NSString *)pageKey
+{
+    AKDirectoryPage *page = [self.pageCache objectForKey: pageKey];
+    if (page && -[page.dateLoaded timeIntervalSinceNow] > self.timeToLive)
+    {
+        [self.pageCache removeObjectForKey: pageKey];
+        page = nil;
+    }
+    return page;
+}
+
+- (NSArray *)cachedEntriesForTerm: (NSString *)term
+{
+    term = [AKDirectorySource normalizedTerm: term];
+    if (term.length == 0) return nil;
+    
+    NSMutableArray *entries = nil;
+    NSUInteger pageIndex = 0;
+    AKDirectoryPage *page;
+    while ((page = [self unexpiredPageForKey: [AKDirectorySource pageKeyForTerm: term pageIndex: pageIndex]]))
+    {
+        if (!entries) entries = [[NSMutableArray alloc] init];
+        [entries addObjectsFromArray: page.entries];
+        if (!page.hasMorePages) break;
+        ++pageIndex;
+    }
+    return [entries copy];
+}
+
+- (void)searchForTerm: (NSString *)term
+            pageIndex: (NSUInteger)pageIndex
+    completionHandler: (void (^)(NSArray *, BOOL, NSError *))completionHandler
+{
+    term = [AKDirectorySource normalizedTerm: term];
+    if (term.length == 0 || !completionHandler) return;
+    
+    NSString *pageKey = [AKDirectorySource pageKeyForTerm: term pageIndex: pageIndex];
+    
+    AKDirectoryPage *page = [self unexpiredPageForKey: pageKey];
+    if (page)
+    {
+        dispatch_async(dispatch_get_main_queue(), ^{
+            completionHandler(page.entries, page.hasMorePages, nil);
+        });
+        return;
+    }
+    
+    dispatch_async(self.directory_queue, ^{
+        
+        NSMutableArray *handlers = [self.pendingHandlers objectForKey: pageKey];
+        if (handlers)
+        { // The same page is in flight, wait for its result
+            [handlers addObject: [completionHandler copy]];
+            return;
+        }
+        handlers = [[NSMutableArray alloc] initWithObjects: [completionHandler copy], nil];
+        [self.pendingHandlers setObject: handlers forKey: pageKey];
+        
+        [self.transport searchDirectoryForTerm: term pageIndex: pageIndex pageSize: self.pageSize completionHandler: ^(NSArray *entries, BOOL hasMorePages, NSError *error) {
+            
+            dispatch_async(self.directory_queue, ^{
+                
+                NSArray *handlers = [self.pendingHandlers objectForKey: pageKey];
+                [self.pendingHandlers removeObjectForKey: pageKey];
+                
+                if (error)
+                {
+                    NSLog(@"Directory search of %@ (%ld): %@", self.name, (long)error.code, error.localizedDescription);
+                }
+                else
+                {
+                    AKDirectoryPage *page = [[AKDirectoryPage alloc] init];
+                    page.entries = [entries copy];
+                    page.hasMorePages = hasMorePages;
+                    page.dateLoaded = [NSDate date];
+                    [self.pageCache setObject: page forKey: pageKey cost: page.entries.count * kDirectoryEntryCost];
+                }
+                
+                if (handlers.count == 0) return; // Cancelled, the result is cached if it arrived anyway
+                
+                dispatch_async(dispatch_get_main_queue(), ^{
+                    for (void (^handler)(NSArray *, BOOL, NSError *) in handlers)
+                    {
+                        handler(entries, hasMorePages, error);
+                    }
+                });
+            });
+        }];
+    });
+}
+
+- (BOOL)searchNextPageForTerm: (NSString *)term completionHandler: (void (^)(NSArray *, BOOL, NSError *))completionHandler
+{
+    NSString *normalizedTerm = [AKDirectorySource normalizedTerm: term];
+    
+    NSUInteger pageIndex = 0;
+    AKDirectoryPage *page;
+    while ((page = [self unexpiredPageForKey: [AKDirectorySource pageKeyForTerm: normalizedTerm pageIndex: pageIndex]]))
+    {
+        if (!page.hasMorePages) return NO;
+        ++pageIndex;
+    }
+    [self searchForTerm: term pageIndex: pageIndex completionHandler: completionHandler];
+    return YES;
+}
+
+- (void)cancelSearchForTerm: (NSString *)term
+{
+    term = [AKDirectorySource normalizedTerm: term];
+    if (term.length == 0) return;
+    
+    dispatch_async(self.directory_queue, ^{
+        
+        NSString *suffix = [@"\n" stringByAppendingString: term];
+        NSMutableArray *pageKeys = [[NSMutableArray alloc] init];
+        for (NSString *pageKey in self.pendingHandlers)
+        {
+            if ([pageKey hasSuffix: suffix]) [pageKeys addObject: pageKey];
+        }
+        if (pageKeys.count > 0)
+        {
+            [self.pendingHandlers removeObjectsForKeys: pageKeys];
+            [self.transport cancelSearchForTerm: term];
+        }
+    });
+}
+
+- (void)removeAllCachedEntries
+{
+    [self.pageCache removeAllObjects];
+}
+
+@end
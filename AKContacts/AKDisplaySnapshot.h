@@ -0,0 +1,97 @@
+//
+//  AKDisplaySnapshot.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+@class AKIndexSnapshot;
+
+/**
+ * What the contacts list shows for one source and group: section keys,
+ * contactIDs per section, display names and the range of each name shown
+ * in bold. Persisted after loading so that the next launch can paint the
+ * list before ABAddressBook is accessed
+ */
+@interface AKDisplaySnapshot : NSObject
+
+@property (assign, nonatomic, readonly) ABRecordID sourceID;
+@property (assign, nonatomic, readonly) ABRecordID groupID;
+@property (assign, nonatomic, readonly) ABPersonSortOrdering sortOrdering;
+@property (assign, nonatomic, readonly) ABPersonCompositeNameFormat compositeNameFormat;
+/**
+ * Section keys in display order
+ */
+@property (strong, nonatomic, readonly) NSArray *keys;
+/**
+ * Arrays of contactIDs keyed by section key
+ */
+@property (strong, nonatomic, readonly) NSDictionary *contactIDs;
+@property (strong, nonatomic, readonly) NSSet *memberIDs;
+
++ (NSString *)fileName;
+/**
+ * Small file with the source, group, sort ordering and name format of the
+ * snapshot, written after it
+ */
++ (NSString *)headerFileName;
+/**
+ * Nil if there is no snapshot or it can't be read
+ */
++ (instancetype)snapshotWithContentsOfFile: (NSString *)path;
+/**
+ * Snapshot with only the header fields set, read from the header file next to
+ * path. Enough for isCurrent without reading the sections and names
+ */
++ (instancetype)snapshotHeaderWithContentsOfFile: (NSString *)path;
+/**
+ * Reads names of the members of the group from addressBookRef. Names of
+ * members not in changedContactIDs are taken from previousSnapshot if it
+ * was written with the same sort ordering and name format
+ */
+- (instancetype)initWithIndexSnapshot: (AKIndexSnapshot *)indexSnapshot
+                            memberIDs: (NSSet *)memberIDs
+                             sourceID: (ABRecordID)sourceID
+                              groupID: (ABRecordID)groupID
+                     previousSnapshot: (AKDisplaySnapshot *)previousSnapshot
+                    changedContactIDs: (NSSet *)changedContactIDs
+                    andAddressBookRef: (ABAddressBookRef)addressBookRef;
+
+/**
+ * Whether the snapshot was written with the system sort ordering and name format
+ */
+- (BOOL)isCurrent;
+- (NSString *)displayNameForRecordID: (ABRecordID)recordID;
+/**
+ * Range of the display name shown in bold, NSNotFound location if none
+ */
+- (NSRange)boldRangeForRecordID: (ABRecordID)recordID;
+/**
+ * Writes to a temporary file that replaces the previous snapshot, then the header
+ */
+- (BOOL)writeToFile: (NSString *)path;
+
+@end
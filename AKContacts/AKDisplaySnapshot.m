@@ -0,0 +1,254 @@
+//
+//  AKDisplaySnapshot.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKDisplaySnapshot.h"
+#import "AKAddressBook.h"
+#import "AKIndexSnapshot.h"
+#import "AKContact.h"
+
+static NSString *const kDisplaySnapshotVersionKey = @"version";
+static NSString *const kDisplaySnapshotSourceKey = @"source";
+static NSString *const kDisplaySnapshotGroupKey = @"group";
+static NSString *const kDisplaySnapshotSortOrderingKey = @"sortOrdering";
+static NSString *const kDisplaySnapshotNameFormatKey = @"nameFormat";
+static NSString *const kDisplaySnapshotKeysKey = @"keys";
+static NSString *const kDisplaySnapshotSectionsKey = @"sections";
+static NSString *const kDisplaySnapshotNamesKey = @"names";
+static NSString *const kDisplaySnapshotBoldRangesKey = @"boldRanges";
+static const NSInteger kDisplaySnapshotVersion = 2;
+
+@interface AKDisplaySnapshot ()
+
+/**
+ * Display names and bold ranges ("location,length") keyed by contactID
+ */
+@property (strong, nonatomic) NSDictionary *names;
+@property (strong, nonatomic) NSDictionary *boldRanges;
+
+@end
+
+@implementation AKDisplaySnapshot
+
++ (NSString *)fileName
+{
+    return @"displaySnapshot.plist";
+}
+
++ (NSString *)headerFileName
+{
+    return @"displaySnapshotHeader.plist";
+}
+
++ (NSString *)headerPathForPath: (NSString *)path
+{
+    return [[path stringByDeletingLastPathComponent] stringByAppendingPathComponent: [AKDisplaySnapshot headerFileName]];
+}
+
++ (NSDictionary *)plistWithContentsOfFile: (NSString *)path
+{
+    NSData *data = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedIfSafe error: nil];
+    if (!data) return nil;
+    
+    NSError *error;
+    NSDictionary *plist = [NSPropertyListSerialization propertyListWithData: data options: NSPropertyListImmutable format: NULL error: &error];
+    if (error) { NSLog(@"NSPropertyListSerialization (%ld): %@", (long)error.code, error.localizedDescription); }
+    if (![plist isKindOfClass: [NSDictionary class]] || [[plist objectForKey: kDisplaySnapshotVersionKey] integerValue] != kDisplaySnapshotVersion)
+    {
+        return nil;
+    }
+    return plist;
+}
+
++ (instancetype)snapshotHeaderWithContentsOfFile: (NSString *)path
+{
+    NSDictionary *plist = [AKDisplaySnapshot plistWithContentsOfFile: [AKDisplaySnapshot headerPathForPath: path]];
+    if (!plist) return nil;
+    
+    AKDisplaySnapshot *snapshot = [[AKDisplaySnapshot alloc] init];
+    [snapshot setHeaderFromPlist: plist];
+    return snapshot;
+}
+
++ (instancetype)snapshotWithContentsOfFile: (NSString *)path
+{
+    NSDictionary *plist = [AKDisplaySnapshot plistWithContentsOfFile: path];
+    if (!plist) return nil;
+    
+    AKDisplaySnapshot *snapshot = [[AKDisplaySnapshot alloc] init];
+    [snapshot setHeaderFromPlist: plist];
+    snapshot->_keys = [plist objectForKey: kDisplaySnapshotKeysKey];
+    snapshot->_contactIDs = [plist objectForKey: kDisplaySnapshotSectionsKey];
+    snapshot.names = [plist objectForKey: kDisplaySnapshotNamesKey];
+    snapshot.boldRanges = [plist objectForKey: kDisplaySnapshotBoldRangesKey];
+    
+    NSMutableSet *memberIDs = [[NSMutableSet alloc] init];
+    for (NSArray *sectionArray in [snapshot.contactIDs objectEnumerator])
+    {
+        [memberIDs addObjectsFromArray: sectionArray];
+    }
+    snapshot->_memberIDs = [memberIDs copy];
+    
+    return snapshot;
+}
+
+- (void)setHeaderFromPlist: (NSDictionary *)plist
+{
+    _sourceID = [[plist objectForKey: kDisplaySnapshotSourceKey] intValue];
+    _groupID = [[plist objectForKey: kDisplaySnapshotGroupKey] intValue];
+    _sortOrdering = [[plist objectForKey: kDisplaySnapshotSortOrderingKey] unsignedIntValue];
+    _compositeNameFormat = [[plist objectForKey: kDisplaySnapshotNameFormatKey] unsignedIntValue];
+}
+
+- (NSDictionary *)headerPlist
+{
+    return @{kDisplaySnapshotVersionKey: @(kDisplaySnapshotVersion),
+             kDisplaySnapshotSourceKey: @(self.sourceID),
+             kDisplaySnapshotGroupKey: @(self.groupID),
+             kDisplaySnapshotSortOrderingKey: @(self.sortOrdering),
+             kDisplaySnapshotNameFormatKey: @(self.compositeNameFormat)};
+}
+
+- (instancetype)initWithIndexSnapshot: (AKIndexSnapshot *)indexSnapshot
+                            memberIDs: (NSSet *)memberIDs
+                             sourceID: (ABRecordID)sourceID
+                              groupID: (ABRecordID)groupID
+                     previousSnapshot: (AKDisplaySnapshot *)previousSnapshot
+                    changedContactIDs: (NSSet *)changedContactIDs
+                    andAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    self = [super init];
+    if (self)
+    {
+        _sourceID = sourceID;
+        _groupID = groupID;
+        _sortOrdering = indexSnapshot.sortOrdering;
+        _compositeNameFormat = ABPersonGetCompositeNameFormatForRecord(NULL);
+        
+        if (previousSnapshot.sortOrdering != _sortOrdering || previousSnapshot.compositeNameFormat != _compositeNameFormat)
+        { // Names and bold ranges depend on both
+            previousSnapshot = nil;
+        }
+        
+        NSMutableArray *keys = [[NSMutableArray alloc] init];
+        NSMutableDictionary *contactIDs = [[NSMutableDictionary alloc] init];
+        NSMutableDictionary *names = [[NSMutableDictionary alloc] init];
+        NSMutableDictionary *boldRanges = [[NSMutableDictionary alloc] init];
+        NSMutableSet *displayedIDs = [[NSMutableSet alloc] init];
+        
+        for (NSString *key in [AKAddressBook sectionKeys])
+        {
+            if ([contactIDs objectForKey: key]) continue;
+            
+            NSMutableArray *sectionArray = [[NSMutableArray alloc] init];
+            for (NSNumber *recordID in [indexSnapshot.sections objectForKey: key])
+            {
+                if (![memberIDs member: recordID]) continue;
+                [sectionArray addObject: recordID];
+                [displayedIDs addObject: recordID];
+                
+                NSString *previousName = (changedContactIDs && ![changedContactIDs member: recordID]) ? [previousSnapshot.names objectForKey: recordID.stringValue] : nil;
+                if (previousName)
+                {
+                    NSString *recordKey = recordID.stringValue;
+                    [names setObject: previousName forKey: recordKey];
+                    NSString *boldRange = [previousSnapshot.boldRanges objectForKey: recordKey];
+                    if (boldRange) [boldRanges setObject: boldRange forKey: recordKey];
+                    continue;
+                }
+                
+                @autoreleasepool
+                {
+                    AKContact *contact = [[AKContact alloc] initWithABRecordID: recordID.intValue sortOrdering: _sortOrdering andAddressBookRef: addressBookRef];
+                    NSString *compositeName = contact.compositeName;
+                    if (compositeName)
+                    {
+                        NSString *recordKey = recordID.stringValue;
+                        [names setObject: compositeName forKey: recordKey];
+                        NSRange range = [contact boldRangeOfCompositeName: compositeName];
+                        if (range.location != NSNotFound)
+                        {
+                            [boldRanges setObject: [NSString stringWithFormat: @"%lu,%lu", (unsigned long)range.location, (unsigned long)range.length] forKey: recordKey];
+                        }
+                    }
+                }
+            }
+            if (sectionArray.count > 0)
+            {
+                [contactIDs setObject: sectionArray forKey: key];
+                [keys addObject: key];
+            }
+        }
+        _keys = [keys copy];
+        _contactIDs = [contactIDs copy];
+        _memberIDs = [displayedIDs copy];
+        _names = [names copy];
+        _boldRanges = [boldRanges copy];
+    }
+    return self;
+}
+
+- (BOOL)isCurrent
+{
+    return (self.sortOrdering == ABPersonGetSortOrdering() && self.compositeNameFormat == ABPersonGetCompositeNameFormatForRecord(NULL));
+}
+
+- (NSString *)displayNameForRecordID: (ABRecordID)recordID
+{
+    return [self.names objectForKey: [@(recordID) stringValue]];
+}
+
+- (NSRange)boldRangeForRecordID: (ABRecordID)recordID
+{
+    NSString *range = [self.boldRanges objectForKey: [@(recordID) stringValue]];
+    return (range) ? NSRangeFromString(range) : NSMakeRange(NSNotFound, 0);
+}
+
+- (BOOL)writeToFile: (NSString *)path
+{
+    NSMutableDictionary *plist = [[self headerPlist] mutableCopy];
+    [plist setObject: self.keys forKey: kDisplaySnapshotKeysKey];
+    [plist setObject: self.contactIDs forKey: kDisplaySnapshotSectionsKey];
+    [plist setObject: self.names forKey: kDisplaySnapshotNamesKey];
+    [plist setObject: self.boldRanges forKey: kDisplaySnapshotBoldRangesKey];
+    
+    NSError *error;
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList: plist format: NSPropertyListBinaryFormat_v1_0 options: 0 error: &error];
+    if (error) { NSLog(@"NSPropertyListSerialization (%ld): %@", (long)error.code, error.localizedDescription); return NO; }
+    
+    BOOL success = [data writeToFile: path options: NSDataWritingAtomic error: &error];
+    if (error) { NSLog(@"Display snapshot write (%ld): %@", (long)error.code, error.localizedDescription); return NO; }
+    
+    // Written after the snapshot, a header never describes a snapshot older than itself
+    NSData *headerData = [NSPropertyListSerialization dataWithPropertyList: [self headerPlist] format: NSPropertyListBinaryFormat_v1_0 options: 0 error: &error];
+    if (error) { NSLog(@"NSPropertyListSerialization (%ld): %@", (long)error.code, error.localizedDescription); return success; }
+    [headerData writeToFile: [AKDisplaySnapshot headerPathForPath: path] options: NSDataWritingAtomic error: &error];
+    if (error) { NSLog(@"Display snapshot header write (%ld): %@", (long)error.code, error.localizedDescription); }
+    return success;
+}
+
+@end
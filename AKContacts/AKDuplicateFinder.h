@@ -0,0 +1,65 @@
+//
+//  AKDuplicateFinder.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+@class AKAddressBook;
+
+/**
+ * Finds clusters of contacts that are likely duplicates of each other.
+ * Candidates are grouped by cheap blocking keys (phone number suffix,
+ * folded email address, name prefix) and pairs are scored only within
+ * a block, so the cost grows with the size of the blocks, not with n^2
+ */
+@interface AKDuplicateFinder : NSObject
+
+/**
+ * Blocks larger than this are skipped as the key is too common to be selective
+ * Default value is 64
+ */
+@property (assign, nonatomic) NSUInteger maximumBlockSize;
+/**
+ * Minimum score of a pair to be reported as duplicate. Default value is 3
+ */
+@property (assign, nonatomic) NSInteger scoreThreshold;
+
+- (instancetype)initWithAddressBook: (AKAddressBook *)addressBook;
+/**
+ * Completion handler is called on the main queue with an array of clusters
+ * Each cluster is an array of at least two contactIDs, each of which matched
+ * every other contact of the cluster or is linked to it. Contacts already linked
+ * to each other are never reported as duplicates of one another
+ */
+- (void)findDuplicatesWithCompletionHandler: (void (^)(NSArray *clusters))completionHandler;
+/**
+ * Clusters of the AKContacts as reported by findDuplicatesWithCompletionHandler:
+ * Runs on the calling thread, which reads the contacts
+ */
+- (NSArray *)clustersOfContacts: (NSArray *)contacts;
+
+@end
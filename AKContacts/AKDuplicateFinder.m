@@ -0,0 +1,371 @@
+//
+//  AKDuplicateFinder.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKDuplicateFinder.h"
+#import "AKAddressBook.h"
+#import "AKContact.h"
+#import "AKAddressBookPool.h"
+
+static const NSUInteger kPhoneSuffixLength = 7;
+static const NSUInteger kNamePrefixLength = 4;
+
+@interface AKDuplicateCandidate : NSObject
+
+@property (assign, nonatomic) ABRecordID recordID;
+@property (copy, nonatomic) NSString *foldedName;
+@property (copy, nonatomic) NSString *foldedFirstName;
+@property (copy, nonatomic) NSString *foldedLastName;
+@property (strong, nonatomic) NSSet *phoneSuffixes;
+@property (strong, nonatomic) NSSet *emails;
+@property (strong, nonatomic) NSSet *linkedContactIDs;
+
+@end
+
+@implementation AKDuplicateCandidate
+
+@end
+
+@interface AKDuplicateFinder ()
+
+@property (weak, nonatomic) AKAddressBook *addressBook;
+
+@end
+
+@implementation AKDuplicateFinder
+
+- (instancetype)initWithAddressBook: (AKAddressBook *)addressBook
+{
+    self = [super init];
+    if (self)
+    {
+        _addressBook = addressBook;
+        _maximumBlockSize = 64;
+        _scoreThreshold = 3;
+    }
+    return self;
+}
+
+- (void)findDuplicatesWithCompletionHandler: (void (^)(NSArray *clusters))completionHandler
+{
+    AKAddressBook *addressBook = self.addressBook;
+    
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^{
+        
+        NSArray *contactIDs = addressBook.allContactIDs;
+        
+        NSDate *start = [NSDate date];
+        
+        // ABAddressBook is not thread safe, features are collected serially in a single pass
+        __block NSArray *candidates;
+        [addressBook.addressBookPool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            candidates = [self candidatesForContactIDs: contactIDs withAddressBookRef: addressBookRef];
+        }];
+        NSArray *clusters = [self clustersOfCandidates: candidates];
+        
+        NSLog(@"Duplicates: %lu clusters of %lu contacts found in %.2f", (unsigned long)clusters.count, (unsigned long)candidates.count, fabs([start timeIntervalSinceNow]));
+        
+        if (completionHandler) {
+            dispatch_async(dispatch_get_main_queue(), ^{
+                completionHandler(clusters);
+            });
+        }
+    });
+}
+
+#pragma mark - Clustering Contacts
+
+- (NSArray *)clustersOfContacts: (NSArray *)contacts
+{
+    NSMutableArray *candidates = [[NSMutableArray alloc] initWithCapacity: contacts.count];
+    for (AKContact *contact in contacts)
+    {
+        [candidates addObject: [self candidateWithContact: contact]];
+    }
+    return [self clustersOfCandidates: candidates];
+}
+
+- (NSArray *)clustersOfCandidates: (NSArray *)candidates
+{
+    NSDictionary *blocks = [self blocksForCandidates: candidates];
+    NSArray *pairs = [self scorePairsInBlocks: [blocks allValues] ofCandidates: candidates];
+    return [self clustersWithPairs: pairs ofCandidates: candidates];
+}
+
+#pragma mark - Features
+
+- (NSArray *)candidatesForContactIDs: (NSArray *)contactIDs withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSMutableArray *candidates = [[NSMutableArray alloc] initWithCapacity: contactIDs.count];
+    for (NSNumber *recordID in contactIDs)
+    {
+        @autoreleasepool
+        {
+            AKContact *contact = [self.addressBook contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
+            if (!contact.recordRef) continue;
+            
+            [candidates addObject: [self candidateWithContact: contact]];
+        }
+    }
+    return [candidates copy];
+}
+
+- (AKDuplicateCandidate *)candidateWithContact: (AKContact *)contact
+{
+    NSString *(^fold)(NSString *) = ^(NSString *string) {
+        return string.stringWithDiacriticsRemoved.lowercaseString.stringWithWhiteSpaceTrimmed;
+    };
+    
+    AKDuplicateCandidate *candidate = [[AKDuplicateCandidate alloc] init];
+    candidate.recordID = contact.recordID;
+    if (contact.isOrganization)
+    {
+        candidate.foldedLastName = fold([contact valueForProperty: kABPersonOrganizationProperty]);
+    }
+    else
+    {
+        candidate.foldedFirstName = fold([contact valueForProperty: kABPersonFirstNameProperty]);
+        candidate.foldedLastName = fold([contact valueForProperty: kABPersonLastNameProperty]);
+    }
+    candidate.foldedName = [NSString stringWithFormat: @"%@ %@", candidate.foldedFirstName ?: @"", candidate.foldedLastName ?: @""].stringWithWhiteSpaceTrimmed;
+    
+    NSMutableSet *phoneSuffixes = [[NSMutableSet alloc] init];
+    for (NSString *phoneNumber in [contact valuesForLinkedMultiValueProperty: kABPersonPhoneProperty])
+    {
+        NSString *digits = phoneNumber.stringWithNonDigitsRemoved;
+        if (digits.length >= kPhoneSuffixLength)
+        {
+            [phoneSuffixes addObject: [digits substringFromIndex: digits.length - kPhoneSuffixLength]];
+        }
+    }
+    candidate.phoneSuffixes = phoneSuffixes;
+    
+    NSMutableSet *emails = [[NSMutableSet alloc] init];
+    for (NSString *email in [contact valuesForLinkedMultiValueProperty: kABPersonEmailProperty])
+    {
+        NSString *folded = fold(email);
+        if (folded.length > 0) [emails addObject: folded];
+    }
+    candidate.emails = emails;
+    candidate.linkedContactIDs = [NSSet setWithArray: contact.linkedContactIDs];
+    
+    return candidate;
+}
+
+#pragma mark - Blocking
+
+/**
+ * Returns arrays of candidate indexes keyed by blocking key
+ */
+- (NSDictionary *)blocksForCandidates: (NSArray *)candidates
+{
+    NSMutableDictionary *blocks = [[NSMutableDictionary alloc] init];
+    void (^addToBlock)(NSString *, NSUInteger) = ^(NSString *key, NSUInteger index) {
+        NSMutableArray *block = [blocks objectForKey: key];
+        if (!block)
+        {
+            block = [[NSMutableArray alloc] init];
+            [blocks setObject: block forKey: key];
+        }
+        [block addObject: @(index)];
+    };
+    
+    [candidates enumerateObjectsUsingBlock: ^(AKDuplicateCandidate *candidate, NSUInteger index, BOOL *stop) {
+        for (NSString *suffix in candidate.phoneSuffixes)
+        {
+            addToBlock([@"p:" stringByAppendingString: suffix], index);
+        }
+        for (NSString *email in candidate.emails)
+        {
+            addToBlock([@"e:" stringByAppendingString: email], index);
+        }
+        NSString *lastName = candidate.foldedLastName;
+        if (lastName.length > 0)
+        {
+            NSString *prefix = [lastName substringToIndex: MIN(kNamePrefixLength, lastName.length)];
+            NSString *initial = (candidate.foldedFirstName.length > 0) ? [candidate.foldedFirstName substringToIndex: 1] : @"";
+            addToBlock([NSString stringWithFormat: @"n:%@|%@", prefix, initial], index);
+        }
+    }];
+    
+    NSMutableArray *singletons = [[NSMutableArray alloc] init];
+    for (NSString *key in blocks)
+    {
+        NSUInteger count = [[blocks objectForKey: key] count];
+        if (count < 2 || count > self.maximumBlockSize) [singletons addObject: key];
+    }
+    [blocks removeObjectsForKeys: singletons];
+    return [blocks copy];
+}
+
+#pragma mark - Scoring
+
+- (NSInteger)scoreOfCandidate: (AKDuplicateCandidate *)candidate1 andCandidate: (AKDuplicateCandidate *)candidate2
+{
+    NSInteger score = 0;
+    if ([candidate1.phoneSuffixes intersectsSet: candidate2.phoneSuffixes]) score += 2;
+    if ([candidate1.emails intersectsSet: candidate2.emails]) score += 3;
+    
+    if (candidate1.foldedName.length > 0 && [candidate1.foldedName isEqualToString: candidate2.foldedName])
+    {
+        score += 3;
+    }
+    else if (candidate1.foldedLastName.length > 0 && [candidate1.foldedLastName isEqualToString: candidate2.foldedLastName])
+    {
+        BOOL sameInitial = (candidate1.foldedFirstName.length > 0 && candidate2.foldedFirstName.length > 0 &&
+                            [candidate1.foldedFirstName characterAtIndex: 0] == [candidate2.foldedFirstName characterAtIndex: 0]);
+        if (sameInitial) score += 1;
+    }
+    return score;
+}
+
+/**
+ * Scores pairs within each block concurrently
+ * Returns an array of index pairs and their score packed into NSIndexPaths
+ */
+- (NSArray *)scorePairsInBlocks: (NSArray *)blocks ofCandidates: (NSArray *)candidates
+{
+    NSMutableArray *pairs = [[NSMutableArray alloc] init];
+    NSObject *lock = [[NSObject alloc] init];
+    
+    dispatch_apply(blocks.count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), ^(size_t blockIndex) {
+        NSArray *block = [blocks objectAtIndex: blockIndex];
+        NSMutableArray *blockPairs = [[NSMutableArray alloc] init];
+        
+        for (NSUInteger i = 0; i < block.count; ++i)
+        {
+            NSUInteger index1 = [[block objectAtIndex: i] unsignedIntegerValue];
+            AKDuplicateCandidate *candidate1 = [candidates objectAtIndex: index1];
+            for (NSUInteger j = i + 1; j < block.count; ++j)
+            {
+                NSUInteger index2 = [[block objectAtIndex: j] unsignedIntegerValue];
+                AKDuplicateCandidate *candidate2 = [candidates objectAtIndex: index2];
+                
+                if ([candidate1.linkedContactIDs member: @(candidate2.recordID)])
+                { // Already linked people are the same person by definition
+                    continue;
+                }
+                NSInteger score = [self scoreOfCandidate: candidate1 andCandidate: candidate2];
+                if (score >= self.scoreThreshold)
+                {
+                    NSUInteger indexes[] = {MIN(index1, index2), MAX(index1, index2), score};
+                    [blockPairs addObject: [NSIndexPath indexPathWithIndexes: indexes length: 3]];
+                }
+            }
+        }
+        if (blockPairs.count > 0)
+        {
+            @synchronized (lock) {
+                [pairs addObjectsFromArray: blockPairs];
+            }
+        }
+    });
+    return [pairs copy];
+}
+
+#pragma mark - Clustering
+
+/**
+ * Clusters are merged only when every record of one cluster matched every record
+ * of the other directly, or is linked to it. Chains of pairs through records that
+ * share features with linked people would otherwise merge unrelated clusters
+ */
+- (NSArray *)clustersWithPairs: (NSArray *)pairs ofCandidates: (NSArray *)candidates
+{
+    NSMutableSet *matches = [[NSMutableSet alloc] initWithCapacity: pairs.count];
+    for (NSIndexPath *pair in pairs)
+    {
+        NSUInteger indexes[] = {[pair indexAtPosition: 0], [pair indexAtPosition: 1]};
+        [matches addObject: [NSIndexPath indexPathWithIndexes: indexes length: 2]];
+    }
+    
+    BOOL (^directMatch)(NSUInteger, NSUInteger) = ^BOOL(NSUInteger index1, NSUInteger index2) {
+        NSUInteger indexes[] = {MIN(index1, index2), MAX(index1, index2)};
+        if ([matches member: [NSIndexPath indexPathWithIndexes: indexes length: 2]]) return YES;
+        AKDuplicateCandidate *candidate1 = [candidates objectAtIndex: index1];
+        AKDuplicateCandidate *candidate2 = [candidates objectAtIndex: index2];
+        return ([candidate1.linkedContactIDs member: @(candidate2.recordID)] != nil);
+    };
+    
+    // Strongest pairs are merged first
+    NSArray *sortedPairs = [pairs sortedArrayUsingComparator: ^NSComparisonResult(NSIndexPath *pair1, NSIndexPath *pair2) {
+        NSUInteger score1 = [pair1 indexAtPosition: 2], score2 = [pair2 indexAtPosition: 2];
+        if (score1 > score2) return NSOrderedAscending;
+        if (score1 < score2) return NSOrderedDescending;
+        return [pair1 compare: pair2];
+    }];
+    
+    NSMutableDictionary *clusterOfIndex = [[NSMutableDictionary alloc] init];
+    for (NSIndexPath *pair in sortedPairs)
+    {
+        NSNumber *index1 = @([pair indexAtPosition: 0]);
+        NSNumber *index2 = @([pair indexAtPosition: 1]);
+        NSMutableArray *cluster1 = [clusterOfIndex objectForKey: index1] ?: [NSMutableArray arrayWithObject: index1];
+        NSMutableArray *cluster2 = [clusterOfIndex objectForKey: index2] ?: [NSMutableArray arrayWithObject: index2];
+        if (cluster1 == cluster2) continue;
+        
+        BOOL conflict = NO;
+        for (NSNumber *member1 in cluster1)
+        {
+            for (NSNumber *member2 in cluster2)
+            {
+                if (!directMatch(member1.unsignedIntegerValue, member2.unsignedIntegerValue))
+                {
+                    conflict = YES;
+                    break;
+                }
+            }
+            if (conflict) break;
+        }
+        if (conflict) continue;
+        
+        [cluster1 addObjectsFromArray: cluster2];
+        for (NSNumber *member in cluster1)
+        {
+            [clusterOfIndex setObject: cluster1 forKey: member];
+        }
+    }
+    
+    NSMutableArray *ret = [[NSMutableArray alloc] init];
+    NSMutableSet *seen = [[NSMutableSet alloc] init];
+    for (NSMutableArray *cluster in [clusterOfIndex objectEnumerator])
+    {
+        NSValue *identity = [NSValue valueWithNonretainedObject: cluster];
+        if ([seen member: identity]) continue;
+        [seen addObject: identity];
+        
+        NSMutableArray *recordIDs = [[NSMutableArray alloc] initWithCapacity: cluster.count];
+        for (NSNumber *index in cluster)
+        {
+            [recordIDs addObject: @([[candidates objectAtIndex: index.unsignedIntegerValue] recordID])];
+        }
+        [ret addObject: [recordIDs sortedArrayUsingSelector: @selector(compare:)]];
+    }
+    return [ret copy];
+}
+
+@end
@@ -0,0 +1,174 @@
+//
+//  AKEmailIndex.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKEmailIndex.h"
+#import "AKSearchEntryIndex.h"
+#import "NSString+Additions.h"
+
+@interface AKEmailIndex ()
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+/**
+ * NSMutableIndexSet of recordIDs keyed by canonical addresses
+ */
+@property (strong, nonatomic) NSMutableDictionary *addresses;
+/**
+ * NSMutableIndexSet of recordIDs keyed by domains
+ */
+@property (strong, nonatomic) NSMutableDictionary *domains;
+/**
+ * Canonical addresses keyed by contactID, only for contacts having addresses
+ */
+@property (strong, nonatomic) NSMutableDictionary *records;
+
+@end
+
+@implementation AKEmailIndex
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _queue = dispatch_queue_create([NSStringFromClass([AKEmailIndex class]) UTF8String], DISPATCH_QUEUE_CONCURRENT);
+        _addresses = [[NSMutableDictionary alloc] init];
+        _domains = [[NSMutableDictionary alloc] init];
+        _records = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
++ (NSString *)domainOfAddress: (NSString *)address
+{
+    NSRange separator = [address rangeOfString: @"@" options: NSBackwardsSearch];
+    return [address substringFromIndex: NSMaxRange(separator)];
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+    dispatch_sync(self.queue, ^{
+        count = self.records.count;
+    });
+    return count;
+}
+
+- (void)insertSearchEntry: (AKSearchEntry *)entry
+{
+    NSNumber *recordID = @(entry.recordID);
+    NSArray *addresses = entry.emailAddresses;
+    
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: recordID];
+        
+        if (addresses.count == 0) return;
+        
+        for (NSString *address in addresses)
+        {
+            [[self postingForKey: address inDictionary: self.addresses] addIndex: recordID.unsignedIntegerValue];
+            [[self postingForKey: [AKEmailIndex domainOfAddress: address] inDictionary: self.domains] addIndex: recordID.unsignedIntegerValue];
+        }
+        [self.records setObject: addresses forKey: recordID];
+    });
+}
+
+- (void)removeRecordID: (ABRecordID)recordID
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: @(recordID)];
+    });
+}
+
+- (void)removeAllRecords
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self.addresses removeAllObjects];
+        [self.domains removeAllObjects];
+        [self.records removeAllObjects];
+    });
+}
+
+- (NSMutableIndexSet *)postingForKey: (NSString *)key inDictionary: (NSMutableDictionary *)dictionary
+{
+    NSMutableIndexSet *posting = [dictionary objectForKey: key];
+    if (!posting)
+    {
+        posting = [[NSMutableIndexSet alloc] init];
+        [dictionary setObject: posting forKey: key];
+    }
+    return posting;
+}
+
+- (void)unindexRecordID: (NSNumber *)recordID
+{
+    void (^unindex)(NSString *, NSMutableDictionary *) = ^(NSString *key, NSMutableDictionary *dictionary) {
+        NSMutableIndexSet *posting = [dictionary objectForKey: key];
+        [posting removeIndex: recordID.unsignedIntegerValue];
+        if (posting.count == 0) [dictionary removeObjectForKey: key];
+    };
+    for (NSString *address in [self.records objectForKey: recordID])
+    {
+        unindex(address, self.addresses);
+        unindex([AKEmailIndex domainOfAddress: address], self.domains);
+    }
+    [self.records removeObjectForKey: recordID];
+}
+
+- (NSIndexSet *)recordIDsWithEmailAddress: (NSString *)address
+{
+    NSIndexSet *recordIDs = (address) ? [[self recordIDsWithEmailAddresses: @[address]] objectForKey: address] : nil;
+    return (recordIDs) ? recordIDs : [NSIndexSet indexSet];
+}
+
+- (NSDictionary *)recordIDsWithEmailAddresses: (NSArray *)addresses
+{
+    NSMutableDictionary *recordIDs = [[NSMutableDictionary alloc] init];
+    dispatch_sync(self.queue, ^{
+        for (NSString *address in addresses)
+        {
+            NSIndexSet *posting = [self.addresses objectForKey: address.stringWithCanonicalEmailAddress];
+            if (posting) [recordIDs setObject: [posting copy] forKey: address];
+        }
+    });
+    return [recordIDs copy];
+}
+
+- (NSIndexSet *)recordIDsWithEmailDomain: (NSString *)domain
+{
+    domain = [domain stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceAndNewlineCharacterSet]].lowercaseString;
+    if ([domain hasPrefix: @"@"]) domain = [domain substringFromIndex: 1];
+    while ([domain hasSuffix: @"."]) domain = [domain substringToIndex: domain.length - 1];
+    
+    __block NSIndexSet *recordIDs = nil;
+    dispatch_sync(self.queue, ^{
+        recordIDs = [[self.domains objectForKey: domain] copy];
+    });
+    return (recordIDs) ? recordIDs : [NSIndexSet indexSet];
+}
+
+@end
@@ -0,0 +1,63 @@
+//
+//  AKFacetIndex.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKContactIndex.h"
+
+typedef NS_ENUM(NSInteger, AKFacet)
+{
+    AKFacetOrganization = 0,
+    AKFacetDepartment,
+    AKFacetJobTitle,
+    AKFacetCity,
+    AKFacetCount,
+};
+
+/**
+ * Organization, department, job title and city columns of contacts.
+ * Values are dictionary encoded by their folded form, each code has the
+ * set of recordIDs having the value as its posting. Values are displayed
+ * as they were first indexed
+ */
+@interface AKFacetIndex : NSObject <AKContactIndex>
+
+/**
+ * Values of the facet having at least one record, sorted
+ */
+- (NSArray *)valuesOfFacet: (AKFacet)facet;
+/**
+ * Empty if no record has the value
+ */
+- (NSIndexSet *)recordIDsWithValue: (NSString *)value ofFacet: (AKFacet)facet;
+/**
+ * Number of records keyed by the values of the facet, counting only
+ * members of recordIDs. All records are counted if recordIDs is nil
+ */
+- (NSDictionary *)countsOfFacet: (AKFacet)facet amongRecordIDs: (NSIndexSet *)recordIDs;
+
+@end
@@ -0,0 +1,230 @@
+//
+//  AKFacetIndex.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKFacetIndex.h"
+#import "AKSearchEntryIndex.h"
+#import "NSString+Additions.h"
+
+@interface AKFacetColumn : NSObject
+
+/**
+ * Codes keyed by folded values
+ */
+@property (strong, nonatomic) NSMutableDictionary *codes;
+/**
+ * Displayed values indexed by code
+ */
+@property (strong, nonatomic) NSMutableArray *values;
+/**
+ * NSMutableIndexSet of recordIDs indexed by code
+ */
+@property (strong, nonatomic) NSMutableArray *postings;
+
+@end
+
+@implementation AKFacetColumn
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _codes = [[NSMutableDictionary alloc] init];
+        _values = [[NSMutableArray alloc] init];
+        _postings = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (NSUInteger)codeForValue: (NSString *)value
+{
+    NSString *key = [AKFacetColumn keyForValue: value];
+    NSNumber *code = [self.codes objectForKey: key];
+    if (!code)
+    {
+        code = @(self.values.count);
+        [self.codes setObject: code forKey: key];
+        [self.values addObject: value];
+        [self.postings addObject: [[NSMutableIndexSet alloc] init]];
+    }
+    return code.unsignedIntegerValue;
+}
+
++ (NSString *)keyForValue: (NSString *)value
+{
+    return value.stringWithDiacriticsRemoved.lowercaseString;
+}
+
+@end
+
+@interface AKFacetIndex ()
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+/**
+ * AKFacetColumn indexed by AKFacet
+ */
+@property (strong, nonatomic) NSArray *columns;
+/**
+ * Arrays of codes per facet keyed by contactID, empty for contacts without values
+ */
+@property (strong, nonatomic) NSMutableDictionary *records;
+
+@end
+
+@implementation AKFacetIndex
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _queue = dispatch_queue_create([NSStringFromClass([AKFacetIndex class]) UTF8String], DISPATCH_QUEUE_CONCURRENT);
+        _records = [[NSMutableDictionary alloc] init];
+        [self resetColumns];
+    }
+    return self;
+}
+
+- (void)resetColumns
+{
+    NSMutableArray *columns = [[NSMutableArray alloc] initWithCapacity: AKFacetCount];
+    for (NSInteger facet = 0; facet < AKFacetCount; ++facet)
+    {
+        [columns addObject: [[AKFacetColumn alloc] init]];
+    }
+    self.columns = [columns copy];
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+    dispatch_sync(self.queue, ^{
+        count = self.records.count;
+    });
+    return count;
+}
+
+- (void)insertSearchEntry: (AKSearchEntry *)entry
+{
+    NSNumber *recordID = @(entry.recordID);
+    NSArray *facetValues = (entry.facetValues.count == AKFacetCount) ? entry.facetValues : nil;
+    
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: recordID];
+        
+        NSMutableArray *record = [[NSMutableArray alloc] initWithCapacity: AKFacetCount];
+        for (NSInteger facet = 0; facet < AKFacetCount; ++facet)
+        {
+            AKFacetColumn *column = [self.columns objectAtIndex: facet];
+            NSMutableIndexSet *codes = [[NSMutableIndexSet alloc] init];
+            for (NSString *value in [facetValues objectAtIndex: facet])
+            {
+                NSUInteger code = [column codeForValue: value];
+                [[column.postings objectAtIndex: code] addIndex: recordID.unsignedIntegerValue];
+                [codes addIndex: code];
+            }
+            [record addObject: [codes copy]];
+        }
+        [self.records setObject: [record copy] forKey: recordID];
+    });
+}
+
+- (void)removeRecordID: (ABRecordID)recordID
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: @(recordID)];
+    });
+}
+
+- (void)removeAllRecords
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self.records removeAllObjects];
+        [self resetColumns];
+    });
+}
+
+- (void)unindexRecordID: (NSNumber *)recordID
+{   // Codes are kept with an empty posting until removeAllRecords
+    NSArray *record = [self.records objectForKey: recordID];
+    [record enumerateObjectsUsingBlock: ^(NSIndexSet *codes, NSUInteger facet, BOOL *stop) {
+        AKFacetColumn *column = [self.columns objectAtIndex: facet];
+        [codes enumerateIndexesUsingBlock: ^(NSUInteger code, BOOL *stop) {
+            [[column.postings objectAtIndex: code] removeIndex: recordID.unsignedIntegerValue];
+        }];
+    }];
+    [self.records removeObjectForKey: recordID];
+}
+
+- (NSArray *)valuesOfFacet: (AKFacet)facet
+{
+    NSMutableArray *values = [[NSMutableArray alloc] init];
+    dispatch_sync(self.queue, ^{
+        AKFacetColumn *column = [self.columns objectAtIndex: facet];
+        [column.postings enumerateObjectsUsingBlock: ^(NSIndexSet *posting, NSUInteger code, BOOL *stop) {
+            if (posting.count > 0) [values addObject: [column.values objectAtIndex: code]];
+        }];
+    });
+    return [values sortedArrayUsingSelector: @selector(localizedCaseInsensitiveCompare:)];
+}
+
+- (NSIndexSet *)recordIDsWithValue: (NSString *)value ofFacet: (AKFacet)facet
+{
+    __block NSIndexSet *recordIDs = nil;
+    dispatch_sync(self.queue, ^{
+        AKFacetColumn *column = [self.columns objectAtIndex: facet];
+        NSNumber *code = [column.codes objectForKey: [AKFacetColumn keyForValue: value]];
+        if (code) recordIDs = [[column.postings objectAtIndex: code.unsignedIntegerValue] copy];
+    });
+    return (recordIDs) ? recordIDs : [NSIndexSet indexSet];
+}
+
+- (NSDictionary *)countsOfFacet: (AKFacet)facet amongRecordIDs: (NSIndexSet *)recordIDs
+{
+    NSMutableDictionary *counts = [[NSMutableDictionary alloc] init];
+    dispatch_sync(self.queue, ^{
+        AKFacetColumn *column = [self.columns objectAtIndex: facet];
+        [column.postings enumerateObjectsUsingBlock: ^(NSIndexSet *posting, NSUInteger code, BOOL *stop) {
+            __block NSUInteger count = 0;
+            if (!recordIDs)
+            {
+                count = posting.count;
+            }
+            else
+            { // Counted range by range without building the intersection
+                [posting enumerateRangesUsingBlock: ^(NSRange range, BOOL *stop) {
+                    count += [recordIDs countOfIndexesInRange: range];
+                }];
+            }
+            if (count > 0) [counts setObject: @(count) forKey: [column.values objectAtIndex: code]];
+        }];
+    });
+    return [counts copy];
+}
+
+@end
@@ -62,6 +62,10 @@ typedef NS_ENUM(NSInteger, GroupTypes)
  * but rather the sum of members of all aggregator groups
  */
 @property (assign, nonatomic) BOOL isMainAggregate;
+/**
+ * Incremented when members are edited or reloaded from the address book
+ */
+@property (assign) NSUInteger memberVersion;
 
 - (instancetype)initWithABRecordID: (ABRecordID) recordID andAddressBookRef: (ABAddressBookRef)addressBookRef;
 /**
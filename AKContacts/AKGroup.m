@@ -84,6 +84,7 @@ NSString *const DefaultsKeyGroups = @"Groups";
         if (error) { NSLog(@"%ld", CFErrorGetCode(error)); error = NULL; }
         
         [self.memberIDs addObject: identifier];
+        self.memberVersion += 1;
     }
 }
 
@@ -106,6 +107,7 @@ NSString *const DefaultsKeyGroups = @"Groups";
         [self.deleteMemberIDs addObject: identifier];
         
         [self.memberIDs removeObject: identifier];
+        self.memberVersion += 1;
     }
 }
 
@@ -132,6 +134,7 @@ NSString *const DefaultsKeyGroups = @"Groups";
     {
         [self.memberIDs addObjectsFromArray: self.deleteMemberIDs.allObjects];
         [self setDeleteMemberIDs: nil];
+        self.memberVersion += 1;
     }
     
     if (ABAddressBookHasUnsavedChanges(super.addressBookRef))
@@ -31,9 +31,11 @@
 #import "AKGroupPickerViewController.h"
 #import "AKContactPickerViewController.h"
 #import "AKContactsViewController.h"
+#import "AKUpcomingEventsViewController.h"
 #import "AKGroup.h"
 #import "AKSource.h"
 #import "AKAddressBook.h"
+#import "AKAddressBook+Loader.h"
 
 @interface AKGroupsViewController () <UITableViewDataSource, UITableViewDelegate>
 
@@ -48,6 +50,14 @@
  * Touch handler of edit cancel button
  */
 - (void)cancelButtonTouchUpInside: (id)sender;
+/**
+ * Touch handler of upcoming events button
+ */
+- (void)upcomingButtonTouchUpInside: (id)sender;
+/**
+ * Upcoming events button displayed outside of edit mode
+ */
+- (UIBarButtonItem *)upcomingButton;
 /**
  * Touch gesture recognizer handler attached to tableView in edit mode
  */
@@ -94,6 +104,7 @@
                                                                                target: self
                                                                                action: @selector(addButtonTouchUpInside:)];
     [self.navigationItem setRightBarButtonItem: addButton];
+    [self.navigationItem setLeftBarButtonItem: [self upcomingButton]];
     
     [[NSNotificationCenter defaultCenter] addObserver: self selector: @selector(reloadTableViewData) name: AKGroupPickerViewDidDismissNotification object: nil];
     
@@ -138,7 +149,7 @@
                                                                                        target: self
                                                                                        action: @selector(addButtonTouchUpInside:)];
         [self.navigationItem setRightBarButtonItem: barButtonItem];
-        [self.navigationItem setLeftBarButtonItem: nil];
+        [self.navigationItem setLeftBarButtonItem: [self upcomingButton]];
     }
     
     NSInteger section = 0;
@@ -225,6 +236,20 @@
     [self.tableView endUpdates];
 }
 
+- (void)upcomingButtonTouchUpInside: (id)sender
+{
+    AKUpcomingEventsViewController *upcomingView = [[AKUpcomingEventsViewController alloc] init];
+    [self.navigationController pushViewController: upcomingView animated: YES];
+}
+
+- (UIBarButtonItem *)upcomingButton
+{
+    return [[UIBarButtonItem alloc] initWithTitle: NSLocalizedString(@"Upcoming", @"")
+                                            style: UIBarButtonItemStyleBordered
+                                           target: self
+                                           action: @selector(upcomingButtonTouchUpInside:)];
+}
+
 - (void)tableViewTouchUpInside: (id)sender
 {
     [self.firstResponder resignFirstResponder];
@@ -454,6 +479,8 @@
     
     [akAddressBook setSourceID: [source recordID]];
     [akAddressBook setGroupID: [group recordID]];
+    // Bring the partition of the source ahead of the background loads
+    [akAddressBook loadPartitionOfSourceWithID: [source recordID]];
     
     AKContactsViewController *contactsView = [[AKContactsViewController alloc] init];
     [self.navigationController pushViewController: contactsView animated: YES];
@@ -0,0 +1,81 @@
+//
+//  AKIndexSnapshot.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Immutable, versioned copy of the section tables of AKAddressBook.
+ * The loader applies changes to its private working tables and publishes
+ * a new snapshot when done. Readers hold on to the snapshot they grabbed;
+ * a retired snapshot is freed when its last reader releases it
+ */
+@interface AKIndexSnapshot : NSObject
+
+@property (assign, nonatomic, readonly) NSUInteger generation;
+@property (assign, nonatomic, readonly) ABPersonSortOrdering sortOrdering;
+/**
+ * Arrays of contactIDs keyed by section key
+ */
+@property (strong, nonatomic, readonly) NSDictionary *sectionsSortedByFirst;
+@property (strong, nonatomic, readonly) NSDictionary *sectionsSortedByLast;
+@property (strong, nonatomic, readonly) NSDictionary *sectionsSortedByPhone;
+/**
+ * Sections in sortOrdering and in the inverse ordering
+ */
+@property (nonatomic, readonly) NSDictionary *sections;
+@property (nonatomic, readonly) NSDictionary *inverseSections;
+/**
+ * Position of each contactID in the alphabetic order of sections. Built on first access
+ */
+@property (nonatomic, readonly) NSDictionary *sortRanks;
+@property (nonatomic, readonly) NSArray *allContactIDs;
+@property (nonatomic, readonly) NSSet *contactIDsWithoutPhoneNumber;
+
+/**
+ * Copies the mutable section tables
+ */
+- (instancetype)initWithGeneration: (NSUInteger)generation
+                      sortOrdering: (ABPersonSortOrdering)sortOrdering
+             sectionsSortedByFirst: (NSDictionary *)sectionsSortedByFirst
+              sectionsSortedByLast: (NSDictionary *)sectionsSortedByLast
+             sectionsSortedByPhone: (NSDictionary *)sectionsSortedByPhone;
+/**
+ * Copies only the sections whose keys are in dirtySectionKeys, the sets of keys
+ * keyed by table name (e.g. hashTableSortedByFirst). The immutable arrays of the
+ * other sections are shared with previousSnapshot. Every section is copied if
+ * dirtySectionKeys is nil
+ */
+- (instancetype)initWithGeneration: (NSUInteger)generation
+                      sortOrdering: (ABPersonSortOrdering)sortOrdering
+             sectionsSortedByFirst: (NSDictionary *)sectionsSortedByFirst
+              sectionsSortedByLast: (NSDictionary *)sectionsSortedByLast
+             sectionsSortedByPhone: (NSDictionary *)sectionsSortedByPhone
+                  previousSnapshot: (AKIndexSnapshot *)previousSnapshot
+                  dirtySectionKeys: (NSDictionary *)dirtySectionKeys;
+
+@end
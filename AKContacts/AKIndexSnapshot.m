@@ -0,0 +1,166 @@
+//
+//  AKIndexSnapshot.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKIndexSnapshot.h"
+#import "AKAddressBook.h"
+
+@interface AKIndexSnapshot ()
+{
+    NSDictionary *_sortRanks;
+    NSArray *_allContactIDs;
+}
+
+@end
+
+@implementation AKIndexSnapshot
+
++ (NSDictionary *)immutableCopyOfSections: (NSDictionary *)sections
+                        reusingSections: (NSDictionary *)previousSections
+                     exceptSectionKeys: (NSSet *)dirtySectionKeys
+{
+    NSMutableDictionary *copy = [[NSMutableDictionary alloc] initWithCapacity: sections.count];
+    [sections enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSArray *sectionArray, BOOL *stop) {
+        NSArray *previousSectionArray = [previousSections objectForKey: key];
+        if (previousSectionArray && dirtySectionKeys && ![dirtySectionKeys member: key])
+        {
+            [copy setObject: previousSectionArray forKey: key];
+        }
+        else
+        {
+            [copy setObject: [sectionArray copy] forKey: key];
+        }
+    }];
+    return [copy copy];
+}
+
+- (instancetype)initWithGeneration: (NSUInteger)generation
+                      sortOrdering: (ABPersonSortOrdering)sortOrdering
+             sectionsSortedByFirst: (NSDictionary *)sectionsSortedByFirst
+              sectionsSortedByLast: (NSDictionary *)sectionsSortedByLast
+             sectionsSortedByPhone: (NSDictionary *)sectionsSortedByPhone
+{
+    return [self initWithGeneration: generation
+                       sortOrdering: sortOrdering
+              sectionsSortedByFirst: sectionsSortedByFirst
+               sectionsSortedByLast: sectionsSortedByLast
+              sectionsSortedByPhone: sectionsSortedByPhone
+                   previousSnapshot: nil
+                   dirtySectionKeys: nil];
+}
+
+- (instancetype)initWithGeneration: (NSUInteger)generation
+                      sortOrdering: (ABPersonSortOrdering)sortOrdering
+             sectionsSortedByFirst: (NSDictionary *)sectionsSortedByFirst
+              sectionsSortedByLast: (NSDictionary *)sectionsSortedByLast
+             sectionsSortedByPhone: (NSDictionary *)sectionsSortedByPhone
+                  previousSnapshot: (AKIndexSnapshot *)previousSnapshot
+                  dirtySectionKeys: (NSDictionary *)dirtySectionKeys
+{
+    self = [super init];
+    if (self)
+    {
+        // A table without an entry has no dirty sections, a nil dictionary marks every section dirty
+        NSSet *(^dirtySectionKeysOfTable)(SEL) = ^NSSet *(SEL table) {
+            if (!dirtySectionKeys) return nil;
+            return [dirtySectionKeys objectForKey: NSStringFromSelector(table)] ?: [NSSet set];
+        };
+        
+        _generation = generation;
+        _sortOrdering = sortOrdering;
+        _sectionsSortedByFirst = [AKIndexSnapshot immutableCopyOfSections: sectionsSortedByFirst
+                                                          reusingSections: previousSnapshot.sectionsSortedByFirst
+                                                       exceptSectionKeys: dirtySectionKeysOfTable(@selector(hashTableSortedByFirst))];
+        _sectionsSortedByLast = [AKIndexSnapshot immutableCopyOfSections: sectionsSortedByLast
+                                                         reusingSections: previousSnapshot.sectionsSortedByLast
+                                                      exceptSectionKeys: dirtySectionKeysOfTable(@selector(hashTableSortedByLast))];
+        _sectionsSortedByPhone = [AKIndexSnapshot immutableCopyOfSections: sectionsSortedByPhone
+                                                          reusingSections: previousSnapshot.sectionsSortedByPhone
+                                                       exceptSectionKeys: dirtySectionKeysOfTable(@selector(hashTableSortedByPhone))];
+    }
+    return self;
+}
+
+- (NSDictionary *)sections
+{
+    return (self.sortOrdering == kABPersonSortByFirstName) ? self.sectionsSortedByFirst : self.sectionsSortedByLast;
+}
+
+- (NSDictionary *)inverseSections
+{
+    return (self.sortOrdering != kABPersonSortByFirstName) ? self.sectionsSortedByFirst : self.sectionsSortedByLast;
+}
+
+- (NSDictionary *)sortRanks
+{
+    @synchronized (self)
+    {
+        if (!_sortRanks)
+        {
+            NSDictionary *sections = self.sections;
+            NSMutableDictionary *sortRanks = [[NSMutableDictionary alloc] init];
+            NSUInteger rank = 0;
+            for (NSString *sectionKey in [AKAddressBook sectionKeys])
+            {
+                for (NSNumber *recordID in [sections objectForKey: sectionKey])
+                {
+                    if (![sortRanks objectForKey: recordID])
+                    {
+                        [sortRanks setObject: @(rank++) forKey: recordID];
+                    }
+                }
+            }
+            _sortRanks = [sortRanks copy];
+        }
+        return _sortRanks;
+    }
+}
+
+- (NSArray *)allContactIDs
+{
+    @synchronized (self)
+    {
+        if (!_allContactIDs)
+        {
+            NSMutableSet *contactIDs = [[NSMutableSet alloc] init];
+            for (NSArray *sectionArray in [self.sections objectEnumerator])
+            {
+                [contactIDs addObjectsFromArray: sectionArray];
+            }
+            _allContactIDs = [contactIDs allObjects];
+        }
+        return (_allContactIDs.count > 0) ? _allContactIDs : nil;
+    }
+}
+
+- (NSSet *)contactIDsWithoutPhoneNumber
+{
+    NSArray *contactIDsWithoutPhoneNumbers = [self.sectionsSortedByPhone objectForKey: noPhoneNumberKey];
+    return (contactIDsWithoutPhoneNumbers.count > 0) ? [[NSSet alloc] initWithArray: contactIDsWithoutPhoneNumbers] : [[NSSet alloc] init];
+}
+
+@end
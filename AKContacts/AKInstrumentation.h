@@ -0,0 +1,87 @@
+//
+//  AKInstrumentation.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSUInteger, AKSpan)
+{
+    AKSpanLoad = 0,
+    AKSpanScan,
+    AKSpanDiff,
+    AKSpanIndexInsert,
+    AKSpanArchive,
+    AKSpanSearchKeystroke,
+    AKSpanSearchQueueWait,
+    AKSpanMainThreadDelegate,
+    AKSpanFacetFilter,
+    AKSpanCount
+};
+
+typedef NS_ENUM(NSUInteger, AKCounter)
+{
+    AKCounterGroupsLoaded = 0,
+    AKCounterContactsScanned,
+    AKCounterContactsCreated,
+    AKCounterContactsChanged,
+    AKCounterContactsDeleted,
+    AKCounterSearchTerminations,
+    AKCounterCacheSectionsWritten,
+    AKCounterCacheBytesWritten,
+    AKCounterCount
+};
+
+/**
+ * Opaque start time of a span
+ */
+typedef uint64_t AKSpanStart;
+
+/**
+ * Spans and counters are recorded in buffers owned by the calling thread
+ * so recording takes no locks. Buffers are merged when exported
+ */
+FOUNDATION_EXPORT AKSpanStart AKSpanBegin(void);
+/**
+ * Adds the time elapsed since start to the latency histogram of span
+ */
+FOUNDATION_EXPORT void AKSpanEnd(AKSpan span, AKSpanStart start);
+FOUNDATION_EXPORT void AKCounterAdd(AKCounter counter, int64_t value);
+
+@interface AKInstrumentation : NSObject
+
++ (NSString *)nameOfSpan: (AKSpan)span;
++ (NSString *)nameOfCounter: (AKCounter)counter;
+/**
+ * Count, total, max, p50 and p99 in milliseconds of each span and the value
+ * of each counter merged from the buffers of all threads. Values recorded
+ * concurrently with the export may or may not be included
+ */
++ (NSDictionary *)dictionaryRepresentation;
++ (NSData *)JSONData;
++ (void)reset;
+
+@end
@@ -0,0 +1,234 @@
+//
+//  AKInstrumentation.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKInstrumentation.h"
+#import <mach/mach_time.h>
+#import <pthread.h>
+
+/**
+ * Log-linear buckets of microseconds: four buckets per power of two
+ */
+#define kAKHistogramBucketCount 256
+
+typedef struct AKThreadMetrics {
+    uint32_t histograms[AKSpanCount][kAKHistogramBucketCount];
+    uint64_t totals[AKSpanCount];
+    uint64_t maxima[AKSpanCount];
+    int64_t counters[AKCounterCount];
+    struct AKThreadMetrics *next;
+} AKThreadMetrics;
+
+static pthread_key_t AKThreadMetricsKey;
+static pthread_mutex_t AKThreadMetricsLock = PTHREAD_MUTEX_INITIALIZER;
+/**
+ * Buffers of live threads
+ */
+static AKThreadMetrics *AKThreadMetricsList;
+/**
+ * Buffers of exited threads are merged in here
+ */
+static AKThreadMetrics AKRetiredThreadMetrics;
+static mach_timebase_info_data_t AKTimebase;
+
+static void AKThreadMetricsMerge(AKThreadMetrics *target, const AKThreadMetrics *source)
+{
+    for (NSUInteger span = 0; span < AKSpanCount; ++span)
+    {
+        for (NSUInteger bucket = 0; bucket < kAKHistogramBucketCount; ++bucket)
+        {
+            target->histograms[span][bucket] += source->histograms[span][bucket];
+        }
+        target->totals[span] += source->totals[span];
+        target->maxima[span] = MAX(target->maxima[span], source->maxima[span]);
+    }
+    for (NSUInteger counter = 0; counter < AKCounterCount; ++counter)
+    {
+        target->counters[counter] += source->counters[counter];
+    }
+}
+
+static void AKThreadMetricsRetire(void *value)
+{
+    AKThreadMetrics *metrics = value;
+    pthread_mutex_lock(&AKThreadMetricsLock);
+    AKThreadMetrics **link = &AKThreadMetricsList;
+    while (*link && *link != metrics) link = &(*link)->next;
+    if (*link) *link = metrics->next;
+    AKThreadMetricsMerge(&AKRetiredThreadMetrics, metrics);
+    pthread_mutex_unlock(&AKThreadMetricsLock);
+    free(metrics);
+}
+
+static AKThreadMetrics *AKCurrentThreadMetrics(void)
+{
+    static dispatch_once_t once;
+    dispatch_once(&once, ^{
+        pthread_key_create(&AKThreadMetricsKey, AKThreadMetricsRetire);
+        mach_timebase_info(&AKTimebase);
+    });
+    
+    AKThreadMetrics *metrics = pthread_getspecific(AKThreadMetricsKey);
+    if (!metrics)
+    {
+        metrics = calloc(1, sizeof(AKThreadMetrics));
+        pthread_mutex_lock(&AKThreadMetricsLock);
+        metrics->next = AKThreadMetricsList;
+        AKThreadMetricsList = metrics;
+        pthread_mutex_unlock(&AKThreadMetricsLock);
+        pthread_setspecific(AKThreadMetricsKey, metrics);
+    }
+    return metrics;
+}
+
+NS_INLINE NSUInteger AKHistogramBucket(uint64_t microseconds)
+{
+    if (microseconds < 4) return (NSUInteger)microseconds;
+    NSUInteger exponent = 63 - __builtin_clzll(microseconds);
+    NSUInteger bucket = 4 * (exponent - 1) + ((microseconds >> (exponent - 2)) & 3);
+    return MIN(bucket, kAKHistogramBucketCount - 1);
+}
+
+NS_INLINE double AKHistogramBucketMidpoint(NSUInteger bucket)
+{
+    if (bucket < 4) return bucket + 0.5;
+    NSUInteger exponent = bucket / 4 + 1;
+    double lower = (double)((4 + bucket % 4) << (exponent - 2));
+    double width = (double)(1ULL << (exponent - 2));
+    return lower + width / 2.0;
+}
+
+AKSpanStart AKSpanBegin(void)
+{
+    return mach_absolute_time();
+}
+
+void AKSpanEnd(AKSpan span, AKSpanStart start)
+{
+    AKThreadMetrics *metrics = AKCurrentThreadMetrics();
+    uint64_t nanoseconds = (mach_absolute_time() - start) * AKTimebase.numer / AKTimebase.denom;
+    metrics->histograms[span][AKHistogramBucket(nanoseconds / 1000)] += 1;
+    metrics->totals[span] += nanoseconds;
+    if (nanoseconds > metrics->maxima[span]) metrics->maxima[span] = nanoseconds;
+}
+
+void AKCounterAdd(AKCounter counter, int64_t value)
+{
+    AKCurrentThreadMetrics()->counters[counter] += value;
+}
+
+@implementation AKInstrumentation
+
++ (NSString *)nameOfSpan: (AKSpan)span
+{
+    static NSString *const names[AKSpanCount] = {@"load", @"scan", @"diff", @"indexInsert", @"archive",
+                                                 @"searchKeystroke", @"searchQueueWait", @"mainThreadDelegate", @"facetFilter"};
+    return (span < AKSpanCount) ? names[span] : nil;
+}
+
++ (NSString *)nameOfCounter: (AKCounter)counter
+{
+    static NSString *const names[AKCounterCount] = {@"groupsLoaded", @"contactsScanned", @"contactsCreated",
+                                                    @"contactsChanged", @"contactsDeleted", @"searchTerminations",
+                                                    @"cacheSectionsWritten", @"cacheBytesWritten"};
+    return (counter < AKCounterCount) ? names[counter] : nil;
+}
+
++ (NSDictionary *)dictionaryRepresentation
+{
+    AKThreadMetrics *merged = calloc(1, sizeof(AKThreadMetrics));
+    
+    AKCurrentThreadMetrics(); // Initializes the timebase
+    pthread_mutex_lock(&AKThreadMetricsLock);
+    AKThreadMetricsMerge(merged, &AKRetiredThreadMetrics);
+    for (AKThreadMetrics *metrics = AKThreadMetricsList; metrics; metrics = metrics->next)
+    {
+        AKThreadMetricsMerge(merged, metrics);
+    }
+    pthread_mutex_unlock(&AKThreadMetricsLock);
+    
+    NSMutableDictionary *spans = [[NSMutableDictionary alloc] init];
+    for (NSUInteger span = 0; span < AKSpanCount; ++span)
+    {
+        uint64_t count = 0;
+        for (NSUInteger bucket = 0; bucket < kAKHistogramBucketCount; ++bucket)
+        {
+            count += merged->histograms[span][bucket];
+        }
+        if (count == 0) continue;
+        
+        double p50 = 0.0, p99 = 0.0;
+        uint64_t cumulative = 0;
+        for (NSUInteger bucket = 0; bucket < kAKHistogramBucketCount; ++bucket)
+        {
+            uint64_t previous = cumulative;
+            cumulative += merged->histograms[span][bucket];
+            if (previous < (count + 1) / 2 && cumulative >= (count + 1) / 2) p50 = AKHistogramBucketMidpoint(bucket) / 1000.0;
+            if (previous < (count * 99 + 99) / 100 && cumulative >= (count * 99 + 99) / 100) p99 = AKHistogramBucketMidpoint(bucket) / 1000.0;
+        }
+        
+        [spans setObject: @{@"count": @(count),
+                            @"totalMs": @(merged->totals[span] / 1e6),
+                            @"maxMs": @(merged->maxima[span] / 1e6),
+                            @"p50Ms": @(p50),
+                            @"p99Ms": @(p99)}
+                  forKey: [AKInstrumentation nameOfSpan: span]];
+    }
+    
+    NSMutableDictionary *counters = [[NSMutableDictionary alloc] init];
+    for (NSUInteger counter = 0; counter < AKCounterCount; ++counter)
+    {
+        [counters setObject: @(merged->counters[counter]) forKey: [AKInstrumentation nameOfCounter: counter]];
+    }
+    free(merged);
+    
+    return @{@"spans": [spans copy], @"counters": [counters copy]};
+}
+
++ (NSData *)JSONData
+{
+    NSError *error;
+    NSData *data = [NSJSONSerialization dataWithJSONObject: [AKInstrumentation dictionaryRepresentation] options: 0 error: &error];
+    if (error) { NSLog(@"NSJSONSerialization (%ld): %@", (long)error.code, error.localizedDescription); }
+    return data;
+}
+
++ (void)reset
+{
+    AKCurrentThreadMetrics();
+    pthread_mutex_lock(&AKThreadMetricsLock);
+    AKThreadMetrics *next;
+    for (AKThreadMetrics *metrics = AKThreadMetricsList; metrics; metrics = next)
+    {
+        next = metrics->next;
+        memset(metrics, 0, offsetof(AKThreadMetrics, next));
+    }
+    memset(&AKRetiredThreadMetrics, 0, sizeof(AKThreadMetrics));
+    pthread_mutex_unlock(&AKThreadMetricsLock);
+}
+
+@end
@@ -0,0 +1,56 @@
+//
+//  AKKeypadIndex.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKContactIndex.h"
+
+typedef NS_OPTIONS(NSUInteger, AKKeypadMatch)
+{
+    AKKeypadMatchName = 1 << 0,
+    AKKeypadMatchNumber = 1 << 1,
+};
+
+/**
+ * Dial pad index. Folded name tokens are stored by their keypad digits
+ * (2 = abc, 3 = def, ... 9 = wxyz) in a digit trie, phone numbers are stored
+ * by the trigrams of their digits
+ */
+@interface AKKeypadIndex : NSObject <AKContactIndex>
+
+/**
+ * Keypad digits of a folded token, nil if the token has characters not on the keypad
+ */
++ (NSString *)keypadDigitsForToken: (NSString *)token;
+/**
+ * AKKeypadMatch options keyed by contactID. Names match when one of their tokens
+ * starts with digits on the keypad, phone numbers match when they contain digits.
+ * Phone numbers are only matched by prefix for less than three digits
+ */
+- (NSDictionary *)contactIDsMatchingDigits: (NSString *)digits;
+
+@end
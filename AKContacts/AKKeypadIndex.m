@@ -0,0 +1,411 @@
+//
+//  AKKeypadIndex.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKKeypadIndex.h"
+#import "AKAddressBook.h"
+#import "AKSearchEntryIndex.h"
+
+static const int32_t kKeypadTrieNoNode = -1;
+static const NSUInteger kKeypadTrigramCount = 1000;
+static const NSUInteger kKeypadPhonePrefixLength = 2;
+
+typedef struct AKKeypadTrieNode {
+    int32_t children[10];
+    int32_t posting;
+} AKKeypadTrieNode;
+
+@interface AKKeypadRecord : NSObject
+
+@property (copy, nonatomic) NSArray *keypadTokens;
+@property (copy, nonatomic) NSArray *numbers;
+
+@end
+
+@implementation AKKeypadRecord
+
+@end
+
+@interface AKKeypadIndex ()
+{
+    AKKeypadTrieNode *_nodes;
+    int32_t _nodeCount;
+    int32_t _nodeCapacity;
+}
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+/**
+ * Sets of contactIDs referenced by the posting of trie nodes
+ */
+@property (strong, nonatomic) NSMutableArray *tokenPostings;
+/**
+ * Sets of contactIDs indexed by the value of a digit trigram
+ */
+@property (strong, nonatomic) NSArray *trigramPostings;
+/**
+ * Sets of contactIDs keyed by the first one and two digits of their numbers
+ */
+@property (strong, nonatomic) NSMutableDictionary *phonePrefixPostings;
+/**
+ * AKKeypadRecord keyed by contactID
+ */
+@property (strong, nonatomic) NSMutableDictionary *records;
+
+@end
+
+@implementation AKKeypadIndex
+
+#pragma mark - Class methods
+
++ (NSString *)keypadDigitsForToken: (NSString *)token
+{
+    static const char keypad[] = "22233344455566677778889999";
+    
+    NSUInteger length = token.length;
+    if (length == 0) return nil;
+    
+    unichar *characters = malloc(sizeof(unichar) * length);
+    [token getCharacters: characters range: NSMakeRange(0, length)];
+    
+    BOOL valid = YES;
+    for (NSUInteger index = 0; index < length && valid; ++index)
+    {
+        unichar character = characters[index];
+        if (character >= 'a' && character <= 'z') characters[index] = keypad[character - 'a'];
+        else if (character < '0' || character > '9') valid = NO;
+    }
+    NSString *digits = (valid) ? [[NSString alloc] initWithCharacters: characters length: length] : nil;
+    free(characters);
+    return digits;
+}
+
+NS_INLINE NSInteger AKKeypadTrigram(unichar digit1, unichar digit2, unichar digit3)
+{
+    return (digit1 - '0') * 100 + (digit2 - '0') * 10 + (digit3 - '0');
+}
+
+#pragma mark - Instance methods
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _queue = dispatch_queue_create([NSStringFromClass([AKKeypadIndex class]) UTF8String], DISPATCH_QUEUE_CONCURRENT);
+        _tokenPostings = [[NSMutableArray alloc] init];
+        _phonePrefixPostings = [[NSMutableDictionary alloc] init];
+        _records = [[NSMutableDictionary alloc] init];
+        
+        NSMutableArray *trigramPostings = [[NSMutableArray alloc] initWithCapacity: kKeypadTrigramCount];
+        for (NSUInteger index = 0; index < kKeypadTrigramCount; ++index)
+        {
+            [trigramPostings addObject: [[NSMutableSet alloc] init]];
+        }
+        _trigramPostings = [trigramPostings copy];
+        
+        [self resetTrie];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_nodes);
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+    dispatch_sync(self.queue, ^{
+        count = self.records.count;
+    });
+    return count;
+}
+
+- (void)insertSearchEntry: (AKSearchEntry *)entry
+{
+    NSMutableOrderedSet *keypadTokens = [[NSMutableOrderedSet alloc] init];
+    for (NSString *token in entry.tokens)
+    {
+        NSString *digits = [AKKeypadIndex keypadDigitsForToken: token];
+        if (digits) [keypadTokens addObject: digits];
+    }
+    
+    NSMutableOrderedSet *numbers = [[NSMutableOrderedSet alloc] init];
+    for (NSString *phoneNumber in entry.linkedPhoneNumbers)
+    {
+        NSString *digits = phoneNumber.stringWithNonDigitsRemoved;
+        if (digits.length > 0) [numbers addObject: digits];
+    }
+    
+    NSNumber *recordID = @(entry.recordID);
+    AKKeypadRecord *record = [[AKKeypadRecord alloc] init];
+    record.keypadTokens = [keypadTokens array];
+    record.numbers = [numbers array];
+    
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: recordID];
+        
+        if (record.keypadTokens.count == 0 && record.numbers.count == 0) return;
+        
+        for (NSString *digits in record.keypadTokens)
+        {
+            int32_t node = [self insertDigitsInTrie: digits];
+            if (_nodes[node].posting == kKeypadTrieNoNode)
+            {
+                _nodes[node].posting = (int32_t)self.tokenPostings.count;
+                [self.tokenPostings addObject: [[NSMutableSet alloc] init]];
+            }
+            [[self.tokenPostings objectAtIndex: _nodes[node].posting] addObject: recordID];
+        }
+        for (NSString *digits in record.numbers)
+        {
+            [self enumerateIndexKeysOfNumber: digits usingBlock: ^(NSMutableSet *posting) {
+                [posting addObject: recordID];
+            }];
+        }
+        [self.records setObject: record forKey: recordID];
+    });
+}
+
+- (void)removeRecordID: (ABRecordID)recordID
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: @(recordID)];
+    });
+}
+
+- (void)removeAllRecords
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self resetTrie];
+        [self.tokenPostings removeAllObjects];
+        [self.phonePrefixPostings removeAllObjects];
+        [self.records removeAllObjects];
+        for (NSMutableSet *posting in self.trigramPostings)
+        {
+            [posting removeAllObjects];
+        }
+    });
+}
+
+- (void)unindexRecordID: (NSNumber *)recordID
+{   // Trie nodes are kept with an empty posting until removeAllRecords
+    AKKeypadRecord *record = [self.records objectForKey: recordID];
+    if (!record) return;
+    
+    for (NSString *digits in record.keypadTokens)
+    {
+        int32_t node = [self nodeForDigits: digits];
+        if (node != kKeypadTrieNoNode && _nodes[node].posting != kKeypadTrieNoNode)
+        {
+            [[self.tokenPostings objectAtIndex: _nodes[node].posting] removeObject: recordID];
+        }
+    }
+    for (NSString *digits in record.numbers)
+    {
+        [self enumerateIndexKeysOfNumber: digits usingBlock: ^(NSMutableSet *posting) {
+            [posting removeObject: recordID];
+        }];
+    }
+    [self.records removeObjectForKey: recordID];
+}
+
+/**
+ * Calls block with each posting a phone number is a member of
+ */
+- (void)enumerateIndexKeysOfNumber: (NSString *)digits usingBlock: (void(^)(NSMutableSet *posting))block
+{
+    NSMutableArray *numbers = [[NSMutableArray alloc] initWithObjects: digits, nil];
+    for (NSString *prefix in [AKAddressBook countryCodePrefixes])
+    {
+        if ([digits hasPrefix: prefix] && digits.length > prefix.length)
+        {
+            [numbers addObject: [digits substringFromIndex: prefix.length]];
+        }
+    }
+    for (NSString *number in numbers)
+    {
+        for (NSUInteger length = 1; length <= MIN(number.length, kKeypadPhonePrefixLength); ++length)
+        {
+            NSString *prefix = [number substringToIndex: length];
+            NSMutableSet *posting = [self.phonePrefixPostings objectForKey: prefix];
+            if (!posting)
+            {
+                posting = [[NSMutableSet alloc] init];
+                [self.phonePrefixPostings setObject: posting forKey: prefix];
+            }
+            block(posting);
+        }
+    }
+    
+    NSUInteger length = digits.length;
+    if (length < 3) return;
+    unichar *characters = malloc(sizeof(unichar) * length);
+    [digits getCharacters: characters range: NSMakeRange(0, length)];
+    for (NSUInteger index = 0; index + 2 < length; ++index)
+    {
+        block([self.trigramPostings objectAtIndex: AKKeypadTrigram(characters[index], characters[index + 1], characters[index + 2])]);
+    }
+    free(characters);
+}
+
+#pragma mark - Trie
+
+- (void)resetTrie
+{
+    free(_nodes);
+    _nodeCapacity = 1024;
+    _nodes = malloc(sizeof(AKKeypadTrieNode) * _nodeCapacity);
+    _nodeCount = 0;
+    [self addNode];
+}
+
+- (int32_t)addNode
+{
+    if (_nodeCount == _nodeCapacity)
+    {
+        _nodeCapacity *= 2;
+        _nodes = realloc(_nodes, sizeof(AKKeypadTrieNode) * _nodeCapacity);
+    }
+    AKKeypadTrieNode *node = &_nodes[_nodeCount];
+    for (NSUInteger digit = 0; digit < 10; ++digit) node->children[digit] = kKeypadTrieNoNode;
+    node->posting = kKeypadTrieNoNode;
+    return _nodeCount++;
+}
+
+- (int32_t)insertDigitsInTrie: (NSString *)digits
+{
+    int32_t node = 0;
+    for (NSUInteger index = 0; index < digits.length; ++index)
+    {
+        NSUInteger digit = [digits characterAtIndex: index] - '0';
+        int32_t child = _nodes[node].children[digit];
+        if (child == kKeypadTrieNoNode)
+        {
+            child = [self addNode]; // May move _nodes
+            _nodes[node].children[digit] = child;
+        }
+        node = child;
+    }
+    return node;
+}
+
+- (int32_t)nodeForDigits: (NSString *)digits
+{
+    int32_t node = 0;
+    for (NSUInteger index = 0; index < digits.length && node != kKeypadTrieNoNode; ++index)
+    {
+        unichar character = [digits characterAtIndex: index];
+        if (character < '0' || character > '9') return kKeypadTrieNoNode;
+        node = _nodes[node].children[character - '0'];
+    }
+    return node;
+}
+
+#pragma mark - Matching
+
+- (NSDictionary *)contactIDsMatchingDigits: (NSString *)digits
+{
+    NSMutableDictionary *matches = [[NSMutableDictionary alloc] init];
+    digits = digits.stringWithNonDigitsRemoved;
+    if (digits.length == 0) return matches;
+    
+    void(^addMatches)(NSSet *, AKKeypadMatch) = ^(NSSet *contactIDs, AKKeypadMatch match) {
+        for (NSNumber *recordID in contactIDs)
+        {
+            NSNumber *options = [matches objectForKey: recordID];
+            [matches setObject: @(options.unsignedIntegerValue | match) forKey: recordID];
+        }
+    };
+    
+    dispatch_sync(self.queue, ^{
+        // Names: every posting in the subtree below the node of digits
+        int32_t node = [self nodeForDigits: digits];
+        if (node != kKeypadTrieNoNode)
+        {
+            NSUInteger stackCapacity = 64, stackCount = 0;
+            int32_t *stack = malloc(sizeof(int32_t) * stackCapacity);
+            stack[stackCount++] = node;
+            while (stackCount > 0)
+            {
+                AKKeypadTrieNode *current = &_nodes[stack[--stackCount]];
+                if (current->posting != kKeypadTrieNoNode)
+                {
+                    addMatches([self.tokenPostings objectAtIndex: current->posting], AKKeypadMatchName);
+                }
+                for (NSUInteger digit = 0; digit < 10; ++digit)
+                {
+                    if (current->children[digit] == kKeypadTrieNoNode) continue;
+                    if (stackCount == stackCapacity)
+                    {
+                        stackCapacity *= 2;
+                        stack = realloc(stack, sizeof(int32_t) * stackCapacity);
+                    }
+                    stack[stackCount++] = current->children[digit];
+                }
+            }
+            free(stack);
+        }
+        
+        // Numbers
+        if (digits.length <= kKeypadPhonePrefixLength)
+        {
+            addMatches([self.phonePrefixPostings objectForKey: digits], AKKeypadMatchNumber);
+        }
+        else
+        {   // Candidates from the rarest trigram, verified against the stored numbers
+            NSUInteger length = digits.length;
+            unichar *characters = malloc(sizeof(unichar) * length);
+            [digits getCharacters: characters range: NSMakeRange(0, length)];
+            NSSet *candidates;
+            for (NSUInteger index = 0; index + 2 < length; ++index)
+            {
+                NSSet *posting = [self.trigramPostings objectAtIndex: AKKeypadTrigram(characters[index], characters[index + 1], characters[index + 2])];
+                if (!candidates || posting.count < candidates.count) candidates = posting;
+            }
+            free(characters);
+            
+            NSMutableSet *verified = [[NSMutableSet alloc] init];
+            for (NSNumber *recordID in candidates)
+            {
+                for (NSString *number in [[self.records objectForKey: recordID] numbers])
+                {
+                    if ([number rangeOfString: digits].location != NSNotFound)
+                    {
+                        [verified addObject: recordID];
+                        break;
+                    }
+                }
+            }
+            addMatches(verified, AKKeypadMatchNumber);
+        }
+    });
+    return [matches copy];
+}
+
+@end
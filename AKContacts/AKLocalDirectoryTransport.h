@@ -0,0 +1,54 @@
+//
+//  AKLocalDirectoryTransport.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKDirectorySource.h"
+
+/**
+ * Directory transport answering queries from entries held in memory after a
+ * delay, in place of a directory server. Entries match a term if a word of
+ * their name, organization or email address has the term as prefix
+ */
+@interface AKLocalDirectoryTransport : NSObject <AKDirectoryTransport>
+
+/**
+ * Seconds before a query completes. Default value is 0
+ */
+@property (assign) NSTimeInterval latency;
+/**
+ * Queries received, including cancelled ones
+ */
+@property (assign, readonly) NSUInteger numberOfQueries;
+
+- (instancetype)initWithEntries: (NSArray *)entries;
+/**
+ * Plist of an array of dictionaries of AKDirectoryEntry
+ */
++ (instancetype)transportWithContentsOfFile: (NSString *)path;
+
+@end
@@ -0,0 +1,137 @@
+//
+//  AKLocalDirectoryTransport.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKLocalDirectoryTransport.h"
+
+@interface AKLocalDirectoryTransport ()
+
+@property (strong, nonatomic) NSArray *entries;
+@property (assign) NSUInteger numberOfQueries;
+/**
+ * Sets of the numbers of queries in flight keyed by term, only accessed on server_queue
+ */
+@property (strong, nonatomic) NSMutableDictionary *queriesInFlight;
+@property (strong, nonatomic) dispatch_queue_t server_queue;
+
+- (BOOL)entry: (AKDirectoryEntry *)entry matchesTerm: (NSString *)term;
+
+@end
+
+@implementation AKLocalDirectoryTransport
+
++ (instancetype)transportWithContentsOfFile: (NSString *)path
+{
+    NSMutableArray *entries = [[NSMutableArray alloc] init];
+    for (NSDictionary *dictionary in [NSArray arrayWithContentsOfFile: path])
+    {
+        AKDirectoryEntry *entry = [AKDirectoryEntry entryWithDictionary: dictionary];
+        if (entry) [entries addObject: entry];
+    }
+    return [[AKLocalDirectoryTransport alloc] initWithEntries: entries];
+}
+
+- (instancetype)initWithEntries: (NSArray *)entries
+{
+    self = [super init];
+    if (self)
+    {
+        _entries = [entries copy];
+        _queriesInFlight = [[NSMutableDictionary alloc] init];
+        _server_queue = dispatch_queue_create([NSStringFromClass([AKLocalDirectoryTransport class]) UTF8String], DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+- (BOOL)entry: (AKDirectoryEntry *)entry matchesTerm: (NSString *)term
+{
+    NSArray *fields = @[entry.displayName ?: @"", entry.organization ?: @"", entry.emailAddress ?: @""];
+    NSCharacterSet *separators = [NSCharacterSet characterSetWithCharactersInString: @" @.-_"];
+    for (NSString *field in fields)
+    {
+        for (NSString *word in [field componentsSeparatedByCharactersInSet: separators])
+        {
+            NSRange range = [word rangeOfString: term options: NSAnchoredSearch | NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch];
+            if (range.location != NSNotFound) return YES;
+        }
+    }
+    return NO;
+}
+
+- (void)searchDirectoryForTerm: (NSString *)term
+                     pageIndex: (NSUInteger)pageIndex
+                      pageSize: (NSUInteger)pageSize
+             completionHandler: (void (^)(NSArray *, BOOL, NSError *))completionHandler
+{
+    __block NSNumber *query;
+    dispatch_sync(self.server_queue, ^{
+        self.numberOfQueries += 1;
+        query = @(self.numberOfQueries);
+        
+        NSMutableSet *queries = [self.queriesInFlight objectForKey: term];
+        if (!queries)
+        {
+            queries = [[NSMutableSet alloc] init];
+            [self.queriesInFlight setObject: queries forKey: term];
+        }
+        [queries addObject: query];
+    });
+    
+    dispatch_time_t when = dispatch_time(DISPATCH_TIME_NOW, (int64_t)(self.latency * NSEC_PER_SEC));
+    dispatch_after(when, self.server_queue, ^{
+        
+        NSMutableSet *queries = [self.queriesInFlight objectForKey: term];
+        if (![queries member: query]) return; // Cancelled
+        [queries removeObject: query];
+        if (queries.count == 0) [self.queriesInFlight removeObjectForKey: term];
+        
+        NSMutableArray *matches = [[NSMutableArray alloc] init];
+        for (AKDirectoryEntry *entry in self.entries)
+        {
+            if ([self entry: entry matchesTerm: term]) [matches addObject: entry];
+        }
+        
+        NSUInteger location = pageIndex * pageSize;
+        NSArray *page = @[];
+        if (location < matches.count)
+        {
+            NSRange range = NSMakeRange(location, MIN(pageSize, matches.count - location));
+            page = [matches subarrayWithRange: range];
+        }
+        BOOL hasMorePages = (location + page.count < matches.count);
+        completionHandler(page, hasMorePages, nil);
+    });
+}
+
+- (void)cancelSearchForTerm: (NSString *)term
+{
+    dispatch_async(self.server_queue, ^{
+        [self.queriesInFlight removeObjectForKey: term];
+    });
+}
+
+@end
@@ -0,0 +1,58 @@
+//
+//  AKNameTokenIndex.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKContactIndex.h"
+
+/**
+ * Index of folded name tokens (first, middle, last name, nickname and organization)
+ * Tokens are stored in a BK-tree so that tokens within a bounded edit distance of
+ * a term are found without comparing the term against every token
+ */
+@interface AKNameTokenIndex : NSObject <AKContactIndex>
+
+/**
+ * Tokens are lowercased and have diacritics removed
+ */
++ (NSArray *)tokensForString: (NSString *)string;
+/**
+ * Levenshtein distance: insertions, deletions and substitutions each cost 1
+ * It is a metric, which the pruning of the BK-tree relies on
+ */
++ (NSUInteger)editDistanceBetweenString: (NSString *)string1 andString: (NSString *)string2;
+/**
+ * Set of contactIDs having a name token within maximumDistance edits of term
+ */
+- (NSSet *)contactIDsMatchingTerm: (NSString *)term maximumDistance: (NSUInteger)maximumDistance;
+/**
+ * Set of contactIDs having a name token whose prefix of the length of prefix
+ * is within maximumDistance edits of it, for matching as the user types
+ */
+- (NSSet *)contactIDsMatchingPrefix: (NSString *)prefix maximumDistance: (NSUInteger)maximumDistance;
+
+@end
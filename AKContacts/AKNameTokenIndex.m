@@ -0,0 +1,408 @@
+//
+//  AKNameTokenIndex.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKNameTokenIndex.h"
+#import "AKSearchEntryIndex.h"
+
+@interface AKBKTreeNode : NSObject
+
+@property (copy, nonatomic) NSString *token;
+/**
+ * Child nodes keyed by their edit distance from token
+ */
+@property (strong, nonatomic) NSMutableDictionary *children;
+
+@end
+
+@implementation AKBKTreeNode
+
+@end
+
+/**
+ * BK-tree of distinct tokens. Removed tokens stay in the tree as dead nodes
+ * that are skipped when matching, the tree is rebuilt from the live tokens
+ * once more than half of its nodes are dead
+ */
+@interface AKBKTree : NSObject
+
+@property (strong, nonatomic) AKBKTreeNode *root;
+@property (assign, nonatomic) NSUInteger nodeCount;
+@property (strong, nonatomic) NSMutableSet *deadTokens;
+
+- (void)insertToken: (NSString *)token;
+- (void)removeToken: (NSString *)token;
+- (void)enumerateTokensWithinDistance: (NSUInteger)maximumDistance ofTerm: (NSString *)term usingBlock: (void (^)(NSString *token))block;
+
+@end
+
+@implementation AKBKTree
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _deadTokens = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+- (void)insertToken: (NSString *)token
+{
+    if ([self.deadTokens member: token])
+    { // The node is still in the tree
+        [self.deadTokens removeObject: token];
+        return;
+    }
+    
+    if (!self.root)
+    {
+        self.root = [[AKBKTreeNode alloc] init];
+        self.root.token = token;
+        self.nodeCount = 1;
+        return;
+    }
+    
+    AKBKTreeNode *node = self.root;
+    while (YES)
+    {
+        NSUInteger distance = [AKNameTokenIndex editDistanceBetweenString: token andString: node.token];
+        if (distance == 0) return;
+        
+        AKBKTreeNode *child = [node.children objectForKey: @(distance)];
+        if (!child)
+        {
+            child = [[AKBKTreeNode alloc] init];
+            child.token = token;
+            if (!node.children) node.children = [[NSMutableDictionary alloc] init];
+            [node.children setObject: child forKey: @(distance)];
+            self.nodeCount += 1;
+            return;
+        }
+        node = child;
+    }
+}
+
+- (void)removeToken: (NSString *)token
+{
+    [self.deadTokens addObject: token];
+    if (self.deadTokens.count * 2 <= self.nodeCount) return;
+    
+    NSMutableArray *liveTokens = [[NSMutableArray alloc] initWithCapacity: self.nodeCount - self.deadTokens.count];
+    NSMutableArray *stack = [[NSMutableArray alloc] init];
+    if (self.root) [stack addObject: self.root];
+    while (stack.count > 0)
+    {
+        AKBKTreeNode *node = [stack lastObject];
+        [stack removeLastObject];
+        if (![self.deadTokens member: node.token]) [liveTokens addObject: node.token];
+        [stack addObjectsFromArray: [node.children allValues]];
+    }
+    
+    self.root = nil;
+    self.nodeCount = 0;
+    [self.deadTokens removeAllObjects];
+    for (NSString *liveToken in liveTokens)
+    {
+        [self insertToken: liveToken];
+    }
+}
+
+- (void)enumerateTokensWithinDistance: (NSUInteger)maximumDistance ofTerm: (NSString *)term usingBlock: (void (^)(NSString *token))block
+{
+    NSMutableArray *stack = [[NSMutableArray alloc] init];
+    if (self.root) [stack addObject: self.root];
+    
+    while (stack.count > 0)
+    {
+        AKBKTreeNode *node = [stack lastObject];
+        [stack removeLastObject];
+        
+        NSUInteger distance = [AKNameTokenIndex editDistanceBetweenString: term andString: node.token];
+        if (distance <= maximumDistance && ![self.deadTokens member: node.token])
+        {
+            block(node.token);
+        }
+        // Triangle inequality: only subtrees at distance [d - k, d + k] can contain matches
+        NSUInteger lowerBound = (distance > maximumDistance) ? distance - maximumDistance : 0;
+        NSUInteger upperBound = distance + maximumDistance;
+        [node.children enumerateKeysAndObjectsUsingBlock: ^(NSNumber *key, AKBKTreeNode *child, BOOL *stop) {
+            if (key.unsignedIntegerValue >= lowerBound && key.unsignedIntegerValue <= upperBound)
+            {
+                [stack addObject: child];
+            }
+        }];
+    }
+}
+
+@end
+
+@interface AKNameTokenIndex ()
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+@property (strong, nonatomic) AKBKTree *tokenTree;
+/**
+ * Trees of token prefixes keyed by prefix length
+ */
+@property (strong, nonatomic) NSMutableDictionary *prefixTrees;
+/**
+ * Sets of tokens keyed by their prefixes, a token is a prefix of itself
+ */
+@property (strong, nonatomic) NSMutableDictionary *tokensOfPrefixes;
+/**
+ * Sets of contactIDs keyed by token
+ */
+@property (strong, nonatomic) NSMutableDictionary *postings;
+/**
+ * Arrays of tokens keyed by contactID
+ */
+@property (strong, nonatomic) NSMutableDictionary *tokensOfRecords;
+
+@end
+
+@implementation AKNameTokenIndex
+
+#pragma mark - Class methods
+
++ (NSArray *)tokensForString: (NSString *)string
+{
+    if (string.length == 0) return @[];
+    
+    NSString *folded = string.stringWithDiacriticsRemoved.lowercaseString;
+    NSCharacterSet *separators = [[NSCharacterSet alphanumericCharacterSet] invertedSet];
+    NSMutableArray *tokens = [[NSMutableArray alloc] init];
+    for (NSString *token in [folded componentsSeparatedByCharactersInSet: separators])
+    {
+        if (token.length > 0) [tokens addObject: token];
+    }
+    return [tokens copy];
+}
+
++ (NSUInteger)editDistanceBetweenString: (NSString *)string1 andString: (NSString *)string2
+{
+    NSUInteger length1 = string1.length, length2 = string2.length;
+    if (length1 == 0) return length2;
+    if (length2 == 0) return length1;
+    
+    unichar *characters1 = malloc(sizeof(unichar) * length1);
+    unichar *characters2 = malloc(sizeof(unichar) * length2);
+    [string1 getCharacters: characters1 range: NSMakeRange(0, length1)];
+    [string2 getCharacters: characters2 range: NSMakeRange(0, length2)];
+    
+    NSUInteger *previous = malloc(sizeof(NSUInteger) * (length2 + 1));
+    NSUInteger *current = malloc(sizeof(NSUInteger) * (length2 + 1));
+    
+    for (NSUInteger j = 0; j <= length2; ++j) previous[j] = j;
+    
+    for (NSUInteger i = 1; i <= length1; ++i)
+    {
+        current[0] = i;
+        for (NSUInteger j = 1; j <= length2; ++j)
+        {
+            NSUInteger cost = (characters1[i - 1] == characters2[j - 1]) ? 0 : 1;
+            current[j] = MIN(MIN(previous[j] + 1, current[j - 1] + 1), previous[j - 1] + cost);
+        }
+        NSUInteger *recycled = previous;
+        previous = current;
+        current = recycled;
+    }
+    NSUInteger distance = previous[length2];
+    
+    free(characters1);
+    free(characters2);
+    free(previous);
+    free(current);
+    
+    return distance;
+}
+
+#pragma mark - Instance methods
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _queue = dispatch_queue_create([NSStringFromClass([AKNameTokenIndex class]) UTF8String], DISPATCH_QUEUE_CONCURRENT);
+        _tokenTree = [[AKBKTree alloc] init];
+        _prefixTrees = [[NSMutableDictionary alloc] init];
+        _tokensOfPrefixes = [[NSMutableDictionary alloc] init];
+        _postings = [[NSMutableDictionary alloc] init];
+        _tokensOfRecords = [[NSMutableDictionary alloc] init];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+    dispatch_sync(self.queue, ^{
+        count = self.tokensOfRecords.count;
+    });
+    return count;
+}
+
+- (void)insertSearchEntry: (AKSearchEntry *)entry
+{
+    NSArray *tokens = entry.tokens;
+    NSNumber *recordID = @(entry.recordID);
+    
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: recordID];
+        
+        for (NSString *token in tokens)
+        {
+            NSMutableSet *posting = [self.postings objectForKey: token];
+            if (!posting)
+            {
+                posting = [[NSMutableSet alloc] init];
+                [self.postings setObject: posting forKey: token];
+                [self insertToken: token];
+            }
+            [posting addObject: recordID];
+        }
+        if (tokens.count > 0)
+        {
+            [self.tokensOfRecords setObject: tokens forKey: recordID];
+        }
+    });
+}
+
+- (void)removeRecordID: (ABRecordID)recordID
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self unindexRecordID: @(recordID)];
+    });
+}
+
+- (void)removeAllRecords
+{
+    dispatch_barrier_sync(self.queue, ^{
+        self.tokenTree = [[AKBKTree alloc] init];
+        [self.prefixTrees removeAllObjects];
+        [self.tokensOfPrefixes removeAllObjects];
+        [self.postings removeAllObjects];
+        [self.tokensOfRecords removeAllObjects];
+    });
+}
+
+- (void)unindexRecordID: (NSNumber *)recordID
+{
+    for (NSString *token in [self.tokensOfRecords objectForKey: recordID])
+    {
+        NSMutableSet *posting = [self.postings objectForKey: token];
+        [posting removeObject: recordID];
+        if (posting && posting.count == 0)
+        { // No contact has the token anymore
+            [self.postings removeObjectForKey: token];
+            [self removeToken: token];
+        }
+    }
+    [self.tokensOfRecords removeObjectForKey: recordID];
+}
+
+- (void)insertToken: (NSString *)token
+{
+    [self.tokenTree insertToken: token];
+    
+    for (NSUInteger length = 1; length <= token.length; ++length)
+    {
+        NSString *prefix = [token substringToIndex: length];
+        NSMutableSet *tokens = [self.tokensOfPrefixes objectForKey: prefix];
+        if (!tokens)
+        {
+            tokens = [[NSMutableSet alloc] init];
+            [self.tokensOfPrefixes setObject: tokens forKey: prefix];
+            
+            AKBKTree *prefixTree = [self.prefixTrees objectForKey: @(length)];
+            if (!prefixTree)
+            {
+                prefixTree = [[AKBKTree alloc] init];
+                [self.prefixTrees setObject: prefixTree forKey: @(length)];
+            }
+            [prefixTree insertToken: prefix];
+        }
+        [tokens addObject: token];
+    }
+}
+
+- (void)removeToken: (NSString *)token
+{
+    [self.tokenTree removeToken: token];
+    
+    for (NSUInteger length = 1; length <= token.length; ++length)
+    {
+        NSString *prefix = [token substringToIndex: length];
+        NSMutableSet *tokens = [self.tokensOfPrefixes objectForKey: prefix];
+        [tokens removeObject: token];
+        if (tokens && tokens.count == 0)
+        {
+            [self.tokensOfPrefixes removeObjectForKey: prefix];
+            [[self.prefixTrees objectForKey: @(length)] removeToken: prefix];
+        }
+    }
+}
+
+- (NSSet *)contactIDsMatchingTerm: (NSString *)term maximumDistance: (NSUInteger)maximumDistance
+{
+    NSString *token = [[AKNameTokenIndex tokensForString: term] componentsJoinedByString: @""];
+    NSMutableSet *contactIDs = [[NSMutableSet alloc] init];
+    if (token.length == 0) return contactIDs;
+    
+    dispatch_sync(self.queue, ^{
+        [self.tokenTree enumerateTokensWithinDistance: maximumDistance ofTerm: token usingBlock: ^(NSString *match) {
+            [contactIDs unionSet: [self.postings objectForKey: match]];
+        }];
+    });
+    return [contactIDs copy];
+}
+
+- (NSSet *)contactIDsMatchingPrefix: (NSString *)prefix maximumDistance: (NSUInteger)maximumDistance
+{
+    NSString *token = [[AKNameTokenIndex tokensForString: prefix] componentsJoinedByString: @""];
+    NSMutableSet *contactIDs = [[NSMutableSet alloc] init];
+    if (token.length == 0) return contactIDs;
+    
+    dispatch_sync(self.queue, ^{
+        // Prefixes of the same length as the term, tokens of that length included
+        AKBKTree *prefixTree = [self.prefixTrees objectForKey: @(token.length)];
+        [prefixTree enumerateTokensWithinDistance: maximumDistance ofTerm: token usingBlock: ^(NSString *match) {
+            for (NSString *matchingToken in [self.tokensOfPrefixes objectForKey: match])
+            {
+                [contactIDs unionSet: [self.postings objectForKey: matchingToken]];
+            }
+        }];
+        // Whole tokens shorter than the term
+        [self.tokenTree enumerateTokensWithinDistance: maximumDistance ofTerm: token usingBlock: ^(NSString *match) {
+            if (match.length < token.length) [contactIDs unionSet: [self.postings objectForKey: match]];
+        }];
+    });
+    return [contactIDs copy];
+}
+
+@end
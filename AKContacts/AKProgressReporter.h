@@ -0,0 +1,68 @@
+//
+//  AKProgressReporter.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef void(^AKProgressHandler)(double fractionCompleted, BOOL finished);
+
+/**
+ * Progress of a task made of phases. Workers only bump atomic counters;
+ * observers are called on the main queue from a timer, at most
+ * updatesPerSecond times and only when the progress changed.
+ * The total of each phase is fixed when the phase begins
+ */
+@interface AKProgressReporter : NSObject
+
+@property (assign, nonatomic, readonly) NSUInteger updatesPerSecond;
+@property (assign, readonly) double fractionCompleted;
+@property (assign, readonly, getter = isFinished) BOOL finished;
+
+- (instancetype)initWithUpdatesPerSecond: (NSUInteger)updatesPerSecond;
+/**
+ * Resets the progress and starts publishing updates
+ */
+- (void)startWithPhaseCount: (NSUInteger)phaseCount;
+/**
+ * Completes the current phase and begins the next one
+ */
+- (void)beginPhaseWithTotalUnitCount: (int64_t)totalUnitCount;
+/**
+ * Safe to call from any thread, does not call observers
+ */
+- (void)advanceByUnitCount: (int64_t)unitCount;
+/**
+ * Publishes the final update. Observers see finished only once per start
+ */
+- (void)finish;
+/**
+ * The handler is called with the current state first. Returns a token for removeObserver:
+ */
+- (id)addObserverWithHandler: (AKProgressHandler)handler;
+- (void)removeObserver: (id)observer;
+
+@end
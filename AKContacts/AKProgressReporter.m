@@ -0,0 +1,189 @@
+//
+//  AKProgressReporter.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKProgressReporter.h"
+#import <libkern/OSAtomic.h>
+
+@interface AKProgressReporter ()
+{
+    volatile int64_t _completedUnitCount;
+    volatile int64_t _totalUnitCount;
+    volatile int32_t _phase;
+    volatile int32_t _finished;
+}
+
+@property (assign, nonatomic) NSUInteger phaseCount;
+@property (strong, nonatomic) dispatch_queue_t queue;
+@property (strong, nonatomic) dispatch_source_t timer;
+/**
+ * Handlers keyed by observer token. Only accessed on the main queue
+ */
+@property (strong, nonatomic) NSMapTable *handlers;
+@property (assign, nonatomic) double publishedFraction;
+@property (assign, nonatomic) BOOL publishedFinished;
+
+@end
+
+@implementation AKProgressReporter
+
+- (instancetype)initWithUpdatesPerSecond: (NSUInteger)updatesPerSecond
+{
+    self = [super init];
+    if (self)
+    {
+        _updatesPerSecond = MAX(updatesPerSecond, 1);
+        _queue = dispatch_queue_create([NSStringFromClass([AKProgressReporter class]) UTF8String], DISPATCH_QUEUE_SERIAL);
+        _handlers = [NSMapTable strongToStrongObjectsMapTable];
+        _phaseCount = 1;
+        _phase = -1;
+        _publishedFraction = -1.0;
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    if (_timer) dispatch_source_cancel(_timer);
+}
+
+- (double)fractionCompleted
+{
+    if (_finished) return 1.0;
+    if (_phase < 0) return 0.0;
+    
+    int64_t total = _totalUnitCount;
+    int64_t completed = _completedUnitCount;
+    double phaseFraction = (total > 0) ? MIN((double)completed / total, 1.0) : 0.0;
+    return MIN((_phase + phaseFraction) / self.phaseCount, 1.0);
+}
+
+- (BOOL)isFinished
+{
+    return (_finished != 0);
+}
+
+- (void)startWithPhaseCount: (NSUInteger)phaseCount
+{
+    dispatch_sync(self.queue, ^{
+        self.phaseCount = MAX(phaseCount, 1);
+        _phase = -1;
+        _completedUnitCount = 0;
+        _totalUnitCount = 0;
+        _finished = 0;
+        OSMemoryBarrier();
+        
+        dispatch_async(dispatch_get_main_queue(), ^{
+            self.publishedFraction = -1.0;
+            self.publishedFinished = NO;
+        });
+        
+        if (!self.timer)
+        {
+            self.timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, self.queue);
+            uint64_t interval = NSEC_PER_SEC / self.updatesPerSecond;
+            dispatch_source_set_timer(self.timer, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+            __weak AKProgressReporter *_self = self;
+            dispatch_source_set_event_handler(self.timer, ^{
+                [_self publish];
+            });
+            dispatch_resume(self.timer);
+        }
+    });
+}
+
+- (void)beginPhaseWithTotalUnitCount: (int64_t)totalUnitCount
+{
+    dispatch_sync(self.queue, ^{
+        _totalUnitCount = MAX(totalUnitCount, 0);
+        _completedUnitCount = 0;
+        OSAtomicIncrement32Barrier(&_phase);
+    });
+}
+
+- (void)advanceByUnitCount: (int64_t)unitCount
+{
+    OSAtomicAdd64Barrier(unitCount, &_completedUnitCount);
+}
+
+- (void)finish
+{
+    if (!OSAtomicCompareAndSwap32Barrier(0, 1, &_finished)) return;
+    
+    dispatch_async(self.queue, ^{
+        if (self.timer)
+        {
+            dispatch_source_cancel(self.timer);
+            self.timer = nil;
+        }
+        [self publish];
+    });
+}
+
+/**
+ * Called on queue
+ */
+- (void)publish
+{
+    BOOL finished = self.isFinished;
+    double fractionCompleted = self.fractionCompleted;
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (self.publishedFinished) return; // Finished is published once per start
+        if (!finished && fractionCompleted == self.publishedFraction) return;
+        
+        self.publishedFraction = fractionCompleted;
+        self.publishedFinished = finished;
+        for (AKProgressHandler handler in [[self.handlers objectEnumerator] allObjects])
+        {
+            handler(fractionCompleted, finished);
+        }
+    });
+}
+
+- (id)addObserverWithHandler: (AKProgressHandler)handler
+{
+    id observer = [[NSObject alloc] init];
+    AKProgressHandler copiedHandler = [handler copy];
+    dispatch_block_t block = ^{
+        [self.handlers setObject: copiedHandler forKey: observer];
+        copiedHandler(self.fractionCompleted, self.isFinished);
+    };
+    if ([NSThread isMainThread]) block();
+    else dispatch_async(dispatch_get_main_queue(), block);
+    return observer;
+}
+
+- (void)removeObserver: (id)observer
+{
+    dispatch_block_t block = ^{
+        [self.handlers removeObjectForKey: observer];
+    };
+    if ([NSThread isMainThread]) block();
+    else dispatch_async(dispatch_get_main_queue(), block);
+}
+
+@end
@@ -0,0 +1,54 @@
+//
+//  AKRankedResults.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Immutable array of contactIDs ordered by descending score and ascending sort rank
+ * Only the first page is put in order on creation; the rest is ordered lazily,
+ * a page at a time, as objects past the ordered prefix are accessed
+ */
+@interface AKRankedResults : NSArray
+
+/**
+ * Number of elements ordered on creation and on each subsequent extension
+ * of the ordered prefix. Default value is 50
+ */
++ (NSUInteger)defaultPageSize;
+
+/**
+ * scores and ranks are parallel to recordIDs. Higher scores come first,
+ * equal scores are ordered by ascending rank
+ */
+- (instancetype)initWithRecordIDs: (NSArray *)recordIDs scores: (const NSInteger *)scores ranks: (NSDictionary *)ranks pageSize: (NSUInteger)pageSize;
+/**
+ * The elements in no particular order. Does not order the tail
+ */
+- (NSArray *)unorderedRecordIDs;
+
+@end
@@ -0,0 +1,181 @@
+//
+//  AKRankedResults.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKRankedResults.h"
+
+typedef struct AKRankedEntry {
+    ABRecordID recordID;
+    NSInteger score;
+    NSUInteger rank;
+} AKRankedEntry;
+
+NS_INLINE NSComparisonResult AKRankedEntryCompare(const AKRankedEntry *entry1, const AKRankedEntry *entry2)
+{
+    if (entry1->score != entry2->score) return (entry1->score > entry2->score) ? NSOrderedAscending : NSOrderedDescending;
+    if (entry1->rank != entry2->rank) return (entry1->rank < entry2->rank) ? NSOrderedAscending : NSOrderedDescending;
+    if (entry1->recordID != entry2->recordID) return (entry1->recordID < entry2->recordID) ? NSOrderedAscending : NSOrderedDescending;
+    return NSOrderedSame;
+}
+
+static int AKRankedEntrySortCompare(const void *entry1, const void *entry2)
+{
+    return (int)AKRankedEntryCompare(entry1, entry2);
+}
+
+NS_INLINE void AKRankedEntrySwap(AKRankedEntry *entries, NSUInteger index1, NSUInteger index2)
+{
+    AKRankedEntry entry = entries[index1];
+    entries[index1] = entries[index2];
+    entries[index2] = entry;
+}
+
+/**
+ * Quickselect: moves the k smallest entries of [from, to) to [from, from + k) in no particular order
+ */
+static void AKRankedEntrySelect(AKRankedEntry *entries, NSUInteger from, NSUInteger to, NSUInteger k)
+{
+    NSUInteger target = from + k;
+    while (to - from > 1 && target > from && target < to)
+    {
+        NSUInteger pivot = from + arc4random_uniform((u_int32_t)(to - from));
+        AKRankedEntrySwap(entries, pivot, to - 1);
+        NSUInteger store = from;
+        for (NSUInteger index = from; index < to - 1; ++index)
+        {
+            if (AKRankedEntryCompare(&entries[index], &entries[to - 1]) == NSOrderedAscending)
+            {
+                AKRankedEntrySwap(entries, index, store++);
+            }
+        }
+        AKRankedEntrySwap(entries, store, to - 1);
+        
+        if (store == target || store + 1 == target) return;
+        if (store > target) to = store;
+        else from = store + 1;
+    }
+}
+
+@interface AKRankedResults ()
+{
+    AKRankedEntry *_entries;
+    NSUInteger _count;
+    NSUInteger _orderedCount;
+    NSUInteger _pageSize;
+}
+
+@end
+
+@implementation AKRankedResults
+
++ (NSUInteger)defaultPageSize
+{
+    return 50;
+}
+
+- (instancetype)initWithRecordIDs: (NSArray *)recordIDs scores: (const NSInteger *)scores ranks: (NSDictionary *)ranks pageSize: (NSUInteger)pageSize
+{
+    self = [super init];
+    if (self)
+    {
+        _count = recordIDs.count;
+        _pageSize = MAX(pageSize, 1);
+        _entries = malloc(sizeof(AKRankedEntry) * MAX(_count, 1));
+        
+        NSUInteger index = 0;
+        for (NSNumber *recordID in recordIDs)
+        {
+            NSNumber *rank = [ranks objectForKey: recordID];
+            _entries[index].recordID = recordID.intValue;
+            _entries[index].score = (scores) ? scores[index] : 0;
+            _entries[index].rank = (rank) ? rank.unsignedIntegerValue : NSUIntegerMax;
+            index += 1;
+        }
+        [self orderThroughIndex: 0];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    free(_entries);
+}
+
+/**
+ * Extend the ordered prefix with whole pages until it covers index
+ */
+- (void)orderThroughIndex: (NSUInteger)index
+{
+    @synchronized (self)
+    {
+        while (_orderedCount <= index && _orderedCount < _count)
+        {
+            NSUInteger length = MIN(_pageSize, _count - _orderedCount);
+            AKRankedEntrySelect(_entries, _orderedCount, _count, length);
+            qsort(_entries + _orderedCount, length, sizeof(AKRankedEntry), AKRankedEntrySortCompare);
+            _orderedCount += length;
+        }
+    }
+}
+
+- (NSUInteger)count
+{
+    return _count;
+}
+
+- (id)objectAtIndex: (NSUInteger)index
+{
+    if (index >= _count)
+    {
+        [NSException raise: NSRangeException format: @"Index %lu beyond bounds [0 .. %ld]", (unsigned long)index, (long)_count - 1];
+    }
+    if (index >= _orderedCount)
+    {
+        [self orderThroughIndex: index];
+    }
+    return @(_entries[index].recordID);
+}
+
+- (NSArray *)unorderedRecordIDs
+{
+    NSMutableArray *recordIDs = [[NSMutableArray alloc] initWithCapacity: _count];
+    @synchronized (self)
+    {
+        for (NSUInteger index = 0; index < _count; ++index)
+        {
+            [recordIDs addObject: @(_entries[index].recordID)];
+        }
+    }
+    return [recordIDs copy];
+}
+
+- (id)copyWithZone: (NSZone *)zone
+{   // Immutable; lazy ordering is synchronized
+    return self;
+}
+
+@end
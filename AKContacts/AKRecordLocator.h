@@ -0,0 +1,101 @@
+//
+//  AKRecordLocator.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AddressBook/AddressBook.h>
+
+@class AKContact;
+
+/**
+ * What a contact is sorted by within a section: people by their name of the
+ * sort ordering, or the other name if missing, with the other name breaking
+ * ties. Organizations by their organization name. Records that are neither
+ * sort after them and missing names sort as empty ones
+ */
+@interface AKSortKey : NSObject
+
+@property (assign, nonatomic, readonly) BOOL isPerson;
+@property (assign, nonatomic, readonly) BOOL isOrganization;
+@property (copy, nonatomic, readonly) NSString *name;
+@property (copy, nonatomic, readonly) NSString *tieBreaker;
+
++ (instancetype)sortKeyOfContact: (AKContact *)contact sortOrdering: (ABPersonSortOrdering)sortOrdering;
++ (instancetype)sortKeyWithPropertyList: (NSArray *)propertyList;
+- (NSArray *)propertyListRepresentation;
+- (NSComparisonResult)compare: (AKSortKey *)sortKey;
+
+@end
+
+/**
+ * Sections and sort key of each record of a section table as it was inserted,
+ * so a record is found by binary search in the sections it was inserted in
+ * even after it was renamed or deleted in ABAddressBook.
+ * Not thread safe, used with the section tables on serial_queue
+ */
+@interface AKRecordLocator : NSObject
+
+@property (assign, nonatomic, readonly) ABPersonSortOrdering sortOrdering;
+@property (assign, nonatomic, readonly) NSUInteger count;
+
+- (instancetype)initWithSortOrdering: (ABPersonSortOrdering)sortOrdering;
+/**
+ * Inserts the record into the sorted section unless it is already there, returns its index
+ */
+- (NSUInteger)insertRecordID: (ABRecordID)recordID
+                 withSortKey: (AKSortKey *)sortKey
+            inSectionWithKey: (NSString *)sectionKey
+                  ofSections: (NSDictionary *)sections
+           andAddressBookRef: (ABAddressBookRef)addressBookRef;
+/**
+ * Removes the record from every section it was inserted in, returns its index
+ * in the first of them or NSNotFound if it was not in the sections
+ */
+- (NSUInteger)removeRecordID: (ABRecordID)recordID
+                fromSections: (NSDictionary *)sections
+           andAddressBookRef: (ABAddressBookRef)addressBookRef;
+/**
+ * Keys of the sections the record is in, the section of its name first
+ */
+- (NSArray *)sectionKeysOfRecordID: (ABRecordID)recordID;
+/**
+ * Locates the records of section tables read from the cache with the sort key
+ * sections persisted along with them. Sort keys missing from them are read
+ * from ABAddressBook when first compared
+ */
+- (void)locateRecordsOfSections: (NSDictionary *)sections withSortKeySections: (NSDictionary *)sortKeySections;
+- (void)removeAllRecords;
+/**
+ * Sort keys the sections were ordered with, for persisting them as a table of
+ * their own: arrays of recordID and sort key property list pairs in the order
+ * of the section keyed by section key. Only sections whose records or sort
+ * keys changed since the last call are built again, the others are the arrays
+ * returned before
+ */
+- (NSDictionary *)sortKeySectionsOfSections: (NSDictionary *)sections;
+
+@end
@@ -0,0 +1,336 @@
+//
+//  AKRecordLocator.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKRecordLocator.h"
+#import "AKAddressBook.h"
+#import "AKContact.h"
+
+typedef NS_ENUM(NSInteger, AKSortKeyKind)
+{
+    AKSortKeyKindOther = 0,
+    AKSortKeyKindPerson,
+    AKSortKeyKindOrganization,
+};
+
+@implementation AKSortKey
+
++ (instancetype)sortKeyOfContact: (AKContact *)contact sortOrdering: (ABPersonSortOrdering)sortOrdering
+{
+    AKSortKey *sortKey = [[AKSortKey alloc] init];
+    if (contact.isPerson)
+    {
+        ABPropertyID property = (sortOrdering == kABPersonSortByFirstName) ? kABPersonFirstNameProperty : kABPersonLastNameProperty;
+        ABPropertyID otherProperty = (sortOrdering == kABPersonSortByFirstName) ? kABPersonLastNameProperty : kABPersonFirstNameProperty;
+        sortKey->_isPerson = YES;
+        sortKey->_tieBreaker = [contact valueForProperty: otherProperty];
+        sortKey->_name = [contact valueForProperty: property];
+        if (!sortKey->_name) sortKey->_name = sortKey->_tieBreaker;
+    }
+    else if (contact.isOrganization)
+    {
+        sortKey->_isOrganization = YES;
+        sortKey->_name = [contact valueForProperty: kABPersonOrganizationProperty];
+    }
+    return sortKey;
+}
+
+/**
+ * Kind, then the name and tie breaker if present
+ */
++ (instancetype)sortKeyWithPropertyList: (NSArray *)propertyList
+{
+    if (![propertyList isKindOfClass: [NSArray class]] || propertyList.count == 0 || propertyList.count > 3) return nil;
+    for (NSUInteger index = 1; index < propertyList.count; ++index)
+    {
+        if (![[propertyList objectAtIndex: index] isKindOfClass: [NSString class]]) return nil;
+    }
+    NSNumber *kind = [propertyList objectAtIndex: 0];
+    if (![kind isKindOfClass: [NSNumber class]]) return nil;
+    
+    AKSortKey *sortKey = [[AKSortKey alloc] init];
+    sortKey->_isPerson = (kind.integerValue == AKSortKeyKindPerson);
+    sortKey->_isOrganization = (kind.integerValue == AKSortKeyKindOrganization);
+    sortKey->_name = (propertyList.count > 1) ? [propertyList objectAtIndex: 1] : nil;
+    sortKey->_tieBreaker = (propertyList.count > 2) ? [propertyList objectAtIndex: 2] : nil;
+    return sortKey;
+}
+
+- (NSArray *)propertyListRepresentation
+{
+    AKSortKeyKind kind = (self.isPerson) ? AKSortKeyKindPerson : (self.isOrganization) ? AKSortKeyKindOrganization : AKSortKeyKindOther;
+    if (self.tieBreaker) return @[@(kind), (self.name) ? self.name : @"", self.tieBreaker];
+    if (self.name) return @[@(kind), self.name];
+    return @[@(kind)];
+}
+
+- (NSComparisonResult)compare: (AKSortKey *)sortKey
+{
+    // A total order, sections are binary searched with it
+    BOOL isListed = (self.isPerson || self.isOrganization);
+    BOOL isOtherListed = (sortKey.isPerson || sortKey.isOrganization);
+    if (isListed != isOtherListed)
+    {
+        return (isListed) ? NSOrderedAscending : NSOrderedDescending;
+    }
+    NSString *name = (self.name) ? self.name : @"";
+    NSComparisonResult result = [name localizedCaseInsensitiveCompare: (sortKey.name) ? sortKey.name : @""];
+    if (result == NSOrderedSame)
+    {
+        NSString *tieBreaker = (self.tieBreaker) ? self.tieBreaker : @"";
+        result = [tieBreaker localizedCaseInsensitiveCompare: (sortKey.tieBreaker) ? sortKey.tieBreaker : @""];
+    }
+    return result;
+}
+
+@end
+
+@interface AKRecordLocator ()
+
+/**
+ * NSMutableArray of section keys keyed by recordID
+ */
+@property (strong, nonatomic) NSMutableDictionary *sectionKeys;
+/**
+ * AKSortKey keyed by recordID, as inserted, as persisted or as first read
+ */
+@property (strong, nonatomic) NSMutableDictionary *sortKeys;
+/**
+ * Sort key sections last returned for archiving keyed by section key, and the
+ * keys of the sections whose records or sort keys changed since
+ */
+@property (strong, nonatomic) NSMutableDictionary *sortKeySections;
+@property (strong, nonatomic) NSMutableSet *dirtySectionKeys;
+
+@end
+
+@implementation AKRecordLocator
+
+- (instancetype)initWithSortOrdering: (ABPersonSortOrdering)sortOrdering
+{
+    self = [super init];
+    if (self)
+    {
+        _sortOrdering = sortOrdering;
+        _sectionKeys = [[NSMutableDictionary alloc] init];
+        _sortKeys = [[NSMutableDictionary alloc] init];
+        _sortKeySections = [[NSMutableDictionary alloc] init];
+        _dirtySectionKeys = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return self.sectionKeys.count;
+}
+
+- (AKSortKey *)sortKeyOfRecordID: (NSNumber *)recordID withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    AKSortKey *sortKey = [self.sortKeys objectForKey: recordID];
+    if (!sortKey)
+    {
+        AKContact *contact = [[AKAddressBook sharedInstance] contactForContactId: recordID.intValue withAddressBookRef: addressBookRef];
+        sortKey = [AKSortKey sortKeyOfContact: contact sortOrdering: self.sortOrdering];
+        [self.sortKeys setObject: sortKey forKey: recordID];
+        [self.dirtySectionKeys addObjectsFromArray: [self.sectionKeys objectForKey: recordID]];
+    }
+    return sortKey;
+}
+
+- (NSComparator)comparatorWithAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    return ^NSComparisonResult(NSNumber *recordID1, NSNumber *recordID2) {
+        @autoreleasepool
+        {
+            return [[self sortKeyOfRecordID: recordID1 withAddressBookRef: addressBookRef] compare: [self sortKeyOfRecordID: recordID2 withAddressBookRef: addressBookRef]];
+        }
+    };
+}
+
+- (NSUInteger)insertRecordID: (ABRecordID)recordID
+                 withSortKey: (AKSortKey *)sortKey
+            inSectionWithKey: (NSString *)sectionKey
+                  ofSections: (NSDictionary *)sections
+           andAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSMutableArray *sectionArray = [sections objectForKey: sectionKey];
+    if (!sectionArray) return NSNotFound;
+    
+    NSNumber *key = @(recordID);
+    NSMutableArray *sectionKeys = [self.sectionKeys objectForKey: key];
+    if ([sectionKeys containsObject: sectionKey])
+    {
+        return [self indexOfRecordID: key inSectionArray: sectionArray withAddressBookRef: addressBookRef];
+    }
+    
+    if (sortKey)
+    {
+        [self.sortKeys setObject: sortKey forKey: key];
+        [self.dirtySectionKeys addObjectsFromArray: sectionKeys];
+    }
+    [self.dirtySectionKeys addObject: sectionKey];
+    NSUInteger index = [sectionArray indexOfObject: key
+                                     inSortedRange: NSMakeRange(0, sectionArray.count)
+                                           options: NSBinarySearchingInsertionIndex | NSBinarySearchingLastEqual
+                                   usingComparator: [self comparatorWithAddressBookRef: addressBookRef]];
+    [sectionArray insertObject: key atIndex: index];
+    
+    if (!sectionKeys)
+    {
+        sectionKeys = [[NSMutableArray alloc] initWithCapacity: 1];
+        [self.sectionKeys setObject: sectionKeys forKey: key];
+    }
+    [sectionKeys addObject: sectionKey];
+    return index;
+}
+
+- (NSUInteger)removeRecordID: (ABRecordID)recordID
+                fromSections: (NSDictionary *)sections
+           andAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSNumber *key = @(recordID);
+    NSArray *sectionKeys = [self.sectionKeys objectForKey: key];
+    __block NSUInteger firstIndex = NSNotFound;
+    
+    [sectionKeys enumerateObjectsUsingBlock: ^(NSString *sectionKey, NSUInteger position, BOOL *stop) {
+        NSMutableArray *sectionArray = [sections objectForKey: sectionKey];
+        NSUInteger index = [self indexOfRecordID: key inSectionArray: sectionArray withAddressBookRef: addressBookRef];
+        if (index != NSNotFound)
+        {
+            [sectionArray removeObjectAtIndex: index];
+        }
+        if (position == 0)
+        {
+            firstIndex = index;
+        }
+    }];
+    [self.dirtySectionKeys addObjectsFromArray: sectionKeys];
+    [self.sectionKeys removeObjectForKey: key];
+    [self.sortKeys removeObjectForKey: key];
+    return firstIndex;
+}
+
+/**
+ * Binary search by the sort keys the section was ordered with, then among the
+ * records sorted equal. Sections reordered by changes the loader has not yet
+ * applied are searched linearly
+ */
+- (NSUInteger)indexOfRecordID: (NSNumber *)recordID inSectionArray: (NSArray *)sectionArray withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    if (sectionArray.count == 0) return NSNotFound;
+    
+    NSComparator comparator = [self comparatorWithAddressBookRef: addressBookRef];
+    NSUInteger index = [sectionArray indexOfObject: recordID
+                                     inSortedRange: NSMakeRange(0, sectionArray.count)
+                                           options: NSBinarySearchingFirstEqual
+                                   usingComparator: comparator];
+    for (; index < sectionArray.count; ++index)
+    {
+        NSNumber *candidate = [sectionArray objectAtIndex: index];
+        if ([candidate isEqualToNumber: recordID]) return index;
+        if (comparator(candidate, recordID) != NSOrderedSame) break;
+    }
+    return [sectionArray indexOfObject: recordID];
+}
+
+- (NSArray *)sectionKeysOfRecordID: (ABRecordID)recordID
+{
+    return [[self.sectionKeys objectForKey: @(recordID)] copy];
+}
+
+- (void)locateRecordsOfSections: (NSDictionary *)sections withSortKeySections: (NSDictionary *)sortKeySections
+{
+    [self removeAllRecords];
+    
+    NSCharacterSet *digits = [NSCharacterSet decimalDigitCharacterSet];
+    NSArray *sortedKeys = [[sections allKeys] sortedArrayUsingComparator: ^NSComparisonResult(NSString *key1, NSString *key2) {
+        // Sections of names before digit sections, which only repeat records of "#"
+        BOOL isDigit1 = [key1 isMemberOfCharacterSet: digits], isDigit2 = [key2 isMemberOfCharacterSet: digits];
+        return (isDigit1 == isDigit2) ? [key1 compare: key2] : (isDigit1) ? NSOrderedDescending : NSOrderedAscending;
+    }];
+    for (NSString *sectionKey in sortedKeys)
+    {
+        for (NSNumber *recordID in [sections objectForKey: sectionKey])
+        {
+            NSMutableArray *sectionKeys = [self.sectionKeys objectForKey: recordID];
+            if (!sectionKeys)
+            {
+                sectionKeys = [[NSMutableArray alloc] initWithCapacity: 1];
+                [self.sectionKeys setObject: sectionKeys forKey: recordID];
+            }
+            if (![sectionKeys containsObject: sectionKey]) [sectionKeys addObject: sectionKey];
+        }
+    }
+    
+    // Only keys of located records, the sections they sorted were written with them
+    [sortKeySections enumerateKeysAndObjectsUsingBlock: ^(NSString *sectionKey, NSArray *sortKeySection, BOOL *stop) {
+        if (![sections objectForKey: sectionKey]) return;
+        
+        for (NSArray *pair in sortKeySection)
+        {
+            NSNumber *recordID = ([pair isKindOfClass: [NSArray class]] && pair.count == 2) ? [pair objectAtIndex: 0] : nil;
+            AKSortKey *sortKey = ([recordID isKindOfClass: [NSNumber class]]) ? [AKSortKey sortKeyWithPropertyList: [pair objectAtIndex: 1]] : nil;
+            if (sortKey && [self.sectionKeys objectForKey: recordID]) [self.sortKeys setObject: sortKey forKey: recordID];
+        }
+        // As persisted, so it is only written again once it changes
+        [self.sortKeySections setObject: [sortKeySection copy] forKey: sectionKey];
+    }];
+    [self.dirtySectionKeys removeAllObjects];
+}
+
+- (void)removeAllRecords
+{
+    [self.sectionKeys removeAllObjects];
+    [self.sortKeys removeAllObjects];
+    [self.sortKeySections removeAllObjects];
+    [self.dirtySectionKeys removeAllObjects];
+}
+
+- (NSDictionary *)sortKeySectionsOfSections: (NSDictionary *)sections
+{
+    NSMutableDictionary *sortKeySections = [[NSMutableDictionary alloc] initWithCapacity: sections.count];
+    [sections enumerateKeysAndObjectsUsingBlock: ^(NSString *sectionKey, NSArray *sectionArray, BOOL *stop) {
+        NSArray *sortKeySection = [self.sortKeySections objectForKey: sectionKey];
+        if (!sortKeySection || [self.dirtySectionKeys containsObject: sectionKey])
+        {   // Records whose sort key was never read are read again when first compared
+            NSMutableArray *pairs = [[NSMutableArray alloc] initWithCapacity: sectionArray.count];
+            for (NSNumber *recordID in sectionArray)
+            {
+                AKSortKey *sortKey = [self.sortKeys objectForKey: recordID];
+                if (sortKey) [pairs addObject: @[recordID, [sortKey propertyListRepresentation]]];
+            }
+            sortKeySection = [pairs copy];
+        }
+        [sortKeySections setObject: sortKeySection forKey: sectionKey];
+    }];
+    [self.sortKeySections setDictionary: sortKeySections];
+    [self.dirtySectionKeys removeAllObjects];
+    return [sortKeySections copy];
+}
+
+@end
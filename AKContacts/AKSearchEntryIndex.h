@@ -0,0 +1,115 @@
+//
+//  AKSearchEntryIndex.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKContactIndex.h"
+
+@class AKContact;
+
+/**
+ * Searchable properties of a contact: folded (lowercased, diacritics removed)
+ * names and phone numbers. Matches search terms the same way whether it was
+ * read from ABAddressBook or from a persisted index
+ */
+@interface AKSearchEntry : NSObject
+
+@property (assign, nonatomic, readonly) ABRecordID recordID;
+@property (assign, nonatomic, readonly) BOOL isPerson;
+@property (assign, nonatomic, readonly) BOOL isOrganization;
+@property (copy, nonatomic, readonly) NSString *firstName;
+@property (copy, nonatomic, readonly) NSString *middleName;
+@property (copy, nonatomic, readonly) NSString *lastName;
+@property (copy, nonatomic, readonly) NSString *nickname;
+@property (copy, nonatomic, readonly) NSString *organization;
+/**
+ * Phone numbers of the record in the order of their identifiers
+ */
+@property (copy, nonatomic, readonly) NSArray *phoneNumbers;
+/**
+ * Phone numbers of the record and of its linked records
+ */
+@property (copy, nonatomic, readonly) NSArray *linkedPhoneNumbers;
+/**
+ * Birthday and dates of the record as @[identifier, month, day, year] arrays
+ * The identifier of the birthday is kABMultiValueInvalidIdentifier, the year is 0 if unknown
+ */
+@property (copy, nonatomic, readonly) NSArray *dates;
+/**
+ * Arrays of organization, department, job title and city values of the record
+ * indexed by AKFacet, as displayed
+ */
+@property (copy, nonatomic, readonly) NSArray *facetValues;
+/**
+ * Canonical email addresses of the record and of its linked records
+ */
+@property (copy, nonatomic, readonly) NSArray *emailAddresses;
+
++ (instancetype)entryWithContact: (AKContact *)contact;
+- (instancetype)initWithRecordID: (ABRecordID)recordID propertyList: (NSArray *)propertyList;
+- (NSArray *)propertyListRepresentation;
+/**
+ * Distinct tokens of first, middle, last name, nickname and organization
+ */
+- (NSArray *)tokens;
+/**
+ * See -[AKContact numberOfMatchingTerms:score:]
+ */
+- (NSInteger)numberOfMatchingTerms: (NSArray *)terms score: (NSInteger *)score;
+- (NSArray *)indexesOfPhoneNumbersMatchingTerms: (NSArray *)terms preciseMatch: (BOOL)preciseMatch;
+
+@end
+
+/**
+ * Search entries of all indexed contacts. Persisted next to the section tables
+ * in a paged file that is memory mapped on load: pages are decoded when an
+ * entry of theirs is first requested. Entries inserted or removed after the
+ * load shadow the ones in the file
+ */
+@interface AKSearchEntryIndex : NSObject <AKContactIndex>
+
+/**
+ * Nil if the recordID is not indexed
+ */
+- (AKSearchEntry *)entryForRecordID: (ABRecordID)recordID;
+- (void)enumerateEntriesUsingBlock: (void (^)(AKSearchEntry *entry))block;
+/**
+ * Replaces the content of the index with the file if its stamp matches
+ * Returns NO and leaves the index empty otherwise
+ */
+- (BOOL)loadFromFile: (NSString *)path withStamp: (uint64_t)stamp;
+/**
+ * AKSearchEntry keyed by contactID, nil if the index has not changed since
+ * it was loaded or since the previous call
+ */
+- (NSDictionary *)entriesForArchiving;
+/**
+ * Content of an index file, may be called on any queue
+ */
++ (NSData *)dataWithEntries: (NSDictionary *)entries stamp: (uint64_t)stamp;
+
+@end
@@ -0,0 +1,598 @@
+//
+//  AKSearchEntryIndex.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKSearchEntryIndex.h"
+#import "AKAddressBook.h"
+#import "AKNameTokenIndex.h"
+#import "AKContact.h"
+#import "AKCacheRegistry.h"
+
+static const uint32_t kSearchEntryFileMagic = 0x45534B41; // "AKSE" in little endian
+static const uint32_t kSearchEntryFileVersion = 4;
+static const NSUInteger kSearchEntryPageSize = 256;
+/**
+ * Estimated size of decoded pages relative to their binary property list
+ */
+static const NSUInteger kSearchEntryDecodedPageRatio = 4;
+static const NSInteger kSearchEntryNoYear = 1604; // Year of dates without a year in ABAddressBook
+
+typedef NS_ENUM(NSInteger, AKSearchEntryKind)
+{
+    AKSearchEntryKindOther = 0,
+    AKSearchEntryKindPerson = 1,
+    AKSearchEntryKindOrganization = 2,
+};
+
+typedef struct AKSearchEntryFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t stamp;
+    uint32_t recordCount;
+    uint32_t pageCount;
+} AKSearchEntryFileHeader;
+
+/**
+ * Pages are sorted by recordID, a page holds the records from its firstRecordID
+ * up to the firstRecordID of the next page
+ */
+typedef struct AKSearchEntryFilePage {
+    int32_t firstRecordID;
+    uint32_t offset;
+    uint32_t length;
+} AKSearchEntryFilePage;
+
+#pragma mark - AKSearchEntry
+
+@implementation AKSearchEntry
+
++ (instancetype)entryWithContact: (AKContact *)contact
+{
+    AKSearchEntry *entry = [[AKSearchEntry alloc] init];
+    entry->_recordID = contact.recordID;
+    entry->_isPerson = contact.isPerson;
+    entry->_isOrganization = contact.isOrganization;
+    entry->_firstName = [[contact valueForProperty: kABPersonFirstNameProperty] stringWithDiacriticsRemoved].lowercaseString;
+    entry->_middleName = [[contact valueForProperty: kABPersonMiddleNameProperty] stringWithDiacriticsRemoved].lowercaseString;
+    entry->_lastName = [[contact valueForProperty: kABPersonLastNameProperty] stringWithDiacriticsRemoved].lowercaseString;
+    entry->_nickname = [[contact valueForProperty: kABPersonNicknameProperty] stringWithDiacriticsRemoved].lowercaseString;
+    entry->_organization = [[contact valueForProperty: kABPersonOrganizationProperty] stringWithDiacriticsRemoved].lowercaseString;
+    
+    NSMutableArray *phoneNumbers = [[NSMutableArray alloc] init];
+    for (NSNumber *identifier in [contact identifiersForMultiValueProperty: kABPersonPhoneProperty])
+    {
+        NSString *value = [contact valueForMultiValueProperty: kABPersonPhoneProperty andIdentifier: identifier.intValue];
+        [phoneNumbers addObject: (value) ? value : @""];
+    }
+    entry->_phoneNumbers = [phoneNumbers copy];
+    
+    NSArray *linkedPhoneNumbers = [contact valuesForLinkedMultiValueProperty: kABPersonPhoneProperty];
+    entry->_linkedPhoneNumbers = ([linkedPhoneNumbers isEqualToArray: phoneNumbers]) ? entry->_phoneNumbers : [linkedPhoneNumbers copy];
+    
+    NSMutableArray *dates = [[NSMutableArray alloc] init];
+    NSArray *(^components)(ABMultiValueIdentifier, NSDate *) = ^(ABMultiValueIdentifier identifier, NSDate *date) {
+        NSDateComponents *components = [[AKSearchEntry calendar] components: NSYearCalendarUnit | NSMonthCalendarUnit | NSDayCalendarUnit fromDate: date];
+        NSInteger year = (components.year == kSearchEntryNoYear) ? 0 : components.year;
+        return @[@(identifier), @(components.month), @(components.day), @(year)];
+    };
+    NSDate *birthday = [contact valueForProperty: kABPersonBirthdayProperty];
+    if ([birthday isKindOfClass: [NSDate class]])
+    {
+        [dates addObject: components(kABMultiValueInvalidIdentifier, birthday)];
+    }
+    for (NSNumber *identifier in [contact identifiersForMultiValueProperty: kABPersonDateProperty])
+    {
+        NSDate *date = [contact valueForMultiValueProperty: kABPersonDateProperty andIdentifier: identifier.intValue];
+        if ([date isKindOfClass: [NSDate class]])
+        {
+            [dates addObject: components(identifier.intValue, date)];
+        }
+    }
+    entry->_dates = [dates copy];
+    
+    NSArray *(^values)(NSArray *) = ^(NSArray *strings) {
+        NSMutableOrderedSet *values = [[NSMutableOrderedSet alloc] init];
+        for (NSString *string in strings)
+        {
+            NSString *value = ([string isKindOfClass: [NSString class]]) ? string.stringWithWhiteSpaceTrimmed : nil;
+            if (value.length > 0) [values addObject: value];
+        }
+        return [values array];
+    };
+    NSMutableArray *cities = [[NSMutableArray alloc] init];
+    for (NSNumber *identifier in [contact identifiersForMultiValueProperty: kABPersonAddressProperty])
+    {
+        NSDictionary *address = [contact valueForMultiValueProperty: kABPersonAddressProperty andIdentifier: identifier.intValue];
+        NSString *city = ([address isKindOfClass: [NSDictionary class]]) ? [address objectForKey: (NSString *)kABPersonAddressCityKey] : nil;
+        if (city) [cities addObject: city];
+    }
+    // Indexed by AKFacet
+    NSArray *facetValues = @[values(@[[contact valueForProperty: kABPersonOrganizationProperty] ?: @""]),
+                             values(@[[contact valueForProperty: kABPersonDepartmentProperty] ?: @""]),
+                             values(@[[contact valueForProperty: kABPersonJobTitleProperty] ?: @""]),
+                             values(cities)];
+    entry->_facetValues = facetValues;
+    
+    NSMutableOrderedSet *emailAddresses = [[NSMutableOrderedSet alloc] init];
+    for (NSString *value in [contact valuesForLinkedMultiValueProperty: kABPersonEmailProperty])
+    {
+        NSString *address = ([value isKindOfClass: [NSString class]]) ? value.stringWithCanonicalEmailAddress : nil;
+        if (address) [emailAddresses addObject: address];
+    }
+    entry->_emailAddresses = [emailAddresses array];
+    
+    return entry;
+}
+
+/**
+ * ABAddressBook stores dates at noon GMT, they are read in GMT to keep the day
+ */
++ (NSCalendar *)calendar
+{
+    static NSCalendar *calendar = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        calendar = [[NSCalendar alloc] initWithCalendarIdentifier: NSGregorianCalendar];
+        calendar.timeZone = [NSTimeZone timeZoneForSecondsFromGMT: 0];
+    });
+    return calendar;
+}
+
+- (instancetype)initWithRecordID: (ABRecordID)recordID propertyList: (NSArray *)propertyList
+{
+    if (![propertyList isKindOfClass: [NSArray class]] || propertyList.count != 11) return nil;
+    
+    self = [super init];
+    if (self)
+    {
+        NSString *(^string)(NSUInteger) = ^(NSUInteger index) {
+            NSString *value = [propertyList objectAtIndex: index];
+            return (value.length > 0) ? value : nil;
+        };
+        _recordID = recordID;
+        AKSearchEntryKind kind = [[propertyList objectAtIndex: 0] integerValue];
+        _isPerson = (kind == AKSearchEntryKindPerson);
+        _isOrganization = (kind == AKSearchEntryKindOrganization);
+        _firstName = string(1);
+        _middleName = string(2);
+        _lastName = string(3);
+        _nickname = string(4);
+        _organization = string(5);
+        _phoneNumbers = [propertyList objectAtIndex: 6];
+        NSArray *linkedPhoneNumbers = [propertyList objectAtIndex: 7];
+        _linkedPhoneNumbers = (linkedPhoneNumbers.count > 0) ? linkedPhoneNumbers : _phoneNumbers;
+        _dates = [propertyList objectAtIndex: 8];
+        _facetValues = [propertyList objectAtIndex: 9];
+        _emailAddresses = [propertyList objectAtIndex: 10];
+    }
+    return self;
+}
+
+- (NSArray *)propertyListRepresentation
+{
+    AKSearchEntryKind kind = (self.isPerson) ? AKSearchEntryKindPerson : (self.isOrganization) ? AKSearchEntryKindOrganization : AKSearchEntryKindOther;
+    NSArray *linkedPhoneNumbers = (self.linkedPhoneNumbers == self.phoneNumbers) ? @[] : self.linkedPhoneNumbers;
+    return @[@(kind),
+             (self.firstName) ? self.firstName : @"",
+             (self.middleName) ? self.middleName : @"",
+             (self.lastName) ? self.lastName : @"",
+             (self.nickname) ? self.nickname : @"",
+             (self.organization) ? self.organization : @"",
+             (self.phoneNumbers) ? self.phoneNumbers : @[],
+             (linkedPhoneNumbers) ? linkedPhoneNumbers : @[],
+             (self.dates) ? self.dates : @[],
+             (self.facetValues) ? self.facetValues : @[],
+             (self.emailAddresses) ? self.emailAddresses : @[]];
+}
+
+- (NSArray *)tokens
+{
+    NSMutableOrderedSet *tokens = [[NSMutableOrderedSet alloc] init];
+    for (NSString *name in @[(self.firstName) ? self.firstName : @"", (self.middleName) ? self.middleName : @"",
+                             (self.lastName) ? self.lastName : @"", (self.nickname) ? self.nickname : @"",
+                             (self.organization) ? self.organization : @""])
+    {
+        [tokens addObjectsFromArray: [AKNameTokenIndex tokensForString: name]];
+    }
+    return [tokens array];
+}
+
+- (NSInteger)numberOfMatchingTerms: (NSArray *)terms score: (NSInteger *)score
+{
+    NSInteger termsMatched = 0, matchScore = 0;
+    
+    void(^setBit)(NSInteger *, NSInteger) = ^(NSInteger *byte, NSInteger bit) { *byte |= 1 << bit; };
+    BOOL(^isBitSet)(NSInteger *, NSInteger) = ^(NSInteger *byte, NSInteger bit) { return (BOOL)(*byte & (1 << bit)); };
+    
+    if (self.isPerson)
+    {
+        NSArray *values = @[(self.firstName) ? self.firstName : @"", (self.lastName) ? self.lastName : @"", (self.middleName) ? self.middleName : @""];
+        NSInteger middleNameIndex = 2;
+        
+        NSInteger termBitmask = 0, nameBitmask = 0;
+        for (NSInteger i = 0; i < terms.count; ++i)
+        {
+            NSString *term = [[[terms objectAtIndex: i] lowercaseString] stringWithDiacriticsRemoved];
+            for (NSInteger j = 0; j < values.count; ++j)
+            {
+                NSString *value = [values objectAtIndex: j];
+                if (value.length > 0 && [value hasPrefix: term] && !isBitSet(&termBitmask, i) && !isBitSet(&nameBitmask, j))
+                {
+                    termsMatched += 1;
+                    setBit(&termBitmask, i);
+                    setBit(&nameBitmask, j);
+                    // Whole-word matches outrank prefixes, first and last names outrank the middle name
+                    matchScore += (value.length == term.length) ? 3 : 1;
+                    matchScore += (j != middleNameIndex) ? 1 : 0;
+                }
+            }
+        }
+    }
+    else if (self.isOrganization)
+    {
+        NSString *term = [terms componentsJoinedByString: @" "];
+        term = term.stringWithDiacriticsRemoved.lowercaseString;
+        if (self.organization.length > 0 && [self.organization hasPrefix: term])
+        {
+            termsMatched += 1;
+            matchScore += (self.organization.length == term.length) ? 4 : 2;
+        }
+    }
+    if (score) *score = matchScore;
+    return termsMatched;
+}
+
+- (NSArray *)indexesOfPhoneNumbersMatchingTerms: (NSArray *)terms preciseMatch: (BOOL)preciseMatch
+{
+    BOOL (^stringMatchesTerm)(NSString *, NSString *) = ^(NSString *string, NSString *term) {
+        if (preciseMatch) {
+            return [string isEqualToString: term];
+        }
+        else {
+            return [string hasPrefix: term];
+        }
+    };
+    
+    NSMutableArray *phoneTerms = [[NSMutableArray alloc] init];
+    for (NSString *term in terms)
+    {
+        if (term.stringWithNormalizedPhoneNumber.length > 0)
+        {
+            [phoneTerms addObject: term];
+        }
+    }
+    
+    NSMutableArray *matchingIndexes = [[NSMutableArray alloc] init];
+    if (phoneTerms.count == 0) return matchingIndexes;
+    
+    for (NSInteger index = 0; index < self.phoneNumbers.count; ++index)
+    {
+        NSString *value = [self.phoneNumbers objectAtIndex: index];
+        NSString *digits = value.stringWithNonDigitsRemoved;
+        if (digits.length == 0) continue;
+        
+        for (NSString *term in phoneTerms)
+        {
+            if (term.length == 0)
+            {
+                continue;
+            }
+            if (stringMatchesTerm(digits, term) || stringMatchesTerm(value.stringWithNormalizedPhoneNumber, term) || stringMatchesTerm(value, term))
+            {
+                [matchingIndexes addObject: @(index)];
+                break;
+            }
+            for (NSString *prefix in [AKAddressBook countryCodePrefixes])
+            {
+                if ([digits hasPrefix: prefix])
+                {
+                    digits = [digits substringFromIndex: prefix.length];
+                    if (digits.length > 0 && stringMatchesTerm(digits, term))
+                    {
+                        [matchingIndexes addObject: @(index)];
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return [matchingIndexes copy];
+}
+
+@end
+
+#pragma mark - AKSearchEntryIndex
+
+@interface AKSearchEntryIndex ()
+{
+    const AKSearchEntryFilePage *_pages;
+    uint32_t _pageCount;
+    NSUInteger _count;
+    BOOL _changed;
+}
+
+@property (strong, nonatomic) dispatch_queue_t queue;
+/**
+ * Memory mapped content of the file the index was loaded from
+ */
+@property (strong, nonatomic) NSData *mappedData;
+/**
+ * Decoded pages: dictionaries of AKSearchEntry keyed by contactID, keyed by page index
+ */
+@property (strong, nonatomic) AKCache *pageCache;
+/**
+ * AKSearchEntry keyed by contactID of entries inserted since the load
+ */
+@property (strong, nonatomic) NSMutableDictionary *insertedEntries;
+/**
+ * ContactIDs removed since the load
+ */
+@property (strong, nonatomic) NSMutableSet *removedRecordIDs;
+
+@end
+
+@implementation AKSearchEntryIndex
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _queue = dispatch_queue_create([NSStringFromClass([AKSearchEntryIndex class]) UTF8String], DISPATCH_QUEUE_CONCURRENT);
+        _pageCache = [[AKCache alloc] initWithName: @"searchEntryPages" priority: AKCachePriorityIndex];
+        _insertedEntries = [[NSMutableDictionary alloc] init];
+        _removedRecordIDs = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    __block NSUInteger count;
+    dispatch_sync(self.queue, ^{
+        count = _count;
+    });
+    return count;
+}
+
+- (void)insertSearchEntry: (AKSearchEntry *)entry
+{
+    NSNumber *recordID = @(entry.recordID);
+    dispatch_barrier_sync(self.queue, ^{
+        if (![self lookUpEntryForRecordID: recordID]) ++_count;
+        [self.insertedEntries setObject: entry forKey: recordID];
+        _changed = YES;
+        [self.removedRecordIDs removeObject: recordID];
+    });
+}
+
+- (void)removeRecordID: (ABRecordID)recordID
+{
+    dispatch_barrier_sync(self.queue, ^{
+        if ([self lookUpEntryForRecordID: @(recordID)])
+        {
+            --_count;
+            _changed = YES;
+        }
+        [self.insertedEntries removeObjectForKey: @(recordID)];
+        if (self.mappedData) [self.removedRecordIDs addObject: @(recordID)];
+    });
+}
+
+- (void)removeAllRecords
+{
+    dispatch_barrier_sync(self.queue, ^{
+        [self unmap];
+        _changed = YES;
+    });
+}
+
+- (void)unmap
+{
+    self.mappedData = nil;
+    _pages = NULL;
+    _pageCount = 0;
+    _count = 0;
+    [self.pageCache removeAllObjects];
+    [self.insertedEntries removeAllObjects];
+    [self.removedRecordIDs removeAllObjects];
+}
+
+- (AKSearchEntry *)entryForRecordID: (ABRecordID)recordID
+{
+    __block AKSearchEntry *entry;
+    dispatch_sync(self.queue, ^{
+        entry = [self lookUpEntryForRecordID: @(recordID)];
+    });
+    return entry;
+}
+
+- (void)enumerateEntriesUsingBlock: (void (^)(AKSearchEntry *))block
+{
+    dispatch_sync(self.queue, ^{
+        for (uint32_t pageIndex = 0; pageIndex < _pageCount; ++pageIndex)
+        {
+            @autoreleasepool
+            {
+                [[self entriesOfPageAtIndex: pageIndex] enumerateKeysAndObjectsUsingBlock: ^(NSNumber *recordID, AKSearchEntry *entry, BOOL *stop) {
+                    if (![self.insertedEntries objectForKey: recordID] && ![self.removedRecordIDs member: recordID])
+                    {
+                        block(entry);
+                    }
+                }];
+            }
+        }
+        for (AKSearchEntry *entry in [self.insertedEntries objectEnumerator])
+        {
+            block(entry);
+        }
+    });
+}
+
+/**
+ * Must be called on queue
+ */
+- (AKSearchEntry *)lookUpEntryForRecordID: (NSNumber *)recordID
+{
+    AKSearchEntry *entry = [self.insertedEntries objectForKey: recordID];
+    if (entry || _pageCount == 0 || [self.removedRecordIDs member: recordID]) return entry;
+    
+    // Last page starting at or before recordID
+    int32_t value = recordID.intValue;
+    if (value < _pages[0].firstRecordID) return nil;
+    uint32_t low = 0, high = _pageCount - 1;
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low + 1) / 2;
+        if (_pages[middle].firstRecordID <= value) low = middle;
+        else high = middle - 1;
+    }
+    return [[self entriesOfPageAtIndex: low] objectForKey: recordID];
+}
+
+/**
+ * Must be called on queue
+ */
+- (NSDictionary *)entriesOfPageAtIndex: (uint32_t)pageIndex
+{
+    NSDictionary *entries = [self.pageCache objectForKey: @(pageIndex)];
+    if (entries) return entries;
+    
+    NSData *mappedData = self.mappedData;
+    const AKSearchEntryFilePage page = _pages[pageIndex];
+    NSData *pageData = [NSData dataWithBytesNoCopy: (void *)((const uint8_t *)mappedData.bytes + page.offset) length: page.length freeWhenDone: NO];
+    
+    NSError *error;
+    NSDictionary *plist = [NSPropertyListSerialization propertyListWithData: pageData options: NSPropertyListImmutable format: NULL error: &error];
+    if (error) { NSLog(@"NSPropertyListSerialization (%ld): %@", (long)error.code, error.localizedDescription); }
+    
+    NSMutableDictionary *mutableEntries = [[NSMutableDictionary alloc] initWithCapacity: plist.count];
+    if ([plist isKindOfClass: [NSDictionary class]])
+    {
+        [plist enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSArray *propertyList, BOOL *stop) {
+            AKSearchEntry *entry = [[AKSearchEntry alloc] initWithRecordID: key.intValue propertyList: propertyList];
+            if (entry) [mutableEntries setObject: entry forKey: @(entry.recordID)];
+        }];
+    }
+    entries = [mutableEntries copy];
+    [self.pageCache setObject: entries forKey: @(pageIndex) cost: page.length * kSearchEntryDecodedPageRatio];
+    return entries;
+}
+
+- (BOOL)loadFromFile: (NSString *)path withStamp: (uint64_t)stamp
+{
+    NSError *error;
+    NSData *data = [NSData dataWithContentsOfFile: path options: NSDataReadingMappedAlways error: &error];
+    
+    BOOL valid = (data.length >= sizeof(AKSearchEntryFileHeader));
+    const AKSearchEntryFileHeader *header = data.bytes;
+    valid = valid && header->magic == kSearchEntryFileMagic && header->version == kSearchEntryFileVersion && header->stamp == stamp;
+    valid = valid && (data.length - sizeof(AKSearchEntryFileHeader)) / sizeof(AKSearchEntryFilePage) >= header->pageCount;
+    
+    const AKSearchEntryFilePage *pages = (valid) ? (const AKSearchEntryFilePage *)(header + 1) : NULL;
+    for (uint32_t pageIndex = 0; valid && pageIndex < header->pageCount; ++pageIndex)
+    {
+        valid = ((uint64_t)pages[pageIndex].offset + pages[pageIndex].length <= data.length);
+    }
+    
+    dispatch_barrier_sync(self.queue, ^{
+        [self unmap];
+        if (valid)
+        {
+            self.mappedData = data;
+            _pages = pages;
+            _pageCount = header->pageCount;
+            _count = header->recordCount;
+        }
+        _changed = NO;
+    });
+    return valid;
+}
+
+- (NSDictionary *)entriesForArchiving
+{
+    __block BOOL changed;
+    dispatch_barrier_sync(self.queue, ^{
+        changed = _changed;
+        _changed = NO;
+    });
+    if (!changed) return nil;
+    
+    NSMutableDictionary *entries = [[NSMutableDictionary alloc] init];
+    [self enumerateEntriesUsingBlock: ^(AKSearchEntry *entry) {
+        [entries setObject: entry forKey: @(entry.recordID)];
+    }];
+    return [entries copy];
+}
+
++ (NSData *)dataWithEntries: (NSDictionary *)entries stamp: (uint64_t)stamp
+{
+    NSArray *recordIDs = [[entries allKeys] sortedArrayUsingSelector: @selector(compare:)];
+    
+    uint32_t pageCount = (uint32_t)((recordIDs.count + kSearchEntryPageSize - 1) / kSearchEntryPageSize);
+    AKSearchEntryFileHeader header = { kSearchEntryFileMagic, kSearchEntryFileVersion, stamp, (uint32_t)recordIDs.count, pageCount };
+    AKSearchEntryFilePage *pages = calloc(MAX(pageCount, 1), sizeof(AKSearchEntryFilePage));
+    
+    NSMutableData *pagesData = [[NSMutableData alloc] init];
+    uint32_t offset = (uint32_t)(sizeof(AKSearchEntryFileHeader) + sizeof(AKSearchEntryFilePage) * pageCount);
+    BOOL success = YES;
+    
+    for (uint32_t pageIndex = 0; pageIndex < pageCount && success; ++pageIndex)
+    {
+        @autoreleasepool
+        {
+            NSRange range = NSMakeRange(pageIndex * kSearchEntryPageSize, MIN(kSearchEntryPageSize, recordIDs.count - pageIndex * kSearchEntryPageSize));
+            NSMutableDictionary *plist = [[NSMutableDictionary alloc] initWithCapacity: range.length];
+            for (NSNumber *recordID in [recordIDs subarrayWithRange: range])
+            {
+                [plist setObject: [[entries objectForKey: recordID] propertyListRepresentation] forKey: recordID.stringValue];
+            }
+            
+            NSError *error;
+            NSData *pageData = [NSPropertyListSerialization dataWithPropertyList: plist format: NSPropertyListBinaryFormat_v1_0 options: 0 error: &error];
+            if (error) { NSLog(@"NSPropertyListSerialization (%ld): %@", (long)error.code, error.localizedDescription); success = NO; }
+            
+            pages[pageIndex].firstRecordID = [[recordIDs objectAtIndex: range.location] intValue];
+            pages[pageIndex].offset = offset + (uint32_t)pagesData.length;
+            pages[pageIndex].length = (uint32_t)pageData.length;
+            [pagesData appendData: pageData];
+        }
+    }
+    
+    NSMutableData *data = nil;
+    if (success)
+    {
+        data = [[NSMutableData alloc] initWithBytes: &header length: sizeof(header)];
+        [data appendBytes: pages length: sizeof(AKSearchEntryFilePage) * pageCount];
+        [data appendData: pagesData];
+    }
+    free(pages);
+    
+    return data;
+}
+
+@end
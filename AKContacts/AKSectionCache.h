@@ -0,0 +1,93 @@
+//
+//  AKSectionCache.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+/**
+ * Write-behind persistence of the section tables. Each section is stored in a
+ * file of its own and only sections that differ from their persisted version
+ * are written. Writes are coalesced and run on a background priority queue.
+ * Every file is replaced atomically (written to a temporary file and renamed)
+ * and carries the stamp of its batch. A commit record, listing the stamp of
+ * every file, is written last once all files of a batch are in place. Files
+ * whose stamp differs from the commit record are from an incomplete batch
+ */
+@interface AKSectionCache : NSObject
+
+/**
+ * Bytes written by the last committed batch
+ */
+@property (assign, readonly) unsigned long long bytesWrittenByLastCommit;
+
+- (instancetype)initWithDirectoryPath: (NSString *)path;
+/**
+ * Date committed along with the tables, nil if none was
+ */
+@property (strong, readonly) NSDate *committedWatermark;
+
+/**
+ * Mutable dictionaries of mutable section arrays keyed by table name, nil if
+ * any of the tables has not been written yet or a section file does not match
+ * the commit record. Sections read are considered persisted
+ */
+- (NSDictionary *)readTablesNamed: (NSArray *)tableNames;
+/**
+ * Schedules the write of sections that differ from their persisted version
+ * Sections are copied so call on the queue that mutates the tables
+ */
+- (void)writeTables: (NSDictionary *)tables;
+/**
+ * Schedules the write of a file with the batch. The block is called on the
+ * write queue with the stamp of the batch. A later block for the same file
+ * replaces a block that has not been called yet
+ */
+- (void)writeFileNamed: (NSString *)fileName withDataBlock: (NSData *(^)(uint64_t stamp))block;
+/**
+ * Schedules the write of the date into the commit record of the batch, it is
+ * committedWatermark once the batch is committed
+ */
+- (void)writeWatermark: (NSDate *)date;
+/**
+ * Stamp of the batch the file was last written with, 0 if the last batch
+ * was not committed
+ */
+- (uint64_t)committedStampOfFileNamed: (NSString *)fileName;
+- (NSString *)pathOfFileNamed: (NSString *)fileName;
+/**
+ * Calls the block on the write queue with the result of the next commit,
+ * YES if nothing is left to write. A failed commit is retried with backoff
+ * until it succeeds, the block is only called with the first result
+ */
+- (void)performWhenCommitted: (void (^)(BOOL committed))completionHandler;
+/**
+ * Blocks until scheduled writes are committed, returns NO if the commit failed
+ */
+- (BOOL)waitUntilCommitted;
+- (BOOL)removeAllFiles;
+
+@end
@@ -0,0 +1,516 @@
+//
+//  AKSectionCache.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKSectionCache.h"
+#import "AKInstrumentation.h"
+
+static NSString *const kSectionCacheCommitFileName = @"commit.plist";
+static NSString *const kSectionCacheGenerationKey = @"generation";
+static NSString *const kSectionCacheStampsKey = @"stamps";
+static NSString *const kSectionCacheWatermarkKey = @"watermark";
+static NSString *const kSectionCacheStampKey = @"stamp";
+static NSString *const kSectionCacheSectionKey = @"section";
+/**
+ * Seconds a write waits for further writes to coalesce with
+ */
+static const double kSectionCacheCoalescingDelay = 1.0;
+/**
+ * A failed commit is retried after the coalescing delay doubled for each
+ * consecutive failure, up to this many times doubled
+ */
+static const NSUInteger kSectionCacheMaxBackoffExponent = 6;
+
+@interface AKSectionCache ()
+
+@property (copy, nonatomic) NSString *directoryPath;
+@property (strong, nonatomic) dispatch_queue_t write_queue;
+/**
+ * Arrays of contactIDs keyed by section key keyed by table name as last
+ * scheduled for writing. Only accessed on the queue calling writeTables:
+ */
+@property (strong, nonatomic) NSMutableDictionary *persistedSections;
+/**
+ * Arrays (or NSNull for removed sections) keyed by section key keyed by table
+ * name, and data blocks keyed by file name waiting for the next commit
+ */
+@property (strong, nonatomic) NSMutableDictionary *pendingSections;
+@property (strong, nonatomic) NSMutableDictionary *pendingFiles;
+@property (strong, nonatomic) NSDate *pendingWatermark;
+/**
+ * Blocks waiting for the next commit
+ */
+@property (strong, nonatomic) NSMutableArray *pendingCompletionHandlers;
+@property (assign, nonatomic) BOOL commitScheduled;
+/**
+ * Commits failed in a row, only accessed on write_queue
+ */
+@property (assign, nonatomic) NSUInteger failedCommitCount;
+/**
+ * Stamps of the commit record keyed by file name, relative to directoryPath
+ */
+@property (copy, nonatomic) NSDictionary *committedStamps;
+@property (strong) NSDate *committedWatermark;
+/**
+ * Stamps of the files on disk, which differ from committedStamps after a failed
+ * batch. The next batch starts from these. Only accessed on write_queue
+ */
+@property (copy, nonatomic) NSDictionary *fileStamps;
+@property (assign) unsigned long long bytesWrittenByLastCommit;
+
+@end
+
+@implementation AKSectionCache
+
+#pragma mark - Class methods
+
++ (NSString *)fileNameForSectionKey: (NSString *)key
+{   // Section keys such as # or - are hex encoded to be safe as file names
+    NSData *data = [key dataUsingEncoding: NSUTF8StringEncoding];
+    const uint8_t *bytes = data.bytes;
+    NSMutableString *fileName = [[NSMutableString alloc] initWithCapacity: data.length * 2 + 6];
+    for (NSUInteger index = 0; index < data.length; ++index)
+    {
+        [fileName appendFormat: @"%02x", bytes[index]];
+    }
+    [fileName appendString: @".plist"];
+    return [fileName copy];
+}
+
++ (NSString *)sectionKeyForFileName: (NSString *)fileName
+{
+    NSString *hex = [fileName stringByDeletingPathExtension];
+    if (hex.length % 2 != 0) return nil;
+    
+    NSMutableData *data = [[NSMutableData alloc] initWithCapacity: hex.length / 2];
+    for (NSUInteger index = 0; index < hex.length; index += 2)
+    {
+        unsigned int value;
+        NSScanner *scanner = [NSScanner scannerWithString: [hex substringWithRange: NSMakeRange(index, 2)]];
+        if (![scanner scanHexInt: &value]) return nil;
+        uint8_t byte = (uint8_t)value;
+        [data appendBytes: &byte length: 1];
+    }
+    return [[NSString alloc] initWithData: data encoding: NSUTF8StringEncoding];
+}
+
+#pragma mark - Instance methods
+
+- (instancetype)initWithDirectoryPath: (NSString *)path
+{
+    self = [super init];
+    if (self)
+    {
+        _directoryPath = [path copy];
+        
+        _write_queue = dispatch_queue_create([NSStringFromClass([AKSectionCache class]) UTF8String], DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_write_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0));
+        
+        _persistedSections = [[NSMutableDictionary alloc] init];
+        _pendingSections = [[NSMutableDictionary alloc] init];
+        _pendingFiles = [[NSMutableDictionary alloc] init];
+        _pendingCompletionHandlers = [[NSMutableArray alloc] init];
+        
+        NSDictionary *record = [NSDictionary dictionaryWithContentsOfFile: [path stringByAppendingPathComponent: kSectionCacheCommitFileName]];
+        NSDictionary *stamps = [record objectForKey: kSectionCacheStampsKey];
+        NSDate *watermark = [record objectForKey: kSectionCacheWatermarkKey];
+        _committedStamps = ([stamps isKindOfClass: [NSDictionary class]]) ? stamps : @{};
+        _committedWatermark = ([watermark isKindOfClass: [NSDate class]]) ? watermark : nil;
+        _fileStamps = _committedStamps;
+    }
+    return self;
+}
+
+- (NSString *)pathOfFileNamed: (NSString *)fileName
+{
+    return [self.directoryPath stringByAppendingPathComponent: fileName];
+}
+
+- (NSDictionary *)readTablesNamed: (NSArray *)tableNames
+{
+    NSDictionary *committedStamps;
+    @synchronized(self)
+    {
+        committedStamps = self.committedStamps;
+    }
+    
+    NSMutableDictionary *tables = [[NSMutableDictionary alloc] initWithCapacity: tableNames.count];
+    NSMutableDictionary *persistedSections = [[NSMutableDictionary alloc] initWithCapacity: tableNames.count];
+    
+    for (NSString *tableName in tableNames)
+    {
+        NSMutableDictionary *table = [[NSMutableDictionary alloc] init];
+        NSMutableDictionary *persistedTable = [[NSMutableDictionary alloc] init];
+        
+        // Only the files of the commit record are read, leftovers of incomplete batches are ignored
+        NSString *prefix = [tableName stringByAppendingString: @"/"];
+        for (NSString *relativePath in committedStamps)
+        {
+            if (![relativePath hasPrefix: prefix]) continue;
+            
+            NSString *key = [AKSectionCache sectionKeyForFileName: relativePath.lastPathComponent];
+            if (!key) continue;
+            
+            NSData *data = [NSData dataWithContentsOfFile: [self pathOfFileNamed: relativePath]];
+            NSError *error;
+            NSDictionary *plist = (data) ? [NSPropertyListSerialization propertyListWithData: data options: NSPropertyListMutableContainers format: NULL error: &error] : nil;
+            NSMutableArray *section = ([plist isKindOfClass: [NSDictionary class]]) ? [plist objectForKey: kSectionCacheSectionKey] : nil;
+            if (error || ![section isKindOfClass: [NSMutableArray class]] ||
+                ![[plist objectForKey: kSectionCacheStampKey] isEqual: [committedStamps objectForKey: relativePath]])
+            { // Missing, unreadable or rewritten by a batch that was not committed
+                NSLog(@"Section cache file %@ does not match the commit record", relativePath);
+                return nil;
+            }
+            [table setObject: section forKey: key];
+            [persistedTable setObject: [section copy] forKey: key];
+        }
+        if (table.count == 0) return nil;
+        
+        [tables setObject: table forKey: tableName];
+        [persistedSections setObject: persistedTable forKey: tableName];
+    }
+    self.persistedSections = persistedSections;
+    return [tables copy];
+}
+
+- (void)writeTables: (NSDictionary *)tables
+{
+    NSMutableDictionary *dirtySections = [[NSMutableDictionary alloc] init];
+    
+    [tables enumerateKeysAndObjectsUsingBlock: ^(NSString *tableName, NSDictionary *table, BOOL *stop) {
+        NSMutableDictionary *persistedTable = [self.persistedSections objectForKey: tableName];
+        if (!persistedTable)
+        {
+            persistedTable = [[NSMutableDictionary alloc] init];
+            [self.persistedSections setObject: persistedTable forKey: tableName];
+        }
+        
+        NSMutableDictionary *dirtyTable = [[NSMutableDictionary alloc] init];
+        [table enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSArray *section, BOOL *stop) {
+            if (![[persistedTable objectForKey: key] isEqualToArray: section])
+            {
+                NSArray *copy = [section copy];
+                [dirtyTable setObject: copy forKey: key];
+                [persistedTable setObject: copy forKey: key];
+            }
+        }];
+        for (NSString *key in [persistedTable allKeys])
+        {
+            if (![table objectForKey: key])
+            {
+                [dirtyTable setObject: [NSNull null] forKey: key];
+                [persistedTable removeObjectForKey: key];
+            }
+        }
+        if (dirtyTable.count > 0) [dirtySections setObject: dirtyTable forKey: tableName];
+    }];
+    
+    if (dirtySections.count == 0) return;
+    
+    @synchronized(self)
+    {
+        [dirtySections enumerateKeysAndObjectsUsingBlock: ^(NSString *tableName, NSDictionary *dirtyTable, BOOL *stop) {
+            NSMutableDictionary *pendingTable = [self.pendingSections objectForKey: tableName];
+            if (!pendingTable)
+            {
+                pendingTable = [[NSMutableDictionary alloc] init];
+                [self.pendingSections setObject: pendingTable forKey: tableName];
+            }
+            [pendingTable addEntriesFromDictionary: dirtyTable];
+        }];
+        [self scheduleCommit];
+    }
+}
+
+- (void)writeFileNamed: (NSString *)fileName withDataBlock: (NSData *(^)(uint64_t))block
+{
+    @synchronized(self)
+    {
+        [self.pendingFiles setObject: [block copy] forKey: fileName];
+        [self scheduleCommit];
+    }
+}
+
+- (void)writeWatermark: (NSDate *)date
+{
+    @synchronized(self)
+    {
+        self.pendingWatermark = date;
+        [self scheduleCommit];
+    }
+}
+
+- (uint64_t)committedStampOfFileNamed: (NSString *)fileName
+{
+    @synchronized(self)
+    {
+        return [[self.committedStamps objectForKey: fileName] unsignedLongLongValue];
+    }
+}
+
+- (void)performWhenCommitted: (void (^)(BOOL))completionHandler
+{
+    @synchronized(self)
+    {
+        [self.pendingCompletionHandlers addObject: [completionHandler copy]];
+        [self scheduleCommit];
+    }
+}
+
+/**
+ * Must be called while synchronized on self
+ */
+- (void)scheduleCommit
+{
+    [self scheduleCommitAfterDelay: kSectionCacheCoalescingDelay];
+}
+
+/**
+ * Must be called while synchronized on self
+ */
+- (void)scheduleCommitAfterDelay: (double)delay
+{
+    if (self.commitScheduled) return;
+    self.commitScheduled = YES;
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), self.write_queue, ^{
+        [self commit];
+    });
+}
+
+- (BOOL)waitUntilCommitted
+{
+    __block BOOL success;
+    dispatch_sync(self.write_queue, ^{
+        success = [self commit];
+    });
+    return success;
+}
+
+/**
+ * Must be called on write_queue. Returns whether everything written so far is committed
+ */
+- (BOOL)commit
+{
+    NSDictionary *sections, *files;
+    NSDate *watermark;
+    NSArray *completionHandlers;
+    BOOL uncommitted;
+    @synchronized(self)
+    {
+        completionHandlers = self.pendingCompletionHandlers;
+        self.pendingCompletionHandlers = [[NSMutableArray alloc] init];
+        self.commitScheduled = NO;
+        
+        BOOL uncommittedFiles = ![self.fileStamps isEqualToDictionary: self.committedStamps];
+        uncommitted = (self.pendingSections.count > 0 || self.pendingFiles.count > 0 || self.pendingWatermark || uncommittedFiles);
+        
+        sections = self.pendingSections;
+        files = self.pendingFiles;
+        watermark = (self.pendingWatermark) ? self.pendingWatermark : self.committedWatermark;
+        self.pendingSections = [[NSMutableDictionary alloc] init];
+        self.pendingFiles = [[NSMutableDictionary alloc] init];
+        self.pendingWatermark = nil;
+    }
+    
+    if (!uncommitted)
+    {
+        for (void (^completionHandler)(BOOL) in completionHandlers) completionHandler(YES);
+        return YES;
+    }
+    
+    AKSpanStart start = AKSpanBegin();
+    
+    NSFileManager *fileManager = [NSFileManager defaultManager];
+    uint64_t stamp = ((uint64_t)arc4random() << 32) | arc4random() | 1;
+    unsigned long long bytesWritten = 0;
+    __block BOOL success = YES;
+    NSError *error;
+    
+    if (![fileManager createDirectoryAtPath: self.directoryPath withIntermediateDirectories: YES attributes: nil error: &error])
+    {
+        NSLog(@"Section cache directory (%ld): %@", (long)error.code, error.localizedDescription);
+    }
+    
+    // The previous commit record stays valid for the files this batch doesn't write
+    NSMutableDictionary *stamps = [self.fileStamps mutableCopy];
+    
+    NSMutableDictionary *failedSections = [[NSMutableDictionary alloc] init];
+    for (NSString *tableName in sections)
+    {
+        NSString *tablePath = [self pathOfFileNamed: tableName];
+        if (![fileManager createDirectoryAtPath: tablePath withIntermediateDirectories: YES attributes: nil error: &error])
+        {
+            NSLog(@"Section cache directory (%ld): %@", (long)error.code, error.localizedDescription);
+        }
+        
+        NSDictionary *table = [sections objectForKey: tableName];
+        for (NSString *key in table)
+        {
+            id section = [table objectForKey: key];
+            NSString *relativePath = [tableName stringByAppendingPathComponent: [AKSectionCache fileNameForSectionKey: key]];
+            NSString *path = [self pathOfFileNamed: relativePath];
+            
+            BOOL written = NO;
+            if (section == [NSNull null])
+            {
+                written = (![fileManager fileExistsAtPath: path] || [fileManager removeItemAtPath: path error: &error]);
+                if (written) [stamps removeObjectForKey: relativePath];
+            }
+            else
+            {
+                NSDictionary *plist = @{kSectionCacheStampKey: @(stamp), kSectionCacheSectionKey: section};
+                NSData *data = [NSPropertyListSerialization dataWithPropertyList: plist format: NSPropertyListBinaryFormat_v1_0 options: 0 error: &error];
+                written = (data && [data writeToFile: path options: NSDataWritingAtomic error: &error]);
+                if (written)
+                {
+                    [stamps setObject: @(stamp) forKey: relativePath];
+                    bytesWritten += data.length;
+                    AKCounterAdd(AKCounterCacheSectionsWritten, 1);
+                }
+            }
+            if (!written)
+            {
+                NSLog(@"Section cache write (%ld): %@", (long)error.code, error.localizedDescription);
+                NSMutableDictionary *failedTable = [failedSections objectForKey: tableName];
+                if (!failedTable)
+                {
+                    failedTable = [[NSMutableDictionary alloc] init];
+                    [failedSections setObject: failedTable forKey: tableName];
+                }
+                [failedTable setObject: section forKey: key];
+                success = NO;
+            }
+        }
+    }
+    
+    [files enumerateKeysAndObjectsUsingBlock: ^(NSString *fileName, NSData *(^block)(uint64_t), BOOL *stop) {
+        NSError *error;
+        NSData *data = block(stamp);
+        if (data && [data writeToFile: [self pathOfFileNamed: fileName] options: NSDataWritingAtomic error: &error])
+        {
+            [stamps setObject: @(stamp) forKey: fileName];
+        }
+        else
+        {
+            NSLog(@"Section cache write of %@ (%ld): %@", fileName, (long)error.code, error.localizedDescription);
+            [stamps removeObjectForKey: fileName];
+            success = NO;
+        }
+    }];
+    self.fileStamps = stamps;
+    
+    if (success)
+    {   // Written last, the batch is committed once the record is in place
+        NSMutableDictionary *record = [[NSMutableDictionary alloc] init];
+        [record setObject: @(stamp) forKey: kSectionCacheGenerationKey];
+        [record setObject: stamps forKey: kSectionCacheStampsKey];
+        if (watermark) [record setObject: watermark forKey: kSectionCacheWatermarkKey];
+        
+        NSString *commitPath = [self pathOfFileNamed: kSectionCacheCommitFileName];
+        NSData *data = [NSPropertyListSerialization dataWithPropertyList: record format: NSPropertyListXMLFormat_v1_0 options: 0 error: &error];
+        if (data && [data writeToFile: commitPath options: NSDataWritingAtomic error: &error])
+        {
+            bytesWritten += data.length;
+            @synchronized(self)
+            {
+                self.committedStamps = stamps;
+                self.committedWatermark = watermark;
+            }
+        }
+        else
+        {
+            NSLog(@"Section cache commit record write (%ld): %@", (long)error.code, error.localizedDescription);
+            success = NO;
+        }
+    }
+    
+    if (!success)
+    {   // Failed sections and the watermark are retried with the next write unless rewritten since
+        @synchronized(self)
+        {
+            [failedSections enumerateKeysAndObjectsUsingBlock: ^(NSString *tableName, NSDictionary *failedTable, BOOL *stop) {
+                NSMutableDictionary *pendingTable = [self.pendingSections objectForKey: tableName];
+                if (!pendingTable)
+                {
+                    pendingTable = [[NSMutableDictionary alloc] init];
+                    [self.pendingSections setObject: pendingTable forKey: tableName];
+                }
+                for (NSString *key in failedTable)
+                {
+                    if (![pendingTable objectForKey: key]) [pendingTable setObject: [failedTable objectForKey: key] forKey: key];
+                }
+            }];
+            if (!self.pendingWatermark) self.pendingWatermark = watermark;
+            
+            // Retried without waiting for the next write, backing off while the disk keeps failing
+            self.failedCommitCount += 1;
+            double delay = kSectionCacheCoalescingDelay * (double)(1 << MIN(self.failedCommitCount, kSectionCacheMaxBackoffExponent));
+            [self scheduleCommitAfterDelay: delay];
+        }
+    }
+    else
+    {
+        self.failedCommitCount = 0;
+    }
+    
+    self.bytesWrittenByLastCommit = bytesWritten;
+    AKCounterAdd(AKCounterCacheBytesWritten, (int64_t)bytesWritten);
+    AKSpanEnd(AKSpanArchive, start);
+    
+    for (void (^completionHandler)(BOOL) in completionHandlers) completionHandler(success);
+    return success;
+}
+
+- (BOOL)removeAllFiles
+{
+    @synchronized(self)
+    {
+        [self.pendingSections removeAllObjects];
+        [self.pendingFiles removeAllObjects];
+    }
+    __block BOOL success = YES;
+    dispatch_sync(self.write_queue, ^{
+        @synchronized(self)
+        {
+            self.committedStamps = @{};
+            self.committedWatermark = nil;
+            self.pendingWatermark = nil;
+        }
+        self.fileStamps = @{};
+        NSError *error;
+        if ([[NSFileManager defaultManager] fileExistsAtPath: self.directoryPath])
+        {
+            success = [[NSFileManager defaultManager] removeItemAtPath: self.directoryPath error: &error];
+            if (!success) NSLog(@"Section cache removal (%ld): %@", (long)error.code, error.localizedDescription);
+        }
+    });
+    [self.persistedSections removeAllObjects];
+    return success;
+}
+
+@end
@@ -0,0 +1,103 @@
+//
+//  AKSectionView.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import "AKCacheRegistry.h"
+
+@class AKIndexSnapshot;
+@class AKAddressBook;
+
+/**
+ * Sections of the contacts of one group of a source in one sort ordering,
+ * filtered from a snapshot of the section tables. Immutable
+ */
+@interface AKSectionView : NSObject
+
+@property (assign, nonatomic, readonly) ABRecordID sourceID;
+@property (assign, nonatomic, readonly) ABRecordID groupID;
+@property (assign, nonatomic, readonly) ABPersonSortOrdering sortOrdering;
+/**
+ * Generation of the snapshot the view is current with
+ */
+@property (assign, nonatomic, readonly) NSUInteger generation;
+/**
+ * Member count of the group when the view was filtered
+ */
+@property (assign, nonatomic, readonly) NSUInteger memberCount;
+/**
+ * memberVersion of the group when the view was filtered
+ */
+@property (assign, nonatomic, readonly) NSUInteger memberVersion;
+/**
+ * Non empty section keys in display order
+ */
+@property (strong, nonatomic, readonly) NSArray *keys;
+/**
+ * Arrays of contactIDs keyed by section key
+ */
+@property (strong, nonatomic, readonly) NSDictionary *contactIDs;
+@property (strong, nonatomic, readonly) NSSet *displayedContactIDs;
+
+@end
+
+/**
+ * Least recently used views of the groups displayed. The views are kept
+ * current with each published snapshot by refiltering only the sections that
+ * changed, so switching back to a recently displayed group does not filter
+ * the section tables again. Registered with AKCacheRegistry. Thread safe
+ */
+@interface AKSectionViewCache : NSObject <AKRegisteredCache>
+
+/**
+ * Address book the groups of the views are read from
+ */
+@property (weak, nonatomic, readonly) AKAddressBook *addressBook;
+
+/**
+ * Default value is 8
+ */
+@property (assign) NSUInteger capacity;
+
+- (instancetype)initWithAddressBook: (AKAddressBook *)addressBook;
+/**
+ * View of the group in the snapshot, filtered if it is not cached or the
+ * membership of the group changed. Reads group members, call on the main queue
+ */
+- (AKSectionView *)viewForSourceID: (ABRecordID)sourceID
+                           groupID: (ABRecordID)groupID
+                      sortOrdering: (ABPersonSortOrdering)sortOrdering
+                        ofSnapshot: (AKIndexSnapshot *)snapshot;
+/**
+ * Refilter the sections of the cached views that differ between the snapshots,
+ * all sections of views whose group members changed since they were filtered
+ * Call on serial_queue when a snapshot is published
+ */
+- (void)updateWithSnapshot: (AKIndexSnapshot *)snapshot previousSnapshot: (AKIndexSnapshot *)previousSnapshot;
+- (void)removeAllViews;
+
+@end
@@ -0,0 +1,386 @@
+//
+//  AKSectionView.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKSectionView.h"
+#import "AKIndexSnapshot.h"
+#import "AKAddressBook.h"
+#import "AKSource.h"
+#import "AKGroup.h"
+
+@interface AKSectionView ()
+
+@property (assign, nonatomic) ABRecordID sourceID;
+@property (assign, nonatomic) ABRecordID groupID;
+@property (assign, nonatomic) ABPersonSortOrdering sortOrdering;
+@property (assign, nonatomic) NSUInteger generation;
+@property (assign, nonatomic) NSUInteger memberCount;
+@property (assign, nonatomic) NSUInteger memberVersion;
+@property (strong, nonatomic) NSArray *keys;
+@property (strong, nonatomic) NSDictionary *contactIDs;
+@property (strong, nonatomic) NSSet *displayedContactIDs;
+
+/**
+ * sectionKeys of the address book without duplicates
+ */
++ (NSArray *)displayedSectionKeys;
++ (NSDictionary *)sectionsOfSnapshot: (AKIndexSnapshot *)snapshot withSortOrdering: (ABPersonSortOrdering)sortOrdering;
++ (NSArray *)membersOfSection: (NSArray *)sectionArray inGroup: (NSSet *)memberIDs;
+
+- (BOOL)isViewOfSourceID: (ABRecordID)sourceID groupID: (ABRecordID)groupID sortOrdering: (ABPersonSortOrdering)sortOrdering;
+/**
+ * Copy of the view with the sections of sectionKeys filtered again
+ */
+- (AKSectionView *)viewByFilteringSectionKeys: (NSSet *)sectionKeys ofSnapshot: (AKIndexSnapshot *)snapshot group: (AKGroup *)group;
+
+@end
+
+@implementation AKSectionView
+
++ (NSArray *)displayedSectionKeys
+{
+    static NSArray *displayedSectionKeys = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSOrderedSet *sectionKeys = [[NSOrderedSet alloc] initWithArray: [AKAddressBook sectionKeys]];
+        displayedSectionKeys = [sectionKeys array];
+    });
+    return displayedSectionKeys;
+}
+
++ (NSDictionary *)sectionsOfSnapshot: (AKIndexSnapshot *)snapshot withSortOrdering: (ABPersonSortOrdering)sortOrdering
+{
+    return (sortOrdering == kABPersonSortByFirstName) ? snapshot.sectionsSortedByFirst : snapshot.sectionsSortedByLast;
+}
+
++ (NSArray *)membersOfSection: (NSArray *)sectionArray inGroup: (NSSet *)memberIDs
+{
+    NSIndexSet *indexes = [sectionArray indexesOfObjectsPassingTest: ^BOOL(NSNumber *contactID, NSUInteger idx, BOOL *stop) {
+        return ([memberIDs member: contactID] != nil);
+    }];
+    return (indexes.count == sectionArray.count) ? sectionArray : [sectionArray objectsAtIndexes: indexes];
+}
+
+- (BOOL)isViewOfSourceID: (ABRecordID)sourceID groupID: (ABRecordID)groupID sortOrdering: (ABPersonSortOrdering)sortOrdering
+{
+    return (self.sourceID == sourceID && self.groupID == groupID && self.sortOrdering == sortOrdering);
+}
+
+- (AKSectionView *)viewByFilteringSectionKeys: (NSSet *)sectionKeys ofSnapshot: (AKIndexSnapshot *)snapshot group: (AKGroup *)group
+{
+    AKSectionView *view = [[AKSectionView alloc] init];
+    view.sourceID = self.sourceID;
+    view.groupID = self.groupID;
+    view.sortOrdering = self.sortOrdering;
+    view.generation = snapshot.generation;
+    view.memberCount = group.memberIDs.count;
+    view.memberVersion = group.memberVersion;
+    
+    NSDictionary *sections = [AKSectionView sectionsOfSnapshot: snapshot withSortOrdering: self.sortOrdering];
+    
+    NSMutableDictionary *contactIDs = (self.contactIDs) ? [self.contactIDs mutableCopy] : [[NSMutableDictionary alloc] init];
+    NSMutableSet *displayedContactIDs = (self.displayedContactIDs) ? [self.displayedContactIDs mutableCopy] : [[NSMutableSet alloc] init];
+    for (NSString *key in sectionKeys)
+    {
+        NSArray *previousArray = [contactIDs objectForKey: key];
+        if (previousArray)
+        {
+            [displayedContactIDs minusSet: [NSSet setWithArray: previousArray]];
+            [contactIDs removeObjectForKey: key];
+        }
+        
+        NSArray *sectionArray = [AKSectionView membersOfSection: [sections objectForKey: key] inGroup: group.memberIDs];
+        if (sectionArray.count > 0)
+        {
+            [contactIDs setObject: sectionArray forKey: key];
+            [displayedContactIDs addObjectsFromArray: sectionArray];
+        }
+    }
+    
+    NSMutableArray *keys = [[NSMutableArray alloc] init];
+    for (NSString *key in [AKSectionView displayedSectionKeys])
+    {
+        if ([contactIDs objectForKey: key]) [keys addObject: key];
+    }
+    view.keys = [keys copy];
+    view.contactIDs = [contactIDs copy];
+    view.displayedContactIDs = [displayedContactIDs copy];
+    return view;
+}
+
+@end
+
+/**
+ * Estimated bytes per contact of a view: an entry of a section array and of the set of displayed contacts
+ */
+static const NSUInteger kSectionViewCostPerContact = 48;
+
+@interface AKSectionViewCache ()
+{
+    NSUInteger _hits;
+    NSUInteger _misses;
+    NSUInteger _evictions;
+}
+
+/**
+ * Views, the most recently used first. Guarded by self
+ */
+@property (strong, nonatomic) NSMutableArray *views;
+/**
+ * Generation of the last snapshot the views were updated with. Guarded by self
+ */
+@property (assign, nonatomic) NSUInteger generation;
+
+- (NSUInteger)indexOfViewOfSourceID: (ABRecordID)sourceID groupID: (ABRecordID)groupID sortOrdering: (ABPersonSortOrdering)sortOrdering;
+
+@end
+
+@implementation AKSectionViewCache
+
+@synthesize name = _name;
+@synthesize priority = _priority;
+
+- (instancetype)initWithAddressBook: (AKAddressBook *)addressBook
+{
+    self = [super init];
+    if (self)
+    {
+        _addressBook = addressBook;
+        _capacity = 8;
+        _views = [[NSMutableArray alloc] init];
+        _name = @"sectionViews";
+        _priority = AKCachePriorityDefault;
+        [[AKCacheRegistry sharedInstance] registerCache: self];
+    }
+    return self;
+}
+
+- (NSUInteger)cost
+{
+    NSUInteger cost = 0;
+    @synchronized(self)
+    {
+        for (AKSectionView *view in self.views)
+        {
+            cost += view.displayedContactIDs.count * kSectionViewCostPerContact;
+        }
+    }
+    return cost;
+}
+
+- (NSUInteger)count
+{
+    @synchronized(self)
+    {
+        return self.views.count;
+    }
+}
+
+- (NSUInteger)hits
+{
+    @synchronized(self)
+    {
+        return _hits;
+    }
+}
+
+- (NSUInteger)misses
+{
+    @synchronized(self)
+    {
+        return _misses;
+    }
+}
+
+- (NSUInteger)evictions
+{
+    @synchronized(self)
+    {
+        return _evictions;
+    }
+}
+
+- (NSUInteger)trimToCost: (NSUInteger)cost
+{
+    NSUInteger evicted = 0;
+    @synchronized(self)
+    {
+        NSUInteger viewsCost = 0;
+        for (AKSectionView *view in self.views)
+        {
+            viewsCost += view.displayedContactIDs.count * kSectionViewCostPerContact;
+        }
+        while (viewsCost > cost && self.views.count > 0)
+        {
+            AKSectionView *view = self.views.lastObject;
+            viewsCost -= view.displayedContactIDs.count * kSectionViewCostPerContact;
+            [self.views removeLastObject];
+            ++evicted;
+        }
+        _evictions += evicted;
+    }
+    return evicted;
+}
+
+- (NSUInteger)indexOfViewOfSourceID: (ABRecordID)sourceID groupID: (ABRecordID)groupID sortOrdering: (ABPersonSortOrdering)sortOrdering
+{
+    return [self.views indexOfObjectPassingTest: ^BOOL(AKSectionView *view, NSUInteger idx, BOOL *stop) {
+        return [view isViewOfSourceID: sourceID groupID: groupID sortOrdering: sortOrdering];
+    }];
+}
+
+- (AKSectionView *)viewForSourceID: (ABRecordID)sourceID
+                           groupID: (ABRecordID)groupID
+                      sortOrdering: (ABPersonSortOrdering)sortOrdering
+                        ofSnapshot: (AKIndexSnapshot *)snapshot
+{
+    AKSource *source = [self.addressBook sourceForSourceId: sourceID];
+    AKGroup *group = [source groupForGroupId: groupID];
+    
+    @synchronized(self)
+    {
+        NSUInteger index = [self indexOfViewOfSourceID: sourceID groupID: groupID sortOrdering: sortOrdering];
+        if (index != NSNotFound)
+        {
+            AKSectionView *view = [self.views objectAtIndex: index];
+            [self.views removeObjectAtIndex: index];
+            
+            if (view.generation >= snapshot.generation &&
+                view.memberCount == group.memberIDs.count &&
+                view.memberVersion == group.memberVersion)
+            {
+                [self.views insertObject: view atIndex: 0];
+                ++_hits;
+                return view;
+            }
+        }
+        ++_misses;
+    }
+    
+    AKSectionView *emptyView = [[AKSectionView alloc] init];
+    emptyView.sourceID = sourceID;
+    emptyView.groupID = groupID;
+    emptyView.sortOrdering = sortOrdering;
+    NSSet *sectionKeys = [NSSet setWithArray: [AKSectionView displayedSectionKeys]];
+    AKSectionView *view = [emptyView viewByFilteringSectionKeys: sectionKeys ofSnapshot: snapshot group: group];
+    
+    @synchronized(self)
+    {   // A view of an older snapshot would not be updated with the changes since
+        if (group && view.generation >= self.generation &&
+            [self indexOfViewOfSourceID: sourceID groupID: groupID sortOrdering: sortOrdering] == NSNotFound)
+        {
+            [self.views insertObject: view atIndex: 0];
+            if (self.views.count > self.capacity)
+            {
+                _evictions += self.views.count - self.capacity;
+                [self.views removeObjectsInRange: NSMakeRange(self.capacity, self.views.count - self.capacity)];
+            }
+        }
+    }
+    [[AKCacheRegistry sharedInstance] setNeedsTrim];
+    return view;
+}
+
+- (void)updateWithSnapshot: (AKIndexSnapshot *)snapshot previousSnapshot: (AKIndexSnapshot *)previousSnapshot
+{
+    NSArray *views;
+    @synchronized(self)
+    {
+        self.generation = snapshot.generation;
+        if (!previousSnapshot) [self.views removeAllObjects];
+        views = [self.views copy];
+    }
+    if (views.count == 0) return;
+    
+    // Changed sections are found once per sort ordering
+    NSMutableDictionary *changedSectionKeysBySortOrdering = [[NSMutableDictionary alloc] init];
+    NSMutableArray *updatedViews = [[NSMutableArray alloc] initWithCapacity: views.count];
+    for (AKSectionView *view in views)
+    {
+        NSSet *changedSectionKeys = [changedSectionKeysBySortOrdering objectForKey: @(view.sortOrdering)];
+        if (!changedSectionKeys)
+        {
+            NSDictionary *sections = [AKSectionView sectionsOfSnapshot: snapshot withSortOrdering: view.sortOrdering];
+            NSDictionary *previousSections = [AKSectionView sectionsOfSnapshot: previousSnapshot withSortOrdering: view.sortOrdering];
+            
+            NSMutableSet *sectionKeys = [[NSMutableSet alloc] init];
+            for (NSString *key in [AKSectionView displayedSectionKeys])
+            {
+                NSArray *sectionArray = [sections objectForKey: key];
+                NSArray *previousArray = [previousSections objectForKey: key];
+                if (sectionArray != previousArray && ![sectionArray isEqualToArray: previousArray])
+                {
+                    [sectionKeys addObject: key];
+                }
+            }
+            changedSectionKeys = [sectionKeys copy];
+            [changedSectionKeysBySortOrdering setObject: changedSectionKeys forKey: @(view.sortOrdering)];
+        }
+        
+        AKSource *source = [self.addressBook sourceForSourceId: view.sourceID];
+        AKGroup *group = [source groupForGroupId: view.groupID];
+        if (!group) continue; // Group was deleted
+        
+        // Members added or removed may be in any section, not only in the changed ones
+        BOOL membersChanged = (view.memberVersion != group.memberVersion || view.memberCount != group.memberIDs.count);
+        NSSet *sectionKeys = (membersChanged) ? [NSSet setWithArray: [AKSectionView displayedSectionKeys]] : changedSectionKeys;
+        
+        [updatedViews addObject: [view viewByFilteringSectionKeys: sectionKeys ofSnapshot: snapshot group: group]];
+    }
+    
+    @synchronized(self)
+    {   // Keep the order of use of the views still cached
+        NSMutableArray *views = [[NSMutableArray alloc] initWithCapacity: self.views.count];
+        for (AKSectionView *view in self.views)
+        {
+            if (view.generation >= snapshot.generation)
+            {
+                [views addObject: view];
+                continue;
+            }
+            for (AKSectionView *updatedView in updatedViews)
+            {
+                if ([updatedView isViewOfSourceID: view.sourceID groupID: view.groupID sortOrdering: view.sortOrdering])
+                {
+                    [views addObject: updatedView];
+                    break;
+                }
+            }
+        }
+        self.views = views;
+    }
+}
+
+- (void)removeAllViews
+{
+    @synchronized(self)
+    {
+        [self.views removeAllObjects];
+    }
+}
+
+@end
@@ -0,0 +1,123 @@
+//
+//  AKSourcePartition.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AddressBook/AddressBook.h>
+
+typedef NS_ENUM(NSInteger, AKSourcePartitionStatus)
+{
+    AKSourcePartitionUnloaded = 0,
+    AKSourcePartitionScanning,
+    AKSourcePartitionLoaded,
+};
+
+/**
+ * Contacts of one source scanned by a load pass
+ */
+@interface AKSourcePartition : NSObject
+
+@property (assign, nonatomic, readonly) ABRecordID sourceID;
+@property (assign, readonly) AKSourcePartitionStatus status;
+/**
+ * ContactIDs found in the source, nil until loaded
+ */
+@property (strong) NSSet *contactIDs;
+
+- (instancetype)initWithSourceID: (ABRecordID)sourceID;
+/**
+ * Returns NO if the partition was not in the expected status
+ */
+- (BOOL)changeStatusFrom: (AKSourcePartitionStatus)fromStatus to: (AKSourcePartitionStatus)toStatus;
+
+@end
+
+/**
+ * State shared by the partitions loaded by one pass of the loader. The
+ * partitions of the displayed source are loaded by the pass itself, the others
+ * on background_queue or on demand. Accessed on serial_queue unless noted
+ */
+@interface AKLoadPass : NSObject
+
+/**
+ * AKSourcePartition keyed by sourceID. Immutable, safe to read on any queue
+ */
+@property (strong, nonatomic, readonly) NSDictionary *partitions;
+/**
+ * Loads of the partitions of sources not displayed. Low priority, the load
+ * completes once they are applied
+ */
+@property (strong, nonatomic, readonly) dispatch_queue_t background_queue;
+/**
+ * Created and changed contacts are the ones modified after this date
+ */
+@property (strong, nonatomic, readonly) NSDate *dateLastLoaded;
+/**
+ * Taken before any contact is read, the dateLastLoaded of the next pass once
+ * the tables of this one are committed
+ */
+@property (strong, nonatomic, readonly) NSDate *dateStarted;
+/**
+ * Indexes that were empty when the pass began, populated from the scans
+ */
+@property (strong, nonatomic, readonly) NSArray *unpopulatedIndexes;
+/**
+ * Cached contactIDs not yet found in any partition. What is left once
+ * all partitions are loaded has been deleted
+ */
+@property (strong, nonatomic, readonly) NSMutableSet *unverifiedContactIDs;
+/**
+ * Contacts linked to a contact of a loaded partition. These are left out
+ * of the main aggregate group so linked cards appear once
+ */
+@property (strong, nonatomic, readonly) NSMutableSet *linkedContactIDs;
+/**
+ * Contacts created or changed since dateLastLoaded, found by the loaded partitions
+ */
+@property (strong, nonatomic, readonly) NSMutableSet *changedContactIDs;
+/**
+ * YES if a partition of the pass created, changed or deleted contacts
+ */
+@property (assign, nonatomic) BOOL changed;
+/**
+ * YES once the contacts missing from all partitions have been removed
+ */
+@property (assign, nonatomic) BOOL finished;
+/**
+ * Called on the main queue with changed once all partitions are loaded
+ */
+@property (copy, nonatomic) void (^completionHandler)(BOOL changed);
+
+- (instancetype)initWithSourceIDs: (NSArray *)sourceIDs
+                   dateLastLoaded: (NSDate *)date
+               unpopulatedIndexes: (NSArray *)indexes
+                 cachedContactIDs: (NSArray *)contactIDs;
+
+- (AKSourcePartition *)partitionForSourceID: (ABRecordID)sourceID;
+- (BOOL)allPartitionsLoaded;
+
+@end
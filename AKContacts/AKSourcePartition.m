@@ -0,0 +1,106 @@
+//
+//  AKSourcePartition.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKSourcePartition.h"
+
+@interface AKSourcePartition ()
+
+@property (assign) AKSourcePartitionStatus status;
+
+@end
+
+@implementation AKSourcePartition
+
+- (instancetype)initWithSourceID: (ABRecordID)sourceID
+{
+    self = [super init];
+    if (self)
+    {
+        _sourceID = sourceID;
+        _status = AKSourcePartitionUnloaded;
+    }
+    return self;
+}
+
+- (BOOL)changeStatusFrom: (AKSourcePartitionStatus)fromStatus to: (AKSourcePartitionStatus)toStatus
+{
+    @synchronized(self)
+    {
+        if (self.status != fromStatus) return NO;
+        self.status = toStatus;
+        return YES;
+    }
+}
+
+@end
+
+@implementation AKLoadPass
+
+- (instancetype)initWithSourceIDs: (NSArray *)sourceIDs
+                   dateLastLoaded: (NSDate *)date
+               unpopulatedIndexes: (NSArray *)indexes
+                 cachedContactIDs: (NSArray *)contactIDs
+{
+    self = [super init];
+    if (self)
+    {
+        NSMutableDictionary *partitions = [[NSMutableDictionary alloc] initWithCapacity: sourceIDs.count];
+        for (NSNumber *sourceID in sourceIDs)
+        {
+            [partitions setObject: [[AKSourcePartition alloc] initWithSourceID: sourceID.intValue] forKey: sourceID];
+        }
+        _partitions = [partitions copy];
+        
+        _background_queue = dispatch_queue_create([NSStringFromClass([AKLoadPass class]) UTF8String], DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_background_queue, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+        
+        _dateLastLoaded = date;
+        _dateStarted = [NSDate date];
+        _unpopulatedIndexes = [indexes copy];
+        _unverifiedContactIDs = [[NSMutableSet alloc] initWithArray: contactIDs];
+        _linkedContactIDs = [[NSMutableSet alloc] init];
+        _changedContactIDs = [[NSMutableSet alloc] init];
+    }
+    return self;
+}
+
+- (AKSourcePartition *)partitionForSourceID: (ABRecordID)sourceID
+{
+    return [self.partitions objectForKey: @(sourceID)];
+}
+
+- (BOOL)allPartitionsLoaded
+{
+    for (AKSourcePartition *partition in [self.partitions objectEnumerator])
+    {
+        if (partition.status != AKSourcePartitionLoaded) return NO;
+    }
+    return YES;
+}
+
+@end
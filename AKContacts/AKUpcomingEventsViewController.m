@@ -0,0 +1,270 @@
+//
+//  AKUpcomingEventsViewController.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKUpcomingEventsViewController.h"
+#import "AKContactViewController.h"
+#import "AKContactDetailModel.h"
+#import "AKContact.h"
+#import "AKDateIndex.h"
+#import "AKAddressBook.h"
+
+static const NSUInteger defaultNumberOfDays = 30;
+
+@interface AKUpcomingEventsViewController () <UITableViewDataSource, UITableViewDelegate, AKContactViewControllerDelegate>
+
+@property (strong, nonatomic) UITableView *tableView;
+/**
+ * Arrays of AKDateEvent sharing their daysAhead, ordered by it
+ */
+@property (strong, nonatomic) NSArray *sections;
+/**
+ * Start of the range the sections were queried from
+ */
+@property (strong, nonatomic) NSDate *startDate;
+/**
+ * Contact whose detail model is being built before its view is pushed
+ */
+@property (assign, nonatomic) ABRecordID openingContactID;
+
+/**
+ * Date of the day daysAhead days from startDate
+ */
+- (NSDate *)dateWithDaysAhead: (NSUInteger)daysAhead;
+/**
+ * AKContactViewControllerDelegate
+ */
+- (void)modalViewDidDismissWithContactID: (ABRecordID)contactID;
+- (void)recordDidRemoveWithContactID: (ABRecordID)contactID;
+
+@end
+
+@implementation AKUpcomingEventsViewController
+
+#pragma mark - View lifecycle
+
+- (id)init
+{
+    self = [super init];
+    if (self)
+    {
+        _numberOfDays = defaultNumberOfDays;
+        _openingContactID = kABRecordInvalidID;
+        _sections = @[];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    NSString *keyPath = NSStringFromSelector(@selector(status));
+    [[AKAddressBook sharedInstance] removeObserver: self forKeyPath: keyPath];
+}
+
+- (void)loadView
+{
+    CGFloat width = [UIScreen mainScreen].bounds.size.width;
+    CGFloat height = [UIScreen mainScreen].bounds.size.height;
+    if (SYSTEM_VERSION_LESS_THAN(@"7.0"))
+    {
+        height -= (self.navigationController.navigationBar.frame.size.height + [UIApplication sharedApplication].statusBarFrame.size.height);
+    }
+    [self setTableView: [[UITableView alloc] initWithFrame: CGRectMake(0.f, 0.f, width, height)
+                                                     style: UITableViewStylePlain]];
+    [self.tableView setDataSource: self];
+    [self.tableView setDelegate: self];
+    [self setView: self.tableView];
+}
+
+- (void)viewDidLoad
+{
+    [super viewDidLoad];
+    
+    [self setTitle: NSLocalizedString(@"Upcoming", @"")];
+    
+    NSString *keyPath = NSStringFromSelector(@selector(status));
+    [[AKAddressBook sharedInstance] addObserver: self
+                                     forKeyPath: keyPath
+                                        options: NSKeyValueObservingOptionNew
+                                        context: nil];
+}
+
+- (void)viewWillAppear:(BOOL)animated
+{
+    [super viewWillAppear: animated];
+    
+    [self reloadTableViewData];
+}
+
+#pragma mark - AKContactViewController delegate
+
+- (void)modalViewDidDismissWithContactID: (ABRecordID)contactID
+{
+    [self reloadTableViewData];
+}
+
+- (void)recordDidRemoveWithContactID: (ABRecordID)contactID
+{
+    [self reloadTableViewData];
+}
+
+#pragma mark - Custom methods
+
+- (void)reloadTableViewData
+{
+    dispatch_block_t block = ^{
+        NSCalendar *calendar = [NSCalendar currentCalendar];
+        NSDateComponents *components = [calendar components: NSYearCalendarUnit | NSMonthCalendarUnit | NSDayCalendarUnit fromDate: [NSDate date]];
+        [self setStartDate: [calendar dateFromComponents: components]];
+        
+        NSArray *events = [[AKAddressBook sharedInstance].dateIndex eventsFromDate: self.startDate numberOfDays: self.numberOfDays];
+        
+        NSMutableArray *sections = [[NSMutableArray alloc] init];
+        NSMutableArray *section = nil;
+        for (AKDateEvent *event in events)
+        {   // Events are ordered by their next occurrence
+            if (section == nil || [(AKDateEvent *)[section lastObject] daysAhead] != event.daysAhead)
+            {
+                section = [[NSMutableArray alloc] init];
+                [sections addObject: section];
+            }
+            [section addObject: event];
+        }
+        [self setSections: [sections copy]];
+        
+        [self.tableView reloadData];
+    };
+    
+    if (dispatch_get_specific(IsOnMainQueueKey)) block();
+    else dispatch_async(dispatch_get_main_queue(), block);
+}
+
+- (NSDate *)dateWithDaysAhead: (NSUInteger)daysAhead
+{
+    NSDateComponents *components = [[NSDateComponents alloc] init];
+    [components setDay: daysAhead];
+    return [[NSCalendar currentCalendar] dateByAddingComponents: components toDate: self.startDate options: 0];
+}
+
+#pragma mark - Table view data source
+
+- (NSInteger)numberOfSectionsInTableView: (UITableView *)tableView
+{
+    return [self.sections count];
+}
+
+- (NSInteger)tableView: (UITableView *)tableView numberOfRowsInSection: (NSInteger)section
+{
+    return [[self.sections objectAtIndex: section] count];
+}
+
+- (UITableViewCell *)tableView: (UITableView *)tableView cellForRowAtIndexPath: (NSIndexPath *)indexPath
+{
+    static NSString *CellIdentifier = @"Cell";
+    
+    UITableViewCell *cell = [tableView dequeueReusableCellWithIdentifier: CellIdentifier];
+    if (cell == nil) {
+        cell = [[UITableViewCell alloc] initWithStyle: UITableViewCellStyleValue1 reuseIdentifier: CellIdentifier];
+    }
+    
+    AKDateEvent *event = [[self.sections objectAtIndex: indexPath.section] objectAtIndex: indexPath.row];
+    AKContact *contact = [[AKAddressBook sharedInstance] contactForContactId: event.recordID];
+    
+    NSString *label = ([event isBirthday]) ?
+        [[AKRecord localizedNameForProperty: kABPersonBirthdayProperty] lowercaseString] :
+        [contact localizedLabelForMultiValueProperty: kABPersonDateProperty andIdentifier: event.identifier];
+    if (event.year > 0)
+    {   // Years passed at the occurrence listed
+        NSInteger year = [[NSCalendar currentCalendar] components: NSYearCalendarUnit fromDate: [self dateWithDaysAhead: event.daysAhead]].year;
+        if (year > event.year)
+        {
+            label = [NSString stringWithFormat: @"%@ (%ld)", label, (long)(year - event.year)];
+        }
+    }
+    
+    [cell setTag: event.recordID];
+    [cell.textLabel setText: [contact displayName]];
+    [cell.detailTextLabel setText: label];
+    
+    return cell;
+}
+
+- (NSString *)tableView: (UITableView *)tableView titleForHeaderInSection: (NSInteger)section
+{
+    NSUInteger daysAhead = [(AKDateEvent *)[[self.sections objectAtIndex: section] firstObject] daysAhead];
+    if (daysAhead == 0) return NSLocalizedString(@"Today", @"");
+    if (daysAhead == 1) return NSLocalizedString(@"Tomorrow", @"");
+    
+    static NSDateFormatter *dateFormatter = nil;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        dateFormatter = [[NSDateFormatter alloc] init];
+        [dateFormatter setDateFormat: [NSDateFormatter dateFormatFromTemplate: @"EEEEMMMMd" options: 0 locale: [NSLocale currentLocale]]];
+    });
+    return [dateFormatter stringFromDate: [self dateWithDaysAhead: daysAhead]];
+}
+
+#pragma mark - Table view delegate
+
+- (void)tableView: (UITableView *)tableView didSelectRowAtIndexPath: (NSIndexPath *)indexPath
+{
+    UITableViewCell *cell = [tableView cellForRowAtIndexPath: indexPath];
+    
+    if (self.openingContactID == kABRecordInvalidID)
+    {
+        ABRecordID contactID = (ABRecordID)cell.tag;
+        [self setOpeningContactID: contactID];
+        
+        [AKContactDetailModel loadModelForRecordID: contactID completionHandler: ^(AKContactDetailModel *model) {
+            [self setOpeningContactID: kABRecordInvalidID];
+            
+            AKContactViewController *contactView = [[AKContactViewController alloc] initWithContactID: contactID detailModel: model];
+            [contactView setDelegate: self];
+            [self.navigationController pushViewController: contactView animated: YES];
+        }];
+    }
+    
+    [tableView deselectRowAtIndexPath: indexPath animated: YES];
+}
+
+#pragma mark - Key-Value Observing
+
+- (void)observeValueForKeyPath:(NSString *)keyPath ofObject:(id)object change:(NSDictionary *)change context:(void *)context
+{ // This is not dispatched on main queue
+    
+    AKAddressBook *addressBook = [AKAddressBook sharedInstance];
+    if (object == addressBook && // Comparing the address
+        [keyPath isEqualToString: NSStringFromSelector(@selector(status))])
+    { // Status property of AKAddressBook changed
+        if (addressBook.status == kAddressBookOnline)
+        {
+            [self reloadTableViewData];
+        }
+    }
+}
+
+@end
@@ -17,5 +17,10 @@
 @property (readonly) NSString *stringWithDiacriticsRemoved;
 @property (readonly) NSString *stringWithNormalizedPhoneNumber;
 @property (readonly) NSString *stringWithWhiteSpaceTrimmed;
+/**
+ * Lowercased address without a mailto: scheme, angle brackets and trailing dot of the domain.
+ * Nil unless the string has a local part and a domain separated by @
+ */
+@property (readonly) NSString *stringWithCanonicalEmailAddress;
 
 @end
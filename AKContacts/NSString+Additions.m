@@ -58,4 +58,27 @@
     return [self stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceCharacterSet]];
 }
 
+- (NSString *)stringWithCanonicalEmailAddress
+{
+    NSString *address = [self stringByTrimmingCharactersInSet: [NSCharacterSet whitespaceAndNewlineCharacterSet]].lowercaseString;
+    if ([address hasPrefix: @"mailto:"]) {
+        address = [address substringFromIndex: [@"mailto:" length]];
+    }
+    if ([address hasPrefix: @"<"] && [address hasSuffix: @">"]) {
+        address = [address substringWithRange: NSMakeRange(1, address.length - 2)];
+    }
+    while ([address hasSuffix: @"."]) {
+        address = [address substringToIndex: address.length - 1];
+    }
+    
+    NSRange separator = [address rangeOfString: @"@" options: NSBackwardsSearch];
+    if (separator.location == NSNotFound || separator.location == 0 || NSMaxRange(separator) == address.length) {
+        return nil;
+    }
+    if ([address rangeOfCharacterFromSet: [NSCharacterSet whitespaceAndNewlineCharacterSet]].location != NSNotFound) {
+        return nil;
+    }
+    return address;
+}
+
 @end
@@ -0,0 +1,209 @@
+//
+//  AKAddressBookPoolTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKAddressBookPool.h"
+
+static const NSUInteger kConcurrentLeaseCount = 6;
+
+@interface AKAddressBookPoolTests : XCTestCase
+
+@property (strong, nonatomic) AKAddressBookPool *pool;
+/**
+ * ABAddressBookCreateWithOptions returns NULL without access to contacts, the tests are skipped then
+ */
+@property (assign, nonatomic) BOOL addressBookAvailable;
+
+@end
+
+@implementation AKAddressBookPoolTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    __block BOOL addressBookAvailable = NO;
+    AKAddressBookPool *probe = [[AKAddressBookPool alloc] init];
+    [self performInBackground: ^{
+        [probe performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            addressBookAvailable = (addressBookRef != NULL);
+        }];
+    }];
+    self.addressBookAvailable = addressBookAvailable;
+    if (!addressBookAvailable) NSLog(@"No address book access, skipping %@", self.name);
+    
+    self.pool = [[AKAddressBookPool alloc] init];
+}
+
+- (void)tearDown
+{
+    self.pool = nil;
+    
+    [super tearDown];
+}
+
+/**
+ * The pool must not be used on the main thread. dispatch_sync could run the
+ * block on the calling thread, so it is dispatched asynchronously and waited for
+ */
+- (void)performInBackground: (dispatch_block_t)block
+{
+    dispatch_semaphore_t done = dispatch_semaphore_create(0);
+    dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+        block();
+        dispatch_semaphore_signal(done);
+    });
+    dispatch_semaphore_wait(done, DISPATCH_TIME_FOREVER);
+}
+
+- (void)testNoReferenceOutsideBlock
+{
+    if (!self.addressBookAvailable) return;
+    
+    __block BOOL leasedBefore = YES, leasedAfter = YES;
+    __block ABAddressBookRef leased = NULL, during = NULL;
+    [self performInBackground: ^{
+        leasedBefore = ([self.pool addressBookRefForCurrentThread] != NULL);
+        [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            leased = addressBookRef;
+            during = [self.pool addressBookRefForCurrentThread];
+        }];
+        leasedAfter = ([self.pool addressBookRefForCurrentThread] != NULL);
+    }];
+    
+    XCTAssertFalse(leasedBefore, @"Not leased yet");
+    XCTAssertTrue(during == leased, @"Reference of the block");
+    XCTAssertFalse(leasedAfter, @"Lease ended with the block");
+}
+
+- (void)testNestedBlocksShareReference
+{
+    if (!self.addressBookAvailable) return;
+    
+    __block ABAddressBookRef outer = NULL, inner = NULL;
+    [self performInBackground: ^{
+        [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            outer = addressBookRef;
+            [self.pool performWithAddressBookRef: ^(ABAddressBookRef nestedAddressBookRef) {
+                inner = nestedAddressBookRef;
+            }];
+        }];
+    }];
+    
+    XCTAssertTrue(outer == inner, @"Reference of the outermost block");
+    XCTAssertEqual(self.pool.handlesCreated, (NSUInteger)1, @"No handle for the nested block");
+    XCTAssertEqual(self.pool.idleHandleCount, (NSUInteger)1, @"Returned once");
+}
+
+- (void)testSequentialBlocksReuseHandle
+{
+    if (!self.addressBookAvailable) return;
+    
+    __block ABAddressBookRef first = NULL, second = NULL;
+    [self performInBackground: ^{
+        [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) { first = addressBookRef; }];
+    }];
+    [self performInBackground: ^{
+        [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) { second = addressBookRef; }];
+    }];
+    
+    XCTAssertTrue(first == second, @"Idle handle leased again");
+    XCTAssertEqual(self.pool.handlesCreated, (NSUInteger)1, @"Created once");
+    XCTAssertEqual(self.pool.handlesReverted, (NSUInteger)0, @"Not invalidated");
+}
+
+- (void)testRevertOnlyWhenLeasedAfterInvalidate
+{
+    if (!self.addressBookAvailable) return;
+    
+    __block NSUInteger revertedWithinBlock = NSNotFound;
+    __block ABAddressBookRef outer = NULL, inner = NULL, next = NULL;
+    [self performInBackground: ^{
+        [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+            outer = addressBookRef;
+            [self.pool invalidateHandles];
+            [self.pool performWithAddressBookRef: ^(ABAddressBookRef nestedAddressBookRef) {
+                inner = nestedAddressBookRef;
+            }];
+            revertedWithinBlock = self.pool.handlesReverted;
+        }];
+    }];
+    
+    XCTAssertTrue(outer == inner, @"Nested block keeps the lease");
+    XCTAssertEqual(revertedWithinBlock, (NSUInteger)0, @"Never reverted while leased");
+    
+    [self performInBackground: ^{
+        [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) { next = addressBookRef; }];
+    }];
+    XCTAssertTrue(next == outer, @"Stale handle reused");
+    XCTAssertEqual(self.pool.handlesReverted, (NSUInteger)1, @"Reverted when leased again");
+    
+    [self performInBackground: ^{
+        [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) { }];
+    }];
+    XCTAssertEqual(self.pool.handlesReverted, (NSUInteger)1, @"Reverted once per invalidation");
+    XCTAssertEqual(self.pool.handlesCreated, (NSUInteger)1, @"Never created again");
+}
+
+- (void)testIdleHandlesCapped
+{
+    if (!self.addressBookAvailable) return;
+    
+    // Serial queues of their own get a thread each, so every block holds its lease at the same time
+    dispatch_group_t group = dispatch_group_create();
+    dispatch_semaphore_t entered = dispatch_semaphore_create(0);
+    dispatch_semaphore_t proceed = dispatch_semaphore_create(0);
+    NSMutableArray *queues = [[NSMutableArray alloc] initWithCapacity: kConcurrentLeaseCount];
+    for (NSUInteger index = 0; index < kConcurrentLeaseCount; ++index)
+    {
+        dispatch_queue_t queue = dispatch_queue_create("ak.tests.pool", DISPATCH_QUEUE_SERIAL);
+        [queues addObject: queue];
+        dispatch_group_async(group, queue, ^{
+            [self.pool performWithAddressBookRef: ^(ABAddressBookRef addressBookRef) {
+                dispatch_semaphore_signal(entered);
+                dispatch_semaphore_wait(proceed, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC));
+            }];
+        });
+    }
+    for (NSUInteger index = 0; index < kConcurrentLeaseCount; ++index)
+    {
+        dispatch_semaphore_wait(entered, dispatch_time(DISPATCH_TIME_NOW, 10 * NSEC_PER_SEC));
+    }
+    XCTAssertEqual(self.pool.idleHandleCount, (NSUInteger)0, @"All leased");
+    
+    for (NSUInteger index = 0; index < kConcurrentLeaseCount; ++index)
+    {
+        dispatch_semaphore_signal(proceed);
+    }
+    dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    
+    XCTAssertEqual(self.pool.handlesCreated, kConcurrentLeaseCount, @"One handle per concurrent block");
+    XCTAssertEqual(self.pool.idleHandleCount, (NSUInteger)4, @"Only four kept");
+}
+
+@end
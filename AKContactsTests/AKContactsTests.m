@@ -7,6 +7,18 @@
 //
 
 #import "AKContactsTests.h"
+#import "AKAddressBook.h"
+#import "AKAddressBook+Loader.h"
+#import "AKContact.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKContactsTests ()
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (strong, nonatomic) AKAddressBook *addressBook;
+@property (copy, nonatomic) NSString *sectionCachePath;
+
+@end
 
 @implementation AKContactsTests
 
@@ -14,19 +26,86 @@
 {
     [super setUp];
     
-    // Set-up code here.
+    NSString *name = [NSString stringWithFormat: @"AKContactsTests-%@", [[NSProcessInfo processInfo] globallyUniqueString]];
+    self.sectionCachePath = [NSTemporaryDirectory() stringByAppendingPathComponent: name];
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    self.addressBook = [[AKAddressBook alloc] initWithSectionCacheDirectoryPath: self.sectionCachePath];
+    
+    AKAddressBook *addressBook = self.addressBook;
+    dispatch_sync(addressBook.serial_queue, ^{
+        [addressBook resetTables];
+    });
 }
 
 - (void)tearDown
 {
-    // Tear-down code here.
+    self.addressBook = nil;
+    self.replayAddressBook = nil;
+    [[NSFileManager defaultManager] removeItemAtPath: self.sectionCachePath error: nil];
     
     [super tearDown];
 }
 
-- (void)testExample
+/**
+ * Removed and inserted again, as the loader applies a changed contact
+ */
+- (void)applyRecordID: (ABRecordID)recordID
+{
+    AKAddressBook *addressBook = self.addressBook;
+    AKContact *contact = [self.replayAddressBook contactForRecordID: recordID sortOrdering: kABPersonSortByFirstName];
+    BOOL exists = [self.replayAddressBook hasRecordID: recordID];
+    dispatch_sync(addressBook.serial_queue, ^{
+        [addressBook deleteRecordIDfromContactIdentifiersForContact: contact];
+        if (exists)
+        {
+            [addressBook insertRecordIDinContactIdentifiersForContact: contact withAddressBookRef: NULL];
+            [addressBook processPhoneNumbersOfContact: contact withABAddressBookRef: NULL];
+        }
+    });
+}
+
+- (NSArray *)phoneSectionKeysOfRecordID: (ABRecordID)recordID
+{
+    NSMutableArray *keys = [[NSMutableArray alloc] init];
+    AKAddressBook *addressBook = self.addressBook;
+    dispatch_sync(addressBook.serial_queue, ^{
+        [addressBook.hashTableSortedByPhone enumerateKeysAndObjectsUsingBlock: ^(NSString *key, NSArray *sectionArray, BOOL *stop) {
+            if ([sectionArray containsObject: @(recordID)]) [keys addObject: key];
+        }];
+    });
+    return [keys sortedArrayUsingSelector: @selector(compare:)];
+}
+
+- (void)testPhoneSectionsOfInternationalNumber
 {
-    XCTFail(@"Unit tests are not implemented yet in AKContactsTests");
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: @{@(kABPersonFirstNameProperty): @"Anna",
+                                                                         @(kABPersonPhoneProperty): @[@"+36 20 123 4567"]}];
+    [self applyRecordID: recordID];
+    
+    // First digit, international and first digit of the national number
+    NSArray *keys = @[@"+", @"2", @"3"];
+    XCTAssertEqualObjects([self phoneSectionKeysOfRecordID: recordID], keys, @"Phone sections of +36 20 differ");
+}
+
+- (void)testPhoneSectionsOfChangedContact
+{
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: @{@(kABPersonFirstNameProperty): @"Anna",
+                                                                         @(kABPersonPhoneProperty): @[@"06 30 555 1234"]}];
+    [self applyRecordID: recordID];
+    XCTAssertEqualObjects([self phoneSectionKeysOfRecordID: recordID], @[@"0"], @"Contact is not in the section of its number");
+    
+    [self.replayAddressBook setValues: @{@(kABPersonPhoneProperty): @[@"1 555 0100"]} ofRecordID: recordID];
+    [self applyRecordID: recordID];
+    NSArray *keys = @[@"1", @"5"];
+    XCTAssertEqualObjects([self phoneSectionKeysOfRecordID: recordID], keys, @"Section of the previous number is stale");
+    
+    [self.replayAddressBook setValues: @{@(kABPersonPhoneProperty): [NSNull null]} ofRecordID: recordID];
+    [self applyRecordID: recordID];
+    XCTAssertEqualObjects([self phoneSectionKeysOfRecordID: recordID], @[noPhoneNumberKey], @"Contact without numbers is in a number section");
+    
+    [self.replayAddressBook removeRecordID: recordID];
+    [self applyRecordID: recordID];
+    XCTAssertEqualObjects([self phoneSectionKeysOfRecordID: recordID], @[], @"Deleted contact is left in a phone section");
 }
 
 @end
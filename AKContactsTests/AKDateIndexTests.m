@@ -0,0 +1,179 @@
+//
+//  AKDateIndexTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKDateIndex.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKDateIndexTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (strong, nonatomic) AKDateIndex *dateIndex;
+
+@end
+
+@implementation AKDateIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    self.dateIndex = [[AKDateIndex alloc] init];
+}
+
+- (void)tearDown
+{
+    self.dateIndex = nil;
+    self.replayAddressBook = nil;
+    
+    [super tearDown];
+}
+
+/**
+ * As ABAddressBook stores dates, at noon GMT
+ */
+- (NSDate *)storedDateWithYear: (NSInteger)year month: (NSInteger)month day: (NSInteger)day
+{
+    NSCalendar *calendar = [[NSCalendar alloc] initWithCalendarIdentifier: NSGregorianCalendar];
+    calendar.timeZone = [NSTimeZone timeZoneForSecondsFromGMT: 0];
+    return [calendar dateFromComponents: [self componentsWithYear: year month: month day: day]];
+}
+
+/**
+ * Start of a query, in the current calendar
+ */
+- (NSDate *)localDateWithYear: (NSInteger)year month: (NSInteger)month day: (NSInteger)day
+{
+    return [[NSCalendar currentCalendar] dateFromComponents: [self componentsWithYear: year month: month day: day]];
+}
+
+- (NSDateComponents *)componentsWithYear: (NSInteger)year month: (NSInteger)month day: (NSInteger)day
+{
+    NSDateComponents *components = [[NSDateComponents alloc] init];
+    components.year = year;
+    components.month = month;
+    components.day = day;
+    components.hour = 12;
+    return components;
+}
+
+- (ABRecordID)indexPersonWithValues: (NSDictionary *)values
+{
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: values];
+    [self.dateIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: recordID]];
+    return recordID;
+}
+
+- (void)testEventsInOrderOfOccurrence
+{
+    ABRecordID anna = [self indexPersonWithValues: @{@(kABPersonFirstNameProperty): @"Anna",
+                                                     @(kABPersonBirthdayProperty): [self storedDateWithYear: 1985 month: 7 day: 4],
+                                                     @(kABPersonDateProperty): @[[self storedDateWithYear: 2010 month: 7 day: 6]]}];
+    ABRecordID bob = [self indexPersonWithValues: @{@(kABPersonFirstNameProperty): @"Bob",
+                                                    @(kABPersonBirthdayProperty): [self storedDateWithYear: 1604 month: 7 day: 5]}];
+    [self indexPersonWithValues: @{@(kABPersonFirstNameProperty): @"Cecil"}];
+    XCTAssertEqual(self.dateIndex.count, (NSUInteger)3, @"Contacts without dates are counted");
+    
+    NSArray *events = [self.dateIndex eventsFromDate: [self localDateWithYear: 2013 month: 7 day: 4] numberOfDays: 3];
+    XCTAssertEqual(events.count, (NSUInteger)3, @"Two birthdays and a date");
+    
+    AKDateEvent *event = [events objectAtIndex: 0];
+    XCTAssertEqual(event.recordID, anna, @"Birthday of the first day");
+    XCTAssertTrue(event.isBirthday, @"Birthday");
+    XCTAssertEqual(event.year, (NSInteger)1985, @"Year of birth");
+    XCTAssertEqual(event.daysAhead, (NSUInteger)0, @"Today");
+    
+    event = [events objectAtIndex: 1];
+    XCTAssertEqual(event.recordID, bob, @"Birthday of the second day");
+    XCTAssertEqual(event.year, (NSInteger)0, @"Year of the Contacts app is unknown");
+    XCTAssertEqual(event.daysAhead, (NSUInteger)1, @"Tomorrow");
+    
+    event = [events objectAtIndex: 2];
+    XCTAssertEqual(event.recordID, anna, @"Date of the third day");
+    XCTAssertFalse(event.isBirthday, @"Not a birthday");
+    XCTAssertEqual(event.identifier, (ABMultiValueIdentifier)0, @"Identifier of the date");
+    XCTAssertEqual(event.month, (NSInteger)7, @"Month");
+    XCTAssertEqual(event.day, (NSInteger)6, @"Day");
+    XCTAssertEqual(event.daysAhead, (NSUInteger)2, @"In two days");
+    
+    XCTAssertEqual([self.dateIndex eventsFromDate: [self localDateWithYear: 2013 month: 7 day: 7] numberOfDays: 30].count, (NSUInteger)0, @"None in the next month");
+}
+
+- (void)testRangeWrapsAroundYearEnd
+{
+    ABRecordID recordID = [self indexPersonWithValues: @{@(kABPersonBirthdayProperty): [self storedDateWithYear: 1990 month: 1 day: 2]}];
+    
+    NSArray *events = [self.dateIndex eventsFromDate: [self localDateWithYear: 2013 month: 12 day: 30] numberOfDays: 5];
+    XCTAssertEqual(events.count, (NSUInteger)1, @"Birthday in the next year");
+    XCTAssertEqual([events.firstObject recordID], recordID, @"Birthday in the next year");
+    XCTAssertEqual([events.firstObject daysAhead], (NSUInteger)3, @"December 30 to January 2");
+    
+    events = [self.dateIndex eventsFromDate: [self localDateWithYear: 2013 month: 1 day: 3] numberOfDays: 1000];
+    XCTAssertEqual(events.count, (NSUInteger)1, @"Capped at a year, each event occurs once");
+    XCTAssertEqual([events.firstObject daysAhead], (NSUInteger)364, @"January 3 to January 2");
+}
+
+- (void)testLeapDay
+{
+    [self indexPersonWithValues: @{@(kABPersonBirthdayProperty): [self storedDateWithYear: 1992 month: 2 day: 29]}];
+    
+    NSArray *events = [self.dateIndex eventsFromDate: [self localDateWithYear: 2013 month: 2 day: 27] numberOfDays: 3];
+    XCTAssertEqual(events.count, (NSUInteger)1, @"Occurs on February 28 in other years");
+    XCTAssertEqual([events.firstObject daysAhead], (NSUInteger)1, @"February 27 to February 28");
+    
+    events = [self.dateIndex eventsFromDate: [self localDateWithYear: 2016 month: 2 day: 27] numberOfDays: 3];
+    XCTAssertEqual(events.count, (NSUInteger)1, @"Occurs on February 29 in leap years");
+    XCTAssertEqual([events.firstObject daysAhead], (NSUInteger)2, @"February 27 to February 29");
+    
+    events = [self.dateIndex eventsFromDate: [self localDateWithYear: 2013 month: 3 day: 1] numberOfDays: 300];
+    XCTAssertEqual(events.count, (NSUInteger)0, @"Not on March 1 in other years");
+}
+
+- (void)testRemovedAndChangedRecords
+{
+    ABRecordID anna = [self indexPersonWithValues: @{@(kABPersonBirthdayProperty): [self storedDateWithYear: 1985 month: 7 day: 4]}];
+    ABRecordID bob = [self indexPersonWithValues: @{@(kABPersonBirthdayProperty): [self storedDateWithYear: 1980 month: 7 day: 4]}];
+    NSDate *date = [self localDateWithYear: 2013 month: 7 day: 4];
+    
+    [self.dateIndex removeRecordID: anna];
+    NSArray *events = [self.dateIndex eventsFromDate: date numberOfDays: 1];
+    XCTAssertEqual(events.count, (NSUInteger)1, @"Birthday of the removed record");
+    XCTAssertEqual([events.firstObject recordID], bob, @"Birthday of the record left");
+    
+    [self.replayAddressBook setValues: @{@(kABPersonBirthdayProperty): [self storedDateWithYear: 1980 month: 8 day: 1]} ofRecordID: bob];
+    [self.dateIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: bob]];
+    XCTAssertEqual([self.dateIndex eventsFromDate: date numberOfDays: 1].count, (NSUInteger)0, @"Previous birthday replaced");
+    XCTAssertEqual([self.dateIndex eventsFromDate: date numberOfDays: 29].count, (NSUInteger)1, @"New birthday indexed");
+    
+    [self.dateIndex removeAllRecords];
+    XCTAssertEqual(self.dateIndex.count, (NSUInteger)0, @"Empty");
+    XCTAssertEqual([self.dateIndex eventsFromDate: date numberOfDays: 366].count, (NSUInteger)0, @"No events");
+}
+
+@end
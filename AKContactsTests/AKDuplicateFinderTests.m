@@ -0,0 +1,146 @@
+//
+//  AKDuplicateFinderTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKDuplicateFinder.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKDuplicateFinderTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (strong, nonatomic) AKDuplicateFinder *duplicateFinder;
+
+@end
+
+@implementation AKDuplicateFinderTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    self.duplicateFinder = [[AKDuplicateFinder alloc] initWithAddressBook: nil];
+}
+
+- (void)tearDown
+{
+    self.duplicateFinder = nil;
+    self.replayAddressBook = nil;
+    
+    [super tearDown];
+}
+
+- (ABRecordID)addPersonWithFirstName: (NSString *)firstName lastName: (NSString *)lastName phoneNumbers: (NSArray *)phoneNumbers emails: (NSArray *)emails
+{
+    NSMutableDictionary *values = [[NSMutableDictionary alloc] init];
+    if (firstName) [values setObject: firstName forKey: @(kABPersonFirstNameProperty)];
+    if (lastName) [values setObject: lastName forKey: @(kABPersonLastNameProperty)];
+    if (phoneNumbers) [values setObject: phoneNumbers forKey: @(kABPersonPhoneProperty)];
+    if (emails) [values setObject: emails forKey: @(kABPersonEmailProperty)];
+    return [self.replayAddressBook addPersonWithValues: values];
+}
+
+/**
+ * Clusters of all people of the fake, sorted
+ */
+- (NSArray *)clusters
+{
+    NSMutableArray *contacts = [[NSMutableArray alloc] init];
+    for (NSNumber *recordID in self.replayAddressBook.recordIDs)
+    {
+        [contacts addObject: [self.replayAddressBook contactForRecordID: recordID.intValue sortOrdering: kABPersonSortByFirstName]];
+    }
+    NSArray *clusters = [self.duplicateFinder clustersOfContacts: contacts];
+    return [clusters sortedArrayUsingComparator: ^NSComparisonResult(NSArray *cluster1, NSArray *cluster2) {
+        return [cluster1.firstObject compare: cluster2.firstObject];
+    }];
+}
+
+- (void)testSameFoldedNameAndPhoneNumber
+{
+    ABRecordID recordID1 = [self addPersonWithFirstName: @"Ádám" lastName: @"Kovács" phoneNumbers: @[@"+36 20 123 4567"] emails: nil];
+    ABRecordID recordID2 = [self addPersonWithFirstName: @"adam" lastName: @"Kovacs " phoneNumbers: @[@"06 (20) 123-4567"] emails: nil];
+    [self addPersonWithFirstName: @"Béla" lastName: @"Kovács" phoneNumbers: @[@"+36 30 765 4321"] emails: nil];
+    
+    NSArray *expected = @[@[@(recordID1), @(recordID2)]];
+    XCTAssertEqualObjects([self clusters], expected, @"Same name and phone number suffix");
+}
+
+- (void)testSameEmailAddress
+{
+    ABRecordID recordID1 = [self addPersonWithFirstName: @"John" lastName: @"Smith" phoneNumbers: nil emails: @[@"js@example.com"]];
+    ABRecordID recordID2 = [self addPersonWithFirstName: @"Johnny" lastName: nil phoneNumbers: nil emails: @[@"JS@Example.com"]];
+    
+    NSArray *expected = @[@[@(recordID1), @(recordID2)]];
+    XCTAssertEqualObjects([self clusters], expected, @"Email addresses are folded");
+}
+
+- (void)testWeakMatchesNotReported
+{
+    // Same last name and initial score below the threshold
+    [self addPersonWithFirstName: @"Anna" lastName: @"Nagy" phoneNumbers: @[@"+36 1 111 1111"] emails: nil];
+    [self addPersonWithFirstName: @"Andrea" lastName: @"Nagy" phoneNumbers: @[@"+36 1 222 2222"] emails: nil];
+    // Same phone number, different names
+    [self addPersonWithFirstName: @"Péter" lastName: @"Szabó" phoneNumbers: @[@"+36 1 333 3333"] emails: nil];
+    [self addPersonWithFirstName: @"Zoltán" lastName: @"Tóth" phoneNumbers: @[@"+36 1 333 3333"] emails: nil];
+    
+    XCTAssertEqualObjects([self clusters], @[], @"No pair reaches the score threshold");
+}
+
+- (void)testLinkedPeopleNotReported
+{
+    ABRecordID recordID1 = [self addPersonWithFirstName: @"Eva" lastName: @"Kiss" phoneNumbers: @[@"+36 70 555 0100"] emails: @[@"eva@example.com"]];
+    ABRecordID recordID2 = [self addPersonWithFirstName: @"Eva" lastName: @"Kiss" phoneNumbers: @[@"+36 70 555 0100"] emails: @[@"eva@example.com"]];
+    XCTAssertTrue([self.replayAddressBook linkRecordID: recordID1 toRecordID: recordID2], @"Linked");
+    
+    XCTAssertEqualObjects([self clusters], @[], @"Linked people are the same person");
+}
+
+- (void)testStrongestPairsClusteredFirst
+{
+    // recordID2 matches recordID1 by email and recordID3 by name and phone number,
+    // but recordID1 and recordID3 don't match, so only the stronger pair is a cluster
+    [self addPersonWithFirstName: @"Jane" lastName: @"Doe" phoneNumbers: nil emails: @[@"office@example.com"]];
+    ABRecordID recordID2 = [self addPersonWithFirstName: @"John" lastName: @"Roe" phoneNumbers: @[@"+1 555 010 0100"] emails: @[@"office@example.com"]];
+    ABRecordID recordID3 = [self addPersonWithFirstName: @"John" lastName: @"Roe" phoneNumbers: @[@"555 010 0100"] emails: nil];
+    
+    NSArray *expected = @[@[@(recordID2), @(recordID3)]];
+    XCTAssertEqualObjects([self clusters], expected, @"Clusters only grow by direct matches, strongest first");
+}
+
+- (void)testOversizedBlocksSkipped
+{
+    self.duplicateFinder.maximumBlockSize = 2;
+    [self addPersonWithFirstName: @"Kate" lastName: @"Brown" phoneNumbers: nil emails: @[@"info@example.com"]];
+    [self addPersonWithFirstName: @"Liam" lastName: @"Green" phoneNumbers: nil emails: @[@"info@example.com"]];
+    [self addPersonWithFirstName: @"Mia" lastName: @"White" phoneNumbers: nil emails: @[@"info@example.com"]];
+    
+    XCTAssertEqualObjects([self clusters], @[], @"The shared address is too common to be selective");
+}
+
+@end
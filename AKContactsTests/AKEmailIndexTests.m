@@ -0,0 +1,134 @@
+//
+//  AKEmailIndexTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKEmailIndex.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKEmailIndexTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (strong, nonatomic) AKEmailIndex *emailIndex;
+@property (assign, nonatomic) ABRecordID anna;
+@property (assign, nonatomic) ABRecordID bob;
+@property (assign, nonatomic) ABRecordID cecil;
+
+@end
+
+@implementation AKEmailIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    self.emailIndex = [[AKEmailIndex alloc] init];
+    
+    self.anna = [self.replayAddressBook addPersonWithValues: @{@(kABPersonEmailProperty): @[@"Anna@Example.com ", @"mailto:anna@work.example.com"]}];
+    self.bob = [self.replayAddressBook addPersonWithValues: @{@(kABPersonEmailProperty): @[@"<bob@example.com>", @"not an address"]}];
+    self.cecil = [self.replayAddressBook addPersonWithValues: @{@(kABPersonEmailProperty): @[@"cecil@example.org"]}];
+    ABRecordID dora = [self.replayAddressBook addPersonWithValues: @{@(kABPersonFirstNameProperty): @"Dora"}];
+    [self.replayAddressBook linkRecordID: self.bob toRecordID: self.cecil];
+    
+    for (NSNumber *recordID in @[@(self.anna), @(self.bob), @(self.cecil), @(dora)])
+    {
+        [self.emailIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: recordID.intValue]];
+    }
+}
+
+- (void)tearDown
+{
+    self.emailIndex = nil;
+    self.replayAddressBook = nil;
+    
+    [super tearDown];
+}
+
+- (NSIndexSet *)indexSetWithRecordIDs: (NSArray *)recordIDs
+{
+    NSMutableIndexSet *indexSet = [[NSMutableIndexSet alloc] init];
+    for (NSNumber *recordID in recordIDs)
+    {
+        [indexSet addIndex: recordID.unsignedIntegerValue];
+    }
+    return [indexSet copy];
+}
+
+- (void)testAddresses
+{
+    XCTAssertEqual(self.emailIndex.count, (NSUInteger)3, @"Only contacts having addresses are counted");
+    
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailAddress: @"ANNA@example.COM"], [NSIndexSet indexSetWithIndex: self.anna], @"Canonical address");
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailAddress: @"anna@work.example.com"], [NSIndexSet indexSetWithIndex: self.anna], @"Without the scheme");
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailAddress: @"mailto:<bob@example.com>"], [NSIndexSet indexSetWithIndex: self.bob], @"Lookups are canonicalized");
+    XCTAssertEqual([self.emailIndex recordIDsWithEmailAddress: @"not an address"].count, (NSUInteger)0, @"Not canonical");
+    XCTAssertEqual([self.emailIndex recordIDsWithEmailAddress: nil].count, (NSUInteger)0, @"No address");
+    
+    NSIndexSet *linked = [self indexSetWithRecordIDs: @[@(self.bob), @(self.cecil)]];
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailAddress: @"cecil@example.org"], linked, @"Addresses of linked records");
+}
+
+- (void)testBatchLookup
+{
+    NSArray *addresses = @[@" ANNA@example.com", @"nobody@example.com", @"bob@example.com"];
+    NSDictionary *expected = @{@" ANNA@example.com": [NSIndexSet indexSetWithIndex: self.anna],
+                               @"bob@example.com": [self indexSetWithRecordIDs: @[@(self.bob), @(self.cecil)]]};
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailAddresses: addresses], expected, @"Keyed by the addresses asked for");
+}
+
+- (void)testDomains
+{
+    NSIndexSet *expected = [self indexSetWithRecordIDs: @[@(self.anna), @(self.bob), @(self.cecil)]];
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailDomain: @"example.com"], expected, @"Records of the domain");
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailDomain: @" @EXAMPLE.COM."], expected, @"Domains are canonicalized");
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailDomain: @"work.example.com"], [NSIndexSet indexSetWithIndex: self.anna], @"Subdomain");
+    XCTAssertEqual([self.emailIndex recordIDsWithEmailDomain: @"com"].count, (NSUInteger)0, @"Parent domains are not matched");
+}
+
+- (void)testRemovedAndChangedRecords
+{
+    [self.emailIndex removeRecordID: self.anna];
+    XCTAssertEqual(self.emailIndex.count, (NSUInteger)2, @"Two records left");
+    XCTAssertEqual([self.emailIndex recordIDsWithEmailDomain: @"work.example.com"].count, (NSUInteger)0, @"Domain of the removed record");
+    NSIndexSet *linked = [self indexSetWithRecordIDs: @[@(self.bob), @(self.cecil)]];
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailDomain: @"example.com"], linked, @"Shared domain kept");
+    
+    [self.replayAddressBook unlinkRecordID: self.cecil];
+    for (NSNumber *recordID in @[@(self.bob), @(self.cecil)])
+    {
+        [self.emailIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: recordID.intValue]];
+    }
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailAddress: @"cecil@example.org"], [NSIndexSet indexSetWithIndex: self.cecil], @"Previous addresses replaced");
+    XCTAssertEqualObjects([self.emailIndex recordIDsWithEmailDomain: @"example.com"], [NSIndexSet indexSetWithIndex: self.bob], @"Unlinked");
+    
+    [self.emailIndex removeAllRecords];
+    XCTAssertEqual(self.emailIndex.count, (NSUInteger)0, @"Empty");
+    XCTAssertEqual([self.emailIndex recordIDsWithEmailDomain: @"example.org"].count, (NSUInteger)0, @"No domains");
+}
+
+@end
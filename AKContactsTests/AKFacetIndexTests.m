@@ -0,0 +1,138 @@
+//
+//  AKFacetIndexTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKFacetIndex.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKFacetIndexTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (strong, nonatomic) AKFacetIndex *facetIndex;
+@property (assign, nonatomic) ABRecordID anna;
+@property (assign, nonatomic) ABRecordID bob;
+@property (assign, nonatomic) ABRecordID cecil;
+
+@end
+
+@implementation AKFacetIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    self.facetIndex = [[AKFacetIndex alloc] init];
+    
+    NSDictionary *budapest = @{(NSString *)kABPersonAddressCityKey: @"Budapest"};
+    NSDictionary *szeged = @{(NSString *)kABPersonAddressCityKey: @"Szeged"};
+    self.anna = [self indexPersonWithValues: @{@(kABPersonOrganizationProperty): @"Acme", @(kABPersonDepartmentProperty): @"R&D",
+                                               @(kABPersonJobTitleProperty): @"Engineer", @(kABPersonAddressProperty): @[budapest]}];
+    self.bob = [self indexPersonWithValues: @{@(kABPersonOrganizationProperty): @"ACMÉ ", @(kABPersonJobTitleProperty): @"Manager",
+                                              @(kABPersonAddressProperty): @[szeged, budapest]}];
+    self.cecil = [self indexPersonWithValues: @{@(kABPersonOrganizationProperty): @"Globex"}];
+    [self indexPersonWithValues: @{@(kABPersonFirstNameProperty): @"Dora"}];
+}
+
+- (void)tearDown
+{
+    self.facetIndex = nil;
+    self.replayAddressBook = nil;
+    
+    [super tearDown];
+}
+
+- (ABRecordID)indexPersonWithValues: (NSDictionary *)values
+{
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: values];
+    [self.facetIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: recordID]];
+    return recordID;
+}
+
+- (NSIndexSet *)indexSetWithRecordIDs: (NSArray *)recordIDs
+{
+    NSMutableIndexSet *indexSet = [[NSMutableIndexSet alloc] init];
+    for (NSNumber *recordID in recordIDs)
+    {
+        [indexSet addIndex: recordID.unsignedIntegerValue];
+    }
+    return [indexSet copy];
+}
+
+- (void)testValues
+{
+    XCTAssertEqual(self.facetIndex.count, (NSUInteger)4, @"Contacts without values are counted");
+    
+    NSArray *organizations = @[@"Acme", @"Globex"];
+    XCTAssertEqualObjects([self.facetIndex valuesOfFacet: AKFacetOrganization], organizations, @"Folded values are displayed as first indexed");
+    XCTAssertEqualObjects([self.facetIndex valuesOfFacet: AKFacetDepartment], @[@"R&D"], @"Department");
+    NSArray *jobTitles = @[@"Engineer", @"Manager"];
+    XCTAssertEqualObjects([self.facetIndex valuesOfFacet: AKFacetJobTitle], jobTitles, @"Job titles");
+    NSArray *cities = @[@"Budapest", @"Szeged"];
+    XCTAssertEqualObjects([self.facetIndex valuesOfFacet: AKFacetCity], cities, @"Cities of all addresses");
+}
+
+- (void)testRecordIDsWithValue
+{
+    NSIndexSet *acme = [self indexSetWithRecordIDs: @[@(self.anna), @(self.bob)]];
+    XCTAssertEqualObjects([self.facetIndex recordIDsWithValue: @"acme" ofFacet: AKFacetOrganization], acme, @"Values are looked up folded");
+    XCTAssertEqualObjects([self.facetIndex recordIDsWithValue: @"Budapest" ofFacet: AKFacetCity], acme, @"Two records in Budapest");
+    XCTAssertEqualObjects([self.facetIndex recordIDsWithValue: @"Szeged" ofFacet: AKFacetCity], [NSIndexSet indexSetWithIndex: self.bob], @"Second address");
+    XCTAssertEqual([self.facetIndex recordIDsWithValue: @"Acme" ofFacet: AKFacetCity].count, (NSUInteger)0, @"Facets are separate");
+    XCTAssertEqual([self.facetIndex recordIDsWithValue: @"Initech" ofFacet: AKFacetOrganization].count, (NSUInteger)0, @"No record has the value");
+}
+
+- (void)testCounts
+{
+    NSDictionary *expected = @{@"Acme": @2, @"Globex": @1};
+    XCTAssertEqualObjects([self.facetIndex countsOfFacet: AKFacetOrganization amongRecordIDs: nil], expected, @"All records counted");
+    
+    NSIndexSet *recordIDs = [self indexSetWithRecordIDs: @[@(self.bob), @(self.cecil)]];
+    expected = @{@"Acme": @1, @"Globex": @1};
+    XCTAssertEqualObjects([self.facetIndex countsOfFacet: AKFacetOrganization amongRecordIDs: recordIDs], expected, @"Members of the set counted");
+    XCTAssertEqualObjects([self.facetIndex countsOfFacet: AKFacetDepartment amongRecordIDs: recordIDs], @{}, @"Values of no member are left out");
+}
+
+- (void)testRemovedAndChangedRecords
+{
+    [self.facetIndex removeRecordID: self.anna];
+    XCTAssertEqual(self.facetIndex.count, (NSUInteger)3, @"Three records left");
+    XCTAssertEqualObjects([self.facetIndex valuesOfFacet: AKFacetDepartment], @[], @"Value of the removed record");
+    XCTAssertEqualObjects([self.facetIndex recordIDsWithValue: @"Budapest" ofFacet: AKFacetCity], [NSIndexSet indexSetWithIndex: self.bob], @"Shared value kept");
+    
+    [self.replayAddressBook setValues: @{@(kABPersonOrganizationProperty): @"Globex"} ofRecordID: self.bob];
+    [self.facetIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: self.bob]];
+    XCTAssertEqualObjects([self.facetIndex valuesOfFacet: AKFacetOrganization], @[@"Globex"], @"Previous value replaced");
+    XCTAssertEqualObjects([self.facetIndex countsOfFacet: AKFacetOrganization amongRecordIDs: nil], @{@"Globex": @2}, @"New value indexed");
+    
+    [self.facetIndex removeAllRecords];
+    XCTAssertEqual(self.facetIndex.count, (NSUInteger)0, @"Empty");
+    XCTAssertEqualObjects([self.facetIndex valuesOfFacet: AKFacetCity], @[], @"No values");
+}
+
+@end
@@ -0,0 +1,122 @@
+//
+//  AKKeypadIndexTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKKeypadIndex.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKKeypadIndexTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (strong, nonatomic) AKKeypadIndex *keypadIndex;
+@property (assign, nonatomic) ABRecordID anna;
+@property (assign, nonatomic) ABRecordID bob;
+@property (assign, nonatomic) ABRecordID dan;
+
+@end
+
+@implementation AKKeypadIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    self.keypadIndex = [[AKKeypadIndex alloc] init];
+    
+    self.anna = [self indexPersonWithValues: @{@(kABPersonFirstNameProperty): @"Anna", @(kABPersonLastNameProperty): @"Kovács",
+                                               @(kABPersonPhoneProperty): @[@"+36 20 555 1234"]}];
+    self.bob = [self indexPersonWithValues: @{@(kABPersonFirstNameProperty): @"Bob",
+                                              @(kABPersonPhoneProperty): @[@"555-1234"]}];
+    self.dan = [self indexPersonWithValues: @{@(kABPersonFirstNameProperty): @"Dan",
+                                              @(kABPersonPhoneProperty): @[@"326 000"]}];
+}
+
+- (void)tearDown
+{
+    self.keypadIndex = nil;
+    self.replayAddressBook = nil;
+    
+    [super tearDown];
+}
+
+- (ABRecordID)indexPersonWithValues: (NSDictionary *)values
+{
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: values];
+    [self.keypadIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: recordID]];
+    return recordID;
+}
+
+- (void)testKeypadDigits
+{
+    XCTAssertEqualObjects([AKKeypadIndex keypadDigitsForToken: @"anna"], @"2662", @"Letters");
+    XCTAssertEqualObjects([AKKeypadIndex keypadDigitsForToken: @"r2d2"], @"7232", @"Digits stay");
+    XCTAssertEqualObjects([AKKeypadIndex keypadDigitsForToken: @"wxyz"], @"9999", @"Last key");
+    XCTAssertNil([AKKeypadIndex keypadDigitsForToken: @"o'neil"], @"Not on the keypad");
+    XCTAssertNil([AKKeypadIndex keypadDigitsForToken: @""], @"Empty token");
+}
+
+- (void)testNamePrefixes
+{
+    XCTAssertEqual(self.keypadIndex.count, (NSUInteger)3, @"Three records indexed");
+    
+    NSDictionary *expected = @{@(self.anna): @(AKKeypadMatchName), @(self.bob): @(AKKeypadMatchName)};
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"26"], expected, @"Anna and Bob start with 26");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"2662"], @{@(self.anna): @(AKKeypadMatchName)}, @"Whole token");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"5682"], @{@(self.anna): @(AKKeypadMatchName)}, @"Folded last name");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"#"], @{}, @"No digits");
+}
+
+- (void)testNumbers
+{
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"20"], @{@(self.anna): @(AKKeypadMatchNumber)}, @"Short prefix after the country code");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"55"], @{@(self.bob): @(AKKeypadMatchNumber)}, @"Short prefix");
+    NSDictionary *expected = @{@(self.anna): @(AKKeypadMatchNumber), @(self.bob): @(AKKeypadMatchNumber)};
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"5551"], expected, @"Digits within the numbers");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"5552"], @{}, @"Trigrams present, digits not");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"326"], @{@(self.dan): @(AKKeypadMatchName | AKKeypadMatchNumber)}, @"Name and number");
+}
+
+- (void)testRemovedAndChangedRecords
+{
+    [self.keypadIndex removeRecordID: self.bob];
+    XCTAssertEqual(self.keypadIndex.count, (NSUInteger)2, @"Two records left");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"26"], @{@(self.anna): @(AKKeypadMatchName)}, @"Name of the removed record");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"5551"], @{@(self.anna): @(AKKeypadMatchNumber)}, @"Number of the removed record");
+    
+    [self.replayAddressBook setValues: @{@(kABPersonFirstNameProperty): @"Dora", @(kABPersonPhoneProperty): [NSNull null]} ofRecordID: self.dan];
+    [self.keypadIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: self.dan]];
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"326"], @{}, @"Previous name and number replaced");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"367"], @{@(self.dan): @(AKKeypadMatchName)}, @"New name indexed");
+    
+    [self.keypadIndex removeAllRecords];
+    XCTAssertEqual(self.keypadIndex.count, (NSUInteger)0, @"Empty");
+    XCTAssertEqualObjects([self.keypadIndex contactIDsMatchingDigits: @"2"], @{}, @"Nothing matches");
+}
+
+@end
@@ -0,0 +1,144 @@
+//
+//  AKNameTokenIndexTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKNameTokenIndex.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKNameTokenIndexTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (strong, nonatomic) AKNameTokenIndex *nameTokenIndex;
+
+@end
+
+@implementation AKNameTokenIndexTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    self.nameTokenIndex = [[AKNameTokenIndex alloc] init];
+}
+
+- (void)tearDown
+{
+    self.nameTokenIndex = nil;
+    self.replayAddressBook = nil;
+    
+    [super tearDown];
+}
+
+- (ABRecordID)indexPersonWithFirstName: (NSString *)firstName lastName: (NSString *)lastName
+{
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: @{@(kABPersonFirstNameProperty): firstName, @(kABPersonLastNameProperty): lastName}];
+    [self.nameTokenIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: recordID]];
+    return recordID;
+}
+
+- (void)testEditDistance
+{
+    XCTAssertEqual([AKNameTokenIndex editDistanceBetweenString: @"kitten" andString: @"sitting"], (NSUInteger)3, @"Two substitutions and an insertion");
+    XCTAssertEqual([AKNameTokenIndex editDistanceBetweenString: @"" andString: @"abc"], (NSUInteger)3, @"Insertions only");
+    XCTAssertEqual([AKNameTokenIndex editDistanceBetweenString: @"anna" andString: @"anna"], (NSUInteger)0, @"Same string");
+    XCTAssertEqual([AKNameTokenIndex editDistanceBetweenString: @"abc" andString: @"acb"], (NSUInteger)2, @"Transposition is two substitutions");
+}
+
+- (void)testTokens
+{
+    NSArray *tokens = @[@"kovacs", @"nagy", @"adam"];
+    XCTAssertEqualObjects([AKNameTokenIndex tokensForString: @"Kovács-Nagy  Ádám"], tokens, @"Folded and split on non alphanumerics");
+    XCTAssertEqualObjects([AKNameTokenIndex tokensForString: nil], @[], @"No tokens of nil");
+}
+
+- (void)testTermsWithinDistance
+{
+    ABRecordID katalin = [self indexPersonWithFirstName: @"Katalin" lastName: @"Szabó"];
+    ABRecordID katalyn = [self indexPersonWithFirstName: @"Katalyn" lastName: @"Szabo"];
+    ABRecordID peter = [self indexPersonWithFirstName: @"Péter" lastName: @"Kis"];
+    XCTAssertEqual(self.nameTokenIndex.count, (NSUInteger)3, @"Three records indexed");
+    
+    NSSet *szabo = [NSSet setWithObjects: @(katalin), @(katalyn), nil];
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"SZABÓ" maximumDistance: 0], szabo, @"Terms are folded like tokens");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"katalin" maximumDistance: 0], [NSSet setWithObject: @(katalin)], @"Exact match");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"katalin" maximumDistance: 1], szabo, @"One substitution");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"ptr" maximumDistance: 2], [NSSet setWithObject: @(peter)], @"Two deletions");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"ptr" maximumDistance: 1], [NSSet set], @"Beyond the distance");
+}
+
+- (void)testPrefixesWithinDistance
+{
+    ABRecordID katalin = [self indexPersonWithFirstName: @"Katalin" lastName: @"Szabó"];
+    ABRecordID karoly = [self indexPersonWithFirstName: @"Károly" lastName: @"Kis"];
+    
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingPrefix: @"kat" maximumDistance: 0], [NSSet setWithObject: @(katalin)], @"Exact prefix");
+    NSSet *both = [NSSet setWithObjects: @(katalin), @(karoly), nil];
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingPrefix: @"kat" maximumDistance: 1], both, @"Prefix within one substitution");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingPrefix: @"szb" maximumDistance: 1], [NSSet setWithObject: @(katalin)], @"Prefix of a last name");
+}
+
+- (void)testRemovedAndChangedRecords
+{
+    ABRecordID anna = [self indexPersonWithFirstName: @"Anna" lastName: @"Tóth"];
+    ABRecordID janos = [self indexPersonWithFirstName: @"János" lastName: @"Tóth"];
+    
+    [self.nameTokenIndex removeRecordID: anna];
+    XCTAssertEqual(self.nameTokenIndex.count, (NSUInteger)1, @"One record left");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"anna" maximumDistance: 1], [NSSet set], @"Token of the removed record");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"toth" maximumDistance: 0], [NSSet setWithObject: @(janos)], @"Shared token kept");
+    
+    [self.replayAddressBook setValues: @{@(kABPersonFirstNameProperty): @"Jenő"} ofRecordID: janos];
+    [self.nameTokenIndex insertSearchEntry: [self.replayAddressBook searchEntryForRecordID: janos]];
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"janos" maximumDistance: 0], [NSSet set], @"Previous token replaced");
+    XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: @"jeno" maximumDistance: 0], [NSSet setWithObject: @(janos)], @"New token indexed");
+}
+
+- (void)testRebuildAfterRemovals
+{
+    NSArray *firstNames = @[@"Ágnes", @"Bence", @"Csaba", @"Dóra", @"Emese", @"Ferenc", @"Gábor", @"Hanna", @"Imre", @"Judit"];
+    NSMutableArray *recordIDs = [[NSMutableArray alloc] init];
+    for (NSString *firstName in firstNames)
+    {
+        [recordIDs addObject: @([self indexPersonWithFirstName: firstName lastName: [firstName stringByAppendingString: @"fi"]])];
+    }
+    // Most of the tokens are removed, which rebuilds the trees from the live ones
+    for (NSUInteger index = 0; index < 7; ++index)
+    {
+        [self.nameTokenIndex removeRecordID: [[recordIDs objectAtIndex: index] intValue]];
+    }
+    for (NSUInteger index = 0; index < firstNames.count; ++index)
+    {
+        NSString *term = [AKNameTokenIndex tokensForString: [firstNames objectAtIndex: index]].firstObject;
+        NSSet *expected = (index < 7) ? [NSSet set] : [NSSet setWithObject: [recordIDs objectAtIndex: index]];
+        XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingTerm: term maximumDistance: 0], expected, @"%@ after the rebuild", term);
+        XCTAssertEqualObjects([self.nameTokenIndex contactIDsMatchingPrefix: [term substringToIndex: 3] maximumDistance: 0], expected, @"Prefix of %@ after the rebuild", term);
+    }
+}
+
+@end
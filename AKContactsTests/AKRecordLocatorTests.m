@@ -0,0 +1,183 @@
+//
+//  AKRecordLocatorTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKRecordLocator.h"
+
+@interface AKRecordLocatorTests : XCTestCase
+
+@property (strong, nonatomic) AKRecordLocator *locator;
+@property (strong, nonatomic) NSDictionary *sections;
+
+@end
+
+@implementation AKRecordLocatorTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.locator = [[AKRecordLocator alloc] initWithSortOrdering: kABPersonSortByFirstName];
+    self.sections = @{@"A": [[NSMutableArray alloc] init],
+                      @"B": [[NSMutableArray alloc] init],
+                      @"#": [[NSMutableArray alloc] init]};
+}
+
+- (void)tearDown
+{
+    self.sections = nil;
+    self.locator = nil;
+    
+    [super tearDown];
+}
+
+/**
+ * Sort keys are given with every insert, so no record is read from ABAddressBook
+ */
+- (AKSortKey *)personWithName: (NSString *)name tieBreaker: (NSString *)tieBreaker
+{
+    return [AKSortKey sortKeyWithPropertyList: (tieBreaker) ? @[@1, name, tieBreaker] : @[@1, name]];
+}
+
+- (NSUInteger)insertRecordID: (ABRecordID)recordID withSortKey: (AKSortKey *)sortKey inSectionWithKey: (NSString *)sectionKey
+{
+    return [self.locator insertRecordID: recordID withSortKey: sortKey inSectionWithKey: sectionKey ofSections: self.sections andAddressBookRef: NULL];
+}
+
+- (void)testSortKeyOrder
+{
+    AKSortKey *anna = [self personWithName: @"Anna" tieBreaker: @"Kovács"];
+    AKSortKey *annaB = [self personWithName: @"anna" tieBreaker: @"Szabó"];
+    AKSortKey *acme = [AKSortKey sortKeyWithPropertyList: @[@2, @"Acme"]];
+    AKSortKey *other = [AKSortKey sortKeyWithPropertyList: @[@0]];
+    
+    XCTAssertEqual([acme compare: anna], NSOrderedAscending, @"Organizations sort by name among people");
+    XCTAssertEqual([anna compare: annaB], NSOrderedAscending, @"Tie breaker orders equal names");
+    XCTAssertEqual([other compare: acme], NSOrderedDescending, @"Unlisted records sort last");
+    XCTAssertEqual([other compare: [AKSortKey sortKeyWithPropertyList: @[@0]]], NSOrderedSame, @"Missing names sort as empty ones");
+    
+    AKSortKey *roundTrip = [AKSortKey sortKeyWithPropertyList: [anna propertyListRepresentation]];
+    XCTAssertTrue(roundTrip.isPerson, @"Kind persisted");
+    XCTAssertEqual([roundTrip compare: anna], NSOrderedSame, @"Names persisted");
+    XCTAssertNil([AKSortKey sortKeyWithPropertyList: @[@1, @2]], @"Malformed property list");
+}
+
+- (void)testInsertOrdering
+{
+    XCTAssertEqual([self insertRecordID: 3 withSortKey: [self personWithName: @"Cecil" tieBreaker: nil] inSectionWithKey: @"A"], (NSUInteger)0, @"Empty section");
+    XCTAssertEqual([self insertRecordID: 1 withSortKey: [self personWithName: @"Anna" tieBreaker: nil] inSectionWithKey: @"A"], (NSUInteger)0, @"Before Cecil");
+    XCTAssertEqual([self insertRecordID: 2 withSortKey: [self personWithName: @"Bob" tieBreaker: nil] inSectionWithKey: @"A"], (NSUInteger)1, @"Between");
+    XCTAssertEqual([self insertRecordID: 4 withSortKey: [AKSortKey sortKeyWithPropertyList: @[@0]] inSectionWithKey: @"A"], (NSUInteger)3, @"Unlisted last");
+    
+    XCTAssertEqualObjects([self.sections objectForKey: @"A"], (@[@1, @2, @3, @4]), @"Sorted by name");
+    XCTAssertEqual(self.locator.count, (NSUInteger)4, @"Located");
+}
+
+- (void)testInsertTwice
+{
+    [self insertRecordID: 1 withSortKey: [self personWithName: @"Anna" tieBreaker: nil] inSectionWithKey: @"A"];
+    [self insertRecordID: 2 withSortKey: [self personWithName: @"Bob" tieBreaker: nil] inSectionWithKey: @"A"];
+    
+    XCTAssertEqual([self insertRecordID: 2 withSortKey: [self personWithName: @"Bob" tieBreaker: nil] inSectionWithKey: @"A"], (NSUInteger)1, @"Index of the record already there");
+    XCTAssertEqual([[self.sections objectForKey: @"A"] count], (NSUInteger)2, @"Not inserted again");
+    XCTAssertEqual([self insertRecordID: 1 withSortKey: nil inSectionWithKey: @"C"], NSNotFound, @"No such section");
+}
+
+- (void)testSectionKeysOfRecord
+{
+    [self insertRecordID: 1 withSortKey: [self personWithName: @"Anna" tieBreaker: nil] inSectionWithKey: @"A"];
+    [self insertRecordID: 1 withSortKey: nil inSectionWithKey: @"#"];
+    
+    XCTAssertEqualObjects([self.locator sectionKeysOfRecordID: 1], (@[@"A", @"#"]), @"Section of the name first");
+    XCTAssertNil([self.locator sectionKeysOfRecordID: 2], @"Never inserted");
+}
+
+- (void)testRemoveFromEverySection
+{
+    [self insertRecordID: 1 withSortKey: [self personWithName: @"Anna" tieBreaker: nil] inSectionWithKey: @"A"];
+    [self insertRecordID: 2 withSortKey: [self personWithName: @"Anna" tieBreaker: @"Szabó"] inSectionWithKey: @"A"];
+    [self insertRecordID: 3 withSortKey: [self personWithName: @"Ann" tieBreaker: nil] inSectionWithKey: @"A"];
+    [self insertRecordID: 2 withSortKey: nil inSectionWithKey: @"#"];
+    
+    XCTAssertEqual([self.locator removeRecordID: 2 fromSections: self.sections andAddressBookRef: NULL], (NSUInteger)2, @"Index in the section of its name");
+    XCTAssertEqualObjects([self.sections objectForKey: @"A"], (@[@3, @1]), @"Removed from the name section");
+    XCTAssertEqualObjects([self.sections objectForKey: @"#"], @[], @"Removed from the digit section");
+    XCTAssertNil([self.locator sectionKeysOfRecordID: 2], @"No longer located");
+    XCTAssertEqual(self.locator.count, (NSUInteger)2, @"Others stay");
+    
+    XCTAssertEqual([self.locator removeRecordID: 2 fromSections: self.sections andAddressBookRef: NULL], NSNotFound, @"Removed already");
+}
+
+- (void)testRemoveAmongEqualNames
+{
+    AKSortKey *anna = [self personWithName: @"Anna" tieBreaker: @"Kovács"];
+    for (ABRecordID recordID = 1; recordID <= 5; ++recordID)
+    {
+        [self insertRecordID: recordID withSortKey: anna inSectionWithKey: @"A"];
+    }
+    XCTAssertEqualObjects([self.sections objectForKey: @"A"], (@[@1, @2, @3, @4, @5]), @"Equal keys in insertion order");
+    
+    XCTAssertEqual([self.locator removeRecordID: 4 fromSections: self.sections andAddressBookRef: NULL], (NSUInteger)3, @"Found among equal keys");
+    XCTAssertEqualObjects([self.sections objectForKey: @"A"], (@[@1, @2, @3, @5]), @"Only that record removed");
+}
+
+- (void)testSortKeySectionsRebuildOnlyChanged
+{
+    [self insertRecordID: 1 withSortKey: [self personWithName: @"Anna" tieBreaker: nil] inSectionWithKey: @"A"];
+    [self insertRecordID: 2 withSortKey: [self personWithName: @"Bob" tieBreaker: nil] inSectionWithKey: @"B"];
+    
+    NSDictionary *sortKeySections = [self.locator sortKeySectionsOfSections: self.sections];
+    XCTAssertEqualObjects([sortKeySections objectForKey: @"A"], (@[@[@1, @[@1, @"Anna"]]]), @"Pairs of recordID and sort key");
+    
+    [self insertRecordID: 3 withSortKey: [self personWithName: @"Bea" tieBreaker: nil] inSectionWithKey: @"B"];
+    NSDictionary *nextSortKeySections = [self.locator sortKeySectionsOfSections: self.sections];
+    XCTAssertTrue([nextSortKeySections objectForKey: @"A"] == [sortKeySections objectForKey: @"A"], @"Unchanged section not built again");
+    XCTAssertEqual([[nextSortKeySections objectForKey: @"B"] count], (NSUInteger)2, @"Changed section built again");
+}
+
+- (void)testLocateRecordsOfCachedSections
+{
+    [self insertRecordID: 1 withSortKey: [self personWithName: @"Anna" tieBreaker: nil] inSectionWithKey: @"A"];
+    [self insertRecordID: 3 withSortKey: [self personWithName: @"Anna" tieBreaker: @"Szabó"] inSectionWithKey: @"A"];
+    [self insertRecordID: 3 withSortKey: nil inSectionWithKey: @"#"];
+    NSDictionary *sortKeySections = [self.locator sortKeySectionsOfSections: self.sections];
+    
+    AKRecordLocator *locator = [[AKRecordLocator alloc] initWithSortOrdering: kABPersonSortByFirstName];
+    [locator locateRecordsOfSections: self.sections withSortKeySections: sortKeySections];
+    
+    XCTAssertEqual(locator.count, (NSUInteger)2, @"Records located");
+    XCTAssertEqualObjects([locator sectionKeysOfRecordID: 3], (@[@"A", @"#"]), @"Name section before digit sections");
+    XCTAssertTrue([[locator sortKeySectionsOfSections: self.sections] objectForKey: @"A"] == [sortKeySections objectForKey: @"A"], @"Persisted section not written again");
+    
+    // Found by the persisted sort keys without reading ABAddressBook
+    XCTAssertEqual([locator insertRecordID: 2 withSortKey: [self personWithName: @"Anna" tieBreaker: @"Nagy"] inSectionWithKey: @"A" ofSections: self.sections andAddressBookRef: NULL], (NSUInteger)1, @"Ordered among persisted keys");
+    XCTAssertEqual([locator removeRecordID: 3 fromSections: self.sections andAddressBookRef: NULL], (NSUInteger)2, @"Removed by persisted key");
+    XCTAssertEqualObjects([self.sections objectForKey: @"A"], (@[@1, @2]), @"Sorted");
+}
+
+@end
@@ -0,0 +1,101 @@
+//
+//  AKReplayAddressBook.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AddressBook/AddressBook.h>
+
+@class AKContact;
+@class AKSearchEntry;
+
+/**
+ * In-memory stand-in for the native address book that AKReplayHarness applies
+ * traces to, so replays need no access to the user's contacts and leave them
+ * untouched. People hold values keyed by kABPerson* property, the values of
+ * multi value properties as arrays. Linked people form sets, each member is
+ * linked to all the others. Changes set the creation and modification dates
+ * the loader scans for; linking, unlinking and removing a person change all
+ * the people of its set. Thread safe, the loader reads it on its queues
+ */
+@interface AKReplayAddressBook : NSObject
+
+/**
+ * RecordIDs of the people, ascending
+ */
+@property (strong, nonatomic, readonly) NSArray *recordIDs;
+
+/**
+ * Values are keyed by ABPropertyID numbers. Returns the recordID of the new person
+ */
+- (ABRecordID)addPersonWithValues: (NSDictionary *)values;
+/**
+ * Replaces the values of the properties in values, NSNull removes the value
+ */
+- (BOOL)setValues: (NSDictionary *)values ofRecordID: (ABRecordID)recordID;
+/**
+ * Unlinks the person and removes it from its groups as well
+ */
+- (BOOL)removeRecordID: (ABRecordID)recordID;
+- (BOOL)hasRecordID: (ABRecordID)recordID;
+- (id)valueForProperty: (ABPropertyID)property ofRecordID: (ABRecordID)recordID;
+
+/**
+ * Merges the sets of linked people of the two persons
+ */
+- (BOOL)linkRecordID: (ABRecordID)recordID toRecordID: (ABRecordID)otherRecordID;
+/**
+ * Removes the person from its set of linked people
+ */
+- (BOOL)unlinkRecordID: (ABRecordID)recordID;
+/**
+ * The person and the ones linked to it, ascending. Empty if there is no such person
+ */
+- (NSArray *)linkedRecordIDsOfRecordID: (ABRecordID)recordID;
+/**
+ * Linked people are listed once, here through the lowest recordID of their set
+ */
+- (BOOL)isListedRecordID: (ABRecordID)recordID;
+
+- (BOOL)addRecordID: (ABRecordID)recordID toGroupWithName: (NSString *)name;
+- (BOOL)removeRecordID: (ABRecordID)recordID fromGroupWithName: (NSString *)name;
+- (NSSet *)memberIDsOfGroupWithName: (NSString *)name;
+/**
+ * Sets of member recordIDs keyed by the recordIDs of the groups
+ */
+- (NSDictionary *)memberIDsByGroupID;
+
+/**
+ * Contact reading its values from the fake instead of an ABAddressBookRef,
+ * which is NULL. Has no values if there is no such person
+ */
+- (AKContact *)contactForRecordID: (ABRecordID)recordID sortOrdering: (ABPersonSortOrdering)sortOrdering;
+/**
+ * Search entry of the person as the loader passes it to the indexes
+ */
+- (AKSearchEntry *)searchEntryForRecordID: (ABRecordID)recordID;
+
+@end
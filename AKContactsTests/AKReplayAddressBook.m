@@ -0,0 +1,362 @@
+//
+//  AKReplayAddressBook.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKReplayAddressBook.h"
+#import "AKContact.h"
+#import "AKSearchEntryIndex.h"
+
+/**
+ * AKContact whose values are read from AKReplayAddressBook
+ */
+@interface AKReplayContact : AKContact
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+
+@end
+
+@implementation AKReplayContact
+
+- (ABRecordRef)recordRef
+{
+    return NULL;
+}
+
+- (id)valueForProperty: (ABPropertyID)property
+{
+    id value = [self.replayAddressBook valueForProperty: property ofRecordID: self.recordID];
+    return ([value isKindOfClass: [NSArray class]]) ? nil : value;
+}
+
+- (NSArray *)identifiersForMultiValueProperty: (ABPropertyID)property
+{
+    NSArray *values = [self.replayAddressBook valueForProperty: property ofRecordID: self.recordID];
+    if (![values isKindOfClass: [NSArray class]]) return @[];
+    
+    NSMutableArray *identifiers = [[NSMutableArray alloc] initWithCapacity: values.count];
+    for (NSUInteger index = 0; index < values.count; ++index)
+    {
+        [identifiers addObject: @(index)];
+    }
+    return [identifiers copy];
+}
+
+- (id)valueForMultiValueProperty: (ABPropertyID)property andIdentifier: (ABMultiValueIdentifier)identifier
+{
+    NSArray *values = [self.replayAddressBook valueForProperty: property ofRecordID: self.recordID];
+    if (![values isKindOfClass: [NSArray class]] || identifier < 0 || (NSUInteger)identifier >= values.count) return nil;
+    
+    return [values objectAtIndex: identifier];
+}
+
+- (NSInteger)countForMultiValueProperty: (ABPropertyID)property
+{
+    return [self identifiersForMultiValueProperty: property].count;
+}
+
+/**
+ * Values of the fake have no labels
+ */
+- (NSString *)labelForMultiValueProperty: (ABPropertyID)property andIdentifier: (ABMultiValueIdentifier)identifier
+{
+    return nil;
+}
+
+- (NSArray *)valuesForLinkedMultiValueProperty: (ABPropertyID)property
+{
+    NSMutableArray *values = [[NSMutableArray alloc] init];
+    for (NSNumber *recordID in [self.replayAddressBook linkedRecordIDsOfRecordID: self.recordID])
+    {
+        NSArray *linkedValues = [self.replayAddressBook valueForProperty: property ofRecordID: recordID.intValue];
+        if ([linkedValues isKindOfClass: [NSArray class]]) [values addObjectsFromArray: linkedValues];
+    }
+    return [values copy];
+}
+
+- (NSArray *)linkedContactIDs
+{
+    NSMutableArray *linkedContactIDs = [[self.replayAddressBook linkedRecordIDsOfRecordID: self.recordID] mutableCopy];
+    [linkedContactIDs removeObject: @(self.recordID)];
+    return [linkedContactIDs copy];
+}
+
+@end
+
+@interface AKReplayAddressBook ()
+
+/**
+ * NSMutableDictionary of values keyed by recordID
+ */
+@property (strong, nonatomic) NSMutableDictionary *people;
+/**
+ * NSMutableSet of linked recordIDs keyed by recordID, shared by the members of the set
+ */
+@property (strong, nonatomic) NSMutableDictionary *linkedRecordIDs;
+/**
+ * NSMutableSet of member recordIDs keyed by group name
+ */
+@property (strong, nonatomic) NSMutableDictionary *groups;
+/**
+ * Group recordIDs keyed by group name
+ */
+@property (strong, nonatomic) NSMutableDictionary *groupIDs;
+@property (assign, nonatomic) ABRecordID lastRecordID;
+
+@end
+
+@implementation AKReplayAddressBook
+
++ (void)initialize
+{
+    if (self == [AKReplayAddressBook class])
+    {   // kABPerson* property IDs are set once the framework creates a record
+        CFRelease(ABPersonCreate());
+    }
+}
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _people = [[NSMutableDictionary alloc] init];
+        _linkedRecordIDs = [[NSMutableDictionary alloc] init];
+        _groups = [[NSMutableDictionary alloc] init];
+        _groupIDs = [[NSMutableDictionary alloc] init];
+        _lastRecordID = 0;
+    }
+    return self;
+}
+
+- (NSArray *)recordIDs
+{
+    @synchronized(self)
+    {
+        return [[self.people allKeys] sortedArrayUsingSelector: @selector(compare:)];
+    }
+}
+
+- (ABRecordID)addPersonWithValues: (NSDictionary *)values
+{
+    @synchronized(self)
+    {
+        self.lastRecordID += 1;
+        NSNumber *recordID = @(self.lastRecordID);
+        
+        NSMutableDictionary *person = [[NSMutableDictionary alloc] init];
+        [person setObject: (__bridge NSNumber *)kABPersonKindPerson forKey: @(kABPersonKindProperty)];
+        [person setObject: [NSDate date] forKey: @(kABPersonCreationDateProperty)];
+        [self.people setObject: person forKey: recordID];
+        [self.linkedRecordIDs setObject: [[NSMutableSet alloc] initWithObjects: recordID, nil] forKey: recordID];
+        
+        [self setValues: values ofRecordID: self.lastRecordID];
+        return self.lastRecordID;
+    }
+}
+
+- (BOOL)setValues: (NSDictionary *)values ofRecordID: (ABRecordID)recordID
+{
+    @synchronized(self)
+    {
+        NSMutableDictionary *person = [self.people objectForKey: @(recordID)];
+        if (!person) return NO;
+        
+        for (NSNumber *property in values)
+        {
+            id value = [values objectForKey: property];
+            if (value == [NSNull null]) [person removeObjectForKey: property];
+            else [person setObject: value forKey: property];
+        }
+        [self touchRecordIDs: @[@(recordID)]];
+        return YES;
+    }
+}
+
+- (BOOL)removeRecordID: (ABRecordID)recordID
+{
+    @synchronized(self)
+    {
+        if (![self hasRecordID: recordID]) return NO;
+        
+        [self unlinkRecordID: recordID];
+        [self.linkedRecordIDs removeObjectForKey: @(recordID)];
+        [self.people removeObjectForKey: @(recordID)];
+        for (NSMutableSet *memberIDs in [self.groups objectEnumerator])
+        {
+            [memberIDs removeObject: @(recordID)];
+        }
+        return YES;
+    }
+}
+
+- (BOOL)hasRecordID: (ABRecordID)recordID
+{
+    @synchronized(self)
+    {
+        return ([self.people objectForKey: @(recordID)] != nil);
+    }
+}
+
+- (id)valueForProperty: (ABPropertyID)property ofRecordID: (ABRecordID)recordID
+{
+    @synchronized(self)
+    {
+        return [[self.people objectForKey: @(recordID)] objectForKey: @(property)];
+    }
+}
+
+/**
+ * Sets the modification date of the people to now
+ */
+- (void)touchRecordIDs: (id<NSFastEnumeration>)recordIDs
+{
+    NSDate *date = [NSDate date];
+    for (NSNumber *recordID in recordIDs)
+    {
+        [[self.people objectForKey: recordID] setObject: date forKey: @(kABPersonModificationDateProperty)];
+    }
+}
+
+#pragma mark - Linked People
+
+- (BOOL)linkRecordID: (ABRecordID)recordID toRecordID: (ABRecordID)otherRecordID
+{
+    @synchronized(self)
+    {
+        NSMutableSet *linked = [self.linkedRecordIDs objectForKey: @(recordID)];
+        NSMutableSet *otherLinked = [self.linkedRecordIDs objectForKey: @(otherRecordID)];
+        if (!linked || !otherLinked) return NO;
+        if (linked == otherLinked) return YES;
+        
+        [linked unionSet: otherLinked];
+        for (NSNumber *linkedRecordID in otherLinked)
+        {
+            [self.linkedRecordIDs setObject: linked forKey: linkedRecordID];
+        }
+        [self touchRecordIDs: linked];
+        return YES;
+    }
+}
+
+- (BOOL)unlinkRecordID: (ABRecordID)recordID
+{
+    @synchronized(self)
+    {
+        NSMutableSet *linked = [self.linkedRecordIDs objectForKey: @(recordID)];
+        if (!linked) return NO;
+        
+        [self touchRecordIDs: linked];
+        [linked removeObject: @(recordID)];
+        [self.linkedRecordIDs setObject: [[NSMutableSet alloc] initWithObjects: @(recordID), nil] forKey: @(recordID)];
+        return YES;
+    }
+}
+
+- (NSArray *)linkedRecordIDsOfRecordID: (ABRecordID)recordID
+{
+    @synchronized(self)
+    {
+        NSSet *linked = [self.linkedRecordIDs objectForKey: @(recordID)];
+        return (linked) ? [[linked allObjects] sortedArrayUsingSelector: @selector(compare:)] : @[];
+    }
+}
+
+- (BOOL)isListedRecordID: (ABRecordID)recordID
+{
+    NSNumber *listedRecordID = [[self linkedRecordIDsOfRecordID: recordID] firstObject];
+    return (listedRecordID && listedRecordID.intValue == recordID);
+}
+
+#pragma mark - Groups
+
+- (BOOL)addRecordID: (ABRecordID)recordID toGroupWithName: (NSString *)name
+{
+    @synchronized(self)
+    {
+        if (![self hasRecordID: recordID]) return NO;
+        
+        NSMutableSet *memberIDs = [self.groups objectForKey: name];
+        if (!memberIDs)
+        {
+            memberIDs = [[NSMutableSet alloc] init];
+            [self.groups setObject: memberIDs forKey: name];
+            // Groups are numbered apart from people, as in ABAddressBook
+            [self.groupIDs setObject: @(self.groupIDs.count + 1) forKey: name];
+        }
+        [memberIDs addObject: @(recordID)];
+        return YES;
+    }
+}
+
+- (BOOL)removeRecordID: (ABRecordID)recordID fromGroupWithName: (NSString *)name
+{
+    @synchronized(self)
+    {
+        if (![self hasRecordID: recordID]) return NO;
+        
+        [[self.groups objectForKey: name] removeObject: @(recordID)];
+        return YES;
+    }
+}
+
+- (NSSet *)memberIDsOfGroupWithName: (NSString *)name
+{
+    @synchronized(self)
+    {
+        NSSet *memberIDs = [self.groups objectForKey: name];
+        return (memberIDs) ? [memberIDs copy] : [NSSet set];
+    }
+}
+
+- (NSDictionary *)memberIDsByGroupID
+{
+    @synchronized(self)
+    {
+        NSMutableDictionary *memberIDsByGroupID = [[NSMutableDictionary alloc] initWithCapacity: self.groups.count];
+        for (NSString *name in self.groups)
+        {
+            [memberIDsByGroupID setObject: [[self.groups objectForKey: name] copy] forKey: [self.groupIDs objectForKey: name]];
+        }
+        return [memberIDsByGroupID copy];
+    }
+}
+
+#pragma mark - Contacts
+
+- (AKContact *)contactForRecordID: (ABRecordID)recordID sortOrdering: (ABPersonSortOrdering)sortOrdering
+{
+    AKReplayContact *contact = [[AKReplayContact alloc] initWithABRecordID: recordID sortOrdering: sortOrdering andAddressBookRef: NULL];
+    contact.replayAddressBook = self;
+    return contact;
+}
+
+- (AKSearchEntry *)searchEntryForRecordID: (ABRecordID)recordID
+{
+    return [AKSearchEntry entryWithContact: [self contactForRecordID: recordID sortOrdering: kABPersonSortByFirstName]];
+}
+
+@end
@@ -0,0 +1,88 @@
+//
+//  AKReplayHarness.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+#import <AddressBook/AddressBook.h>
+
+@class AKReplayTrace;
+@class AKReplayAddressBook;
+@class AKAddressBook;
+
+/**
+ * Latency samples in seconds
+ */
+@interface AKReplayLatencies : NSObject
+
+@property (assign, nonatomic, readonly) NSUInteger count;
+@property (assign, nonatomic, readonly) NSTimeInterval p50;
+@property (assign, nonatomic, readonly) NSTimeInterval p99;
+
+- (void)addSample: (NSTimeInterval)sample;
+- (NSTimeInterval)percentile: (double)percentile;
+
+@end
+
+/**
+ * Replays traces against an in-memory AKReplayAddressBook. A private AKAddressBook
+ * loads the people of the fake instead of the native address book. Each notified
+ * burst of changes reloads it as the external change callback does, so the loader
+ * scans for the people created and modified since the last load and reports them
+ * to the harness, its presentation delegate. Typed terms are searched through an
+ * AKContactsTableViewDataSource of the private address book.
+ * Runs on the main queue, which it runs while it waits for loads and searches
+ */
+@interface AKReplayHarness : NSObject
+
+@property (strong, nonatomic, readonly) AKReplayAddressBook *addressBook;
+/**
+ * Loads the fake, never the native address book. Its section cache is in a temporary directory
+ */
+@property (strong, nonatomic, readonly) AKAddressBook *indexedAddressBook;
+/**
+ * From notifying the change of a burst to the main queue applying the updates the loader reported
+ */
+@property (strong, nonatomic, readonly) AKReplayLatencies *changeLatencies;
+/**
+ * From passing a keystroke to the data source to the data source delivering its search results
+ */
+@property (strong, nonatomic, readonly) AKReplayLatencies *keystrokeLatencies;
+/**
+ * Descriptions of the steps after which the loaded tables and indexes differ from a full rebuild,
+ * the delegate was not told of a change or a search found a contact that is not listed
+ */
+@property (strong, nonatomic, readonly) NSArray *failures;
+
+- (BOOL)replayTrace: (AKReplayTrace *)trace;
+/**
+ * Differences of the published sections and of the token, keypad, email, date,
+ * facet and search entry indexes from the ones built from all listed people of
+ * the fake without the loader. Sections are compared exactly, phone sections as sets
+ */
+- (NSArray *)verifyAgainstFullRebuild;
+
+@end
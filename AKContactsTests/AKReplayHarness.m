@@ -0,0 +1,977 @@
+//
+//  AKReplayHarness.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKReplayHarness.h"
+#import "AKReplayAddressBook.h"
+#import "AKReplayTrace.h"
+#import "AKAddressBook.h"
+#import "AKAddressBook+Loader.h"
+#import "AKContact.h"
+#import "AKContactIndex.h"
+#import "AKIndexSnapshot.h"
+#import "AKRecordLocator.h"
+#import "AKNameTokenIndex.h"
+#import "AKKeypadIndex.h"
+#import "AKSearchEntryIndex.h"
+#import "AKEmailIndex.h"
+#import "AKDateIndex.h"
+#import "AKFacetIndex.h"
+#import "AKSource.h"
+#import "AKGroup.h"
+#import "AKSectionCache.h"
+#import "AKAddressBookPool.h"
+#import "AKContactsTableViewDataSource.h"
+
+static const NSInteger kReplayNoYear = 1604; // Year of dates without a year in ABAddressBook
+/**
+ * Events are compared over a leap year starting on January 1
+ */
+static const NSInteger kReplayEventsYear = 2016;
+static const NSUInteger kReplayEventsDayCount = 366;
+/**
+ * Token prefixes up to this length are compared besides the whole tokens
+ */
+static const NSUInteger kReplayPrefixLength = 3;
+
+@interface AKReplayLatencies ()
+
+@property (strong, nonatomic) NSMutableArray *samples;
+
+@end
+
+@implementation AKReplayLatencies
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _samples = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (NSUInteger)count
+{
+    return self.samples.count;
+}
+
+- (void)addSample: (NSTimeInterval)sample
+{
+    [self.samples addObject: @(sample)];
+}
+
+- (NSTimeInterval)percentile: (double)percentile
+{
+    if (self.samples.count == 0) return 0.0;
+
+    NSArray *sorted = [self.samples sortedArrayUsingSelector: @selector(compare:)];
+    NSUInteger rank = (NSUInteger)ceil(percentile / 100.0 * sorted.count);
+    rank = MIN(MAX(rank, 1), sorted.count);
+    return [sorted[rank - 1] doubleValue];
+}
+
+- (NSTimeInterval)p50
+{
+    return [self percentile: 50.0];
+}
+
+- (NSTimeInterval)p99
+{
+    return [self percentile: 99.0];
+}
+
+@end
+
+static const ABRecordID kReplaySourceID = 1;
+/**
+ * Seconds a load or a search step may take before the replay gives up on it
+ */
+static const NSTimeInterval kReplayTimeout = 10.0;
+
+/**
+ * AKAddressBook loading the people and groups of an AKReplayAddressBook in one source
+ * instead of the native address book. The load itself is the one of the app: the scan
+ * for created and modified people, applying the changes to the tables and indexes and
+ * the presentation delegate callbacks. People are scanned in the order of their
+ * recordIDs so the lowest recordID of linked people is listed, as in the fake
+ */
+@interface AKReplayIndexedAddressBook : AKAddressBook
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+
+@end
+
+@implementation AKReplayIndexedAddressBook
+
+/**
+ * Reloads are not throttled and the defaults of the app are left alone
+ */
+- (NSDate *)dateAddressBookLoaded
+{
+    return nil;
+}
+
+- (void)setDateAddressBookLoaded: (NSDate *)dateAddressBookLoaded
+{
+}
+
+- (AKContact *)contactForContactId: (ABRecordID)recordId withAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    return [self.replayAddressBook contactForRecordID: recordId sortOrdering: self.sortOrdering];
+}
+
+- (void)loadSourcesWithABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    if (self.sources.count > 0) return;
+    
+    AKSource *source = [[AKSource alloc] initWithABRecordID: kReplaySourceID andAddressBookRef: NULL];
+    source.isDefault = YES;
+    self.sources = [[NSMutableArray alloc] initWithObjects: source, nil];
+    self.sourceID = kReplaySourceID;
+    self.groupID = kGroupAggregate;
+}
+
+- (void)loadGroupsOfSource: (AKSource *)source withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    NSDictionary *memberIDsByGroupID = [self.replayAddressBook memberIDsByGroupID];
+    for (NSNumber *groupID in memberIDsByGroupID)
+    {
+        AKGroup *group = [source groupForGroupId: groupID.intValue];
+        if (!group)
+        {
+            group = [[AKGroup alloc] initWithABRecordID: groupID.intValue andAddressBookRef: NULL];
+            [source.groups addObject: group];
+        }
+        NSSet *memberIDs = [memberIDsByGroupID objectForKey: groupID];
+        if (![group.memberIDs isEqualToSet: memberIDs])
+        {
+            [group.memberIDs setSet: memberIDs];
+            group.memberVersion += 1;
+        }
+    }
+}
+
+- (NSArray *)contactIDsInSourceWithID: (ABRecordID)sourceID withABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    return (sourceID == kReplaySourceID) ? self.replayAddressBook.recordIDs : @[];
+}
+
+/**
+ * The display snapshot of the app is left alone
+ */
+- (BOOL)archiveDisplaySnapshotWithChangedContactIDs: (NSSet *)changedContactIDs andABAddressBookRef: (ABAddressBookRef)addressBookRef
+{
+    return NO;
+}
+
+@end
+
+/**
+ * Sections and contact indexes built from all listed people of the fake, without the loader
+ */
+@interface AKReplayRebuild : NSObject
+
+@property (strong, nonatomic) NSDictionary *sectionsSortedByFirst;
+@property (strong, nonatomic) NSDictionary *sectionsSortedByLast;
+@property (strong, nonatomic) NSDictionary *sectionsSortedByPhone;
+@property (strong, nonatomic) AKNameTokenIndex *nameTokenIndex;
+@property (strong, nonatomic) AKKeypadIndex *keypadIndex;
+@property (strong, nonatomic) AKSearchEntryIndex *searchEntryIndex;
+@property (strong, nonatomic) AKDateIndex *dateIndex;
+@property (strong, nonatomic) AKFacetIndex *facetIndex;
+@property (strong, nonatomic) AKEmailIndex *emailIndex;
+@property (strong, nonatomic) NSArray *contactIndexes;
+
+@end
+
+@implementation AKReplayRebuild
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _nameTokenIndex = [[AKNameTokenIndex alloc] init];
+        _keypadIndex = [[AKKeypadIndex alloc] init];
+        _searchEntryIndex = [[AKSearchEntryIndex alloc] init];
+        _dateIndex = [[AKDateIndex alloc] init];
+        _facetIndex = [[AKFacetIndex alloc] init];
+        _emailIndex = [[AKEmailIndex alloc] init];
+        // In the order of the contactIndexes of AKAddressBook
+        _contactIndexes = @[_nameTokenIndex, _keypadIndex, _searchEntryIndex, _dateIndex, _facetIndex, _emailIndex];
+    }
+    return self;
+}
+
+@end
+
+@interface AKReplayHarness () <AKAddressBookPresentationDelegate, AKContactsTableViewDataSourceDelegate>
+
+@property (strong, nonatomic) AKReplayAddressBook *addressBook;
+@property (strong, nonatomic) AKAddressBook *indexedAddressBook;
+@property (strong, nonatomic) AKContactsTableViewDataSource *dataSource;
+@property (strong, nonatomic) AKReplayLatencies *changeLatencies;
+@property (strong, nonatomic) AKReplayLatencies *keystrokeLatencies;
+@property (strong, nonatomic) NSMutableArray *replayFailures;
+/**
+ * Section cache of indexedAddressBook, removed when the harness is deallocated
+ */
+@property (copy, nonatomic) NSString *sectionCachePath;
+/**
+ * Trace labels to recordIDs of the contacts created by the trace
+ */
+@property (strong, nonatomic) NSMutableDictionary *contactIDs;
+/**
+ * Records changed since the last notified step
+ */
+@property (strong, nonatomic) NSMutableSet *pendingRecordIDs;
+/**
+ * Records the presentation delegate was told are listed
+ */
+@property (strong, nonatomic) NSMutableSet *presentedRecordIDs;
+/**
+ * Inserted and removed records reported by the loader during the current load, as
+ * @[@YES or @NO, recordID] in the order of the callbacks. Guarded by itself
+ */
+@property (strong, nonatomic) NSMutableArray *updates;
+/**
+ * Set on the main queue as the delegate callbacks of the loader arrive
+ */
+@property (strong, nonatomic) NSDate *dateUpdated;
+@property (assign, nonatomic) NSUInteger loadCount;
+@property (strong, nonatomic) NSDate *dateSearchEnded;
+
+@end
+
+@implementation AKReplayHarness
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        NSString *name = [NSString stringWithFormat: @"AKReplaySectionCache-%@", [[NSProcessInfo processInfo] globallyUniqueString]];
+        _sectionCachePath = [NSTemporaryDirectory() stringByAppendingPathComponent: name];
+        
+        _addressBook = [[AKReplayAddressBook alloc] init];
+        AKReplayIndexedAddressBook *indexedAddressBook = [[AKReplayIndexedAddressBook alloc] initWithSectionCacheDirectoryPath: _sectionCachePath];
+        indexedAddressBook.replayAddressBook = _addressBook;
+        indexedAddressBook.presentationDelegate = self;
+        _indexedAddressBook = indexedAddressBook;
+        _dataSource = [[AKContactsTableViewDataSource alloc] initWithAddressBook: indexedAddressBook];
+        _dataSource.delegate = self;
+        _changeLatencies = [[AKReplayLatencies alloc] init];
+        _keystrokeLatencies = [[AKReplayLatencies alloc] init];
+        _replayFailures = [[NSMutableArray alloc] init];
+        _contactIDs = [[NSMutableDictionary alloc] init];
+        _pendingRecordIDs = [[NSMutableSet alloc] init];
+        _presentedRecordIDs = [[NSMutableSet alloc] init];
+        _updates = [[NSMutableArray alloc] init];
+    }
+    return self;
+}
+
+- (void)dealloc
+{
+    _indexedAddressBook.presentationDelegate = nil;
+    _dataSource.delegate = nil;
+    [_indexedAddressBook.sectionCache waitUntilCommitted];
+    [[NSFileManager defaultManager] removeItemAtPath: _sectionCachePath error: nil];
+}
+
+- (NSArray *)failures
+{
+    return [self.replayFailures copy];
+}
+
+#pragma mark - Replay
+
+- (BOOL)replayTrace: (AKReplayTrace *)trace
+{
+    NSAssert([NSThread isMainThread], @"Must be dispatched on main thread");
+    
+    NSUInteger failuresCount = self.replayFailures.count;
+    
+    if (self.loadCount == 0 && ![self loadAddressBook])
+    {
+        [self.replayFailures addObject: @"The first load did not end or was not committed"];
+        return NO;
+    }
+    
+    NSUInteger stepIndex = 0;
+    for (AKReplayStep *step in trace.steps)
+    {
+        stepIndex += 1;
+        if (step.operation == AKReplayOperationType)
+        {
+            for (NSString *failure in [self typeTerm: step.term])
+            {
+                [self.replayFailures addObject: [NSString stringWithFormat: @"Step %lu: %@", (unsigned long)stepIndex, failure]];
+            }
+            continue;
+        }
+        
+        if (![self applyStep: step])
+        {
+            [self.replayFailures addObject: [NSString stringWithFormat: @"Step %lu: %@ could not be applied", (unsigned long)stepIndex, [step dictionaryRepresentation]]];
+            continue;
+        }
+        if (!step.notifies)
+        {
+            continue;
+        }
+        
+        NSMutableArray *failures = [[self notifyChange] mutableCopy];
+        [failures addObjectsFromArray: [self verifyAgainstFullRebuild]];
+        for (NSString *failure in failures)
+        {
+            [self.replayFailures addObject: [NSString stringWithFormat: @"Step %lu: %@", (unsigned long)stepIndex, failure]];
+        }
+    }
+    
+    return (self.replayFailures.count == failuresCount);
+}
+
+- (BOOL)applyStep: (AKReplayStep *)step
+{
+    AKReplayAddressBook *addressBook = self.addressBook;
+    NSNumber *recordID = (step.label) ? self.contactIDs[step.label] : nil;
+    NSNumber *otherRecordID = (step.otherLabel) ? self.contactIDs[step.otherLabel] : nil;
+    
+    if ((step.operation != AKReplayOperationCreate && !recordID) ||
+        (step.operation == AKReplayOperationLink && !otherRecordID))
+    {
+        NSLog(@"Replay step %@ of unknown contact", [step dictionaryRepresentation]);
+        return NO;
+    }
+    
+    ABRecordID contactID = [recordID intValue];
+    switch (step.operation)
+    {
+        case AKReplayOperationCreate:
+        {
+            NSMutableDictionary *values = [[self valuesOfStep: step] mutableCopy];
+            if (step.phoneNumber)
+            {
+                values[@(kABPersonPhoneProperty)] = @[step.phoneNumber];
+            }
+            contactID = [addressBook addPersonWithValues: values];
+            self.contactIDs[step.label] = @(contactID);
+            [self markChangedRecordID: contactID];
+            break;
+        }
+        case AKReplayOperationRename:
+            [addressBook setValues: [self valuesOfStep: step] ofRecordID: contactID];
+            [self markChangedRecordID: contactID];
+            break;
+        case AKReplayOperationDelete:
+            // The people linked to it are marked before they lose the link
+            [self markChangedRecordID: contactID];
+            [addressBook removeRecordID: contactID];
+            [self.contactIDs removeObjectForKey: step.label];
+            break;
+        case AKReplayOperationLink:
+            [self markChangedRecordID: contactID];
+            [self markChangedRecordID: [otherRecordID intValue]];
+            [addressBook linkRecordID: contactID toRecordID: [otherRecordID intValue]];
+            break;
+        case AKReplayOperationUnlink:
+            if (otherRecordID && [[addressBook linkedRecordIDsOfRecordID: contactID] containsObject: otherRecordID])
+            {
+                [self markChangedRecordID: contactID];
+                [addressBook unlinkRecordID: contactID];
+            }
+            break;
+        case AKReplayOperationGroupAdd:
+            // Group membership is not part of the section tables and contact indexes
+            [addressBook addRecordID: contactID toGroupWithName: step.group];
+            break;
+        case AKReplayOperationGroupRemove:
+            [addressBook removeRecordID: contactID fromGroupWithName: step.group];
+            break;
+        case AKReplayOperationType:
+            break;
+    }
+    return YES;
+}
+
+/**
+ * Names, email address, city and birthday of a create or rename step, missing ones are removed
+ */
+- (NSDictionary *)valuesOfStep: (AKReplayStep *)step
+{
+    id null = [NSNull null];
+    NSDate *birthday = [self dateOfBirthday: step.birthday];
+    return @{@(kABPersonFirstNameProperty): step.firstName ?: null,
+             @(kABPersonLastNameProperty): step.lastName ?: null,
+             @(kABPersonEmailProperty): (step.emailAddress) ? @[step.emailAddress] : null,
+             @(kABPersonAddressProperty): (step.city) ? @[@{(NSString *)kABPersonAddressCityKey: step.city}] : null,
+             @(kABPersonBirthdayProperty): birthday ?: null};
+}
+
+/**
+ * ABAddressBook stores dates at noon GMT
+ */
+- (NSDate *)dateOfBirthday: (NSString *)birthday
+{
+    NSArray *components = [birthday componentsSeparatedByString: @"-"];
+    if (components.count < 2 || components.count > 3) return nil;
+    
+    NSCalendar *calendar = [[NSCalendar alloc] initWithCalendarIdentifier: NSGregorianCalendar];
+    calendar.timeZone = [NSTimeZone timeZoneForSecondsFromGMT: 0];
+    
+    NSDateComponents *dateComponents = [[NSDateComponents alloc] init];
+    dateComponents.year = (components.count == 3) ? [components[0] integerValue] : kReplayNoYear;
+    dateComponents.month = [components[components.count - 2] integerValue];
+    dateComponents.day = [components[components.count - 1] integerValue];
+    dateComponents.hour = 12;
+    return [calendar dateFromComponents: dateComponents];
+}
+
+- (void)markChangedRecordID: (ABRecordID)recordID
+{
+    [self.pendingRecordIDs addObject: @(recordID)];
+    [self.pendingRecordIDs addObjectsFromArray: [self.addressBook linkedRecordIDsOfRecordID: recordID]];
+}
+
+- (BOOL)runMainLoopUntil: (BOOL (^)(void))condition
+{
+    NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow: kReplayTimeout];
+    while (!condition())
+    {
+        if ([timeout timeIntervalSinceNow] < 0.0) return NO;
+        [[NSRunLoop currentRunLoop] runMode: NSDefaultRunLoopMode beforeDate: [NSDate dateWithTimeIntervalSinceNow: 0.01]];
+    }
+    return YES;
+}
+
+/**
+ * Reloads as the external change callback of ABAddressBook does and waits until
+ * the load ended and its changes are committed to the section cache, where the
+ * next load reads the watermark of the changes it has seen. Returns NO if either
+ * did not happen
+ */
+- (BOOL)loadAddressBook
+{
+    NSUInteger loadCount = self.loadCount;
+    [self.indexedAddressBook.addressBookPool invalidateHandles];
+    [self.indexedAddressBook reloadAddressBook];
+    
+    BOOL loaded = [self runMainLoopUntil: ^BOOL{
+        return (self.loadCount > loadCount);
+    }];
+    dispatch_sync(self.indexedAddressBook.serial_queue, ^{});
+    BOOL committed = [self.indexedAddressBook.sectionCache waitUntilCommitted];
+    return loaded && committed;
+}
+
+/**
+ * Notifies the indexed address book of the changes applied to the fake since the last
+ * notified step. Returns the records whose insertion or removal was not reported
+ */
+- (NSArray *)notifyChange
+{
+    NSMutableArray *failures = [[NSMutableArray alloc] init];
+    
+    NSSet *changedRecordIDs = [self.pendingRecordIDs copy];
+    [self.pendingRecordIDs removeAllObjects];
+    @synchronized(self.updates)
+    {
+        [self.updates removeAllObjects];
+    }
+    self.dateUpdated = nil;
+    
+    NSDate *dateChanged = [NSDate date];
+    if (![self loadAddressBook])
+    {
+        [failures addObject: @"Load did not end or was not committed"];
+        return failures;
+    }
+    if (self.dateUpdated)
+    {
+        [self.changeLatencies addSample: [self.dateUpdated timeIntervalSinceDate: dateChanged]];
+    }
+    
+    NSArray *updates;
+    @synchronized(self.updates)
+    {
+        updates = [self.updates copy];
+    }
+    NSMutableSet *insertedRecordIDs = [[NSMutableSet alloc] init];
+    for (NSArray *update in updates)
+    {
+        NSNumber *recordID = [update objectAtIndex: 1];
+        if ([[update objectAtIndex: 0] boolValue])
+        {
+            [self.presentedRecordIDs addObject: recordID];
+            [insertedRecordIDs addObject: recordID];
+        }
+        else
+        {
+            [self.presentedRecordIDs removeObject: recordID];
+        }
+    }
+    
+    NSSet *listedIDs = [self listedRecordIDs];
+    if (![self.presentedRecordIDs isEqualToSet: listedIDs])
+    {
+        NSMutableSet *extraIDs = [self.presentedRecordIDs mutableCopy];
+        [extraIDs minusSet: listedIDs];
+        NSMutableSet *missingIDs = [listedIDs mutableCopy];
+        [missingIDs minusSet: self.presentedRecordIDs];
+        [failures addObject: [NSString stringWithFormat: @"Delegate was told of %lu listed contacts, the fake lists %lu (extra %@, missing %@)",
+                              (unsigned long)self.presentedRecordIDs.count, (unsigned long)listedIDs.count,
+                              [[extraIDs allObjects] componentsJoinedByString: @","], [[missingIDs allObjects] componentsJoinedByString: @","]]];
+        [self.presentedRecordIDs setSet: listedIDs];
+    }
+    
+    // Rows of changed contacts are reloaded by inserting them again
+    NSMutableSet *unreportedIDs = [changedRecordIDs mutableCopy];
+    [unreportedIDs intersectSet: listedIDs];
+    [unreportedIDs minusSet: insertedRecordIDs];
+    if (unreportedIDs.count > 0)
+    {
+        [failures addObject: [NSString stringWithFormat: @"Changes of %@ were not reported to the delegate",
+                              [[unreportedIDs allObjects] componentsJoinedByString: @","]]];
+    }
+    return failures;
+}
+
+/**
+ * Types the term into the data source a character at a time, each one after the
+ * results of the previous one were delivered. Returns stale results
+ */
+- (NSArray *)typeTerm: (NSString *)term
+{
+    NSMutableArray *failures = [[NSMutableArray alloc] init];
+    
+    AKContactsTableViewDataSource *dataSource = self.dataSource;
+    [dataSource loadData];
+    
+    NSSet *listedIDs = [self listedRecordIDs];
+    for (NSUInteger length = 1; length <= term.length; ++length)
+    {
+        NSString *searchTerm = [term substringToIndex: length];
+        self.dateSearchEnded = nil;
+        NSDate *date = [NSDate date];
+        [dataSource handleSearchForTerm: searchTerm];
+        if (![self runMainLoopUntil: ^BOOL{ return (self.dateSearchEnded != nil); }])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Search for %@ did not end", searchTerm]];
+            break;
+        }
+        [self.keystrokeLatencies addSample: [self.dateSearchEnded timeIntervalSinceDate: date]];
+        
+        for (NSNumber *recordID in dataSource.filteredContactIDs)
+        {
+            if (![listedIDs member: recordID])
+            {
+                [failures addObject: [NSString stringWithFormat: @"Search for %@ found %@, which is not listed", searchTerm, recordID]];
+                break;
+            }
+        }
+    }
+    [dataSource finishSearch];
+    
+    return failures;
+}
+
+#pragma mark - AKAddressBookPresentationDelegate
+
+- (void)addressBook: (AKAddressBook *)addressBook didInsertRecordID: (ABRecordID)recordID
+{
+    @synchronized(self.updates)
+    {
+        [self.updates addObject: @[@YES, @(recordID)]];
+    }
+}
+
+- (void)addressBook: (AKAddressBook *)addressBook didRemoveRecordID: (ABRecordID)recordID
+{
+    @synchronized(self.updates)
+    {
+        [self.updates addObject: @[@NO, @(recordID)]];
+    }
+}
+
+- (void)addressBookDidEndUpdates: (AKAddressBook *)addressBook
+{
+    // The table view applies the updates on the main queue
+    dispatch_async(dispatch_get_main_queue(), ^{
+        if (!self.dateUpdated) self.dateUpdated = [NSDate date];
+    });
+}
+
+- (void)addressBookDidEndLoading: (AKAddressBook *)addressBook
+{
+    self.loadCount += 1;
+}
+
+#pragma mark - AKContactsTableViewDataSourceDelegate
+
+- (void)dataSourceDidEndSearch: (AKContactsTableViewDataSource *)dataSource
+{
+    self.dateSearchEnded = [NSDate date];
+}
+
+#pragma mark - Verification
+
+- (NSSet *)listedRecordIDs
+{
+    NSMutableSet *listedIDs = [[NSMutableSet alloc] init];
+    for (NSNumber *recordID in self.addressBook.recordIDs)
+    {
+        if ([self.addressBook isListedRecordID: [recordID intValue]]) [listedIDs addObject: recordID];
+    }
+    return [listedIDs copy];
+}
+
+/**
+ * Sections of each listed person: the section of the name it is sorted by, also the
+ * section of the first digit of a name of digits only, ordered by AKSortKey. Phone
+ * sections of the first digits of the phone numbers of the person and of the people
+ * linked to it, of the first digit of the national numbers, + for international numbers
+ */
+- (AKReplayRebuild *)rebuild
+{
+    AKReplayRebuild *rebuild = [[AKReplayRebuild alloc] init];
+    NSArray *listedIDs = [[[self listedRecordIDs] allObjects] sortedArrayUsingSelector: @selector(compare:)];
+    
+    for (NSNumber *sortOrdering in @[@(kABPersonSortByFirstName), @(kABPersonSortByLastName)])
+    {
+        NSMutableDictionary *sections = [[NSMutableDictionary alloc] init];
+        NSMutableDictionary *sortKeys = [[NSMutableDictionary alloc] init];
+        for (NSNumber *recordID in listedIDs)
+        {
+            AKContact *contact = [self.addressBook contactForRecordID: [recordID intValue] sortOrdering: [sortOrdering intValue]];
+            NSString *name = [contact nameToDetermineSectionForSortOrdering: [sortOrdering intValue]];
+            NSMutableArray *keys = [[NSMutableArray alloc] initWithObjects: [AKContact sectionKeyForName: name], nil];
+            if ([keys.firstObject isEqualToString: @"#"] && [name isMemberOfCharacterSet: [NSCharacterSet decimalDigitCharacterSet]])
+            {
+                [keys addObject: [name substringToIndex: 1]];
+            }
+            for (NSString *key in keys)
+            {
+                if (!sections[key]) sections[key] = [[NSMutableArray alloc] init];
+                [sections[key] addObject: recordID];
+            }
+            sortKeys[recordID] = [AKSortKey sortKeyOfContact: contact sortOrdering: [sortOrdering intValue]];
+        }
+        for (NSMutableArray *section in [sections objectEnumerator])
+        {
+            [section sortUsingComparator: ^NSComparisonResult(NSNumber *recordID1, NSNumber *recordID2) {
+                return [sortKeys[recordID1] compare: sortKeys[recordID2]];
+            }];
+        }
+        if ([sortOrdering intValue] == kABPersonSortByFirstName) rebuild.sectionsSortedByFirst = sections;
+        else rebuild.sectionsSortedByLast = sections;
+    }
+    
+    NSMutableDictionary *phoneSections = [[NSMutableDictionary alloc] init];
+    for (NSNumber *recordID in listedIDs)
+    {
+        NSMutableSet *keys = [[NSMutableSet alloc] init];
+        for (NSNumber *linkedRecordID in [self.addressBook linkedRecordIDsOfRecordID: [recordID intValue]])
+        {
+            for (NSString *phoneNumber in [self.addressBook valueForProperty: kABPersonPhoneProperty ofRecordID: [linkedRecordID intValue]])
+            {
+                NSString *digits = [[phoneNumber componentsSeparatedByCharactersInSet: [[NSCharacterSet decimalDigitCharacterSet] invertedSet]] componentsJoinedByString: @""];
+                if (digits.length == 0) continue;
+                [keys addObject: [digits substringToIndex: 1]];
+                if ([phoneNumber hasPrefix: @"+"]) [keys addObject: @"+"];
+                for (NSString *prefix in [AKAddressBook countryCodePrefixes])
+                {
+                    if (![digits hasPrefix: prefix]) continue;
+                    if (digits.length > prefix.length) [keys addObject: [digits substringWithRange: NSMakeRange(prefix.length, 1)]];
+                    break;
+                }
+            }
+        }
+        if (keys.count == 0) [keys addObject: noPhoneNumberKey];
+        for (NSString *key in keys)
+        {
+            if (!phoneSections[key]) phoneSections[key] = [[NSMutableArray alloc] init];
+            [phoneSections[key] addObject: recordID];
+        }
+        
+        AKSearchEntry *entry = [AKSearchEntry entryWithContact: [self.addressBook contactForRecordID: [recordID intValue] sortOrdering: self.indexedAddressBook.sortOrdering]];
+        for (id<AKContactIndex> index in rebuild.contactIndexes)
+        {
+            [index insertSearchEntry: entry];
+        }
+    }
+    rebuild.sectionsSortedByPhone = phoneSections;
+    
+    return rebuild;
+}
+
+- (NSArray *)verifyAgainstFullRebuild
+{
+    NSMutableArray *failures = [[NSMutableArray alloc] init];
+    
+    AKReplayRebuild *rebuild = [self rebuild];
+    AKIndexSnapshot *snapshot = self.indexedAddressBook.snapshot;
+    
+    [self compareSections: snapshot.sectionsSortedByFirst withSections: rebuild.sectionsSortedByFirst
+             sortOrdering: kABPersonSortByFirstName failures: failures];
+    [self compareSections: snapshot.sectionsSortedByLast withSections: rebuild.sectionsSortedByLast
+             sortOrdering: kABPersonSortByLastName failures: failures];
+    [self comparePhoneSections: snapshot.sectionsSortedByPhone withSections: rebuild.sectionsSortedByPhone failures: failures];
+    
+    __block NSArray *indexFailures;
+    AKAddressBook *indexedAddressBook = self.indexedAddressBook;
+    dispatch_sync(indexedAddressBook.serial_queue, ^{
+        indexFailures = [self compareIndexesOfAddressBook: indexedAddressBook withRebuild: rebuild];
+    });
+    [failures addObjectsFromArray: indexFailures];
+    
+    return [failures copy];
+}
+
+- (void)compareSections: (NSDictionary *)sections
+           withSections: (NSDictionary *)rebuiltSections
+           sortOrdering: (ABPersonSortOrdering)sortOrdering
+               failures: (NSMutableArray *)failures
+{
+    NSString *ordering = (sortOrdering == kABPersonSortByFirstName) ? @"first" : @"last";
+    
+    NSMutableSet *keys = [[NSMutableSet alloc] initWithArray: [sections allKeys]];
+    [keys addObjectsFromArray: [rebuiltSections allKeys]];
+    for (NSString *key in [[keys allObjects] sortedArrayUsingSelector: @selector(compare:)])
+    {
+        NSArray *section = sections[key] ?: @[];
+        NSArray *rebuiltSection = rebuiltSections[key] ?: @[];
+        
+        NSMutableSet *extraIDs = [[NSMutableSet alloc] initWithArray: section];
+        [extraIDs minusSet: [NSSet setWithArray: rebuiltSection]];
+        NSMutableSet *missingIDs = [[NSMutableSet alloc] initWithArray: rebuiltSection];
+        [missingIDs minusSet: [NSSet setWithArray: section]];
+        if (extraIDs.count > 0 || missingIDs.count > 0 || section.count != rebuiltSection.count)
+        {
+            [failures addObject: [NSString stringWithFormat: @"Section %@ by %@ name lists %lu contacts, a full rebuild %lu (extra %@, missing %@)",
+                                  key, ordering, (unsigned long)section.count, (unsigned long)rebuiltSection.count,
+                                  [[extraIDs allObjects] componentsJoinedByString: @","], [[missingIDs allObjects] componentsJoinedByString: @","]]];
+            continue;
+        }
+        
+        // Contacts of equal sort keys are in the order they were inserted in
+        AKSortKey *previousSortKey = nil;
+        for (NSUInteger index = 0; index < section.count; ++index)
+        {
+            AKContact *contact = [self.addressBook contactForRecordID: [section[index] intValue] sortOrdering: sortOrdering];
+            AKSortKey *sortKey = [AKSortKey sortKeyOfContact: contact sortOrdering: sortOrdering];
+            if (previousSortKey && [previousSortKey compare: sortKey] == NSOrderedDescending)
+            {
+                [failures addObject: [NSString stringWithFormat: @"Section %@ by %@ name is out of order at %lu", key, ordering, (unsigned long)index]];
+                break;
+            }
+            previousSortKey = sortKey;
+        }
+    }
+}
+
+/**
+ * Phone sections are unordered, they are compared as sets of listed contacts
+ */
+- (void)comparePhoneSections: (NSDictionary *)sections
+                withSections: (NSDictionary *)rebuiltSections
+                    failures: (NSMutableArray *)failures
+{
+    NSMutableSet *keys = [[NSMutableSet alloc] initWithArray: [sections allKeys]];
+    [keys addObjectsFromArray: [rebuiltSections allKeys]];
+    for (NSString *key in [[keys allObjects] sortedArrayUsingSelector: @selector(compare:)])
+    {
+        NSArray *section = sections[key] ?: @[];
+        NSSet *sectionIDs = [NSSet setWithArray: section];
+        NSSet *rebuiltIDs = [NSSet setWithArray: rebuiltSections[key] ?: @[]];
+        if (![sectionIDs isEqualToSet: rebuiltIDs] || section.count != sectionIDs.count)
+        {
+            NSMutableSet *extraIDs = [sectionIDs mutableCopy];
+            [extraIDs minusSet: rebuiltIDs];
+            NSMutableSet *missingIDs = [rebuiltIDs mutableCopy];
+            [missingIDs minusSet: sectionIDs];
+            [failures addObject: [NSString stringWithFormat: @"Phone section %@ lists %lu contacts, a full rebuild %lu (extra %@, missing %@)",
+                                  key, (unsigned long)section.count, (unsigned long)rebuiltIDs.count,
+                                  [[extraIDs allObjects] componentsJoinedByString: @","], [[missingIDs allObjects] componentsJoinedByString: @","]]];
+        }
+    }
+}
+
+/**
+ * Must be dispatched on the serial_queue of indexedAddressBook
+ */
+- (NSArray *)compareIndexesOfAddressBook: (AKAddressBook *)indexedAddressBook withRebuild: (AKReplayRebuild *)rebuild
+{
+    NSMutableArray *failures = [[NSMutableArray alloc] init];
+    
+    NSArray *indexes = indexedAddressBook.contactIndexes;
+    NSArray *rebuiltIndexes = rebuild.contactIndexes;
+    for (NSUInteger index = 0; index < indexes.count; ++index)
+    {
+        id<AKContactIndex> contactIndex = indexes[index];
+        id<AKContactIndex> rebuiltContactIndex = rebuiltIndexes[index];
+        if (contactIndex.count != rebuiltContactIndex.count)
+        {
+            [failures addObject: [NSString stringWithFormat: @"%@ has %lu records, a full rebuild %lu", NSStringFromClass([(NSObject *)contactIndex class]),
+                                  (unsigned long)contactIndex.count, (unsigned long)rebuiltContactIndex.count]];
+        }
+    }
+    
+    // Search entries, the terms the other indexes are queried with are taken from both
+    NSMutableDictionary *entries = [[NSMutableDictionary alloc] init];
+    NSMutableDictionary *rebuiltEntries = [[NSMutableDictionary alloc] init];
+    NSMutableSet *tokens = [[NSMutableSet alloc] init];
+    NSMutableSet *phoneNumbers = [[NSMutableSet alloc] init];
+    NSMutableSet *emailAddresses = [[NSMutableSet alloc] init];
+    void (^collect)(AKSearchEntry *, NSMutableDictionary *) = ^(AKSearchEntry *entry, NSMutableDictionary *dictionary) {
+        [dictionary setObject: [entry propertyListRepresentation] forKey: @(entry.recordID)];
+        [tokens addObjectsFromArray: [entry tokens]];
+        [phoneNumbers addObjectsFromArray: entry.linkedPhoneNumbers];
+        [emailAddresses addObjectsFromArray: entry.emailAddresses];
+    };
+    [indexedAddressBook.searchEntryIndex enumerateEntriesUsingBlock: ^(AKSearchEntry *entry) {
+        collect(entry, entries);
+    }];
+    [rebuild.searchEntryIndex enumerateEntriesUsingBlock: ^(AKSearchEntry *entry) {
+        collect(entry, rebuiltEntries);
+    }];
+    if (![entries isEqualToDictionary: rebuiltEntries])
+    {
+        NSMutableArray *recordIDs = [[NSMutableArray alloc] init];
+        NSMutableSet *keys = [[NSMutableSet alloc] initWithArray: [entries allKeys]];
+        [keys addObjectsFromArray: [rebuiltEntries allKeys]];
+        for (NSNumber *recordID in keys)
+        {
+            if (![entries[recordID] isEqual: rebuiltEntries[recordID]]) [recordIDs addObject: recordID];
+        }
+        [failures addObject: [NSString stringWithFormat: @"Search entries of %@ differ", [recordIDs componentsJoinedByString: @","]]];
+    }
+    
+    // Name tokens, by prefix and within an edit of the whole token
+    NSMutableSet *prefixes = [[NSMutableSet alloc] init];
+    for (NSString *token in tokens)
+    {
+        for (NSUInteger length = 1; length <= MIN(token.length, kReplayPrefixLength); ++length)
+        {
+            [prefixes addObject: [token substringToIndex: length]];
+        }
+    }
+    for (NSString *prefix in prefixes)
+    {
+        if (![[indexedAddressBook.nameTokenIndex contactIDsMatchingPrefix: prefix maximumDistance: 0]
+              isEqualToSet: [rebuild.nameTokenIndex contactIDsMatchingPrefix: prefix maximumDistance: 0]])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Name token index matches prefix %@ differently", prefix]];
+        }
+    }
+    for (NSString *token in tokens)
+    {
+        if (![[indexedAddressBook.nameTokenIndex contactIDsMatchingTerm: token maximumDistance: 1]
+              isEqualToSet: [rebuild.nameTokenIndex contactIDsMatchingTerm: token maximumDistance: 1]])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Name token index matches %@ within an edit differently", token]];
+        }
+        
+        NSString *digits = [AKKeypadIndex keypadDigitsForToken: token];
+        if (digits && ![[indexedAddressBook.keypadIndex contactIDsMatchingDigits: digits]
+                        isEqualToDictionary: [rebuild.keypadIndex contactIDsMatchingDigits: digits]])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Keypad index matches %@ differently", digits]];
+        }
+    }
+    for (NSString *phoneNumber in phoneNumbers)
+    {
+        NSString *digits = [[phoneNumber componentsSeparatedByCharactersInSet: [[NSCharacterSet decimalDigitCharacterSet] invertedSet]] componentsJoinedByString: @""];
+        if (digits.length == 0) continue;
+        if (![[indexedAddressBook.keypadIndex contactIDsMatchingDigits: digits]
+              isEqualToDictionary: [rebuild.keypadIndex contactIDsMatchingDigits: digits]])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Keypad index matches phone number %@ differently", digits]];
+        }
+    }
+    
+    // Email addresses and their domains
+    for (NSString *address in emailAddresses)
+    {
+        if (![[indexedAddressBook.emailIndex recordIDsWithEmailAddress: address]
+              isEqualToIndexSet: [rebuild.emailIndex recordIDsWithEmailAddress: address]])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Email index matches %@ differently", address]];
+        }
+        NSString *domain = [address substringFromIndex: NSMaxRange([address rangeOfString: @"@" options: NSBackwardsSearch])];
+        if (![[indexedAddressBook.emailIndex recordIDsWithEmailDomain: domain]
+              isEqualToIndexSet: [rebuild.emailIndex recordIDsWithEmailDomain: domain]])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Email index matches domain %@ differently", domain]];
+        }
+    }
+    
+    // Events of a whole leap year, the order within a day is the order of insertion
+    NSDateComponents *components = [[NSDateComponents alloc] init];
+    components.year = kReplayEventsYear;
+    components.month = 1;
+    components.day = 1;
+    NSDate *date = [[NSCalendar currentCalendar] dateFromComponents: components];
+    NSArray *(^eventDescriptions)(AKDateIndex *) = ^NSArray *(AKDateIndex *dateIndex) {
+        NSMutableArray *descriptions = [[NSMutableArray alloc] init];
+        for (AKDateEvent *event in [dateIndex eventsFromDate: date numberOfDays: kReplayEventsDayCount])
+        {
+            [descriptions addObject: [NSString stringWithFormat: @"%lu %d %d %ld-%ld-%ld", (unsigned long)event.daysAhead, event.recordID, event.identifier,
+                                      (long)event.year, (long)event.month, (long)event.day]];
+        }
+        return [descriptions sortedArrayUsingSelector: @selector(compare:)];
+    };
+    if (![eventDescriptions(indexedAddressBook.dateIndex) isEqualToArray: eventDescriptions(rebuild.dateIndex)])
+    {
+        [failures addObject: @"Date index lists different events"];
+    }
+    
+    // Facet values and their postings
+    for (AKFacet facet = 0; facet < AKFacetCount; ++facet)
+    {
+        NSArray *values = [indexedAddressBook.facetIndex valuesOfFacet: facet];
+        if (![values isEqualToArray: [rebuild.facetIndex valuesOfFacet: facet]])
+        {
+            [failures addObject: [NSString stringWithFormat: @"Facet %ld has different values", (long)facet]];
+            continue;
+        }
+        for (NSString *value in values)
+        {
+            if (![[indexedAddressBook.facetIndex recordIDsWithValue: value ofFacet: facet]
+                  isEqualToIndexSet: [rebuild.facetIndex recordIDsWithValue: value ofFacet: facet]])
+            {
+                [failures addObject: [NSString stringWithFormat: @"Facet %ld matches %@ differently", (long)facet, value]];
+            }
+        }
+    }
+    
+    return failures;
+}
+
+@end
@@ -0,0 +1,90 @@
+//
+//  AKReplayTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKReplayHarness.h"
+#import "AKReplayTrace.h"
+
+static const uint32_t kReplaySeed = 20131028;
+static const NSUInteger kReplayStepCount = 150;
+
+@interface AKReplayTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayHarness *harness;
+
+@end
+
+@implementation AKReplayTests
+
+- (void)setUp
+{
+    [super setUp];
+
+    self.harness = [[AKReplayHarness alloc] init];
+}
+
+- (void)tearDown
+{
+    self.harness = nil;
+
+    [super tearDown];
+}
+
+- (void)testTraceRoundTrip
+{
+    AKReplayTrace *trace = [AKReplayTrace generatedTraceWithSeed: kReplaySeed stepCount: kReplayStepCount];
+    NSString *path = [NSTemporaryDirectory() stringByAppendingPathComponent: @"AKReplayTrace.json"];
+    XCTAssertTrue([trace writeToFile: path], @"Trace is not written");
+
+    AKReplayTrace *readTrace = [AKReplayTrace traceWithContentsOfFile: path];
+    NSArray *steps = [trace.steps valueForKey: NSStringFromSelector(@selector(dictionaryRepresentation))];
+    NSArray *readSteps = [readTrace.steps valueForKey: NSStringFromSelector(@selector(dictionaryRepresentation))];
+    XCTAssertEqualObjects(steps, readSteps, @"Trace differs after reading it back");
+
+    AKReplayTrace *regeneratedTrace = [AKReplayTrace generatedTraceWithSeed: kReplaySeed stepCount: kReplayStepCount];
+    XCTAssertEqualObjects(steps, [regeneratedTrace.steps valueForKey: NSStringFromSelector(@selector(dictionaryRepresentation))], @"Same seed generates a different trace");
+
+    [[NSFileManager defaultManager] removeItemAtPath: path error: nil];
+}
+
+- (void)testGeneratedTraceMatchesFullRebuild
+{
+    AKReplayTrace *trace = [AKReplayTrace generatedTraceWithSeed: kReplaySeed stepCount: kReplayStepCount];
+    BOOL replayed = [self.harness replayTrace: trace];
+
+    NSLog(@"Change to delegate update p50: %.1fms p99: %.1fms (%lu)", self.harness.changeLatencies.p50 * 1000.0,
+          self.harness.changeLatencies.p99 * 1000.0, (unsigned long)self.harness.changeLatencies.count);
+    NSLog(@"Keystroke to search results p50: %.1fms p99: %.1fms (%lu)", self.harness.keystrokeLatencies.p50 * 1000.0,
+          self.harness.keystrokeLatencies.p99 * 1000.0, (unsigned long)self.harness.keystrokeLatencies.count);
+
+    XCTAssertTrue(replayed, @"Sections or indexes differ from a full rebuild: %@", self.harness.failures);
+    XCTAssertTrue(self.harness.changeLatencies.count > 0, @"No change was reported to the delegate");
+    XCTAssertTrue(self.harness.keystrokeLatencies.count > 0, @"No search ended");
+}
+
+@end
@@ -0,0 +1,106 @@
+//
+//  AKReplayTrace.h
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(NSInteger, AKReplayOperation)
+{
+    AKReplayOperationCreate = 0,
+    AKReplayOperationRename,
+    AKReplayOperationDelete,
+    AKReplayOperationLink,
+    AKReplayOperationUnlink,
+    AKReplayOperationGroupAdd,
+    AKReplayOperationGroupRemove,
+    AKReplayOperationType,
+};
+
+/**
+ * One change of the address book or one search term typed
+ */
+@interface AKReplayStep : NSObject
+
+@property (assign, nonatomic) AKReplayOperation operation;
+/**
+ * Trace local name of the contact the step changes
+ */
+@property (copy, nonatomic) NSString *label;
+/**
+ * Label of the contact linked to or unlinked from label
+ */
+@property (copy, nonatomic) NSString *otherLabel;
+/**
+ * Trace local name of the group of group edits
+ */
+@property (copy, nonatomic) NSString *group;
+@property (copy, nonatomic) NSString *firstName;
+@property (copy, nonatomic) NSString *lastName;
+@property (copy, nonatomic) NSString *phoneNumber;
+@property (copy, nonatomic) NSString *emailAddress;
+@property (copy, nonatomic) NSString *city;
+/**
+ * yyyy-MM-dd, or MM-dd if the year is unknown
+ */
+@property (copy, nonatomic) NSString *birthday;
+/**
+ * Typed a character at a time
+ */
+@property (copy, nonatomic) NSString *term;
+/**
+ * When NO the change is saved without notifying the address book, as the
+ * changes of a sync storm arriving before its notification. Default value is YES
+ */
+@property (assign, nonatomic) BOOL notifies;
+
++ (instancetype)stepWithDictionary: (NSDictionary *)dictionary;
+- (NSDictionary *)dictionaryRepresentation;
+
+@end
+
+/**
+ * Steps replayed by AKReplayHarness. Recorded traces are JSON arrays of step dictionaries:
+ * {"op": "create", "label": "c1", "first": "Ann", "last": "Smith", "phone": "555 0100",
+ *  "email": "c1.7@example.com", "city": "Szeged", "birthday": "1980-02-29", "notifies": false}
+ * op is one of create, rename, delete, link, unlink, groupAdd, groupRemove and type
+ */
+@interface AKReplayTrace : NSObject
+
+@property (copy, nonatomic, readonly) NSArray *steps;
+
+- (instancetype)initWithSteps: (NSArray *)steps;
++ (instancetype)traceWithContentsOfFile: (NSString *)path;
+/**
+ * The same seed generates the same trace: a bulk create followed by renames
+ * across sections that also change email addresses, cities and birthdays,
+ * deletes, link edits, group edits and terms typed in between, with bursts
+ * of changes notified once
+ */
++ (instancetype)generatedTraceWithSeed: (uint32_t)seed stepCount: (NSUInteger)stepCount;
+- (BOOL)writeToFile: (NSString *)path;
+
+@end
@@ -0,0 +1,295 @@
+//
+//  AKReplayTrace.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import "AKReplayTrace.h"
+
+static NSString *const kReplayOperationNames[] = {
+    @"create", @"rename", @"delete", @"link", @"unlink", @"groupAdd", @"groupRemove", @"type",
+};
+
+static const NSUInteger kReplayOperationCount = sizeof(kReplayOperationNames) / sizeof(kReplayOperationNames[0]);
+static const NSUInteger kReplayBulkCreateCount = 200;
+static const NSUInteger kReplayGroupCount = 3;
+
+@implementation AKReplayStep
+
+- (instancetype)init
+{
+    self = [super init];
+    if (self)
+    {
+        _notifies = YES;
+    }
+    return self;
+}
+
++ (instancetype)stepWithDictionary: (NSDictionary *)dictionary
+{
+    NSString *name = dictionary[@"op"];
+    NSUInteger operation = 0;
+    while (operation < kReplayOperationCount && ![kReplayOperationNames[operation] isEqualToString: name])
+    {
+        operation += 1;
+    }
+    if (operation == kReplayOperationCount)
+    {
+        NSLog(@"Unknown replay operation: %@", name);
+        return nil;
+    }
+
+    AKReplayStep *step = [[self alloc] init];
+    step.operation = (AKReplayOperation)operation;
+    step.label = dictionary[@"label"];
+    step.otherLabel = dictionary[@"other"];
+    step.group = dictionary[@"group"];
+    step.firstName = dictionary[@"first"];
+    step.lastName = dictionary[@"last"];
+    step.phoneNumber = dictionary[@"phone"];
+    step.emailAddress = dictionary[@"email"];
+    step.city = dictionary[@"city"];
+    step.birthday = dictionary[@"birthday"];
+    step.term = dictionary[@"term"];
+    if (dictionary[@"notifies"])
+    {
+        step.notifies = [dictionary[@"notifies"] boolValue];
+    }
+    return step;
+}
+
+- (NSDictionary *)dictionaryRepresentation
+{
+    NSMutableDictionary *dictionary = [[NSMutableDictionary alloc] init];
+    dictionary[@"op"] = kReplayOperationNames[self.operation];
+    if (self.label) dictionary[@"label"] = self.label;
+    if (self.otherLabel) dictionary[@"other"] = self.otherLabel;
+    if (self.group) dictionary[@"group"] = self.group;
+    if (self.firstName) dictionary[@"first"] = self.firstName;
+    if (self.lastName) dictionary[@"last"] = self.lastName;
+    if (self.phoneNumber) dictionary[@"phone"] = self.phoneNumber;
+    if (self.emailAddress) dictionary[@"email"] = self.emailAddress;
+    if (self.city) dictionary[@"city"] = self.city;
+    if (self.birthday) dictionary[@"birthday"] = self.birthday;
+    if (self.term) dictionary[@"term"] = self.term;
+    if (!self.notifies) dictionary[@"notifies"] = @NO;
+    return [dictionary copy];
+}
+
+@end
+
+@implementation AKReplayTrace
+
+- (instancetype)initWithSteps: (NSArray *)steps
+{
+    self = [super init];
+    if (self)
+    {
+        _steps = [steps copy];
+    }
+    return self;
+}
+
++ (instancetype)traceWithContentsOfFile: (NSString *)path
+{
+    NSData *data = [NSData dataWithContentsOfFile: path];
+    if (!data) return nil;
+
+    NSError *error = nil;
+    NSArray *array = [NSJSONSerialization JSONObjectWithData: data options: 0 error: &error];
+    if (![array isKindOfClass: [NSArray class]])
+    {
+        NSLog(@"Could not read replay trace %@: %@", path, error);
+        return nil;
+    }
+
+    NSMutableArray *steps = [[NSMutableArray alloc] initWithCapacity: array.count];
+    for (NSDictionary *dictionary in array)
+    {
+        AKReplayStep *step = [AKReplayStep stepWithDictionary: dictionary];
+        if (!step) return nil;
+        [steps addObject: step];
+    }
+    return [[self alloc] initWithSteps: steps];
+}
+
+- (BOOL)writeToFile: (NSString *)path
+{
+    NSArray *array = [self.steps valueForKey: NSStringFromSelector(@selector(dictionaryRepresentation))];
+    NSError *error = nil;
+    NSData *data = [NSJSONSerialization dataWithJSONObject: array options: NSJSONWritingPrettyPrinted error: &error];
+    if (!data)
+    {
+        NSLog(@"Could not write replay trace %@: %@", path, error);
+        return NO;
+    }
+    return [data writeToFile: path atomically: YES];
+}
+
+#pragma mark - Generated Traces
+
++ (NSArray *)firstNames
+{
+    return @[@"Ann", @"Ben", @"Ágnes", @"Zoltán", @"Émile", @"Olga", @"Yuki", @"Ida", @"Quentin", @"Xavier"];
+}
+
++ (NSArray *)lastNames
+{
+    // Names of sections at both ends of the index, accented and digit leading ones included
+    return @[@"Adams", @"Baker", @"Čapek", @"Kovács", @"Nagy", @"Östlund", @"Smith", @"Zimmer", @"3M Support", @"7-Eleven"];
+}
+
++ (NSArray *)cities
+{
+    return @[@"Budapest", @"Szeged", @"Paris", @"Tokyo", @"Zürich"];
+}
+
++ (NSArray *)emailDomains
+{
+    return @[@"example.com", @"example.org", @"mail.example.net"];
+}
+
++ (instancetype)generatedTraceWithSeed: (uint32_t)seed stepCount: (NSUInteger)stepCount
+{
+    __block uint32_t state = seed;
+    uint32_t (^next)(uint32_t) = ^uint32_t(uint32_t bound) {
+        state = state * 1103515245 + 12345;
+        return (state >> 16) % bound;
+    };
+
+    NSArray *firstNames = [self firstNames];
+    NSArray *lastNames = [self lastNames];
+    NSMutableArray *labels = [[NSMutableArray alloc] init];
+    NSMutableArray *steps = [[NSMutableArray alloc] initWithCapacity: stepCount + kReplayBulkCreateCount];
+    NSUInteger counter = 0;
+
+    NSArray *cities = [self cities];
+    NSArray *emailDomains = [self emailDomains];
+    // Days of the months of a leap year, February 29 included
+    static const uint32_t daysOfMonths[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    void (^setDetails)(AKReplayStep *) = ^(AKReplayStep *step) {
+        step.firstName = firstNames[next((uint32_t)firstNames.count)];
+        step.lastName = lastNames[next((uint32_t)lastNames.count)];
+        if (next(3) > 0)
+        {
+            step.emailAddress = [NSString stringWithFormat: @"%@.%u@%@", step.label, next(100), emailDomains[next((uint32_t)emailDomains.count)]];
+        }
+        if (next(2) > 0)
+        {
+            step.city = cities[next((uint32_t)cities.count)];
+        }
+        if (next(3) == 0)
+        {
+            uint32_t month = 1 + next(12);
+            uint32_t day = 1 + next(daysOfMonths[month - 1]);
+            uint32_t year = (next(2) > 0) ? 1950 + next(60) : 0;
+            if (month == 2 && day == 29 && year > 0) year = 1952 + 4 * next(15);
+            step.birthday = (year > 0) ? [NSString stringWithFormat: @"%04u-%02u-%02u", year, month, day] : [NSString stringWithFormat: @"%02u-%02u", month, day];
+        }
+    };
+
+    AKReplayStep *(^create)(void) = ^AKReplayStep *(void) {
+        AKReplayStep *step = [[AKReplayStep alloc] init];
+        step.operation = AKReplayOperationCreate;
+        step.label = [NSString stringWithFormat: @"c%lu", (unsigned long)counter];
+        setDetails(step);
+        if (next(4) > 0)
+        {
+            step.phoneNumber = [NSString stringWithFormat: @"555 %04u", next(10000)];
+        }
+        [labels addObject: step.label];
+        return step;
+    };
+
+    for (NSUInteger index = 0; index < kReplayBulkCreateCount; ++index)
+    {
+        counter += 1;
+        AKReplayStep *step = create();
+        step.notifies = (index == kReplayBulkCreateCount - 1);
+        [steps addObject: step];
+    }
+
+    for (NSUInteger index = 0; index < stepCount; ++index)
+    {
+        AKReplayStep *step = nil;
+        uint32_t dice = next(100);
+        if (dice < 20 || labels.count < 2)
+        {
+            counter += 1;
+            step = create();
+        }
+        else if (dice < 40)
+        {
+            step = [[AKReplayStep alloc] init];
+            step.operation = AKReplayOperationRename;
+            step.label = labels[next((uint32_t)labels.count)];
+            setDetails(step);
+        }
+        else if (dice < 50)
+        {
+            step = [[AKReplayStep alloc] init];
+            step.operation = AKReplayOperationDelete;
+            uint32_t position = next((uint32_t)labels.count);
+            step.label = labels[position];
+            [labels removeObjectAtIndex: position];
+        }
+        else if (dice < 60)
+        {
+            step = [[AKReplayStep alloc] init];
+            step.operation = (dice < 55) ? AKReplayOperationLink : AKReplayOperationUnlink;
+            step.label = labels[next((uint32_t)labels.count)];
+            step.otherLabel = labels[next((uint32_t)labels.count)];
+        }
+        else if (dice < 75)
+        {
+            step = [[AKReplayStep alloc] init];
+            step.operation = (dice < 70) ? AKReplayOperationGroupAdd : AKReplayOperationGroupRemove;
+            step.label = labels[next((uint32_t)labels.count)];
+            step.group = [NSString stringWithFormat: @"g%u", next(kReplayGroupCount)];
+        }
+        else
+        {
+            step = [[AKReplayStep alloc] init];
+            step.operation = AKReplayOperationType;
+            NSString *name = (next(2) == 0) ? firstNames[next((uint32_t)firstNames.count)] : lastNames[next((uint32_t)lastNames.count)];
+            step.term = [name substringToIndex: 1 + next((uint32_t)MIN(name.length, 4))];
+        }
+        if (step.operation != AKReplayOperationType)
+        {
+            // One in three changes arrives in a burst with the next one
+            step.notifies = (next(3) > 0);
+        }
+        [steps addObject: step];
+    }
+
+    AKReplayStep *last = [steps lastObject];
+    last.notifies = YES;
+
+    return [[self alloc] initWithSteps: steps];
+}
+
+@end
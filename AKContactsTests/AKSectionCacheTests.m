@@ -0,0 +1,197 @@
+//
+//  AKSectionCacheTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKSectionCache.h"
+
+static NSString *const kTableFirst = @"first";
+static NSString *const kTableLast = @"last";
+
+@interface AKSectionCacheTests : XCTestCase
+
+@property (copy, nonatomic) NSString *directoryPath;
+@property (strong, nonatomic) AKSectionCache *sectionCache;
+
+@end
+
+@implementation AKSectionCacheTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    NSString *name = [NSString stringWithFormat: @"AKSectionCacheTests-%@", [[NSProcessInfo processInfo] globallyUniqueString]];
+    self.directoryPath = [NSTemporaryDirectory() stringByAppendingPathComponent: name];
+    self.sectionCache = [[AKSectionCache alloc] initWithDirectoryPath: self.directoryPath];
+}
+
+- (void)tearDown
+{
+    self.sectionCache = nil;
+    [[NSFileManager defaultManager] removeItemAtPath: self.directoryPath error: nil];
+    
+    [super tearDown];
+}
+
+- (NSDictionary *)tables
+{
+    return @{kTableFirst: @{@"A": @[@1, @2], @"B": @[@3], @"#": @[@4]},
+             kTableLast: @{@"C": @[@1], @"K": @[@2, @3, @4]}};
+}
+
+/**
+ * As the next launch reads them
+ */
+- (NSDictionary *)readTables
+{
+    AKSectionCache *sectionCache = [[AKSectionCache alloc] initWithDirectoryPath: self.directoryPath];
+    return [sectionCache readTablesNamed: @[kTableFirst, kTableLast]];
+}
+
+- (NSString *)relativePathOfSectionKey: (NSString *)key inTable: (NSString *)tableName
+{
+    NSMutableString *fileName = [[NSMutableString alloc] init];
+    NSData *data = [key dataUsingEncoding: NSUTF8StringEncoding];
+    for (NSUInteger index = 0; index < data.length; ++index)
+    {
+        [fileName appendFormat: @"%02x", ((const uint8_t *)data.bytes)[index]];
+    }
+    return [tableName stringByAppendingPathComponent: [fileName stringByAppendingString: @".plist"]];
+}
+
+- (NSNumber *)stampOfSectionKey: (NSString *)key inTable: (NSString *)tableName
+{
+    NSString *path = [self.sectionCache pathOfFileNamed: [self relativePathOfSectionKey: key inTable: tableName]];
+    NSDictionary *plist = [NSDictionary dictionaryWithContentsOfFile: path];
+    return [plist objectForKey: @"stamp"];
+}
+
+- (void)testRoundTrip
+{
+    XCTAssertNil([self readTables], @"Nothing written yet");
+    
+    NSDate *watermark = [NSDate dateWithTimeIntervalSince1970: 1382918400];
+    [self.sectionCache writeTables: [self tables]];
+    [self.sectionCache writeWatermark: watermark];
+    XCTAssertTrue([self.sectionCache waitUntilCommitted], @"Committed");
+    XCTAssertEqualObjects(self.sectionCache.committedWatermark, watermark, @"Watermark of the commit");
+    
+    NSDictionary *tables = [self readTables];
+    XCTAssertEqualObjects(tables, [self tables], @"Tables read back");
+    XCTAssertTrue([[[tables objectForKey: kTableFirst] objectForKey: @"A"] isKindOfClass: [NSMutableArray class]], @"Sections are mutable");
+    
+    AKSectionCache *sectionCache = [[AKSectionCache alloc] initWithDirectoryPath: self.directoryPath];
+    XCTAssertEqualObjects(sectionCache.committedWatermark, watermark, @"Watermark read back");
+}
+
+- (void)testOnlyChangedSectionsWritten
+{
+    [self.sectionCache writeTables: [self tables]];
+    XCTAssertTrue([self.sectionCache waitUntilCommitted], @"Committed");
+    NSNumber *stampA = [self stampOfSectionKey: @"A" inTable: kTableFirst];
+    NSNumber *stampB = [self stampOfSectionKey: @"B" inTable: kTableFirst];
+    XCTAssertNotNil(stampA, @"Section file written");
+    
+    NSMutableDictionary *tables = [[self tables] mutableCopy];
+    NSMutableDictionary *first = [[tables objectForKey: kTableFirst] mutableCopy];
+    [first setObject: @[@3, @5] forKey: @"B"];
+    [first removeObjectForKey: @"#"];
+    [tables setObject: first forKey: kTableFirst];
+    [self.sectionCache writeTables: tables];
+    XCTAssertTrue([self.sectionCache waitUntilCommitted], @"Committed");
+    
+    XCTAssertEqualObjects([self stampOfSectionKey: @"A" inTable: kTableFirst], stampA, @"Unchanged section not rewritten");
+    XCTAssertNotEqualObjects([self stampOfSectionKey: @"B" inTable: kTableFirst], stampB, @"Changed section rewritten");
+    NSString *removedPath = [self.sectionCache pathOfFileNamed: [self relativePathOfSectionKey: @"#" inTable: kTableFirst]];
+    XCTAssertFalse([[NSFileManager defaultManager] fileExistsAtPath: removedPath], @"Removed section deleted");
+    XCTAssertEqualObjects([self readTables], tables, @"Tables read back");
+    
+    stampB = [self stampOfSectionKey: @"B" inTable: kTableFirst];
+    [self.sectionCache writeTables: tables];
+    XCTAssertTrue([self.sectionCache waitUntilCommitted], @"Nothing left to write");
+    XCTAssertEqualObjects([self stampOfSectionKey: @"B" inTable: kTableFirst], stampB, @"No batch without changes");
+}
+
+- (void)testStampMismatch
+{
+    [self.sectionCache writeTables: [self tables]];
+    XCTAssertTrue([self.sectionCache waitUntilCommitted], @"Committed");
+    
+    // A batch that rewrote a section but did not get to write its commit record
+    NSString *path = [self.sectionCache pathOfFileNamed: [self relativePathOfSectionKey: @"K" inTable: kTableLast]];
+    NSDictionary *plist = @{@"stamp": @12345, @"section": @[@2, @3]};
+    NSData *data = [NSPropertyListSerialization dataWithPropertyList: plist format: NSPropertyListBinaryFormat_v1_0 options: 0 error: nil];
+    XCTAssertTrue([data writeToFile: path atomically: YES], @"Section file rewritten");
+    XCTAssertNil([self readTables], @"Section file does not match the commit record");
+    
+    // A batch that removed a section but did not get to write its commit record
+    [[NSFileManager defaultManager] removeItemAtPath: path error: nil];
+    XCTAssertNil([self readTables], @"Section file of the commit record is missing");
+}
+
+- (void)testRecoveryAfterMismatch
+{
+    [self.sectionCache writeTables: [self tables]];
+    XCTAssertTrue([self.sectionCache waitUntilCommitted], @"Committed");
+    
+    NSString *path = [self.sectionCache pathOfFileNamed: [self relativePathOfSectionKey: @"C" inTable: kTableLast]];
+    XCTAssertTrue([@"garbage" writeToFile: path atomically: YES encoding: NSUTF8StringEncoding error: nil], @"Section file corrupted");
+    
+    AKSectionCache *sectionCache = [[AKSectionCache alloc] initWithDirectoryPath: self.directoryPath];
+    XCTAssertNil([sectionCache readTablesNamed: @[kTableFirst, kTableLast]], @"Unreadable section file");
+    
+    // The loader rebuilds the tables and writes them all
+    XCTAssertTrue([sectionCache removeAllFiles], @"Files removed");
+    [sectionCache writeTables: [self tables]];
+    XCTAssertTrue([sectionCache waitUntilCommitted], @"Committed");
+    XCTAssertEqualObjects([self readTables], [self tables], @"Tables read back");
+}
+
+- (void)testFailedCommitRetried
+{
+    // A file in place of the directory of a table fails the writes of its sections
+    XCTAssertTrue([[NSFileManager defaultManager] createDirectoryAtPath: self.directoryPath withIntermediateDirectories: YES attributes: nil error: nil], @"Directory");
+    NSString *blockingPath = [self.sectionCache pathOfFileNamed: kTableLast];
+    XCTAssertTrue([@"" writeToFile: blockingPath atomically: YES encoding: NSUTF8StringEncoding error: nil], @"Blocking file");
+    
+    __block BOOL handlerResult = YES;
+    [self.sectionCache writeTables: [self tables]];
+    [self.sectionCache performWhenCommitted: ^(BOOL committed) {
+        handlerResult = committed;
+    }];
+    XCTAssertFalse([self.sectionCache waitUntilCommitted], @"Commit failed");
+    XCTAssertFalse(handlerResult, @"Completion handler called with the failure");
+    XCTAssertNil([self readTables], @"Nothing committed");
+    
+    // The failed sections are written by the next commit without being written again
+    XCTAssertTrue([[NSFileManager defaultManager] removeItemAtPath: blockingPath error: nil], @"Blocking file removed");
+    XCTAssertTrue([self.sectionCache waitUntilCommitted], @"Retried commit");
+    XCTAssertEqualObjects([self readTables], [self tables], @"Tables read back");
+}
+
+@end
@@ -0,0 +1,220 @@
+//
+//  AKVCardTests.m
+//
+//  Copyright (c) 2013 Adam Kornafeld All rights reserved.
+//
+//  Redistribution and use in source and binary forms, with or without
+//  modification, are permitted provided that the following conditions
+//  are met:
+//  1. Redistributions of source code must retain the above copyright
+//  notice, this list of conditions and the following disclaimer.
+//  2. Redistributions in binary form must reproduce the above copyright
+//  notice, this list of conditions and the following disclaimer in the
+//  documentation and/or other materials provided with the distribution.
+//  3. The name of the author may not be used to endorse or promote products
+//  derived from this software without specific prior written permission.
+//
+//  THIS SOFTWARE IS PROVIDED BY THE AUTHOR ``AS IS'' AND ANY EXPRESS OR
+//  IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+//  OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+//  IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY DIRECT, INDIRECT,
+//  INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+//  NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+//  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+//  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+//  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+//  THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#import <XCTest/XCTest.h>
+#import "AKAddressBook+VCard.h"
+#import "AKContact.h"
+#import "AKReplayAddressBook.h"
+
+@interface AKVCardTests : XCTestCase
+
+@property (strong, nonatomic) AKReplayAddressBook *replayAddressBook;
+@property (copy, nonatomic) NSString *path;
+
+@end
+
+@implementation AKVCardTests
+
+- (void)setUp
+{
+    [super setUp];
+    
+    self.replayAddressBook = [[AKReplayAddressBook alloc] init];
+    NSString *name = [NSString stringWithFormat: @"AKVCardTests-%@.vcf", [[NSProcessInfo processInfo] globallyUniqueString]];
+    self.path = [NSTemporaryDirectory() stringByAppendingPathComponent: name];
+}
+
+- (void)tearDown
+{
+    [[NSFileManager defaultManager] removeItemAtPath: self.path error: nil];
+    self.replayAddressBook = nil;
+    
+    [super tearDown];
+}
+
+/**
+ * ABAddressBook stores dates at noon GMT
+ */
+- (NSDate *)dateWithYear: (NSInteger)year month: (NSInteger)month day: (NSInteger)day
+{
+    NSCalendar *calendar = [[NSCalendar alloc] initWithCalendarIdentifier: NSGregorianCalendar];
+    calendar.timeZone = [NSTimeZone timeZoneForSecondsFromGMT: 0];
+    NSDateComponents *components = [[NSDateComponents alloc] init];
+    components.year = year;
+    components.month = month;
+    components.day = day;
+    components.hour = 12;
+    return [calendar dateFromComponents: components];
+}
+
+- (NSDateComponents *)componentsOfDate: (NSDate *)date
+{
+    NSCalendar *calendar = [[NSCalendar alloc] initWithCalendarIdentifier: NSGregorianCalendar];
+    calendar.timeZone = [NSTimeZone timeZoneForSecondsFromGMT: 0];
+    return [calendar components: NSYearCalendarUnit | NSMonthCalendarUnit | NSDayCalendarUnit fromDate: date];
+}
+
+/**
+ * Exported by the writer of the export and read back by the reader of the import
+ */
+- (NSArray *)recordsOfRoundTripOfRecordID: (ABRecordID)recordID
+{
+    AKContact *contact = [self.replayAddressBook contactForRecordID: recordID sortOrdering: kABPersonSortByFirstName];
+    NSString *vCard = AKVCardStringWithContact(contact);
+    XCTAssertTrue([vCard writeToFile: self.path atomically: YES encoding: NSUTF8StringEncoding error: nil], @"vCard not written");
+    return AKVCardRecordsWithContentsOfFile(self.path);
+}
+
+- (NSArray *)valuesOfMultiValueProperty: (ABPropertyID)property ofRecord: (id)record
+{
+    ABMultiValueRef multiValue = ABRecordCopyValue((__bridge ABRecordRef)record, property);
+    if (!multiValue) return @[];
+    NSArray *values = (NSArray *)CFBridgingRelease(ABMultiValueCopyArrayOfAllValues(multiValue));
+    CFRelease(multiValue);
+    return values ?: @[];
+}
+
+- (NSArray *)labelsOfMultiValueProperty: (ABPropertyID)property ofRecord: (id)record
+{
+    NSMutableArray *labels = [[NSMutableArray alloc] init];
+    ABMultiValueRef multiValue = ABRecordCopyValue((__bridge ABRecordRef)record, property);
+    if (!multiValue) return labels;
+    for (CFIndex index = 0; index < ABMultiValueGetCount(multiValue); ++index)
+    {
+        NSString *label = (NSString *)CFBridgingRelease(ABMultiValueCopyLabelAtIndex(multiValue, index));
+        [labels addObject: label ?: @""];
+    }
+    CFRelease(multiValue);
+    return labels;
+}
+
+- (id)valueForProperty: (ABPropertyID)property ofRecord: (id)record
+{
+    return (id)CFBridgingRelease(ABRecordCopyValue((__bridge ABRecordRef)record, property));
+}
+
+- (void)testRoundTrip
+{
+    NSString *note = @"Első sor; második, harmadik\nÁrvíztűrő tükörfúrógép, a line long enough to be folded more than once by the writer";
+    NSDictionary *address = @{(NSString *)kABPersonAddressStreetKey: @"Andrássy út 1",
+                              (NSString *)kABPersonAddressCityKey: @"Budapest",
+                              (NSString *)kABPersonAddressZIPKey: @"1061",
+                              (NSString *)kABPersonAddressCountryKey: @"Hungary"};
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: @{@(kABPersonFirstNameProperty): @"Ádám",
+                                                                        @(kABPersonLastNameProperty): @"Kovács, Jr; the 2nd",
+                                                                        @(kABPersonOrganizationProperty): @"Acme; Ltd",
+                                                                        @(kABPersonDepartmentProperty): @"R&D",
+                                                                        @(kABPersonJobTitleProperty): @"Engineer",
+                                                                        @(kABPersonNoteProperty): note,
+                                                                        @(kABPersonBirthdayProperty): [self dateWithYear: 1985 month: 7 day: 4],
+                                                                        @(kABPersonPhoneProperty): @[@"+36 20 123 4567", @"(555) 010-0100"],
+                                                                        @(kABPersonEmailProperty): @[@"adam@example.com"],
+                                                                        @(kABPersonAddressProperty): @[address]}];
+    
+    NSArray *records = [self recordsOfRoundTripOfRecordID: recordID];
+    XCTAssertEqual(records.count, (NSUInteger)1, @"One vCard written, one read");
+    id record = records.firstObject;
+    
+    XCTAssertEqualObjects([self valueForProperty: kABPersonFirstNameProperty ofRecord: record], @"Ádám", @"First name");
+    XCTAssertEqualObjects([self valueForProperty: kABPersonLastNameProperty ofRecord: record], @"Kovács, Jr; the 2nd", @"Escaped last name");
+    XCTAssertEqualObjects([self valueForProperty: kABPersonOrganizationProperty ofRecord: record], @"Acme; Ltd", @"Escaped organization");
+    XCTAssertEqualObjects([self valueForProperty: kABPersonDepartmentProperty ofRecord: record], @"R&D", @"Department");
+    XCTAssertEqualObjects([self valueForProperty: kABPersonJobTitleProperty ofRecord: record], @"Engineer", @"Job title");
+    XCTAssertEqualObjects([self valueForProperty: kABPersonNoteProperty ofRecord: record], note, @"Folded note with a line break");
+    
+    NSDateComponents *birthday = [self componentsOfDate: [self valueForProperty: kABPersonBirthdayProperty ofRecord: record]];
+    XCTAssertEqual(birthday.year, (NSInteger)1985, @"Birthday year");
+    XCTAssertEqual(birthday.month, (NSInteger)7, @"Birthday month");
+    XCTAssertEqual(birthday.day, (NSInteger)4, @"Birthday day");
+    
+    NSArray *phoneNumbers = @[@"+36 20 123 4567", @"(555) 010-0100"];
+    XCTAssertEqualObjects([self valuesOfMultiValueProperty: kABPersonPhoneProperty ofRecord: record], phoneNumbers, @"Phone numbers in order");
+    XCTAssertEqualObjects([self valuesOfMultiValueProperty: kABPersonEmailProperty ofRecord: record], @[@"adam@example.com"], @"Email address");
+    NSArray *addresses = [self valuesOfMultiValueProperty: kABPersonAddressProperty ofRecord: record];
+    XCTAssertEqual(addresses.count, (NSUInteger)1, @"One address");
+    XCTAssertEqualObjects(addresses.firstObject, address, @"Address components");
+}
+
+- (void)testRoundTripOfBirthdayWithoutYear
+{
+    ABRecordID recordID = [self.replayAddressBook addPersonWithValues: @{@(kABPersonFirstNameProperty): @"Anna",
+                                                                        @(kABPersonBirthdayProperty): [self dateWithYear: 1604 month: 3 day: 15]}];
+    AKContact *contact = [self.replayAddressBook contactForRecordID: recordID sortOrdering: kABPersonSortByFirstName];
+    XCTAssertTrue([AKVCardStringWithContact(contact) rangeOfString: @"\r\nBDAY:--0315\r\n"].location != NSNotFound, @"Written as --MMDD");
+    
+    NSArray *records = [self recordsOfRoundTripOfRecordID: recordID];
+    XCTAssertEqual(records.count, (NSUInteger)1, @"One vCard written, one read");
+    NSDateComponents *birthday = [self componentsOfDate: [self valueForProperty: kABPersonBirthdayProperty ofRecord: records.firstObject]];
+    XCTAssertEqual(birthday.year, (NSInteger)1604, @"Read with the year of the Contacts app");
+    XCTAssertEqual(birthday.month, (NSInteger)3, @"Birthday month");
+    XCTAssertEqual(birthday.day, (NSInteger)15, @"Birthday day");
+}
+
+- (void)testLabelsOfTypes
+{
+    NSString *vCards = @"BEGIN:VCARD\r\n"
+                       @"VERSION:3.0\r\n"
+                       @"N:Doe;John;;;\r\n"
+                       @"TEL;TYPE=CELL:+1 555 0100\r\n"
+                       @"TEL;TYPE=\"Summer house; lake\":+1 555 0101\r\n"
+                       @"TEL;TYPE=HOME,FAX:+1 555 0102\r\n"
+                       @"item1.EMAIL;TYPE=INTERNET;TYPE=WORK:john@example.com\r\n"
+                       @"EMAIL;TYPE=Private:john@example.org\r\n"
+                       @"END:VCARD\r\n"
+                       @"BEGIN:VCARD\r\n"
+                       @"VERSION:2.1\r\n"
+                       @"FN:Jane Roe\r\n"
+                       @"TEL;HOME;VOICE:+1 555 0103\r\n"
+                       @"BDAY:--1224\r\n"
+                       @"END:VCARD\r\n";
+    XCTAssertTrue([vCards writeToFile: self.path atomically: YES encoding: NSUTF8StringEncoding error: nil], @"vCards not written");
+    
+    NSArray *records = AKVCardRecordsWithContentsOfFile(self.path);
+    XCTAssertEqual(records.count, (NSUInteger)2, @"Two vCards read");
+    
+    id john = [records firstObject];
+    NSArray *phoneLabels = @[(__bridge NSString *)kABPersonPhoneMobileLabel, @"Summer house; lake", (__bridge NSString *)kABPersonPhoneHomeFAXLabel];
+    XCTAssertEqualObjects([self labelsOfMultiValueProperty: kABPersonPhoneProperty ofRecord: john], phoneLabels, @"Standard types and a quoted custom label");
+    NSArray *emailLabels = @[(__bridge NSString *)kABWorkLabel, @"Private"];
+    XCTAssertEqualObjects([self labelsOfMultiValueProperty: kABPersonEmailProperty ofRecord: john], emailLabels, @"Grouped line and an unquoted custom label");
+    
+    id jane = [records lastObject];
+    XCTAssertEqualObjects([self valueForProperty: kABPersonFirstNameProperty ofRecord: jane], @"Jane Roe", @"Formatted name without N");
+    XCTAssertEqualObjects([self labelsOfMultiValueProperty: kABPersonPhoneProperty ofRecord: jane], @[(__bridge NSString *)kABHomeLabel], @"vCard 2.1 bare types");
+    NSDateComponents *birthday = [self componentsOfDate: [self valueForProperty: kABPersonBirthdayProperty ofRecord: jane]];
+    XCTAssertEqual(birthday.year, (NSInteger)1604, @"Birthday without a year");
+    XCTAssertEqual(birthday.month, (NSInteger)12, @"Birthday month");
+    XCTAssertEqual(birthday.day, (NSInteger)24, @"Birthday day");
+}
+
+- (void)testMissingFile
+{
+    XCTAssertNil(AKVCardRecordsWithContentsOfFile(self.path), @"Nothing to read");
+}
+
+@end